@@ -0,0 +1,471 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#endif
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "clock_sync.h"
+
+// the round trips of the last WINDOW requests are kept, the ones at most DELAY_MARGIN_US slower than
+// the fastest one are fitted (at least MIN_SAMPLES of the fastest)
+static const int WINDOW = 128;
+static const int MIN_SAMPLES = 8;
+static const int64_t DELAY_MARGIN_US = 1000;
+// the fitted line weighs them by 1 / (half of their extra delay + WEIGHT_FLOOR_US)^2
+static const double WEIGHT_FLOOR_US = 200.0;
+// the drift is fitted only over a long enough time, before that the last drift (or none) is used
+static const int64_t MIN_DRIFT_SPAN_US = 5000000;
+static const double MAX_DRIFT = 500e-6;
+// round trips further than this from the first fit are left out of the second one
+static const double OUTLIER_MADS = 3.0;
+static const double OUTLIER_FLOOR_US = 100.0;
+static const int64_t MAX_ROUND_TRIP_US = 1000000;
+// a new fit moves the given out clock by at most this much per second of the local clock (the clock stays monotonic)
+static const double MAX_SLEW = 0.005;
+// the first requests go faster, so that the drone is synchronized soon after it connects
+static const int BURST_REQUESTS = 16;
+static const int64_t BURST_PERIOD_US = 50000;
+static const int CLOCK_SYNC_THREAD_NICE = -10;
+
+/********************************************************** clocks **********************************************/
+
+static double simulated_offset_us = 0, simulated_drift = 0;
+static int64_t simulated_since = 0;
+
+static int64_t raw_clock_us(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// local clock the round trips are measured with (monotonic, so that steps of the wall clock do not matter)
+static int64_t local_clock_us()
+{
+	int64_t t = raw_clock_us(CLOCK_MONOTONIC);
+	return t + (int64_t)(simulated_offset_us + simulated_drift * (t - simulated_since));
+}
+
+static int64_t local_wall_clock_us()
+{
+	int64_t t = raw_clock_us(CLOCK_REALTIME);
+	return t + (int64_t)(simulated_offset_us + simulated_drift * (raw_clock_us(CLOCK_MONOTONIC) - simulated_since));
+}
+
+void clock_sync_simulate(double offset_ms, double drift_ppm)
+{
+	simulated_since = raw_clock_us(CLOCK_MONOTONIC);
+	simulated_offset_us = offset_ms * 1000;
+	simulated_drift = drift_ppm * 1e-6;
+}
+
+/********************************************************** fit *************************************************/
+
+struct sync_sample
+{
+	int64_t local;           // us, middle of the round trip on the local clock
+	int64_t offset;          // us, master wall clock - local clock
+	int64_t delay;           // us, round trip without the time spent in the master
+};
+
+// master wall clock = local + offset + drift * (local - local_ref)
+struct sync_fit
+{
+	int valid = 0;
+	int64_t local_ref = 0, offset = 0;
+	double drift = 0;
+	int samples = 0;
+	double delay_us = 0, error_us = 0;
+};
+
+static double median(std::vector<double> &v)
+{
+	std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+	return v[v.size() / 2];
+}
+
+// the offset of a round trip is off by at most half of its delay over the shortest one
+static double weight(const sync_sample &s, int64_t shortest)
+{
+	double slack = (s.delay - shortest) / 2.0 + WEIGHT_FLOOR_US;
+	return 1.0 / (slack * slack);
+}
+
+// the round trips with short delays have (nearly) symmetric paths, so their offsets are the accurate ones:
+// a line through the fastest ones, fitted again without the ones far from it
+static int fit_samples(const std::vector<sync_sample> &all, double last_drift, sync_fit &fit)
+{
+	if ((int)all.size() < MIN_SAMPLES) return 0;
+	std::vector<int64_t> delays;
+	for (const sync_sample &s : all) delays.push_back(s.delay);
+	std::sort(delays.begin(), delays.end());
+	int64_t fastest = std::max(delays[0] + DELAY_MARGIN_US, delays[MIN_SAMPLES - 1]);
+	std::vector<sync_sample> used;
+	for (const sync_sample &s : all)
+		if (s.delay <= fastest) used.push_back(s);
+
+	int64_t local_ref = all.back().local, offset_ref = used[0].offset;
+	double a = 0, b = last_drift;
+	std::vector<double> residual;
+	for (int round = 0; round < 2; round++)
+	{
+		int64_t first = used[0].local, last = used[0].local;
+		for (const sync_sample &s : used)
+		{
+			first = std::min(first, s.local);
+			last = std::max(last, s.local);
+		}
+		if (last - first >= MIN_DRIFT_SPAN_US)
+		{
+			double sx = 0, sy = 0, sxx = 0, sxy = 0, n = 0;
+			for (const sync_sample &s : used)
+			{
+				double x = s.local - local_ref, y = s.offset - offset_ref, w = weight(s, delays[0]);
+				sx += w * x;
+				sy += w * y;
+				sxx += w * x * x;
+				sxy += w * x * y;
+				n += w;
+			}
+			b = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+			b = std::min(std::max(b, -MAX_DRIFT), MAX_DRIFT);
+			a = (sy - b * sx) / n;
+		}
+		else
+		{
+			std::vector<double> v;
+			for (const sync_sample &s : used) v.push_back(s.offset - offset_ref - b * (s.local - local_ref));
+			a = median(v);
+		}
+
+		residual.clear();
+		for (const sync_sample &s : used) residual.push_back(s.offset - offset_ref - (a + b * (s.local - local_ref)));
+		if (round == 1) break;
+		std::vector<double> deviation;
+		for (double r : residual) deviation.push_back(fabs(r));
+		double limit = OUTLIER_MADS * median(deviation) + OUTLIER_FLOOR_US;
+		std::vector<sync_sample> kept;
+		for (size_t i = 0; i < used.size(); i++)
+			if (fabs(residual[i]) <= limit) kept.push_back(used[i]);
+		if ((int)kept.size() < MIN_SAMPLES / 2) break;
+		used.swap(kept);
+	}
+
+	double sum = 0;
+	for (double r : residual) sum += r * r;
+	fit.valid = 1;
+	fit.local_ref = local_ref;
+	fit.offset = offset_ref + (int64_t)llround(a);
+	fit.drift = b;
+	fit.samples = used.size();
+	fit.delay_us = delays[0];
+	fit.error_us = sqrt(sum / residual.size());
+	return 1;
+}
+
+/********************************************************** network threads *************************************/
+
+#define MODE_NONE    0
+#define MODE_SERVE   1
+#define MODE_FOLLOW  2
+
+static std::thread sync_thread;
+static std::atomic<int> sync_running(0), sync_mode(MODE_NONE);
+static int sync_socket = -1;
+static std::atomic<uint32_t> stat_requests(0), stat_replies(0);
+
+static std::mutex fit_mutex;     // protects current_fit and the given out clock below
+static sync_fit current_fit;
+static char follow_address[INET_ADDRSTRLEN];
+static int follow_port = 0;
+
+// the clock given out: the local wall clock until the first fit, then local + given_offset, which follows the fit
+// at most MAX_SLEW fast; while a dance runs, the local wall clock is not switched to the fit
+static int dance_running = 0;
+static int given_synchronized = 0;
+static int64_t given_local = 0;
+static double given_offset = 0, given_last = 0;    // us
+
+// with fit_mutex locked
+static double given_clock_us()
+{
+	int64_t t = local_clock_us();
+	int fitted = (sync_mode == MODE_FOLLOW) && current_fit.valid;
+	double target = fitted ? current_fit.offset + current_fit.drift * (t - current_fit.local_ref) : 0;
+	if (fitted && !given_synchronized && !dance_running)
+	{
+		// the first fit, nothing uses the clock yet: it can jump
+		given_synchronized = 1;
+		given_offset = target;
+		given_last = 0;
+	}
+	else if (fitted && given_synchronized)
+	{
+		double step = MAX_SLEW * (t - given_local);
+		given_offset += std::min(std::max(target - given_offset, -step), step);
+	}
+	given_local = t;
+
+	double now = given_synchronized ? t + given_offset : local_wall_clock_us();
+	given_last = std::max(given_last, now);
+	return given_last;
+}
+
+double clock_sync_now_ms()
+{
+	std::lock_guard<std::mutex> lock(fit_mutex);
+	return given_clock_us() / 1000.0;
+}
+
+void clock_sync_dance_running(int running)
+{
+	std::lock_guard<std::mutex> lock(fit_mutex);
+	given_clock_us();     // a fit that came before the start is still taken
+	dance_running = running;
+}
+
+clock_sync_status clock_sync_get_status()
+{
+	clock_sync_status s;
+	memset(&s, 0, sizeof(s));
+	{
+		std::lock_guard<std::mutex> lock(fit_mutex);
+		s.synchronized = (sync_mode == MODE_SERVE) || ((sync_mode == MODE_FOLLOW) && current_fit.valid && (given_synchronized || !dance_running));
+		s.samples = current_fit.samples;
+		s.drift_ppm = current_fit.drift * 1e6;
+		s.delay_ms = current_fit.delay_us / 1000.0;
+		s.error_ms = current_fit.error_us / 1000.0;
+	}
+	s.offset_ms = clock_sync_now_ms() - local_wall_clock_us() / 1000.0;
+	s.requests = stat_requests;
+	s.replies = stat_replies;
+	return s;
+}
+
+// the master: every request goes back with the wall clock times of its arrival and of the reply
+static void serve_loop()
+{
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), CLOCK_SYNC_THREAD_NICE);   // may fail without permission
+
+	while (sync_running)
+	{
+		struct pollfd pfd = { sync_socket, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) <= 0) continue;
+		clock_sync_packet p;
+		sockaddr_in from;
+		socklen_t from_len = sizeof(from);
+		ssize_t len = recvfrom(sync_socket, &p, sizeof(p), MSG_DONTWAIT, (sockaddr *)&from, &from_len);
+		int64_t received = local_wall_clock_us();
+		if ((len != sizeof(p)) || (p.magic != CLOCK_SYNC_MAGIC)) continue;
+		stat_requests++;
+		p.receive_time = received;
+		p.reply_time = local_wall_clock_us();
+		if (sendto(sync_socket, &p, sizeof(p), 0, (const sockaddr *)&from, from_len) == sizeof(p)) stat_replies++;
+	}
+}
+
+static void receive_reply(std::vector<sync_sample> &window)
+{
+	clock_sync_packet p;
+	ssize_t len = recv(sync_socket, &p, sizeof(p), MSG_DONTWAIT);
+	int64_t received = local_clock_us();
+	if ((len != sizeof(p)) || (p.magic != CLOCK_SYNC_MAGIC)) return;
+	int64_t round_trip = received - p.request_time, in_master = p.reply_time - p.receive_time;
+	if ((round_trip < 0) || (round_trip > MAX_ROUND_TRIP_US) || (in_master < 0) || (in_master > round_trip)) return;
+	stat_replies++;
+
+	sync_sample s;
+	s.local = p.request_time + round_trip / 2;
+	s.offset = (p.receive_time + p.reply_time) / 2 - s.local;
+	s.delay = round_trip - in_master;
+	window.push_back(s);
+	if ((int)window.size() > WINDOW) window.erase(window.begin());
+
+	double last_drift;
+	{
+		std::lock_guard<std::mutex> lock(fit_mutex);
+		last_drift = current_fit.drift;
+	}
+	sync_fit fit;
+	if (!fit_samples(window, last_drift, fit)) return;
+	std::lock_guard<std::mutex> lock(fit_mutex);
+	current_fit = fit;
+}
+
+// a drone: requests at the fixed rate (faster at first), the replies are received in between
+static void follow_loop(sockaddr_in master, float rate_hz)
+{
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), CLOCK_SYNC_THREAD_NICE);   // may fail without permission
+
+	std::vector<sync_sample> window;
+	uint32_t sequence = 0;
+	int64_t period_us = (int64_t)(1e6 / rate_hz);
+	int64_t next_send = raw_clock_us(CLOCK_MONOTONIC);
+
+	while (sync_running)
+	{
+		int64_t now = raw_clock_us(CLOCK_MONOTONIC);
+		if (now >= next_send)
+		{
+			clock_sync_packet p;
+			memset(&p, 0, sizeof(p));
+			p.magic = CLOCK_SYNC_MAGIC;
+			p.sequence = sequence++;
+			p.request_time = local_clock_us();
+			if (sendto(sync_socket, &p, sizeof(p), 0, (const sockaddr *)&master, sizeof(master)) == sizeof(p)) stat_requests++;
+			next_send += (sequence < BURST_REQUESTS) ? std::min(BURST_PERIOD_US, period_us) : period_us;
+			if (next_send < now) next_send = now + period_us;   // do not burst after a stall
+			continue;
+		}
+		struct pollfd pfd = { sync_socket, POLLIN, 0 };
+		int wait_ms = (int)((next_send - now + 999) / 1000);
+		if (poll(&pfd, 1, wait_ms) > 0)
+			while (sync_running && (pfd.revents & POLLIN))
+			{
+				receive_reply(window);
+				if (poll(&pfd, 1, 0) <= 0) break;
+			}
+	}
+}
+
+static int open_socket(int port)
+{
+	sync_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sync_socket < 0) return 0;
+	int on = 1;
+	setsockopt(sync_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(port);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sync_socket, (const sockaddr *)&local, sizeof(local)) < 0)
+	{
+		close(sync_socket);
+		sync_socket = -1;
+		return 0;
+	}
+	return 1;
+}
+
+int clock_sync_serve(int port)
+{
+	if (sync_running || !open_socket(port)) return 0;
+	sync_mode = MODE_SERVE;
+	sync_running = 1;
+	sync_thread = std::thread(serve_loop);
+	return 1;
+}
+
+int clock_sync_follow(const char *master_address, int port, float rate_hz)
+{
+	if (rate_hz <= 0) return 0;
+	// a reconnect to the same master keeps following it
+	if (sync_running && (sync_mode == MODE_FOLLOW) && (port == follow_port) && (strcmp(master_address, follow_address) == 0)) return 1;
+	sockaddr_in master;
+	memset(&master, 0, sizeof(master));
+	master.sin_family = AF_INET;
+	master.sin_port = htons(port);
+	if (inet_pton(AF_INET, master_address, &master.sin_addr) != 1) return 0;
+	clock_sync_stop();
+	if (!open_socket(0)) return 0;
+	{
+		// the last fit stays until the new master gives one (the given out clock then slews to it)
+		std::lock_guard<std::mutex> lock(fit_mutex);
+		if (sync_mode != MODE_FOLLOW) current_fit = sync_fit();
+		strncpy(follow_address, master_address, sizeof(follow_address) - 1);
+		follow_port = port;
+	}
+	sync_mode = MODE_FOLLOW;
+	sync_running = 1;
+	sync_thread = std::thread(follow_loop, master, rate_hz);
+	return 1;
+}
+
+// the fitted clock stays in use after stop, so that a running dance keeps its time
+void clock_sync_stop()
+{
+	if (!sync_running) return;
+	sync_running = 0;
+	if (sync_thread.joinable()) sync_thread.join();
+	close(sync_socket);
+	sync_socket = -1;
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_clockSyncServe(JNIEnv *env,
+                                                  jobject,
+                                                  jint port)
+{
+	return clock_sync_serve(port) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_clockSyncFollow(JNIEnv *env,
+                                                   jobject,
+                                                   jstring masterAddress,
+                                                   jint port,
+                                                   jfloat rateHz)
+{
+	const char *address = env->GetStringUTFChars(masterAddress, 0);
+	int ok = clock_sync_follow(address, port, rateHz);
+	env->ReleaseStringUTFChars(masterAddress, address);
+	return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_clockSyncDanceRunning(JNIEnv *env,
+                                                         jobject,
+                                                         jboolean running)
+{
+	clock_sync_dance_running(running ? 1 : 0);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_clockSyncStop(JNIEnv *env,
+                                                 jobject)
+{
+	clock_sync_stop();
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_sk_uniba_krucena_NativeBridge_clockSyncTime(JNIEnv *env,
+                                                 jobject)
+{
+	return (jlong)floor(clock_sync_now_ms());
+}
+
+// [synchronized, samples, offset_ms, drift_ppm, delay_ms, error_ms]
+extern "C"
+JNIEXPORT jfloatArray JNICALL
+Java_sk_uniba_krucena_NativeBridge_clockSyncStatus(JNIEnv *env,
+                                                   jobject)
+{
+	clock_sync_status s = clock_sync_get_status();
+	jfloat v[6] = { (jfloat)s.synchronized, (jfloat)s.samples, (jfloat)s.offset_ms, (jfloat)s.drift_ppm,
+	                (jfloat)s.delay_ms, (jfloat)s.error_ms };
+	jfloatArray result = env->NewFloatArray(6);
+	if (result) env->SetFloatArrayRegion(result, 0, 6, v);
+	return result;
+}
+
+#endif
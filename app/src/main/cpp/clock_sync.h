@@ -0,0 +1,57 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+// synchronized dance clock: the master answers UDP time requests, every other drone sends them at a fixed
+// rate (NTP-style: 4 timestamps per round trip), keeps the round trips with the shortest delays and fits
+// the offset and the drift of its clock against the master clock, so that all the drones can start and
+// follow the dance at the same master time instead of at the arrival of the START message
+
+#include <stdint.h>
+
+#define CLOCK_SYNC_DEFAULT_PORT  8995     // next to SWARM_DEFAULT_PORT
+
+// one request (from a drone) or reply (from the master), little endian
+#pragma pack(push, 1)
+struct clock_sync_packet
+{
+	uint32_t magic;          // CLOCK_SYNC_MAGIC
+	uint32_t sequence;
+	int64_t request_time;    // us, local clock of the drone when it sent the request (returned by the master)
+	int64_t receive_time;    // us, master wall clock when the request came
+	int64_t reply_time;      // us, master wall clock when the reply left
+};
+#pragma pack(pop)
+
+#define CLOCK_SYNC_MAGIC   0x4e595343u   // "CSYN"
+
+struct clock_sync_status
+{
+	int synchronized;        // enough round trips to follow the master
+	int samples;             // round trips used by the last fit
+	double offset_ms;        // master clock - local wall clock, now
+	double drift_ppm;        // how much faster the master clock runs
+	double delay_ms;         // shortest round trip in the window
+	double error_ms;         // rms of the fit over the used round trips
+	uint32_t requests, replies;
+};
+
+// on the master: answers the requests on port, returns 0 when the socket cannot be opened or it already runs
+int clock_sync_serve(int port);
+// on the other drones: rate_hz requests per second to the master (after a short burst),
+// returns 1 without a restart when it already follows the same master
+int clock_sync_follow(const char *master_address, int port, float rate_hz);
+void clock_sync_stop();
+
+// master wall clock in ms: the local wall clock on the master, before the first synchronization and
+// when nothing runs, the fitted master clock on a synchronized drone; it never goes back, and the later fits
+// change it gradually (at most 5 ms per s)
+double clock_sync_now_ms();
+// while a dance runs, a drone that started it unsynchronized stays on its local wall clock
+// (the switch to the master clock would move the dance by the whole offset)
+void clock_sync_dance_running(int running);
+clock_sync_status clock_sync_get_status();
+
+// for tools/clock_sync_loopback: the local clock of this process runs offset_ms ahead and drift_ppm faster
+void clock_sync_simulate(double offset_ms, double drift_ppm);
+
+#endif
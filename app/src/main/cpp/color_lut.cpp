@@ -0,0 +1,238 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "color_lut.h"
+
+#define COLOR_LUT_MAGIC     0x54554c43u   // "CLUT", the samples file
+#define MAX_SAMPLES         50000         // the oldest are dropped beyond that
+#define SAMPLE_SPREAD       2             // cells around a sample that it votes for (in each direction)
+
+struct color_sample
+{
+	uint8_t r, g, b, color_class;
+};
+
+static uint8_t lut[COLOR_LUT_SIZE];
+static int lut_enabled = 0;
+static std::vector<color_sample> samples;
+static std::string samples_path;
+
+// requested from the other threads, applied by color_lut_prepare
+static std::mutex pending_lock;
+static int pending_enabled = 0;
+static std::string pending_path;
+static int pending_thresholds[6] = { 0, 0, 0, 0, 0, 0 };
+static int pending_clear = 0;            // bitmask of the classes whose samples are to be cleared
+static int pending_rebuild = 0, pending_load = 0;
+
+void color_lut_setup(int enabled, const char *path)
+{
+	std::lock_guard<std::mutex> guard(pending_lock);
+	pending_enabled = enabled;
+	if (path && (pending_path != path))
+	{
+		pending_path = path;
+		pending_load = 1;
+	}
+	pending_rebuild = 1;
+}
+
+void color_lut_set_thresholds(const int thresholds[6])
+{
+	std::lock_guard<std::mutex> guard(pending_lock);
+	if (memcmp(pending_thresholds, thresholds, sizeof(pending_thresholds)) == 0) return;
+	memcpy(pending_thresholds, thresholds, sizeof(pending_thresholds));
+	pending_rebuild = 1;
+}
+
+void color_lut_clear_samples(int color_class)
+{
+	std::lock_guard<std::mutex> guard(pending_lock);
+	pending_clear |= (color_class < 0) ? 0xFF : (1 << color_class);
+	pending_rebuild = 1;
+}
+
+static void load_samples()
+{
+	samples.clear();
+	FILE *f = fopen(samples_path.c_str(), "rb");
+	if (!f) return;
+	uint32_t header[2];
+	if ((fread(header, sizeof(header), 1, f) == 1) && (header[0] == COLOR_LUT_MAGIC) && (header[1] <= MAX_SAMPLES))
+	{
+		samples.resize(header[1]);
+		if (fread(samples.data(), sizeof(color_sample), samples.size(), f) != samples.size()) samples.clear();
+	}
+	fclose(f);
+}
+
+static void save_samples()
+{
+	if (samples_path.empty()) return;
+	FILE *f = fopen(samples_path.c_str(), "wb");
+	if (!f) return;
+	uint32_t header[2] = { COLOR_LUT_MAGIC, (uint32_t)samples.size() };
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(samples.data(), sizeof(color_sample), samples.size(), f);
+	fclose(f);
+}
+
+static void build(const int thresholds[6])
+{
+	// the classes of the thresholds in the middle of each cell
+	const int half = 1 << (7 - COLOR_LUT_BITS);
+	const int cells = 1 << COLOR_LUT_BITS;
+	uint8_t f[6];
+	for (int r = 0, i = 0; r < cells; r++)
+		for (int g = 0; g < cells; g++)
+			for (int b = 0; b < cells; b++, i++)
+			{
+				color_features((r << (8 - COLOR_LUT_BITS)) + half, (g << (8 - COLOR_LUT_BITS)) + half,
+				               (b << (8 - COLOR_LUT_BITS)) + half, f);
+				lut[i] = classes_by_thresholds(f, thresholds);
+			}
+	if (samples.empty()) return;
+
+	// the cells near the samples get the class with the largest vote (1 / (1 + d^2) for a sample d cells away)
+	std::unordered_map<int, std::array<float, COLOR_CLASSES + 1>> votes;
+	for (const color_sample &s : samples)
+	{
+		int cr = s.r >> (8 - COLOR_LUT_BITS), cg = s.g >> (8 - COLOR_LUT_BITS), cb = s.b >> (8 - COLOR_LUT_BITS);
+		for (int dr = -SAMPLE_SPREAD; dr <= SAMPLE_SPREAD; dr++)
+			for (int dg = -SAMPLE_SPREAD; dg <= SAMPLE_SPREAD; dg++)
+				for (int db = -SAMPLE_SPREAD; db <= SAMPLE_SPREAD; db++)
+				{
+					int r = cr + dr, g = cg + dg, b = cb + db;
+					if ((r < 0) || (g < 0) || (b < 0) || (r >= cells) || (g >= cells) || (b >= cells)) continue;
+					int i = (r << (2 * COLOR_LUT_BITS)) | (g << COLOR_LUT_BITS) | b;
+					auto it = votes.find(i);
+					if (it == votes.end()) it = votes.emplace(i, std::array<float, COLOR_CLASSES + 1>()).first;
+					it->second[s.color_class] += 1.0f / (1 + dr * dr + dg * dg + db * db);
+				}
+	}
+	for (const auto &v : votes)
+	{
+		int best = 0;
+		for (int c = 1; c <= COLOR_CLASSES; c++)
+			if (v.second[c] > v.second[best]) best = c;
+		lut[v.first] = (best == COLOR_CLASS_NONE) ? 0 : (uint8_t)(1 << best);
+	}
+}
+
+int color_lut_prepare()
+{
+	int thresholds[6], rebuild, clear;
+	{
+		std::lock_guard<std::mutex> guard(pending_lock);
+		lut_enabled = pending_enabled;
+		if (pending_load)
+		{
+			samples_path = pending_path;
+			load_samples();
+			pending_load = 0;
+		}
+		memcpy(thresholds, pending_thresholds, sizeof(thresholds));
+		rebuild = pending_rebuild;
+		clear = pending_clear;
+		pending_rebuild = 0;
+		pending_clear = 0;
+	}
+	if (clear)
+	{
+		samples.erase(std::remove_if(samples.begin(), samples.end(),
+		                             [clear](const color_sample &s) { return (clear >> s.color_class) & 1; }), samples.end());
+		save_samples();
+	}
+	if (rebuild && lut_enabled) build(thresholds);
+	return lut_enabled;
+}
+
+int color_lut_add_samples(const cv::Mat &input, int x, int y, int radius, int color_class)
+{
+	if ((input.channels() < 3) || (color_class < 0) || (color_class > COLOR_CLASS_NONE)) return (int)samples.size();
+	int ch = input.channels();
+	for (int v = std::max(0, y - radius); v <= std::min(input.rows - 1, y + radius); v++)
+	{
+		const uchar *row = input.ptr<uchar>(v);
+		for (int u = std::max(0, x - radius); u <= std::min(input.cols - 1, x + radius); u++)
+		{
+			const uchar *p = row + u * ch;
+			samples.push_back(color_sample{ p[0], p[1], p[2], (uint8_t)color_class });
+		}
+	}
+	if (samples.size() > MAX_SAMPLES) samples.erase(samples.begin(), samples.end() - MAX_SAMPLES);
+	save_samples();
+
+	std::lock_guard<std::mutex> guard(pending_lock);
+	pending_rebuild = 1;
+	return (int)samples.size();
+}
+
+uint8_t color_lut_lookup(int r, int g, int b)
+{
+	return lut[COLOR_LUT_INDEX(r, g, b)];
+}
+
+void color_lut_classify(const cv::Mat &input, cv::Mat *masks)
+{
+	for (int c = 0; c < COLOR_CLASSES; c++) masks[c].create(input.size(), CV_8UC1);
+	int ch = input.channels();
+	for (int y = 0; y < input.rows; y++)
+	{
+		const uchar *in = input.ptr<uchar>(y);
+		uchar *m[COLOR_CLASSES];
+		for (int c = 0; c < COLOR_CLASSES; c++) m[c] = masks[c].ptr<uchar>(y);
+		for (int x = 0; x < input.cols; x++, in += ch)
+		{
+			uint8_t classes = lut[COLOR_LUT_INDEX(in[0], in[1], in[2])];
+			for (int c = 0; c < COLOR_CLASSES; c++) m[c][x] = ((classes >> c) & 1) ? 200 : 0;
+		}
+	}
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_setupColorLut(JNIEnv *env,
+                                                 jobject,
+                                                 jint enabled,
+                                                 jstring samplesPath)
+{
+	const char *path = env->GetStringUTFChars(samplesPath, 0);
+	color_lut_setup(enabled, path);
+	env->ReleaseStringUTFChars(samplesPath, path);
+}
+
+// called on the thread of localization, with the frame the user tapped on
+extern "C"
+JNIEXPORT jint JNICALL
+Java_sk_uniba_krucena_NativeBridge_colorLutAddSamples(JNIEnv *env,
+                                                      jobject,
+                                                      jlong matAddrInput,
+                                                      jint x,
+                                                      jint y,
+                                                      jint radius,
+                                                      jint colorClass)
+{
+	return color_lut_add_samples(*(const cv::Mat *)matAddrInput, x, y, radius, colorClass);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_colorLutClearSamples(JNIEnv *env,
+                                                        jobject,
+                                                        jint colorClass)
+{
+	color_lut_clear_samples(colorClass);
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+// color classification by a single lookup per pixel: a 64x64x64 table (6 bits of R, G, B) holds for each
+// cell the bitmask of the color classes the cell belongs to; the table is built from the six thresholds
+// of the features below (the same classes as the arithmetic of localization, evaluated in the middle of
+// each cell), and the cells around the labeled pixel samples collected during calibration are then
+// reassigned to the class with the most (distance weighted) samples, so that the boundaries between
+// the classes can take any shape (blue vs. black, yellow vs. red)
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+
+#define COLOR_LUT_BITS      6
+#define COLOR_LUT_SIZE      (1 << (3 * COLOR_LUT_BITS))
+#define COLOR_LUT_INDEX(r, g, b) ((((r) >> (8 - COLOR_LUT_BITS)) << (2 * COLOR_LUT_BITS)) | \
+                                  (((g) >> (8 - COLOR_LUT_BITS)) << COLOR_LUT_BITS) | ((b) >> (8 - COLOR_LUT_BITS)))
+
+// classes, the order of COLOR ENCODING in fastimglib.cpp, NONE is only a label of samples (background)
+enum { COLOR_CLASS_BLUE = 0, COLOR_CLASS_BLACK, COLOR_CLASS_RED, COLOR_CLASS_GREEN, COLOR_CLASS_YELLOW, COLOR_CLASS_NONE };
+#define COLOR_CLASSES 5
+
+// the features compared with the thresholds (the order of the calibration sliders)
+enum { FEATURE_RED = 0, FEATURE_GREEN, FEATURE_BLUE, FEATURE_YELLOW, FEATURE_BK_MAX, FEATURE_BK_CHROMA };
+
+static inline uint8_t sat_sub(int a, int b) { return (uint8_t)((a > b) ? a - b : 0); }
+static inline uint8_t sat_add(int a, int b) { return (uint8_t)((a + b < 255) ? a + b : 255); }
+
+// the features of localization for one pixel, with the same saturated 8-bit arithmetic
+static inline void color_features(int r, int g, int b, uint8_t f[6])
+{
+	int max_rg = std::max(r, g), min_rg = std::min(r, g);
+	f[FEATURE_RED] = sat_sub(r, std::max(g, b));
+	f[FEATURE_GREEN] = sat_sub(g, std::max(r, b));
+	f[FEATURE_BLUE] = sat_sub(b, max_rg);
+	f[FEATURE_YELLOW] = sat_sub(sat_sub(min_rg, sat_sub(max_rg, min_rg)), b);
+	f[FEATURE_BK_MAX] = sat_add(max_rg, b);
+	f[FEATURE_BK_CHROMA] = sat_add(sat_sub(f[FEATURE_BK_MAX], std::min(min_rg, b)), b);
+}
+
+// thresholds = [red, green, blue, yellow, black max, black chroma] (the order of the features)
+static inline uint8_t classes_by_thresholds(const uint8_t f[6], const int thresholds[6])
+{
+	uint8_t c = 0;
+	if (f[FEATURE_BLUE] > thresholds[FEATURE_BLUE]) c |= 1 << COLOR_CLASS_BLUE;
+	if ((f[FEATURE_BK_MAX] <= thresholds[FEATURE_BK_MAX]) && (f[FEATURE_BK_CHROMA] <= thresholds[FEATURE_BK_CHROMA])) c |= 1 << COLOR_CLASS_BLACK;
+	if (f[FEATURE_RED] > thresholds[FEATURE_RED]) c |= 1 << COLOR_CLASS_RED;
+	if (f[FEATURE_GREEN] > thresholds[FEATURE_GREEN]) c |= 1 << COLOR_CLASS_GREEN;
+	if (f[FEATURE_YELLOW] > thresholds[FEATURE_YELLOW]) c |= 1 << COLOR_CLASS_YELLOW;
+	return c;
+}
+
+// all the changes are only requested here (from any thread), and applied by color_lut_prepare()
+// on the thread that classifies, before the frame
+void color_lut_setup(int enabled, const char *samples_path);
+void color_lut_set_thresholds(const int thresholds[6]);
+void color_lut_clear_samples(int color_class);    // -1 = all
+
+// applies the pending changes (rebuilds the table if needed), returns 1 if the table is to be used
+int color_lut_prepare();
+// adds the pixels of the square (2 * radius + 1) around (x, y) as samples of color_class, and saves them,
+// returns the number of samples
+int color_lut_add_samples(const cv::Mat &input, int x, int y, int radius, int color_class);
+
+// the class bitmask of one pixel
+uint8_t color_lut_lookup(int r, int g, int b);
+// masks[COLOR_CLASSES] (8 bit, the size of input) = 200 where the pixel belongs to the class, 0 elsewhere
+void color_lut_classify(const cv::Mat &input, cv::Mat *masks);
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#include <android/log.h>
+#else
+// Linux build of the tools (no JNI, log to stderr)
+#include <stdio.h>
+#define ANDROID_LOG_INFO 0
+#define ANDROID_LOG_ERROR 0
+#define __android_log_print(prio, tag, ...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "dance_bundle.h"
+
+#define LOG_TAG "DanceBundle"
+
+static void *bundle_data = 0;
+static size_t bundle_size = 0;
+
+static const dance_bundle_header *header;
+static const dance_bundle_dance *dances;
+static const dance_bundle_block *blocks;
+static const dance_record *records;
+static const char *strings;
+
+// delta-encoded times are summed once at load, so that any command can be read in O(1)
+static std::vector<int32_t> times;
+
+void dance_bundle_close()
+{
+	if (bundle_data) munmap(bundle_data, bundle_size);
+	bundle_data = 0;
+	bundle_size = 0;
+	header = 0;
+	times.clear();
+}
+
+// all offsets and indices are checked here, so that the accessors below can trust the file
+static int validate_bundle()
+{
+	if (bundle_size < sizeof(dance_bundle_header)) return 0;
+	if (memcmp(header->magic, DANCE_BUNDLE_MAGIC, 4) != 0) return 0;
+	if (header->version != DANCE_BUNDLE_VERSION)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "unsupported version %d", header->version);
+		return 0;
+	}
+
+	uint64_t expected = sizeof(dance_bundle_header) + (uint64_t)header->num_dances * sizeof(dance_bundle_dance) +
+	                    (uint64_t)header->num_blocks * sizeof(dance_bundle_block) +
+	                    (uint64_t)header->num_records * sizeof(dance_record) + header->strings_size;
+	if (expected != bundle_size) return 0;
+	if ((header->strings_size > 0) && (strings[header->strings_size - 1] != 0)) return 0;
+
+	for (uint32_t i = 0; i < header->num_dances; i++)
+		if ((uint64_t)dances[i].first_performance + dances[i].num_performances > header->num_blocks) return 0;
+
+	for (uint32_t i = 0; i < header->num_blocks; i++)
+	{
+		const dance_bundle_block &b = blocks[i];
+		if ((uint64_t)b.first_record + b.num_records > header->num_records) return 0;
+		if ((uint64_t)b.first_procedure + b.num_procedures > header->num_blocks) return 0;
+		if ((b.name != DANCE_BUNDLE_NO_NAME) && (b.name >= header->strings_size)) return 0;
+		for (uint32_t r = b.first_record; r < b.first_record + b.num_records; r++)
+		{
+			if (records[r].kind > DANCE_VSPEED) return 0;
+			if ((records[r].kind == DANCE_RUN) && (records[r].aux != DANCE_BUNDLE_UNRESOLVED) && (records[r].aux >= header->num_blocks)) return 0;
+		}
+	}
+	return 1;
+}
+
+int dance_bundle_open(const char *path)
+{
+	dance_bundle_close();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+
+	struct stat st;
+	if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(dance_bundle_header)))
+	{
+		close(fd);
+		return -1;
+	}
+
+	bundle_size = st.st_size;
+	bundle_data = mmap(0, bundle_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (bundle_data == MAP_FAILED)
+	{
+		bundle_data = 0;
+		bundle_size = 0;
+		return -1;
+	}
+
+	const char *p = (const char *)bundle_data;
+	header = (const dance_bundle_header *)p;
+	dances = (const dance_bundle_dance *)(p + sizeof(dance_bundle_header));
+	blocks = (const dance_bundle_block *)(dances + header->num_dances);
+	records = (const dance_record *)(blocks + header->num_blocks);
+	strings = (const char *)(records + header->num_records);
+
+	if (!validate_bundle())
+	{
+		__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "%s is not a valid dance bundle", path);
+		dance_bundle_close();
+		return -1;
+	}
+
+	times.resize(header->num_records);
+	for (uint32_t i = 0; i < header->num_blocks; i++)
+	{
+		int32_t t = 0;
+		for (uint32_t r = blocks[i].first_record; r < blocks[i].first_record + blocks[i].num_records; r++)
+		{
+			t += records[r].dt;
+			times[r] = t;
+		}
+	}
+
+	__android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%s: %d dances, %d blocks, %d commands", path,
+	                    header->num_dances, header->num_blocks, header->num_records);
+	return header->num_dances;
+}
+
+int dance_bundle_find_dance(int drone_id)
+{
+	if (!header) return -1;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (uint32_t i = 0; i < header->num_dances; i++)
+			if (dances[i].drone_id == drone_id) return i;
+		drone_id = 0;   // the same fallback as for dance_K.txt
+	}
+	return -1;
+}
+
+const dance_bundle_dance *dance_bundle_get_dance(int index)
+{
+	if (!header || (index < 0) || (index >= header->num_dances)) return 0;
+	return dances + index;
+}
+
+const dance_bundle_block *dance_bundle_get_block(int index)
+{
+	if (!header || (index < 0) || ((uint32_t)index >= header->num_blocks)) return 0;
+	return blocks + index;
+}
+
+const dance_record *dance_bundle_records()
+{
+	return header ? records : 0;
+}
+
+const int32_t *dance_bundle_times()
+{
+	return header ? times.data() : 0;
+}
+
+const char *dance_bundle_name(const dance_bundle_block *block)
+{
+	if (!header || (block->name == DANCE_BUNDLE_NO_NAME)) return "";
+	return strings + block->name;
+}
+
+int dance_bundle_num_blocks()
+{
+	return header ? header->num_blocks : 0;
+}
+
+int dance_bundle_num_records()
+{
+	return header ? header->num_records : 0;
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_sk_uniba_krucena_NativeBridge_openDanceBundle(JNIEnv *env,
+                                                   jobject,
+                                                   jstring path)
+{
+	const char *p = env->GetStringUTFChars(path, 0);
+	int n = dance_bundle_open(p);
+	env->ReleaseStringUTFChars(path, p);
+	return n;
+}
+
+// [first_performance, num_performances] of the dance for this drone
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_sk_uniba_krucena_NativeBridge_danceBundlePerformances(JNIEnv *env,
+                                                           jobject,
+                                                           jint droneId)
+{
+	const dance_bundle_dance *d = dance_bundle_get_dance(dance_bundle_find_dance(droneId));
+	if (!d) return 0;
+	jint result[2] = { (jint)d->first_performance, (jint)d->num_performances };
+	jintArray a = env->NewIntArray(2);
+	env->SetIntArrayRegion(a, 0, 2, result);
+	return a;
+}
+
+// [first_record, num_records, landing_time, first_procedure, num_procedures] of the block
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_sk_uniba_krucena_NativeBridge_danceBundleBlock(JNIEnv *env,
+                                                    jobject,
+                                                    jint block)
+{
+	const dance_bundle_block *b = dance_bundle_get_block(block);
+	if (!b) return 0;
+	jint result[5] = { (jint)b->first_record, (jint)b->num_records, b->landing_time, (jint)b->first_procedure, (jint)b->num_procedures };
+	jintArray a = env->NewIntArray(5);
+	env->SetIntArrayRegion(a, 0, 5, result);
+	return a;
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_sk_uniba_krucena_NativeBridge_danceBundleName(JNIEnv *env,
+                                                   jobject,
+                                                   jint block)
+{
+	const dance_bundle_block *b = dance_bundle_get_block(block);
+	return env->NewStringUTF(b ? dance_bundle_name(b) : "");
+}
+
+// the records directly in the mapped file (read only!)
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_sk_uniba_krucena_NativeBridge_danceBundleRecords(JNIEnv *env,
+                                                      jobject)
+{
+	if (!dance_bundle_num_records()) return 0;
+	return env->NewDirectByteBuffer((void *)dance_bundle_records(), (jlong)dance_bundle_num_records() * sizeof(dance_record));
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_sk_uniba_krucena_NativeBridge_danceBundleTimes(JNIEnv *env,
+                                                    jobject)
+{
+	if (!dance_bundle_num_records()) return 0;
+	return env->NewDirectByteBuffer((void *)dance_bundle_times(), (jlong)dance_bundle_num_records() * sizeof(int32_t));
+}
+
+#endif
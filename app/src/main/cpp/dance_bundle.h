@@ -0,0 +1,107 @@
+#ifndef DANCE_BUNDLE_H
+#define DANCE_BUNDLE_H
+
+// compiled dances: the dance_K.txt files of all drones in one binary file (tools/dance_compiler.cpp),
+// memory-mapped by the app and read by index without parsing, see Dance.kt for the meaning of the commands
+//
+// file layout (little endian, everything fixed-width):
+//
+//   dance_bundle_header
+//   dance_bundle_dance   [num_dances]     one per dance_K.txt
+//   dance_bundle_block   [num_blocks]     command lists: performances and procedures
+//   dance_record         [num_records]    commands of all blocks
+//   char                 [strings_size]   zero-terminated procedure names
+//
+// the performances of one dance are consecutive blocks, the procedures of one performance too,
+// each block starts with the NONE command (as Dance.kt does), RUN refers directly to the procedure block
+
+#include <stdint.h>
+
+#define DANCE_BUNDLE_MAGIC   "DNCB"
+#define DANCE_BUNDLE_VERSION 1
+
+#define DANCE_BUNDLE_NO_NAME 0xFFFFFFFFu
+#define DANCE_BUNDLE_UNRESOLVED 0xFFFFu
+
+// command kinds, in the same order as DanceInstructionKind in Dance.kt
+#define DANCE_FLY       0
+#define DANCE_POS       1
+#define DANCE_LEDS      2
+#define DANCE_END       3
+#define DANCE_TAKEOFF   4
+#define DANCE_LAND      5
+#define DANCE_RUN       6
+#define DANCE_NONE      7
+#define DANCE_REFPOINT  8
+#define DANCE_RELATIVE  9
+#define DANCE_ABSOLUTE 10
+#define DANCE_HSPEED   11
+#define DANCE_VSPEED   12
+
+// FLY flags, the values are ordinals of the enums in Dance.kt
+#define DANCE_FLY_ALT_MODE(flags)      ((flags) & 1)           // InstructionPosValue
+#define DANCE_FLY_RP_MODE(flags)       (((flags) >> 1) & 3)    // InstructionAngularValue
+#define DANCE_FLY_YAW_MODE(flags)      (((flags) >> 3) & 3)    // InstructionAngularValue
+#define DANCE_FLY_COORD_SYSTEM(flags)  (((flags) >> 5) & 1)    // InstructionCoordSystem
+#define DANCE_FLY_FLAGS(alt, rp, yaw, coord)  ((alt) | ((rp) << 1) | ((yaw) << 3) | ((coord) << 5))
+
+#pragma pack(push, 1)
+
+struct dance_bundle_header
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t num_dances;
+	uint32_t num_blocks;
+	uint32_t num_records;
+	uint32_t strings_size;
+	uint32_t reserved[3];
+};
+
+struct dance_bundle_dance
+{
+	int32_t drone_id;              // K from dance_K.txt
+	uint32_t first_performance;    // block index
+	uint32_t num_performances;
+	uint32_t reserved;
+};
+
+struct dance_bundle_block
+{
+	uint32_t first_record;
+	uint32_t num_records;
+	int32_t landing_time;          // time of the (last) LAND command, 0 if none
+	uint32_t name;                 // offset in strings, DANCE_BUNDLE_NO_NAME for performances
+	uint32_t first_procedure;      // block index, procedures of this performance
+	uint32_t num_procedures;
+};
+
+struct dance_record
+{
+	int32_t dt;        // ms, time of the command minus time of the previous command in the block
+	uint8_t kind;      // DANCE_xxx
+	uint8_t flags;     // FLY: DANCE_FLY_FLAGS, LEDS: 1 = on
+	uint16_t aux;      // RUN: procedure block index (or DANCE_BUNDLE_UNRESOLVED)
+	float a[4];        // FLY: pitch roll yaw altitude, POS/REFPOINT/RELATIVE: x y z yaw, HSPEED/VSPEED: limit
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(dance_bundle_header) == 32, "dance bundle header size");
+static_assert(sizeof(dance_bundle_dance) == 16, "dance bundle dance size");
+static_assert(sizeof(dance_bundle_block) == 24, "dance bundle block size");
+static_assert(sizeof(dance_record) == 24, "dance record size");
+
+// loaded bundle (memory-mapped, valid until the next dance_bundle_open)
+int dance_bundle_open(const char *path);      // returns number of dances or -1
+void dance_bundle_close();
+int dance_bundle_find_dance(int drone_id);    // dance index, falls back to drone 0, -1 if none
+const dance_bundle_dance *dance_bundle_get_dance(int index);
+const dance_bundle_block *dance_bundle_get_block(int index);
+const dance_record *dance_bundle_records();
+const int32_t *dance_bundle_times();          // absolute time of each record (relative to its block start)
+const char *dance_bundle_name(const dance_bundle_block *block);
+int dance_bundle_num_blocks();
+int dance_bundle_num_records();
+
+#endif
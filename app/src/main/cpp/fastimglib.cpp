@@ -1,18 +1,27 @@
+#ifndef FASTIMGLIB_NO_JNI
 #include <jni.h>
+#endif
 #include <opencv2/opencv.hpp>
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
 #include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "fastimglib.h"
+#include "mat_layout.h"
+#include "position_controller.h"
+#include "swarm_exchange.h"
+#include "overlay_renderer.h"
+#include "color_lut.h"
 
 // uncomment this for release version (remove debugging from code)
 //#define RELEASE_VERSION
 
-// for each android device you run this on, you need to figure out the dimensions of the screen
-// that is available for the application and then what portion of that is used for video live fragment
-// - i.e. what is the size of the border 
-
-// the index in the array is the drone ID (1..6), ignore element at pos. 0
+// the live video fragment is letterboxed differently on each android device (black bars left/right
+// or top/bottom), for example:
 
 //Image dimensions: (effective always approx. 16:9)
 // 1: Samsung A40     2014x996    effective: 1770x996   => border left 122, border right 122 
@@ -20,35 +29,21 @@
 // 3: GalaxyS8        1980x996    effective: 1770x996   => border left 105, border right 105
 // 4: Huawei:         1133x664    effective: 1133x638   => border top   13, border bottom 13 
 // 5: Xiaomi:         2079x966    effective: 1717x966   => border left 181, border right 181   (canvas.drawBitmap(btmp, 31.0f, 0.0f, paint))
-// 6: Samsung A40     2014x996    effective: 1770x996   => border left 122, border right 122
-
-//    Motorola g20    2400x1800(phone)  2175x1080(app with top bar)  2175x1020 (app)  effective: 1795x1010
-//                      but the app reports surface size: 2095x1010, border left 150, border right 150
 
-// for D3: samsung g s8 
+// instead of keeping a table per drone, the borders are detected from the first frames (uniform black
+// columns and rows) and cached, and the whole pipeline then works only on the valid sub-image
 
-static int screen_width[7]      = { 0, 2014, 1397, 1980, 1133, 2079, 2014 };
-static int screen_height[7]     = { 0, 996, 667, 996, 664, 966, 996 };
-static int border_horizontal[7] = { 0, 122, 106, 105, 0, 181, 122};
-static int border_vertical[7]   = { 0, 0, 0, 0, 13, 0, 0 };
+// a column/row is considered border, when none of its pixels has any RGB channel above this level
+static const int BORDER_BLACK_LEVEL = 16;
+// number of (not completely black) frames used to detect the borders, then the valid area is frozen
+static const int VALID_AREA_DETECTION_FRAMES = 5;
 
+static cv::Rect valid_area;              // in full-frame pixel coordinates
+static cv::Size valid_area_frame_size;   // size of the frame the valid area was detected for
+static int valid_area_frames = 0;        // how many frames contributed to the detection so far
 
-// for D3: samsung a41
-
-/*
-static int screen_width[7]      = { 0, 2014, 1397, 2111, 1133, 2079, 2014 };
-static int screen_height[7]     = { 0, 996, 667, 1006, 664, 966, 996 };
-static int border_horizontal[7] = { 0, 122, 106, 156, 0, 181, 122};
-static int border_vertical[7]   = { 0, 0, 0, 0, 13, 0, 0 };
-*/
-
-// for D3: motorola
-/*
-static int screen_width[7]      = { 0, 2014, 1397, 2095, 1133, 2079, 2014 };
-static int screen_height[7]     = { 0, 996, 667, 1010, 664, 966, 996 };
-static int border_horizontal[7] = { 0, 122, 106, 150, 0, 181, 122};
-static int border_vertical[7]   = { 0, 0, 0, 0, 13, 0, 0 };
-*/
+// effective width of the drone2 image (A30), camera pixel size was measured for this resolution
+static const int REFERENCE_VALID_WIDTH = 1185;
 
 // pixel size:  0.01188185654008438818565400843882 mm ?  (from online calculations)
 //focal length: 6.7 mm  => from measurement then pixel_size = 0.00754055977064093182411092861206 mm  (from m1)
@@ -59,10 +54,11 @@ static int border_vertical[7]   = { 0, 0, 0, 0, 13, 0, 0 };
 //              x1 = 413 pixels, x2 = 540 pixels
 
 // actual image is 1185 x 667 (drone2 is used as reference from which other are derived)
-static int IMAGE_MINIMUM_VALID_X; // = 106;
-static int IMAGE_MAXIMUM_VALID_X; // = 1290;
+// all the image coordinates are relative to the valid area (the cropped sub-image)
+static int IMAGE_MINIMUM_VALID_X; // = 0;
+static int IMAGE_MAXIMUM_VALID_X; // = 1184;
 static int IMAGE_MINIMUM_VALID_Y; // = 0;
-static int IMAGE_MAXIMUM_VALID_Y; // = 667;
+static int IMAGE_MAXIMUM_VALID_Y; // = 666;
 
 static int IMAGE_MINIMUM_REASONABLE_X;
 static int IMAGE_MINIMUM_REASONABLE_Y;
@@ -102,6 +98,10 @@ static int visualize_contours = 1;
 
 static int visualization = 0;  // 0 = default, 1 = RGB, 2 = BLACK, 3 = YELLOW
 
+// set on the worker threads of localize_batch: the frames are recorded, no debug output, overlay, filters,
+// controller or swarm updates
+static thread_local int offline = 0;
+
 // for visualization
 static const cv::Scalar black_color(0, 0, 0);
 static const cv::Scalar red_color(255, 0, 0);
@@ -121,56 +121,144 @@ static const float default_pixel_size = 0.0000075;  // m
 //static const float default_pixel_size = 0.000003375;  // m
 
 // corners detected this close (relative) to the border are ignored unless not enough other are found
+// (not needed when the lens distortion is corrected)
 static const float UNREASONABLE_BORDER = 0.025;    
 
+// optional calibrated camera (OpenCV model), fx, fy, cx, cy are relative to the width of the valid image area, 
+// so that one calibration works for every display mapping, camera_fx <= 0 means not calibrated (ideal pinhole camera)
+static int camera_calibrated = 0;
+static double camera_fx, camera_fy, camera_cx, camera_cy;
+static std::vector<double> camera_distortion(5, 0.0);    // k1, k2, p1, p2, k3
+
+// only the detected corners are undistorted, through a coarse table of undistorted positions of grid nodes
+static const int UNDISTORTION_GRID_STEP = 16;   // pixels
+static const float EDGE_PROBE = 12.0f;          // pixels along an edge, to undistort its direction at a corner
+struct undistortion_grid
+{
+	int cols, rows;
+	std::vector<cv::Point2f> nodes;
+};
+// setupCamera builds a new table while localization may be reading the old one, so a table is never modified,
+// only replaced whole (std::atomic_store), and the readers keep the one they loaded
+static std::shared_ptr<const undistortion_grid> undistortion_table;
+
 // camera color detection thresholds
 static int black_maxRGB_t, black_chroma_t, red_t, green_t, blue_t, yellow_t;
 
 
-void init_image_parameters(int drone_id)
+// precomputes the ideal (undistorted, square pixel) positions of grid nodes over the valid image area
+void build_undistortion_table(const cv::Rect &area)
+{
+	double fx = camera_fx * area.width;
+	double fy = camera_fy * area.width;
+	double cx = camera_cx * area.width;
+	double cy = camera_cy * area.width;
+	
+	cv::Matx33d camera_matrix(fx, 0, cx, 0, fy, cy, 0, 0, 1);
+	cv::Matx33d ideal_camera_matrix(fx, 0, cx, 0, fx, cy, 0, 0, 1);   // square pixels, as the rest of the code assumes
+	
+	std::shared_ptr<undistortion_grid> grid = std::make_shared<undistortion_grid>();
+	grid->cols = area.width / UNDISTORTION_GRID_STEP + 2;
+	grid->rows = area.height / UNDISTORTION_GRID_STEP + 2;
+	
+	std::vector<cv::Point2f> nodes;
+	nodes.reserve(grid->cols * grid->rows);
+	for (int r = 0; r < grid->rows; r++)
+		for (int c = 0; c < grid->cols; c++)
+			nodes.push_back(cv::Point2f(c * UNDISTORTION_GRID_STEP, r * UNDISTORTION_GRID_STEP));
+	
+	cv::undistortPoints(nodes, grid->nodes, camera_matrix, camera_distortion, cv::Mat(), ideal_camera_matrix);
+	std::atomic_store(&undistortion_table, std::shared_ptr<const undistortion_grid>(grid));
+}
+
+// bilinear interpolation in the undistortion table
+cv::Point2f undistort_point_f(const cv::Point2f &p)
 {
-	IMAGE_MINIMUM_VALID_X = border_horizontal[drone_id];
-    IMAGE_MAXIMUM_VALID_X = screen_width[drone_id] - border_horizontal[drone_id] - 1;
-    IMAGE_MINIMUM_VALID_Y = border_vertical[drone_id];
-    IMAGE_MAXIMUM_VALID_Y = screen_height[drone_id] - border_vertical[drone_id] - 1;
+	std::shared_ptr<const undistortion_grid> grid = std::atomic_load(&undistortion_table);
+	if (!grid) return p;        // calibrated before the valid area is known
+	float gx = p.x / (float)UNDISTORTION_GRID_STEP;
+	float gy = p.y / (float)UNDISTORTION_GRID_STEP;
+	int c = std::max(0, std::min((int)gx, grid->cols - 2));
+	int r = std::max(0, std::min((int)gy, grid->rows - 2));
+	float ax = gx - c;
+	float ay = gy - r;
+	
+	const cv::Point2f *row0 = &grid->nodes[r * grid->cols + c];
+	const cv::Point2f *row1 = row0 + grid->cols;
+	cv::Point2f top = row0[0] * (1.0f - ax) + row0[1] * ax;
+	cv::Point2f bottom = row1[0] * (1.0f - ax) + row1[1] * ax;
+	return top * (1.0f - ay) + bottom * ay;
+}
+
+cv::Point undistort_point(const cv::Point &p)
+{
+	cv::Point2f q = undistort_point_f(cv::Point2f((float)p.x, (float)p.y));
+	return cv::Point((int)(q.x + 0.5f), (int)(q.y + 0.5f));
+}
+
+// the direction of an edge at a corner (both in the distorted image) in the undistorted image,
+// from the undistorted position of a point a little along the edge
+cv::Point2f undistort_direction(const cv::Point &corner, const cv::Point2f &direction)
+{
+	float n = cv::norm(direction);
+	if (n < 1e-6) return direction;
+	cv::Point2f p((float)corner.x, (float)corner.y);
+	return undistort_point_f(p + direction * (EDGE_PROBE / n)) - undistort_point_f(p);
+}
+
+void init_image_parameters(const cv::Rect &area)
+{
+	IMAGE_MINIMUM_VALID_X = 0;
+    IMAGE_MAXIMUM_VALID_X = area.width - 1;
+    IMAGE_MINIMUM_VALID_Y = 0;
+    IMAGE_MAXIMUM_VALID_Y = area.height - 1;
 	
 	IMAGE_MINIMUM_REASONABLE_X = IMAGE_MINIMUM_VALID_X + (IMAGE_MINIMUM_VALID_X - IMAGE_MINIMUM_VALID_X) * UNREASONABLE_BORDER;
 	IMAGE_MINIMUM_REASONABLE_Y = IMAGE_MINIMUM_VALID_Y + (IMAGE_MINIMUM_VALID_Y - IMAGE_MINIMUM_VALID_Y) * UNREASONABLE_BORDER;
 	IMAGE_MAXIMUM_REASONABLE_X = IMAGE_MAXIMUM_VALID_X - (IMAGE_MINIMUM_VALID_X - IMAGE_MINIMUM_VALID_X) * UNREASONABLE_BORDER;
 	IMAGE_MAXIMUM_REASONABLE_Y = IMAGE_MAXIMUM_VALID_Y + (IMAGE_MINIMUM_VALID_Y - IMAGE_MINIMUM_VALID_Y) * UNREASONABLE_BORDER;	
 	
-	camera_center_x = screen_width[drone_id] / 2;
-	camera_center_y = screen_height[drone_id] / 2;
-	MIN_CORNER_SEGMENT_LENGTH_SQR = (int)(0.09  * (screen_width[drone_id] - 2 * border_horizontal[drone_id]));  //original coef 0.12
+	camera_center_x = area.width / 2;
+	camera_center_y = area.height / 2;
+	MIN_CORNER_SEGMENT_LENGTH_SQR = (int)(0.09  * area.width);  //original coef 0.12
 	MIN_CORNER_SEGMENT_LENGTH_SQR *= MIN_CORNER_SEGMENT_LENGTH_SQR;
-	MAX_CLOSE_NEIGHBOR_POINTS_SQR = (int)(0.072 * (screen_width[drone_id] - 2 * border_horizontal[drone_id]));
+	MAX_CLOSE_NEIGHBOR_POINTS_SQR = (int)(0.072 * area.width);
 	MAX_CLOSE_NEIGHBOR_POINTS_SQR *= MAX_CLOSE_NEIGHBOR_POINTS_SQR;
 	
-	MIN_CORNER_DISTANCE = (int)(0.02  * (screen_width[drone_id] - 2 * border_horizontal[drone_id]));
+	MIN_CORNER_DISTANCE = (int)(0.02  * area.width);
 	     
-	camera_pixel_size = default_pixel_size * (float)(screen_width[2] - 2 * border_horizontal[2]) / (IMAGE_MAXIMUM_VALID_X - IMAGE_MINIMUM_VALID_X + 1); 
+	camera_pixel_size = default_pixel_size * (float)REFERENCE_VALID_WIDTH / area.width; 
+	
+	if (camera_calibrated)
+	{
+		// only the ratio of focal length and pixel size matters in the height and position calculation
+		camera_center_x = (int)(camera_cx * area.width + 0.5);
+		camera_center_y = (int)(camera_cy * area.width + 0.5);
+		camera_pixel_size = camera_focal_length / (camera_fx * area.width);
+		build_undistortion_table(area);
+	}
 }
 
 void print_image_parameters()
 {
 	FILE *f = fopen(cpp_log_file, "a+");
+	fprintf(f, "valid area: x=%d, y=%d, w=%d, h=%d (frame %dx%d)\n", valid_area.x, valid_area.y, valid_area.width, valid_area.height,
+	           valid_area_frame_size.width, valid_area_frame_size.height);
 	fprintf(f, "IMAGE_MINIMUM_VALID_X=%d, IMAGE_MAXIMUM_VALID_X=%d, IMAGE_MINIMUM_VALID_Y=%d, IMAGE_MAXIMUM_VALID_Y=%d\n", 
 	           IMAGE_MINIMUM_VALID_X, IMAGE_MAXIMUM_VALID_X,IMAGE_MINIMUM_VALID_Y, IMAGE_MAXIMUM_VALID_Y);
 	fprintf(f, "camera_center_x=%d, camera_center_y=%d, MIN_CORNER_SEGMENT_LENGTH_SQR=%ld, MAX_CLOSE_NEIGHBOR_POINTS_SQR=%ld\n",
 	           camera_center_x, camera_center_y, MIN_CORNER_SEGMENT_LENGTH_SQR, MAX_CLOSE_NEIGHBOR_POINTS_SQR);
 	fprintf(f, "pixel_size=%f\n", camera_pixel_size);
+	if (camera_calibrated)
+		fprintf(f, "calibrated camera: fx=%.4f, fy=%.4f, cx=%.4f, cy=%.4f, k1=%.4f, k2=%.4f, p1=%.5f, p2=%.5f, k3=%.4f\n", camera_fx, camera_fy, camera_cx, camera_cy,
+		           camera_distortion[0], camera_distortion[1], camera_distortion[2], camera_distortion[3], camera_distortion[4]);
 	fprintf(f, "black_maxRGB_t=%d, black_chroma_t=%d, red_t=%d, green_t=%d, blue_t=%d, yellow_t=%d\n", black_maxRGB_t, black_chroma_t, red_t, green_t, blue_t, yellow_t);
 	fprintf(f, "---\n");
 	fclose(f);
 }
 
 // world locations of the verteces - indexed with corner ID 
-static const cv::Vec2f world_coordinates[20] = { {-1.05f, 1.05f}, {-0.10f, 1.05f},    {0.10f, 1.05f}, {1.05f, 1.05f},
-	                                             {-1.05f, 0.10f}, {-0.10f, 0.10f},    {0.10f, 0.10f}, {1.05f, 0.10f},
-						                         {-1.05f, -0.10f}, {-0.10f, -0.10f},  {0.10f, -0.10f}, {1.05f, -0.10f},
-                                                 {-1.05f, -1.05f}, {-0.10f, -1.05f},  {0.10f, -1.05f}, {1.05f, -1.05f},
-                                                 {-0.575f, 0.575f}, {0.575f, 0.575f},  {-0.575f, -0.575f}, {0.575f, -0.575f}
-											   };
+static const cv::Vec2f world_coordinates[20] = MAT_WORLD_COORDINATES;
 
 
 // special return value that indicates that localization was not possible
@@ -194,7 +282,7 @@ static const cv::Vec4f unknown_camera_pos = cv::Vec4f(999.0f, 999.0f, 999.0f, 99
 
 // yellow then follow from up-to down from left-to right 16..19
 
-uint8_t color_ids[5][4] = { {0, 1, 4, 5}, {2, 3, 6, 7}, {10, 11, 14, 15}, {8, 9, 12, 13}, {16, 17, 18, 19} };
+uint8_t color_ids[5][4] = MAT_COLOR_IDS;
 
 // index: [a:2][b:2][c:2][d:2][e:2], where a=color(P1), b=color(P2), c=angle4(outgoing_of_P1,outgoing_of_P2), d=bin_cross(out1,P1P2), e=bin_cross(in1,P1P2)
 //                                   angle4(alpha) = 0,1,2,3 for alpha=0,90,180,270 (approx)
@@ -212,10 +300,10 @@ int8_t id2dy[] = {0, 1, -1, 0};
 
 static const float dot_cross_eps = 0.1736;   // corresponds to about 10 degrees error tolerance
 
-static char str[1000];  // for debug prints
+static thread_local char str[1000];  // for debug prints
 
 // calculated between a yellow and non-yellow corners, used in special ambiguous cases
-static float min_distance;
+static thread_local float min_distance;
 
 long distance_sqr(cv::Point *a, cv::Point *b)
 {
@@ -236,8 +324,6 @@ void init_cpp_debug(int drone_id)
         time_debug_started = current_millis_time();
         first_run = 1;
     }
-    if (first_run) init_image_parameters(drone_id);
-		
     if (CPP_DEBUG_ON)
 	{
 		if (!first_run)
@@ -259,7 +345,6 @@ void init_cpp_debug(int drone_id)
 		fprintf(f, "Starting cpp debug (droneId=%d)...\n", drone_id);
 		fclose(f);
 		time_debug_started = current_millis_time();
-		print_image_parameters();
 	}
 	
 	if (POSITION_DEBUG_ON)
@@ -291,7 +376,7 @@ void log_position(cv::Vec4f pos)
 
 void cpp_debug(const char *tag, const char *msg)
 {
-	if (CPP_DEBUG_ON == 0) return;
+	if ((CPP_DEBUG_ON == 0) || offline) return;
 	FILE *f = fopen(cpp_log_file, "a+");
 	double tajm = current_millis_time() - time_debug_started;
 	fprintf(f, "%10.2lf %s: %s\n", tajm, tag, msg);
@@ -300,7 +385,7 @@ void cpp_debug(const char *tag, const char *msg)
 
 void cpp_debug_f(const char *tag, const char *msg, float num)
 {
-	if (CPP_DEBUG_ON == 0) return;
+	if ((CPP_DEBUG_ON == 0) || offline) return;
 	FILE *f = fopen(cpp_log_file, "a+");
 	double tajm = current_millis_time() - time_debug_started;
 	fprintf(f, "%10.2lf %s: %s%.4lf\n", tajm, tag, msg, num);
@@ -309,7 +394,7 @@ void cpp_debug_f(const char *tag, const char *msg, float num)
 
 void cpp_debug(const char *tag, const char *msg, long num)
 {
-	if (CPP_DEBUG_ON == 0) return;
+	if ((CPP_DEBUG_ON == 0) || offline) return;
 	FILE *f = fopen(cpp_log_file, "a+");
 	double tajm = current_millis_time() - time_debug_started;
 	fprintf(f, "%10.2lf %s: %s%ld\n", tajm, tag, msg, num);
@@ -318,7 +403,7 @@ void cpp_debug(const char *tag, const char *msg, long num)
 
 void cpp_debug(const char *tag, const char *msg, long num1, long num2)
 {
-	if (CPP_DEBUG_ON == 0) return;
+	if ((CPP_DEBUG_ON == 0) || offline) return;
 	FILE *f = fopen(cpp_log_file, "a+");
 	double tajm = current_millis_time() - time_debug_started;
 	fprintf(f, "%10.2lf %s: %s%ld %ld\n", tajm, tag, msg, num1, num2);
@@ -327,7 +412,7 @@ void cpp_debug(const char *tag, const char *msg, long num1, long num2)
 
 void cpp_debug_f(const char *tag, const char *msg, float num1, float num2)
 {
-	if (CPP_DEBUG_ON == 0) return;
+	if ((CPP_DEBUG_ON == 0) || offline) return;
 	FILE *f = fopen(cpp_log_file, "a+");
 	double tajm = current_millis_time() - time_debug_started;
 	fprintf(f, "%10.2lf %s: %s%.2f %.2f\n", tajm, tag, msg, num1, num2);
@@ -365,7 +450,7 @@ uint8_t angle_between(cv::Point2f v1, cv::Point2f v2)
 
 char *binrep(int i)
 {
-	static char br[20];
+	static thread_local char br[20];
     sprintf(br, "%d%d|%d%d|%d%d|%d%d|%d%d", (i & 512) >> 9, (i & 256) >> 8, (i & 128) >> 7, (i & 64) >> 6, (i & 32) >> 5,
 	                                          (i & 16) >> 4, (i & 8) >> 3, (i & 4) >> 2, (i & 2) >> 1, i & 1);
     return br;
@@ -373,7 +458,7 @@ char *binrep(int i)
 
 char *binrep2(int i)
 {
-	static char br[20];
+	static thread_local char br[20];
 	sprintf(br, "%d%d|%d|%d|%d|%d|%d%d", (i & 128) >> 7, (i & 64) >> 6, (i & 32) >> 5, (i & 16) >> 4, (i & 8) >> 3, (i & 4) >> 2, (i & 2) >> 1, i & 1);
 	return br;
 }
@@ -731,16 +816,97 @@ inline float dotproduct(cv::Point2f &u, cv::Point2f &v)
 	return u.x * v.x + u.y * v.y;
 }
 
+/*** processing governor ***/
+
+// when the phone heats up and throttles, the processing time of a frame grows; the governor compares it with
+// a latency budget and steps through the quality levels (with hysteresis), trading precision for bounded latency
+
+enum { QUALITY_FULL = 0,      // the whole valid area at full resolution
+       QUALITY_HALF,          // the whole valid area at half resolution
+       QUALITY_ROI,           // only around the corners of the last frame, at half resolution
+       QUALITY_SKIP };        // as ROI, and every other frame returns the last pose
+
+static const float PROCESSING_TIME_SMOOTHING = 0.2f;   // of the moving average
+static const int DEGRADE_AFTER_FRAMES = 5;             // over the budget
+static const int IMPROVE_AFTER_FRAMES = 30;            // under IMPROVE_FRACTION of the budget
+static const float IMPROVE_FRACTION = 0.45f;           // each level takes roughly half the time of the one below
+
+static float governor_budget_ms = 0;     // 0 = off, always full quality
+static int governor_max_level = QUALITY_SKIP;
+static int quality_level = QUALITY_FULL;
+static float processing_ms = 0;          // moving average
+static int over_budget_frames = 0, under_budget_frames = 0;
+
+// what localization processes: the area (in valid area coordinates) and its reduction
+static thread_local int processing_scale = 1;
+static thread_local cv::Rect processing_area;
+static cv::Rect last_corners_box;        // of the last frame, in valid area coordinates, empty = none
+
+void governor_update(float ms)
+{
+	processing_ms = (processing_ms > 0) ? processing_ms + PROCESSING_TIME_SMOOTHING * (ms - processing_ms) : ms;
+	if (governor_budget_ms <= 0)
+	{
+		quality_level = QUALITY_FULL;
+		return;
+	}
+	over_budget_frames = (processing_ms > governor_budget_ms) ? over_budget_frames + 1 : 0;
+	under_budget_frames = (processing_ms < IMPROVE_FRACTION * governor_budget_ms) ? under_budget_frames + 1 : 0;
+	int level = quality_level;
+	if ((over_budget_frames >= DEGRADE_AFTER_FRAMES) && (quality_level < governor_max_level)) level++;
+	else if ((under_budget_frames >= IMPROVE_AFTER_FRAMES) && (quality_level > QUALITY_FULL)) level--;
+	else if (quality_level > governor_max_level) level = governor_max_level;
+	if (level != quality_level)
+	{
+		sprintf(str, "quality level %d -> %d, processing %.1f ms, budget %.1f ms", quality_level, level, processing_ms, governor_budget_ms);
+		cpp_debug("governor", str);
+		quality_level = level;
+		over_budget_frames = under_budget_frames = 0;
+	}
+}
+
+// the image localization works on at the current quality level (valid = the valid area of the frame)
+cv::Mat processing_image(const cv::Mat &valid)
+{
+	static thread_local cv::Mat reduced;
+	int level = offline ? QUALITY_FULL : quality_level;   // the recorded frames are not in a hurry
+	cv::Rect full(0, 0, valid.cols, valid.rows);
+	processing_area = full;
+	if ((level >= QUALITY_ROI) && !last_corners_box.empty())
+	{
+		// the drone moves between the frames, and the neighbouring corners are needed as well
+		int margin = std::max(last_corners_box.width, last_corners_box.height) / 2 + valid.cols / 10;
+		cv::Rect roi(last_corners_box.x - margin, last_corners_box.y - margin,
+		             last_corners_box.width + 2 * margin, last_corners_box.height + 2 * margin);
+		roi &= full;
+		roi.x &= ~1;
+		roi.y &= ~1;
+		roi.width &= ~31;          // few different sizes, so that the masks are not reallocated for every frame
+		roi.height &= ~31;
+		if ((roi.width > 0) && (roi.height > 0)) processing_area = roi;
+	}
+	processing_scale = (level >= QUALITY_HALF) ? 2 : 1;
+	if (processing_scale == 1) return valid(processing_area);
+	cv::resize(valid(processing_area), reduced, cv::Size(processing_area.width / 2, processing_area.height / 2), 0, 0, cv::INTER_NEAREST);
+	return reduced;
+}
+
 int far_enough_from_border(cv::Point p)
 {
 	if (p.x < IMAGE_MINIMUM_VALID_X + 5) return 0;
 	if (p.x > IMAGE_MAXIMUM_VALID_X - 5) return 0;
 	if (p.y < IMAGE_MINIMUM_VALID_Y + 5) return 0;
 	if (p.y > IMAGE_MAXIMUM_VALID_Y - 5) return 0;
+	// the edges of a region of interest cut the mat squares, and make false corners there
+	int margin = 5 * processing_scale;
+	if (processing_area.x > 0 && p.x < processing_area.x + margin) return 0;
+	if (processing_area.y > 0 && p.y < processing_area.y + margin) return 0;
+	if (processing_area.x + processing_area.width <= IMAGE_MAXIMUM_VALID_X && p.x > processing_area.x + processing_area.width - margin) return 0;
+	if (processing_area.y + processing_area.height <= IMAGE_MAXIMUM_VALID_Y && p.y > processing_area.y + processing_area.height - margin) return 0;
 	return 1;
 }
 
-void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &corner_color, std::vector<std::pair<cv::Point,std::pair<cv::Point2f, cv::Point2f>>> &corner_points)
+void find_corners(cv::Mat &thresholded_image, const cv::Scalar &corner_color, std::vector<std::pair<cv::Point,std::pair<cv::Point2f, cv::Point2f>>> &corner_points)
 {
 	std::vector<std::vector<cv::Point>> contours;
     std::vector<cv::Vec4i> hierarchy;
@@ -748,6 +914,12 @@ void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &
     // Step 1: find contours in the thresholded image, and approximate them with polygons
 	cv::findContours(thresholded_image, contours, hierarchy, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE); //, offset);
 	
+	// from the processed (reduced, cropped) image to the valid area coordinates
+	if ((processing_scale != 1) || (processing_area.x != 0) || (processing_area.y != 0))
+		for (size_t i = 0; i < contours.size(); ++i)
+			for (size_t j = 0; j < contours[i].size(); ++j)
+				contours[i][j] = contours[i][j] * processing_scale + processing_area.tl();
+	
 	//DBGDBG
 	cpp_debug("corners", "step 1, #of contours=", contours.size());
 	
@@ -766,7 +938,7 @@ void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &
 
     // optional: visualize the contours
 	
-	if (visualize_contours)
+	if (visualize_contours && !offline)
 	{
 		for (size_t i = 0; i < contours.size(); ++i) 
 		{
@@ -777,7 +949,7 @@ void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &
 			
 			for (size_t j = 0; j < contour.size(); ++j)	{
 				cv::Point *pt = &contour[j];			
-				cv::line(input, *last, *pt, cv::Scalar(100, 100, 25), 4, cv::LINE_4);
+				overlay_debug_line(*last, *pt, cv::Scalar(100, 100, 25), 4);
 				last = pt;
 			}
 		}
@@ -875,11 +1047,11 @@ void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &
 	}
 
 	// DBG: visualize the corners found
-	if (visualize_contours) {
+	if (visualize_contours && !offline) {
 		for (size_t i = 0; i < corners.size(); i++)
 		{			
-			cv::line(input, *(std::get<0>(corners[i]).first), *(std::get<0>(corners[i]).second), cv::Scalar(255, 30, 30), 5, cv::LINE_4);
-			cv::line(input, *(std::get<1>(corners[i]).first), *(std::get<1>(corners[i]).second), cv::Scalar(255, 30, 30), 5, cv::LINE_4);
+			overlay_debug_line(*(std::get<0>(corners[i]).first), *(std::get<0>(corners[i]).second), cv::Scalar(255, 30, 30), 5);
+			overlay_debug_line(*(std::get<1>(corners[i]).first), *(std::get<1>(corners[i]).second), cv::Scalar(255, 30, 30), 5);
 		}
 	}
 	
@@ -941,7 +1113,7 @@ void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &
 		}
 	}	
 	
-	if (visualize_contours)
+	if (visualize_contours && !offline)
 	{
 		// DBG: visualize the corner points found
 		cpp_debug("corners", "--------------------corners found:");
@@ -954,8 +1126,8 @@ void find_corners(cv::Mat &thresholded_image, cv::Mat &input, const cv::Scalar &
             cpp_debug_f("corners", "       A: [dx,dy]: ", corner_points[i].second.first.x, corner_points[i].second.first.y);
             cpp_debug_f("corners", "       B: [dx,dy]: ", corner_points[i].second.second.x, corner_points[i].second.second.y);
 			
-			cv::rectangle(input, corner_points[i].first - delta, corner_points[i].first + delta, cv::Scalar(255, 255, 255), cv::FILLED);   
-            cv::rectangle(input, corner_points[i].first - smalldelta, corner_points[i].first + smalldelta, corner_color, cv::FILLED);   			
+			overlay_debug_box(corner_points[i].first - delta, corner_points[i].first + delta, cv::Scalar(255, 255, 255), cv::FILLED);
+            overlay_debug_box(corner_points[i].first - smalldelta, corner_points[i].first + smalldelta, corner_color, cv::FILLED);
 		}
 	}	
 }
@@ -1124,96 +1296,586 @@ void normalize_all_vectors_in_corner_points(std::vector<std::pair<cv::Point,std:
         }
 }
 
-float filter_yaw(float yaw)
+// TODO: estimate the following based on FPS
+static const int MAX_BLOCKED_ITEMS_WHEN_POSITION_JUMPS = 6;
+
+// the state of the jump filters below: one for the live frames, and a new one for each sequence of recorded
+// frames (localize_batch)
+struct pose_filter_state
+{
+	float last_reported_yaw = 0.0f;
+	int yaw_counter = 0;
+	float last_reported_height = 0.0f;
+	int height_counter = 0;
+	double last_reported_x = 0.0;
+	double last_reported_y = 0.0;
+	int pos_counter = MAX_BLOCKED_ITEMS_WHEN_POSITION_JUMPS;
+};
+static pose_filter_state live_filters;
+
+float filter_yaw(pose_filter_state &st, float yaw)
 {
-	static float last_reported_yaw = 0.0f;
-	static int yaw_counter = 0;
 	static const float MAX_ALLOWED_YAW_JUMP = 35.0f / 180.0f * M_PI;
 	// TODO: estimate the following based on FPS rate
 	static const int MAX_BLOCKED_ITEMS_WHEN_YAW_JUMPS = 6;
 	
-	if (fabs(yaw - last_reported_yaw) <= MAX_ALLOWED_YAW_JUMP)
+	if (fabs(yaw - st.last_reported_yaw) <= MAX_ALLOWED_YAW_JUMP)
 	{
-		last_reported_yaw = yaw;
-		yaw_counter /= 2;
+		st.last_reported_yaw = yaw;
+		st.yaw_counter /= 2;
 		return yaw;
 	}
 	else
 	{
-		yaw_counter++;
-		if (yaw_counter > MAX_BLOCKED_ITEMS_WHEN_YAW_JUMPS)
+		st.yaw_counter++;
+		if (st.yaw_counter > MAX_BLOCKED_ITEMS_WHEN_YAW_JUMPS)
 		{
-			yaw_counter = 0;
-			last_reported_yaw = yaw;
+			st.yaw_counter = 0;
+			st.last_reported_yaw = yaw;
 			return yaw;
 		}
 	}
-	return last_reported_yaw;
+	return st.last_reported_yaw;
 }
 
-float filter_height(float height)
+float filter_height(pose_filter_state &st, float height)
 {
-	static float last_reported_height = 0.0f;
-	static int height_counter = 0;
 	static const float MAX_ALLOWED_HEIGHT_JUMP = 0.45;  // 45 cm
 	// TODO: estimate the following based on FPS
 	static const int MAX_BLOCKED_ITEMS_WHEN_HEIGHT_JUMPS = 6;
 	
-	if (fabs(height - last_reported_height) <= MAX_ALLOWED_HEIGHT_JUMP)
+	if (fabs(height - st.last_reported_height) <= MAX_ALLOWED_HEIGHT_JUMP)
 	{
-		last_reported_height = height;
-		height_counter /= 2;
+		st.last_reported_height = height;
+		st.height_counter /= 2;
 		return height;
 	}
 	else
 	{
-		height_counter++;
-		if (height_counter > MAX_BLOCKED_ITEMS_WHEN_HEIGHT_JUMPS)
+		st.height_counter++;
+		if (st.height_counter > MAX_BLOCKED_ITEMS_WHEN_HEIGHT_JUMPS)
 		{
-			height_counter = 0;
-			last_reported_height = height;
+			st.height_counter = 0;
+			st.last_reported_height = height;
 			return height;
 		}
 	}
-	return last_reported_height;
+	return st.last_reported_height;
 }
 
-cv::Vec2d filter_position(cv::Vec2d &position)
+cv::Vec2d filter_position(pose_filter_state &st, cv::Vec2d &position)
 {
-	static double last_reported_x = 0.0;
-	static double last_reported_y = 0.0;
 	static const float MAX_ALLOWED_POSITION_JUMP_SQR = 0.35 * 0.35;  // 35 cm
-	// TODO: estimate the following based on FPS
-	static const int MAX_BLOCKED_ITEMS_WHEN_POSITION_JUMPS = 6;
-	static int pos_counter = MAX_BLOCKED_ITEMS_WHEN_POSITION_JUMPS;
 	
 	cv::Vec2d result(position);
 	
-	double jump_size = (last_reported_x - position[0]) * (last_reported_x - position[0]) + (last_reported_y - position[1]) * (last_reported_y - position[1]);
+	double jump_size = (st.last_reported_x - position[0]) * (st.last_reported_x - position[0]) + (st.last_reported_y - position[1]) * (st.last_reported_y - position[1]);
 	
 	if (jump_size <= MAX_ALLOWED_POSITION_JUMP_SQR)
 	{
-		last_reported_x = position[0];
-		last_reported_y = position[1];
-		pos_counter /= 2;
+		st.last_reported_x = position[0];
+		st.last_reported_y = position[1];
+		st.pos_counter /= 2;
 		return result;
 	}
 	else
 	{
-		pos_counter++;
-		if (pos_counter > MAX_BLOCKED_ITEMS_WHEN_POSITION_JUMPS)
+		st.pos_counter++;
+		if (st.pos_counter > MAX_BLOCKED_ITEMS_WHEN_POSITION_JUMPS)
 		{
-			pos_counter = 0;
-			last_reported_x = position[0];
-			last_reported_y = position[1];
+			st.pos_counter = 0;
+			st.last_reported_x = position[0];
+			st.last_reported_y = position[1];
 			return result;
 		}
 	}
-	result[0] = last_reported_x;
-	result[1] = last_reported_y;
+	result[0] = st.last_reported_x;
+	result[1] = st.last_reported_y;
 	return result;
 }
 
+// returns the number of leading entries of a 1D reduced (per-row or per-column maximum) image that are black
+int count_black_border(const cv::Mat &reduced_max, int from_end)
+{
+	int n = (int)reduced_max.total();
+	int ch = reduced_max.channels();
+	const uchar *p = reduced_max.ptr<uchar>(0);
+	
+	int count = 0;
+	for (int i = 0; i < n; i++)
+	{
+		const uchar *px = p + (from_end ? (n - 1 - i) : i) * ch;
+		int brightest = px[0];
+		for (int c = 1; c < std::min(ch, 3); c++)  // ignore alpha channel
+			if (px[c] > brightest) brightest = px[c];
+		if (brightest > BORDER_BLACK_LEVEL) break;
+		count++;
+	}
+	return count;
+}
+
+// detects the uniform black borders around the video in the first frames, and keeps the valid area cached afterwards
+// returns 1, if the valid area is known
+int update_valid_area(cv::Mat &input)
+{
+	if (input.size() != valid_area_frame_size)
+	{
+		valid_area_frame_size = input.size();
+		valid_area_frames = 0;
+	}
+	if (valid_area_frames >= VALID_AREA_DETECTION_FRAMES) return 1;
+	
+	static cv::Mat column_max, row_max;
+	cv::reduce(input, column_max, 0, cv::REDUCE_MAX);
+	
+	int left = count_black_border(column_max, 0);
+	if (left == input.cols) return valid_area_frames > 0;  // completely black frame (video not running yet), nothing to learn from
+	int right = count_black_border(column_max, 1);
+	
+	cv::reduce(input, row_max, 1, cv::REDUCE_MAX);
+	int top = count_black_border(row_max, 0);
+	int bottom = count_black_border(row_max, 1);
+	
+	cv::Rect detected(left, top, input.cols - left - right, input.rows - top - bottom);
+	
+	// dark content at the image edge could look like a border in some frames, so take the largest area seen
+	if (valid_area_frames == 0) valid_area = detected;
+	else valid_area |= detected;
+	valid_area_frames++;
+	
+	init_image_parameters(valid_area);
+	
+	sprintf(str, "valid area detection %d: [%d,%d,%d,%d], borders l=%d, r=%d, t=%d, b=%d", valid_area_frames, 
+	             valid_area.x, valid_area.y, valid_area.width, valid_area.height, left, right, top, bottom);
+	cpp_debug("init", str);
+	if (CPP_DEBUG_ON && !offline && (valid_area_frames == VALID_AREA_DETECTION_FRAMES)) print_image_parameters();
+	
+	return 1;
+}
+
+/*** coarse pre-pass ***/
+
+static const int COARSE_STEP = 8;                   // every 8th pixel of every 8th row
+static const float MIN_COLOR_COVERAGE = 0.002f;     // fraction of the samples for a color to be present
+static float last_coverage[5] = { 0, 0, 0, 0, 0 };  // of the last frame, index is color (see COLOR ENCODING)
+static int last_rejected = 0;
+
+// the fraction of the samples of each color (coverage[5], COLOR ENCODING), returns the number of colors present
+int coarse_color_coverage(const cv::Mat &input, int use_lut, float *coverage)
+{
+	const int thresholds[6] = { red_t, green_t, blue_t, yellow_t, black_maxRGB_t, black_chroma_t };
+	int counts[COLOR_CLASSES] = { 0, 0, 0, 0, 0 };
+	int ch = input.channels(), sampled = 0;
+	uint8_t f[6];
+	if (ch < 3) return 0;
+	for (int y = COARSE_STEP / 2; y < input.rows; y += COARSE_STEP)
+	{
+		const uchar *in = input.ptr<uchar>(y) + (COARSE_STEP / 2) * ch;
+		for (int x = COARSE_STEP / 2; x < input.cols; x += COARSE_STEP, in += COARSE_STEP * ch)
+		{
+			uint8_t classes;
+			if (use_lut) classes = color_lut_lookup(in[0], in[1], in[2]);
+			else
+			{
+				color_features(in[0], in[1], in[2], f);
+				classes = classes_by_thresholds(f, thresholds);
+			}
+			for (int c = 0; c < COLOR_CLASSES; c++) counts[c] += (classes >> c) & 1;
+			sampled++;
+		}
+	}
+	int present = 0;
+	for (int c = 0; c < COLOR_CLASSES; c++)
+	{
+		coverage[c] = sampled ? counts[c] / (float)sampled : 0;
+		present += (coverage[c] >= MIN_COLOR_COVERAGE);
+	}
+	return present;
+}
+
+/*** duplicate frames ***/
+
+// the surface is captured again soon after each localization, often before the decoder has delivered a new
+// frame, so the same picture comes again: a sparse fingerprint recognizes it, and the pose of its first
+// localization is returned without processing it again (and without feeding the filters, the controller
+// and the swarm with the same evidence twice)
+
+static const int FINGERPRINT_STEP = 13;             // pixels, odd, so that it does not follow the codec blocks
+static uint64_t last_fingerprint = 0;
+static float last_pose[4] = { 999.0f, 999.0f, 999.0f, 999.0f };
+static double last_pose_time = 0;                   // ms, when the frame of the pose was localized
+static int last_duplicate = 0;
+
+// FNV-1a of every FINGERPRINT_STEP-th pixel of every FINGERPRINT_STEP-th row (all the channels) and of the size
+uint64_t frame_fingerprint(const cv::Mat &input)
+{
+	uint64_t h = 14695981039346656037ULL;
+	h = (h ^ (uint64_t)input.cols) * 1099511628211ULL;
+	h = (h ^ (uint64_t)input.rows) * 1099511628211ULL;
+	int ch = (int)input.elemSize();
+	for (int y = FINGERPRINT_STEP / 2; y < input.rows; y += FINGERPRINT_STEP)
+	{
+		const uchar *p = input.ptr<uchar>(y);
+		for (int x = FINGERPRINT_STEP / 2; x < input.cols; x += FINGERPRINT_STEP)
+			for (int c = 0; c < ch; c++)
+				h = (h ^ p[x * ch + c]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+/*** corner velocity ***/
+
+// the corners found in a frame are tracked into the next frame by pyramidal Lucas-Kanade: each of them is a point
+// fixed on the ground, so the difference of the camera positions it gives in the two frames (the same mapping
+// of the pixels as in localization, with the yaw and the height of each frame) is the motion of the drone, and
+// their median over the time between the frames is a velocity at the frame rate - also when the corners of the
+// second frame are not identified or the pose is not found there
+
+static const int VELOCITY_MIN_POINTS = 3;           // tracked, for a velocity
+static const int VELOCITY_MAX_POINTS = 40;          // tracked from one frame
+static const double VELOCITY_MAX_GAP_MS = 300;      // between the frames, otherwise the tracking starts again
+static const float VELOCITY_SMOOTHING = 0.5f;       // of the low-pass
+static int velocity_enabled = 1;
+static std::vector<cv::Point2f> velocity_corners;   // found by the last localization, valid area coordinates (distorted)
+static cv::Mat velocity_gray;                       // the previous frame (valid area)
+static std::vector<cv::Point2f> velocity_points;    // to be tracked from it
+static float velocity_yaw = 999.0f, velocity_height = 999.0f;   // of the last pose, 999 = none yet
+static double velocity_frame_time = 0;              // ms, of the previous frame
+static float velocity[2] = { 0, 0 };                // world, m/s
+static int velocity_tracked = 0;                    // points the last velocity was measured from, 0 = unknown
+static double velocity_time = 0;                    // ms, when it was measured
+
+// the vector from the ground point seen at pixel p (valid area coordinates) to the camera, as in localization
+cv::Point2f ground_offset(const cv::Point2f &p, float yaw, float height)
+{
+	cv::Point2f u = camera_calibrated ? undistort_point_f(p) : p;
+	cv::Point2f w((camera_center_x - u.x) * camera_pixel_size, (u.y - camera_center_y) * camera_pixel_size);
+	float scaling_factor = height / camera_focal_length;
+	return cv::Point2f((w.x * cosf(yaw) - w.y * sinf(yaw)) * scaling_factor, (w.x * sinf(yaw) + w.y * cosf(yaw)) * scaling_factor);
+}
+
+float median_of(std::vector<float> &v)
+{
+	std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+	return v[v.size() / 2];
+}
+
+// called after the localization of the frame (pose = its result, frame_time = when it started)
+void velocity_update(cv::Mat &frame, const float *pose, double frame_time)
+{
+	static cv::Mat gray;
+	static std::vector<cv::Point2f> tracked;
+	static std::vector<uchar> status;
+	static std::vector<float> err, dx, dy;
+
+	if (!velocity_enabled || valid_area.empty())
+	{
+		velocity_gray.release();
+		velocity_tracked = 0;
+		return;
+	}
+	cv::Mat valid = frame(valid_area);
+	if (velocity_gray.empty() || (velocity_gray.size() != valid.size()) || (frame_time - velocity_frame_time > VELOCITY_MAX_GAP_MS))
+		velocity_points.clear();
+	tracked.clear();
+	if (velocity_points.empty() && (velocity_corners.size() < VELOCITY_MIN_POINTS))
+	{
+		// nothing to track now or in the next frame
+		velocity_gray.release();
+		velocity_tracked = 0;
+		return;
+	}
+	cv::cvtColor(valid, gray, (valid.channels() == 4) ? cv::COLOR_RGBA2GRAY : cv::COLOR_RGB2GRAY);
+
+	velocity_tracked = 0;
+	if (!velocity_points.empty() && (velocity_height < 900.0f))
+	{
+		cv::calcOpticalFlowPyrLK(velocity_gray, gray, velocity_points, tracked, status, err, cv::Size(21, 21), 3);
+		// without a pose now, the yaw and the height are assumed not to change since the last one
+		float yaw = (pose[0] < 900.0f) ? pose[3] : velocity_yaw;
+		float height = (pose[0] < 900.0f) ? pose[2] : velocity_height;
+		dx.clear();
+		dy.clear();
+		size_t n = 0;
+		for (size_t i = 0; i < tracked.size(); i++)
+			if (status[i])
+			{
+				cv::Point2f d = ground_offset(tracked[i], yaw, height) - ground_offset(velocity_points[i], velocity_yaw, velocity_height);
+				dx.push_back(d.x);
+				dy.push_back(d.y);
+				tracked[n++] = tracked[i];
+			}
+		tracked.resize(n);
+
+		float dt = (float)((frame_time - velocity_frame_time) / 1000.0);
+		if ((n >= VELOCITY_MIN_POINTS) && (dt > 0))
+		{
+			float vx = median_of(dx) / dt, vy = median_of(dy) / dt;
+			int restart = (frame_time - velocity_time > VELOCITY_MAX_GAP_MS);
+			velocity[0] = restart ? vx : velocity[0] + VELOCITY_SMOOTHING * (vx - velocity[0]);
+			velocity[1] = restart ? vy : velocity[1] + VELOCITY_SMOOTHING * (vy - velocity[1]);
+			velocity_tracked = (int)n;
+			velocity_time = frame_time;
+			controller_update_velocity(velocity);
+			sprintf(str, "velocity=(%.3f,%.3f) from %d points, dt=%.3f", velocity[0], velocity[1], (int)n, dt);
+			cpp_debug("velocity", str);
+		}
+	}
+
+	// the next frame tracks the new corners, or further the tracked ones when there are too few of them
+	if (pose[0] < 900.0f)
+	{
+		velocity_yaw = pose[3];
+		velocity_height = pose[2];
+	}
+	velocity_points = (velocity_corners.size() >= VELOCITY_MIN_POINTS) ? velocity_corners : tracked;
+	if (velocity_points.size() > VELOCITY_MAX_POINTS) velocity_points.resize(VELOCITY_MAX_POINTS);
+	std::swap(gray, velocity_gray);
+	velocity_frame_time = frame_time;
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+// [vx, vy (world, m/s), points it was measured from (0 = unknown), age in ms] of the velocity from the tracked corners
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_localizationVelocity(JNIEnv *env,
+														jobject,
+														jfloatArray result)
+{
+	float v[4] = { velocity[0], velocity[1], (float)velocity_tracked, (float)(current_millis_time() - velocity_time) };
+	env->SetFloatArrayRegion(result, 0, std::min(4, (int)env->GetArrayLength(result)), v);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_setupVelocity(JNIEnv *env,
+												 jobject,
+												 jint enabled)
+{
+	velocity_enabled = enabled;
+}
+
+#endif
+
+/*** attitude aided localization ***/
+
+// with the attitude of the aircraft (and of the gimbal) and the compass heading given with the frame
+// (localizationWithAttitude), the corners are moved to where a camera pointing straight down would see them
+// (the ray of each pixel is rotated back by the tilt of the camera), the heading is a prior of the yaw (its
+// offset from the yaw of the mat is learned on the frames where the two-color pairs give the yaw), the corners
+// of the colored squares that no pair identified get their ID from the directions of their edges, and a single
+// identified corner gives the pose with the height of the last frames
+
+static const float MAX_TILT = 30.0f / 180.0f * M_PI;            // larger tilts are not trusted (a wrong reading)
+static const float HEADING_OFFSET_SMOOTHING = 0.1f;
+static const double HEIGHT_PRIOR_MAX_AGE_MS = 1000;             // since the last height from a pair of corners
+static const float EDGE_AXIS_COS = 0.866f;                      // an edge is along an axis of the mat within 30 degrees
+static const float CONVEX_PROBE = 8.0f;                         // pixels from a corner, where its color is looked for
+
+static thread_local int attitude_known = 0;       // for the frame being localized
+static thread_local float tilt_roll, tilt_pitch;  // rad, of the camera from straight down, positive = it looks right / forward
+static thread_local float heading_yaw;            // rad, the yaw of the mat by the compass (without the learned offset)
+static float north_correction = 0;        // deg, the heading when facing the +y of the mat
+
+// what the frames before give to a frame localized with the attitude: the live frames keep them in live_priors,
+// the recorded ones get them from the frames before them in the second pass of localize_batch
+struct localization_priors
+{
+	float heading_offset = 0;     // rad, yaw of the mat - heading_yaw, learned
+	int heading_offset_known = 0;
+	float height = 0;             // m, the last height from a pair of corners
+	double height_time = 0;       // ms, of its frame, 0 = none yet
+};
+
+static localization_priors live_priors;
+
+// attitude = [roll, pitch, yaw, compass heading, gimbal roll, gimbal pitch] in degrees as the SDK gives them
+// (NaN = not available): the gimbal angles are absolute (pitch -90 = straight down), without them the camera
+// is assumed to be fixed to the aircraft, with the top of the image forward; the signs are checked against
+// the tilted frames of mat_renderer by tools/tilt_check (its roll is the pitch here and its pitch the roll)
+void set_attitude(const float *attitude)
+{
+	int gimbal = !std::isnan(attitude[4]) && !std::isnan(attitude[5]);
+	float roll = gimbal ? attitude[4] : attitude[0];
+	float pitch = gimbal ? attitude[5] + 90.0f : attitude[1];
+	float heading = std::isnan(attitude[3]) ? attitude[2] : attitude[3];
+	attitude_known = !std::isnan(roll) && !std::isnan(pitch) && !std::isnan(heading);
+	if (!attitude_known) return;
+	// rolling right tilts the down-looking camera to the left, pitching up tilts it forward
+	tilt_roll = -roll / 180.0f * M_PI;
+	tilt_pitch = pitch / 180.0f * M_PI;
+	if ((fabsf(tilt_roll) > MAX_TILT) || (fabsf(tilt_pitch) > MAX_TILT)) tilt_roll = tilt_pitch = 0;
+	// the heading is clockwise, the yaw of the mat counter-clockwise
+	heading_yaw = (north_correction - heading) / 180.0f * M_PI;
+}
+
+float yaw_prior(const localization_priors &priors)
+{
+	return heading_yaw + priors.heading_offset;
+}
+
+// offset = yaw of the mat - heading_yaw of a frame
+void learn_heading_offset(localization_priors &priors, float offset)
+{
+	if (!priors.heading_offset_known) priors.heading_offset = offset;
+	else priors.heading_offset += HEADING_OFFSET_SMOOTHING * remainderf(offset - priors.heading_offset, 2 * M_PI);
+	priors.heading_offset_known = 1;
+}
+
+// the height of the last frame with a pair of corners, if it is recent enough for the frame at time (ms)
+int height_prior_valid(const localization_priors &priors, double time)
+{
+	return (priors.height_time > 0) && (time >= priors.height_time) && (time - priors.height_time < HEIGHT_PRIOR_MAX_AGE_MS);
+}
+
+// where a camera pointing straight down would see what the tilted camera sees at pixel p
+cv::Point2f tilt_compensate_f(const cv::Point2f &p)
+{
+	// the ray of the pixel in the camera: x to the right, y down the image, z along the optical axis
+	float x = (p.x - camera_center_x) * camera_pixel_size;
+	float y = (p.y - camera_center_y) * camera_pixel_size;
+	float z = camera_focal_length;
+	// roll turns the optical axis towards the right, then pitch towards the top of the image (forward),
+	// in the order of the yaw-pitch-roll angles of the SDK
+	float cp = cosf(tilt_pitch), sp = sinf(tilt_pitch), cr = cosf(tilt_roll), sr = sinf(tilt_roll);
+	float x1 = x * cr + z * sr;
+	float z1 = -x * sr + z * cr;
+	float y2 = y * cp - z1 * sp;
+	float z2 = y * sp + z1 * cp;
+	if (z2 < 1e-6f) return p;
+	float k = camera_focal_length / (z2 * camera_pixel_size);
+	return cv::Point2f(camera_center_x + x1 * k, camera_center_y + y2 * k);
+}
+
+cv::Point tilt_compensate(const cv::Point &p)
+{
+	cv::Point2f q = tilt_compensate_f(cv::Point2f((float)p.x, (float)p.y));
+	return cv::Point((int)floorf(q.x + 0.5f), (int)floorf(q.y + 0.5f));
+}
+
+// the direction of an edge at a corner, as a camera pointing straight down would see it (as undistort_direction)
+cv::Point2f tilt_direction(const cv::Point &corner, const cv::Point2f &direction)
+{
+	float n = cv::norm(direction);
+	if (n < 1e-6) return direction;
+	cv::Point2f p((float)corner.x, (float)corner.y);
+	return tilt_compensate_f(p + direction * (EDGE_PROBE / n)) - tilt_compensate_f(p);
+}
+
+static int mask_at(const cv::Mat &mask, const cv::Point2f &p)
+{
+	int x = (int)floorf((p.x - processing_area.x) / processing_scale);
+	int y = (int)floorf((p.y - processing_area.y) / processing_scale);
+	if ((x < 0) || (y < 0) || (x >= mask.cols) || (y >= mask.rows)) return 0;
+	return mask.at<uchar>(y, x) != 0;
+}
+
+// a corner of a colored square (not of a hole in it, such as around the yellow square): its color is between
+// its edges, and not on the other side (mask of its color, corner in valid area coordinates, before undistortion)
+int is_convex_corner(const std::pair<cv::Point, std::pair<cv::Point2f, cv::Point2f>> &corner, const cv::Mat &mask)
+{
+	// the incoming edge leads to the corner, the outgoing one away from it
+	cv::Point2f bisector = corner.second.second - corner.second.first;
+	float n = cv::norm(bisector);
+	if (n < 1e-6f) return 0;
+	bisector *= CONVEX_PROBE / n;
+	cv::Point2f p((float)corner.first.x, (float)corner.first.y);
+	return mask_at(mask, p + bisector) && !mask_at(mask, p - bisector);
+}
+
+// the ID of a corner of a colored square (color 0..3) by the directions of its edges on the mat (with the yaw
+// of the camera), 255 = the edges are not along the two axes of the mat
+uint8_t id_by_orientation(int color, const std::pair<cv::Point, std::pair<cv::Point2f, cv::Point2f>> &corner, float yaw)
+{
+	float c = cosf(yaw), s = sinf(yaw);
+	const cv::Point2f edges[2] = { -corner.second.first, corner.second.second };
+	float sx = 0, sy = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		// the y of the pixels grows opposite to the world y, then rotated by the yaw
+		float wx = edges[i].x * c + edges[i].y * s;
+		float wy = edges[i].x * s - edges[i].y * c;
+		float n = sqrtf(wx * wx + wy * wy);
+		if (n < 1e-6f) return 255;
+		if (fabsf(wx) >= EDGE_AXIS_COS * n) sx = wx;
+		else if (fabsf(wy) >= EDGE_AXIS_COS * n) sy = wy;
+		else return 255;
+	}
+	if ((sx == 0) || (sy == 0)) return 255;
+	// the edges of the top left corner go right and down, etc. (the order of MAT_COLOR_IDS)
+	return color_ids[color][((sx < 0) ? 1 : 0) + ((sy > 0) ? 2 : 0)];
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_setupAttitude(JNIEnv *env,
+												 jobject,
+												 jfloat northCorrection)
+{
+	north_correction = northCorrection;
+	live_priors.heading_offset_known = 0;
+	live_priors.heading_offset = 0;
+}
+
+#endif
+
+// thresholds = [red, green, blue, yellow, black max, black chroma] (the order of the features of color_lut.h)
+void setup_colors(const int thresholds[6])
+{
+	red_t = thresholds[0];
+	green_t = thresholds[1];
+	blue_t = thresholds[2];
+	yellow_t = thresholds[3];
+	black_maxRGB_t = thresholds[4];
+	black_chroma_t = thresholds[5];
+	color_lut_set_thresholds(thresholds);
+	last_fingerprint = 0;     // the same frame gives a different result now
+}
+
+// calibration = [fx, fy, cx, cy, k1, k2, p1, p2, k3], fx, fy <= 0: not calibrated
+void setup_camera(const float calibration[9])
+{
+	camera_calibrated = (calibration[0] > 0) && (calibration[1] > 0);
+	camera_fx = calibration[0];
+	camera_fy = calibration[1];
+	camera_cx = calibration[2];
+	camera_cy = calibration[3];
+	camera_distortion = { calibration[4], calibration[5], calibration[6], calibration[7], calibration[8] };
+	last_fingerprint = 0;     // the same frame gives a different result now
+	
+	// if we already know the image, recompute the camera parameters (and the table) now
+	if (valid_area_frames > 0) init_image_parameters(valid_area);
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+// [rejected by the coarse pass, coverage of blue, black, red, green, yellow, duplicate frame (2 = skipped by the
+// governor), age of the pose in ms, quality level, processing time in ms (moving average)] of the last localization
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_localizationStats(JNIEnv *env,
+													 jobject,
+													 jfloatArray stats)
+{
+	float st[10] = { (float)last_rejected, last_coverage[0], last_coverage[1], last_coverage[2], last_coverage[3], last_coverage[4],
+	                 (float)last_duplicate, (float)(current_millis_time() - last_pose_time), (float)quality_level, processing_ms };
+	env->SetFloatArrayRegion(stats, 0, std::min(10, (int)env->GetArrayLength(stats)), st);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_setupGovernor(JNIEnv *env,
+												 jobject,
+												 jfloat budget_ms,
+												 jint max_level)
+{
+	governor_budget_ms = budget_ms;
+	governor_max_level = std::max((int)QUALITY_FULL, std::min((int)max_level, (int)QUALITY_SKIP));
+}
+
 extern "C"
 JNIEXPORT void JNICALL
 Java_sk_uniba_krucena_NativeBridge_setupColors(JNIEnv *env,
@@ -1225,12 +1887,19 @@ Java_sk_uniba_krucena_NativeBridge_setupColors(JNIEnv *env,
 													  jint new_blue_t, 
 													  jint new_yellow_t)
 {
-	black_maxRGB_t = new_black_maxRGB_t;
-	black_chroma_t = new_black_chroma_t; 
-	red_t = new_red_t; 
-    green_t = new_green_t;
-	blue_t = new_blue_t; 
-	yellow_t = new_yellow_t;
+	const int thresholds[6] = { new_red_t, new_green_t, new_blue_t, new_yellow_t, new_black_maxRGB_t, new_black_chroma_t };
+	setup_colors(thresholds);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_setupCamera(JNIEnv *env,
+													 jobject,
+													 jfloat fx, jfloat fy, jfloat cx, jfloat cy,
+													 jfloat k1, jfloat k2, jfloat p1, jfloat p2, jfloat k3)
+{
+	const float calibration[9] = { fx, fy, cx, cy, k1, k2, p1, p2, k3 };
+	setup_camera(calibration);
 }
 
 extern "C"
@@ -1243,6 +1912,7 @@ Java_sk_uniba_krucena_NativeBridge_setMode(JNIEnv *env,
 												 jint position_debug)
 {
     visualization = visualization_mode;
+	last_fingerprint = 0;
 #ifndef RELEASE_VERSION
 	visualize_contours = show_contours;
 	CPP_DEBUG_ON = cpp_debug;
@@ -1250,28 +1920,102 @@ Java_sk_uniba_krucena_NativeBridge_setMode(JNIEnv *env,
 #endif
 }
 
-extern "C"
-JNIEXPORT void JNICALL
-Java_sk_uniba_krucena_NativeBridge_localization(
-        JNIEnv *env,
-        jobject,
-        jlong matAddrInput,
-        jfloatArray cameraPosition,
-		jint drone_id
+#endif
+
+static int offline_use_lut = 0;     // the lookup table is prepared by localize_batch before its workers start
+
+// localize_features: the features of the frame (instead of the frame) and the thresholds of this thread
+static thread_local const localization_features *offline_features = 0;
+static thread_local const int *offline_thresholds = 0;
+
+// the coverage of the coarse pre-pass from the feature planes, the same samples as coarse_color_coverage
+static int coarse_feature_coverage(const cv::Mat *planes, const int thresholds[6], float *coverage)
+{
+	int counts[COLOR_CLASSES] = { 0, 0, 0, 0, 0 };
+	int sampled = 0;
+	uint8_t f[6];
+	for (int y = COARSE_STEP / 2; y < planes[0].rows; y += COARSE_STEP)
+		for (int x = COARSE_STEP / 2; x < planes[0].cols; x += COARSE_STEP)
+		{
+			for (int i = 0; i < 6; i++) f[i] = planes[i].at<uchar>(y, x);
+			uint8_t classes = classes_by_thresholds(f, thresholds);
+			for (int c = 0; c < COLOR_CLASSES; c++) counts[c] += (classes >> c) & 1;
+			sampled++;
+		}
+	int present = 0;
+	for (int c = 0; c < COLOR_CLASSES; c++)
+	{
+		coverage[c] = sampled ? counts[c] / (float)sampled : 0;
+		present += (coverage[c] >= MIN_COLOR_COVERAGE);
+	}
+	return present;
+}
+
+// the pose of one frame (and how it went) into result, the live frames also update the filters, the controller,
+// the swarm exchange and the overlay; with the attitude, the frame uses and updates the priors (time = of the frame, ms)
+static void localize(
+        cv::Mat &frame,
+		int drone_id,
+		localization_priors &priors,
+		double time,
+		localization_result &result
 		) {
 
-    // Static Mats for color extraction 
-    static cv::Mat maxRG, maxRB, maxGB, minVAR, maxRGB;
-    static cv::Mat black, red, green, blue, yellow;
-    static cv::Size lastSize;
-	static std::vector<cv::Mat> channels(3);
+    // Static Mats for color extraction, one set for each thread
+    static thread_local cv::Mat maxRG, maxRB, maxGB, minVAR, maxRGB;
+    static thread_local cv::Mat black, red, green, blue, yellow;
+    static thread_local cv::Size lastSize;
+	static thread_local std::vector<cv::Mat> channels(3);
 
-	init_cpp_debug(drone_id);
+	memcpy(result.pose, unknown_camera_pos.val, sizeof(result.pose));
+	result.rejected = 0;
+	memset(result.coverage, 0, sizeof(result.coverage));
+	result.corners = result.identified = 0;
+	result.pair_height = 0;
+	result.heading_offset = NAN;
+	
+	if (!offline)
+	{
+		init_cpp_debug(drone_id);
+		overlay_clear_debug();
+		velocity_corners.clear();
+	}
 
     if (!tables_precomputed)
         precompute_id_inference_tables();
     	
-    cv::Mat &input = *(cv::Mat *) matAddrInput;
+	// the valid area of the recorded frames is detected by localize_batch before
+	if (offline_features)
+	{
+		if ((valid_area_frames == 0) || (offline_features->planes[0].size() != valid_area.size())) return;
+	}
+	else if (offline ? ((valid_area_frames == 0) || (frame.size() != valid_area_frame_size)) : !update_valid_area(frame))
+		return;   // the video is not running yet
+	cv::Mat valid = offline_features ? cv::Mat() : frame(valid_area);    // the letterbox borders are never processed
+	if (!offline) overlay_set_origin(valid_area.tl());
+	int use_lut = offline ? (offline_use_lut && !offline_features) : color_lut_prepare();
+	
+	// takeoff, landing, drifting off the mat: when fewer than two colors are seen at all, the pose cannot be
+	// found, so the full pipeline is skipped and the controller is told at once
+	int colors_present = offline_features ? coarse_feature_coverage(offline_features->planes, offline_thresholds, result.coverage)
+	                                      : coarse_color_coverage(valid, use_lut, result.coverage);
+	result.rejected = (colors_present < 2);
+	if (result.rejected)
+	{
+		cpp_debug("corners", "rejected by the coarse pass, colors present:", (long)colors_present);
+		if (offline) return;
+		controller_pose_lost();
+		last_corners_box = cv::Rect();
+		return;
+	}
+	cv::Mat input;
+	if (offline_features)
+	{
+		processing_scale = 1;
+		processing_area = cv::Rect(0, 0, valid_area.width, valid_area.height);
+		input = offline_features->planes[0];
+	}
+	else input = processing_image(valid);
 	
 	// on first call or input size changed, reallocate
     if (black.empty() || input.size() != lastSize) {
@@ -1299,103 +2043,158 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 		}
 	}
 
-    cv::split(input, channels);  // uses existing memory
+	if (offline_features)
+	{
+		// the features were computed once for all the thresholds tried
+		const cv::Mat *planes = offline_features->planes;
+		const int *t = offline_thresholds;
+		cv::threshold(planes[FEATURE_BK_MAX], maxRGB, t[FEATURE_BK_MAX], 200.0, cv::THRESH_BINARY_INV);
+		cv::threshold(planes[FEATURE_BK_CHROMA], minVAR, t[FEATURE_BK_CHROMA], 200.0, cv::THRESH_BINARY_INV);
+		cv::bitwise_and(maxRGB, minVAR, black);
+		cv::threshold(planes[FEATURE_RED], red, t[FEATURE_RED], 200.0, cv::THRESH_BINARY);
+		cv::threshold(planes[FEATURE_GREEN], green, t[FEATURE_GREEN], 200.0, cv::THRESH_BINARY);
+		cv::threshold(planes[FEATURE_BLUE], blue, t[FEATURE_BLUE], 200.0, cv::THRESH_BINARY);
+		cv::threshold(planes[FEATURE_YELLOW], yellow, t[FEATURE_YELLOW], 200.0, cv::THRESH_BINARY);
+	}
+	else if (use_lut)
+	{
+		// one lookup per pixel instead of the arithmetic below (color_lut.h)
+		static thread_local cv::Mat masks[COLOR_CLASSES];
+		color_lut_classify(input, masks);
+		blue = masks[COLOR_CLASS_BLUE];
+		black = masks[COLOR_CLASS_BLACK];
+		red = masks[COLOR_CLASS_RED];
+		green = masks[COLOR_CLASS_GREEN];
+		yellow = masks[COLOR_CLASS_YELLOW];
+	}
+	else
+	{
+	    cv::split(input, channels);  // uses existing memory
 					
-    // maxRG = max(R, G)
-    cv::max(channels[0], channels[1], maxRG);
+	    // maxRG = max(R, G)
+	    cv::max(channels[0], channels[1], maxRG);
 
-    // maxRB = max(R, B)
-    cv::max(channels[0], channels[2], maxRB);
+	    // maxRB = max(R, B)
+	    cv::max(channels[0], channels[2], maxRB);
 
-    // maxGB = max(G, B)
-    cv::max(channels[1], channels[2], maxGB);
+	    // maxGB = max(G, B)
+	    cv::max(channels[1], channels[2], maxGB);
 
-	// minVAR = min(R, G)   (minRG)
-	cv::min(channels[0], channels[1], minVAR);
-	
-	// yellow = minRG - (maxRG - minRG) - B = 2 * minRG - maxRG - B   
-	cv::subtract(maxRG, minVAR, yellow);
-	cv::subtract(minVAR, yellow, yellow);
-	cv::subtract(yellow, channels[2], yellow); 
+		// minVAR = min(R, G)   (minRG)
+		cv::min(channels[0], channels[1], minVAR);
 	
-	// minVAR = min(minRG, B)   (minRGB)
-	cv::min(minVAR, channels[2], minVAR);
+		// yellow = minRG - (maxRG - minRG) - B = 2 * minRG - maxRG - B   
+		cv::subtract(maxRG, minVAR, yellow);
+		cv::subtract(minVAR, yellow, yellow);
+		cv::subtract(yellow, channels[2], yellow); 
 	
-    // maxRGB = R + G + B
-    cv::add(maxRG, channels[2], maxRGB);
+		// minVAR = min(minRG, B)   (minRGB)
+		cv::min(minVAR, channels[2], minVAR);
 	
-	double brightness = cv::mean(maxRGB)[0];
+	    // maxRGB = R + G + B
+	    cv::add(maxRG, channels[2], maxRGB);
 	
-	// clearing black borders with grey to avoid black detection there
-	if (IMAGE_MINIMUM_VALID_X > 0)
-	{
-	    cv::rectangle(maxRGB, cv::Point(0, 0), cv::Point(IMAGE_MINIMUM_VALID_X - 1, maxRGB.rows - 1), cv::Scalar(200, 255, 255), cv::FILLED);
-	    cv::rectangle(maxRGB, cv::Point(IMAGE_MAXIMUM_VALID_X + 1, 0), cv::Point(maxRGB.cols - 1, maxRGB.rows - 1), cv::Scalar(200, 255, 255), cv::FILLED);
-	}
-	if (IMAGE_MINIMUM_VALID_Y > 0)
-	{
-	    cv::rectangle(maxRGB, cv::Point(0, 0), cv::Point(maxRGB.cols - 1, IMAGE_MINIMUM_VALID_Y - 1), cv::Scalar(200, 255, 255), cv::FILLED);
-	    cv::rectangle(maxRGB, cv::Point(0, IMAGE_MAXIMUM_VALID_Y + 1), cv::Point(maxRGB.cols - 1, maxRGB.rows - 1), cv::Scalar(240, 240, 240), cv::FILLED);
-	}
+		double brightness = cv::mean(maxRGB)[0];
 	
-	// minVAR = maxRGB - minRGB  (chroma)
-	cv::subtract(maxRGB, minVAR, minVAR);
+		// minVAR = maxRGB - minRGB  (chroma)
+		cv::subtract(maxRGB, minVAR, minVAR);
 	
-	// minVAR = minVAR + blue   - better distinguish between black and blue
-    cv::add(minVAR, channels[2], minVAR);
+		// minVAR = minVAR + blue   - better distinguish between black and blue
+	    cv::add(minVAR, channels[2], minVAR);
 
-    // red = red - maxGB 
-	cv::subtract(channels[0], maxGB, red);
+	    // red = red - maxGB 
+		cv::subtract(channels[0], maxGB, red);
 
-    // green = green - maxRB 
-	cv::subtract(channels[1], maxRB, green);
+	    // green = green - maxRB 
+		cv::subtract(channels[1], maxRB, green);
 
-    // blue = blue - maxRG 
-	cv::subtract(channels[2], maxRG, blue);
+	    // blue = blue - maxRG 
+		cv::subtract(channels[2], maxRG, blue);
 	
-	// alternate for yellow:
-	//   yellow = min(red,green) - blue
-	// (that would save 2 full-image operations)
+		// alternate for yellow:
+		//   yellow = min(red,green) - blue
+		// (that would save 2 full-image operations)
 	    
-	//cv::blur(maxRGB, maxRGB, cv::Size(10, 10));
+		//cv::blur(maxRGB, maxRGB, cv::Size(10, 10));
+	
+		cpp_debug_f("corners", "mean br=", brightness);
 	
-	cpp_debug_f("corners", "mean br=", brightness);
+		/* this worked in the lab, but does not work in steelpark: 
+		black_maxRGB_t = brightness / 1.32;
+		black_chroma_t = brightness / 2.22;
+		red_t = brightness / 3.2;
+		green_t = brightness / 4.2;
+		blue_t = brightness / 4.2;
+		yellow_t = brightness / 8;  */
 	
-	/* this worked in the lab, but does not work in steelpark: 
-	black_maxRGB_t = brightness / 1.32;
-	black_chroma_t = brightness / 2.22;
-	red_t = brightness / 3.2;
-	green_t = brightness / 4.2;
-	blue_t = brightness / 4.2;
-	yellow_t = brightness / 8;  */
+		cv::threshold(maxRGB, maxRGB, black_maxRGB_t, 200.0, cv::THRESH_BINARY_INV);  
+		cv::threshold(minVAR, minVAR, black_chroma_t, 200.0, cv::THRESH_BINARY_INV); 
+		cv::bitwise_and(maxRGB, minVAR, black);
 	
-	cv::threshold(maxRGB, maxRGB, black_maxRGB_t, 200.0, cv::THRESH_BINARY_INV);  
-	cv::threshold(minVAR, minVAR, black_chroma_t, 200.0, cv::THRESH_BINARY_INV); 
-	cv::bitwise_and(maxRGB, minVAR, black);
+		cv::threshold(red, red, red_t, 200.0, cv::THRESH_BINARY);            
+		cv::threshold(green, green, green_t, 200.0, cv::THRESH_BINARY);  
+		cv::threshold(blue, blue, blue_t, 200.0, cv::THRESH_BINARY); 
+		cv::threshold(yellow, yellow, yellow_t, 200.0, cv::THRESH_BINARY);     
 	
-	cv::threshold(red, red, red_t, 200.0, cv::THRESH_BINARY);            
-	cv::threshold(green, green, green_t, 200.0, cv::THRESH_BINARY);  
-	cv::threshold(blue, blue, blue_t, 200.0, cv::THRESH_BINARY); 
-	cv::threshold(yellow, yellow, yellow_t, 200.0, cv::THRESH_BINARY);     
+	}
 	
 	// representation of corners in camera frame system: (corner_point, (incoming vector, outgoing vector)) 
 	std::vector<std::pair<cv::Point,std::pair<cv::Point2f,cv::Point2f>>> corner_points[5];  // index is color (see COLOR ENCODING)
 	
 	cpp_debug("corners", "blue");
-    find_corners(blue, input, blue_color, corner_points[0]);
+    find_corners(blue, blue_color, corner_points[0]);
     cpp_debug("corners", "black");
-	find_corners(black, input, black_color, corner_points[1]);
+	find_corners(black, black_color, corner_points[1]);
     cpp_debug("corners", "red");
-	find_corners(red, input, red_color, corner_points[2]);
+	find_corners(red, red_color, corner_points[2]);
     cpp_debug("corners", "green");
-	find_corners(green, input, green_color, corner_points[3]);
+	find_corners(green, green_color, corner_points[3]);
 	cpp_debug("corners", "yellow");
-	find_corners(yellow, input, yellow_color, corner_points[4]);
+	find_corners(yellow, yellow_color, corner_points[4]);
+	
+	if (!offline)
+	{
+		// where to look in the next frame at the ROI quality level
+		last_corners_box = cv::Rect();
+		for (int i = 0; i < 5; i++)
+			for (size_t j = 0; j < corner_points[i].size(); j++)
+				last_corners_box = last_corners_box.empty() ? cv::Rect(corner_points[i][j].first, cv::Size(1, 1))
+				                                            : (last_corners_box | cv::Rect(corner_points[i][j].first, cv::Size(1, 1)));
+		// and what the velocity tracks, before the undistortion
+		for (int i = 0; i < 5; i++)
+			for (size_t j = 0; j < corner_points[i].size(); j++)
+				velocity_corners.push_back(cv::Point2f((float)corner_points[i][j].first.x, (float)corner_points[i][j].first.y));
+	}
+	
+	// with the attitude, the corners of the colored squares can be identified one by one (below),
+	// which needs to know the corners of the squares from the corners of the holes in them
+	std::vector<uint8_t> convex[4];
+	if (attitude_known)
+	{
+		const cv::Mat *masks[4] = { &blue, &black, &red, &green };
+		for (int i = 0; i < 4; i++)
+			for (size_t j = 0; j < corner_points[i].size(); j++)
+				convex[i].push_back((uint8_t)is_convex_corner(corner_points[i][j], *masks[i]));
+	}
 	
 	// let's remove those corners that are on the edge of the camera view - these are often not precise,
 	// but only if we have enough corners in total
 	int total_corners_we_have = corner_points[0].size() + corner_points[1].size() + corner_points[2].size() + corner_points[3].size() + corner_points[4].size();
-    if (total_corners_we_have > 3)
+	result.corners = total_corners_we_have;
+    if (camera_calibrated)
+	{
+		// with the lens distortion corrected, the corners near the edge are as good as the others;
+		// the edge directions (for the IDs) are corrected with their corners
+		for (int i = 0; i < 5; i++)
+			for (size_t j = 0; j < corner_points[i].size(); j++)
+			{
+				std::pair<cv::Point, std::pair<cv::Point2f, cv::Point2f>> &corner = corner_points[i][j];
+				corner.second.first = undistort_direction(corner.first, corner.second.first);
+				corner.second.second = undistort_direction(corner.first, corner.second.second);
+				corner.first = undistort_point(corner.first);
+			}
+	}
+	else if (total_corners_we_have > 3)
 	{
 		for (int i = 0; i < 4; i++)
 			for (int j = 0; j < corner_points[i].size(); j++)
@@ -1406,16 +2205,32 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 					{
 						cpp_debug("corners", "removed a corner close to the edge");
 						corner_points[i].erase(corner_points[i].begin() + j);
+						if (attitude_known) convex[i].erase(convex[i].begin() + j);
 						total_corners_we_have--;
 						if (total_corners_we_have == 3) break;
 					}
 	}
-	if (visualization == 2)
-		cv::merge(std::vector<cv::Mat>{maxRGB, minVAR, black}, input);
-	else if (visualization == 1)
-		cv::merge(std::vector<cv::Mat>{red, green, blue }, input);
-	else if (visualization == 3)
-        cv::merge(std::vector<cv::Mat>{yellow, yellow, channels[2] }, input);
+	if (attitude_known)
+		for (int i = 0; i < 5; i++)
+			for (size_t j = 0; j < corner_points[i].size(); j++)
+			{
+				std::pair<cv::Point, std::pair<cv::Point2f, cv::Point2f>> &corner = corner_points[i][j];
+				corner.second.first = tilt_direction(corner.first, corner.second.first);
+				corner.second.second = tilt_direction(corner.first, corner.second.second);
+				corner.first = tilt_compensate(corner.first);
+			}
+	
+	// the overlay shows the visualization planes instead of the frame (NativeBridge.renderOverlay)
+	cv::Rect shown_area = processing_area + valid_area.tl();
+	if (!offline)
+	{
+		if (visualization == 2)
+			overlay_show_planes(use_lut ? black : maxRGB, use_lut ? black : minVAR, black, shown_area);
+		else if (visualization == 1)
+			overlay_show_planes(red, green, blue, shown_area);
+		else if (visualization == 3)
+			overlay_show_planes(yellow, yellow, use_lut ? blue : channels[2], shown_area);
+	}
 		
 	
 	normalize_all_vectors_in_corner_points(corner_points);
@@ -1425,7 +2240,6 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 	
 	if (corner_counts[0] + corner_counts[1] + corner_counts[2] + corner_counts[3] + corner_counts[4] < 2) // we see only 1 corner in total => no localization this time
 	{
-		env->SetFloatArrayRegion(cameraPosition, 0, 4, unknown_camera_pos.val);
 		return;
     }
 	
@@ -1529,6 +2343,23 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 			sprintf(str, "determined_ids[%d][%d] = %d", c, i, max_id);
 			cpp_debug("corners", str);
 		}
+	
+	if (attitude_known)
+	{
+		// the corners without a pair get their ID from their orientation, when no other corner has it
+		float yaw = yaw_prior(priors);
+		for (int c = 0; c < 4; c++)
+			for (int i = 0; i < corner_counts[c]; i++)
+			{
+				if ((determined_ids[c][i] != 255) || !convex[c][i]) continue;
+				uint8_t id = id_by_orientation(c, corner_points[c][i], yaw);
+				for (int k = 0; k < corner_counts[c]; k++)
+					if (determined_ids[c][k] == id) id = 255;
+				determined_ids[c][i] = id;
+				sprintf(str, "determined_ids[%d][%d] = %d by orientation", c, i, id);
+				cpp_debug("corners", str);
+			}
+	}
 		
 	// now we need to find the yaw: for each two corners of different colors, look at the angles at the floor and in the camera, finally possibly remove outliers and make average
 	
@@ -1577,12 +2408,15 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 	cpp_debug("corners", "num_yaws", num_yaws);
 	
 	float camera_yaw;
-	if (num_yaws == 0)  // no two-color pair is seen
+	if ((num_yaws == 0) && attitude_known)  // no two-color pair is seen, but the compass is
+	{
+		camera_yaw = yaw_prior(priors);
+	}
+	else if (num_yaws == 0)
 	{
-		env->SetFloatArrayRegion(cameraPosition, 0, 4, unknown_camera_pos.val);
 		return;
 	}
-	if (num_yaws == 1)
+	else if (num_yaws == 1)
 	{
 		camera_yaw = collected_yaws[0];
 	}
@@ -1656,8 +2490,13 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 		}
 	}
 	
+	if (attitude_known && (num_yaws > 0))
+	{
+		result.heading_offset = remainderf(camera_yaw - heading_yaw, 2 * M_PI);
+		learn_heading_offset(priors, result.heading_offset);
+	}
 	cpp_debug_f("corners", "prefinal yaw(rad,deg)=", camera_yaw, camera_yaw / M_PI * 180.0f);
-	camera_yaw = filter_yaw(camera_yaw);
+	if (!offline) camera_yaw = filter_yaw(live_filters, camera_yaw);
 	cpp_debug_f("corners", "filtered yaw(rad,deg)=", camera_yaw, camera_yaw / M_PI * 180.0f);
 
 	// construct and collect all the real-world 3D vectors from detected corners together with their origin in the corner into one data structure
@@ -1681,10 +2520,12 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 		}
 		
 	int num_corners = camera_incoming_world_vectors_normalized.size();
+	result.identified = num_corners;
 	
-	if (num_corners < 2)  // we need at least two corners
+	// with the attitude, one corner is enough, with the height of the last frames
+	int height_prior = attitude_known && height_prior_valid(priors, time);
+	if ((num_corners < 2) && !(height_prior && (num_corners == 1)))  // we need at least two corners
 	{
-		env->SetFloatArrayRegion(cameraPosition, 0, 4, unknown_camera_pos.val);
 		return;
 	}
 	
@@ -1774,16 +2615,21 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 		}
 	}
 	
-	if (cnt2 < 1)  // no heights survived
+	if ((cnt2 < 1) && !height_prior)  // no heights survived
 	{
-		env->SetFloatArrayRegion(cameraPosition, 0, 4, unknown_camera_pos.val);
 		return;
 	}
 	
-	float average_height = height_sum / cnt2; 
+	float average_height = (cnt2 < 1) ? priors.height : height_sum / cnt2; 
 	cpp_debug_f("corners", "prefinal height estimate=", average_height);
-	average_height = filter_height(average_height);
+	if (!offline) average_height = filter_height(live_filters, average_height);
 	cpp_debug_f("corners", "final height estimate=", average_height);
+	if (cnt2 >= 1)
+	{
+		result.pair_height = average_height;
+		priors.height = average_height;
+		priors.height_time = time;
+	}
 	
 	//------------end of height estimation
 	
@@ -1858,13 +2704,364 @@ Java_sk_uniba_krucena_NativeBridge_localization(
 	camera_position /= cnt; 
 	sprintf(str, "prefinal camera position estimate=[%lf,%lf]", camera_position[0], camera_position[1]);
 	cpp_debug("corners", str);
-	camera_position = filter_position(camera_position);
+	if (!offline) camera_position = filter_position(live_filters, camera_position);
 	sprintf(str, "filtered camera position estimate=[%lf,%lf]", camera_position[0], camera_position[1]);
 	cpp_debug("corners", str);
 	
 	cv::Vec4f cameraPos = cv::Vec4f(camera_position[0], camera_position[1], average_height, camera_yaw);
-	env->SetFloatArrayRegion(cameraPosition, 0, 4, cameraPos.val);
+	memcpy(result.pose, cameraPos.val, sizeof(result.pose));
+	if (offline) return;
+	controller_update_pose(cameraPos.val);   // the native controller reads the newest pose directly
+	swarm_update_pose(cameraPos.val);        // and the swarm exchange sends it to the other drones
 	
 	log_position(cameraPos);
 }
 
+#ifndef FASTIMGLIB_NO_JNI
+
+// the same frames are not localized again, and the governor may skip some
+static void localize_new_frames(
+        JNIEnv *env,
+        jlong matAddrInput,
+        jfloatArray cameraPosition,
+		jint drone_id
+		) {
+	static int skip_toggle = 0;
+	static localization_result live;
+	cv::Mat &frame = *(cv::Mat *) matAddrInput;
+	uint64_t fingerprint = frame_fingerprint(frame);
+	last_duplicate = (fingerprint == last_fingerprint) ? 1 : 0;
+	if (!last_duplicate && (quality_level >= QUALITY_SKIP) && (skip_toggle ^= 1)) last_duplicate = 2;
+	if (last_duplicate)
+	{
+		env->SetFloatArrayRegion(cameraPosition, 0, 4, last_pose);
+		return;
+	}
+	last_fingerprint = fingerprint;
+	double started = current_millis_time();
+	localize(frame, drone_id, live_priors, started, live);
+	last_pose_time = current_millis_time();
+	last_rejected = live.rejected;
+	memcpy(last_coverage, live.coverage, sizeof(last_coverage));
+	memcpy(last_pose, live.pose, sizeof(last_pose));
+	env->SetFloatArrayRegion(cameraPosition, 0, 4, last_pose);
+	velocity_update(frame, last_pose, started);
+	if (!last_rejected) governor_update((float)(last_pose_time - started));
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_localization(
+        JNIEnv *env,
+        jobject,
+        jlong matAddrInput,
+        jfloatArray cameraPosition,
+		jint drone_id
+		) {
+	attitude_known = 0;
+	localize_new_frames(env, matAddrInput, cameraPosition, drone_id);
+}
+
+// attitude = [roll, pitch, yaw, compass heading, gimbal roll, gimbal pitch] (see set_attitude)
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_localizationWithAttitude(
+        JNIEnv *env,
+        jobject,
+        jlong matAddrInput,
+        jfloatArray cameraPosition,
+		jint drone_id,
+		jfloatArray attitude
+		) {
+	float att[6];
+	env->GetFloatArrayRegion(attitude, 0, 6, att);
+	set_attitude(att);
+	localize_new_frames(env, matAddrInput, cameraPosition, drone_id);
+}
+
+#endif
+
+/*** batch of recorded frames ***/
+
+// the priors of each frame from the results of the frames before it, in their order, as the live frames have them
+static void ordered_priors(const std::vector<localization_result> &results, std::vector<localization_priors> &priors)
+{
+	localization_priors p;
+	priors.resize(results.size());
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		priors[i] = p;
+		const localization_result &r = results[i];
+		if (!std::isnan(r.heading_offset)) learn_heading_offset(p, r.heading_offset);
+		if (r.pair_height > 0)
+		{
+			p.height = r.pair_height;
+			p.height_time = r.time;
+		}
+	}
+}
+
+// the frames are localized in parallel without the priors first, then the ones with a single identified corner
+// again with the priors of the frames before them (where the height of the first pass is recent enough)
+static int needs_priors(const localization_result &r, const localization_priors &priors)
+{
+	return (r.pose[0] > 900.0f) && (r.identified == 1) && height_prior_valid(priors, r.time);
+}
+
+void localize_batch(const std::vector<localization_frame> &frames, const localization_batch_config &config,
+                    std::vector<localization_result> &results)
+{
+	int was_offline = offline;
+	offline = 1;              // no debug output from this thread either
+	results.assign(frames.size(), localization_result());
+	setup_colors(config.thresholds);
+	setup_camera(config.camera);
+	color_lut_setup(config.color_lut, config.color_samples);
+	offline_use_lut = color_lut_prepare();
+	if (!tables_precomputed) precompute_id_inference_tables();
+	
+	// the valid area from the first frames, the same way as from the live ones, the workers only read it
+	valid_area_frame_size = cv::Size();
+	valid_area_frames = 0;
+	for (size_t i = 0; (i < frames.size()) && (valid_area_frames < VALID_AREA_DETECTION_FRAMES); i++)
+	{
+		cv::Mat image = frames[i].image;
+		update_valid_area(image);
+	}
+	
+	std::vector<size_t> order(frames.size());
+	for (size_t i = 0; i < frames.size(); i++) order[i] = i;
+	std::vector<localization_priors> priors(frames.size());
+	int threads = (config.threads > 0) ? config.threads : (int)std::thread::hardware_concurrency();
+	threads = std::max(1, std::min(threads, (int)frames.size()));
+	for (int pass = 0; (pass < 2) && !order.empty(); pass++)
+	{
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+			workers.emplace_back([&]() {
+				offline = 1;
+				for (size_t k = next++; k < order.size(); k = next++)
+				{
+					size_t i = order[k];
+					cv::Mat image = frames[i].image;
+					float ms = pass ? results[i].ms : 0;
+					double started = current_millis_time();
+					set_attitude(frames[i].attitude);
+					localize(image, 0, priors[i], frames[i].time, results[i]);
+					results[i].ms = ms + (float)(current_millis_time() - started);
+					results[i].time = frames[i].time;
+				}
+			});
+		for (auto &w : workers) w.join();
+		
+		ordered_priors(results, priors);
+		order.clear();
+		for (size_t i = 0; i < frames.size(); i++)
+			if (needs_priors(results[i], priors[i])) order.push_back(i);
+	}
+	
+	// the filters need the frames in order; unlike the live frames, where the filtered yaw and height are used
+	// to compute the position, they act on the final poses here
+	pose_filter_state filters;
+	for (localization_result &r : results)
+	{
+		memcpy(r.filtered_pose, r.pose, sizeof(r.pose));
+		if (!config.filtered || (r.pose[0] > 900.0f)) continue;
+		r.filtered_pose[3] = filter_yaw(filters, r.pose[3]);
+		r.filtered_pose[2] = filter_height(filters, r.pose[2]);
+		cv::Vec2d position(r.pose[0], r.pose[1]);
+		position = filter_position(filters, position);
+		r.filtered_pose[0] = (float)position[0];
+		r.filtered_pose[1] = (float)position[1];
+	}
+	offline = was_offline;
+}
+
+// the same arithmetic as localize (and as color_features), only without the thresholds
+static void compute_features(const cv::Mat &valid, localization_features &features)
+{
+	std::vector<cv::Mat> channels(3);
+	cv::Mat maxRG, maxRB, maxGB, minRG, minRGB;
+	cv::Mat *planes = features.planes;
+	cv::split(valid, channels);
+	cv::max(channels[0], channels[1], maxRG);
+	cv::min(channels[0], channels[1], minRG);
+	cv::subtract(maxRG, minRG, planes[FEATURE_YELLOW]);
+	cv::subtract(minRG, planes[FEATURE_YELLOW], planes[FEATURE_YELLOW]);
+	cv::subtract(planes[FEATURE_YELLOW], channels[2], planes[FEATURE_YELLOW]);
+	cv::min(minRG, channels[2], minRGB);
+	cv::add(maxRG, channels[2], planes[FEATURE_BK_MAX]);
+	cv::subtract(planes[FEATURE_BK_MAX], minRGB, planes[FEATURE_BK_CHROMA]);
+	cv::add(planes[FEATURE_BK_CHROMA], channels[2], planes[FEATURE_BK_CHROMA]);
+	cv::max(channels[0], channels[2], maxRB);
+	cv::max(channels[1], channels[2], maxGB);
+	cv::subtract(channels[0], maxGB, planes[FEATURE_RED]);
+	cv::subtract(channels[1], maxRB, planes[FEATURE_GREEN]);
+	cv::subtract(channels[2], maxRG, planes[FEATURE_BLUE]);
+}
+
+void localization_features_batch(const std::vector<localization_frame> &frames, const localization_batch_config &config,
+                                 std::vector<localization_features> &features)
+{
+	int was_offline = offline;
+	offline = 1;
+	features.assign(frames.size(), localization_features());
+	setup_camera(config.camera);
+	if (!tables_precomputed) precompute_id_inference_tables();
+	valid_area_frame_size = cv::Size();
+	valid_area_frames = 0;
+	for (size_t i = 0; (i < frames.size()) && (valid_area_frames < VALID_AREA_DETECTION_FRAMES); i++)
+	{
+		cv::Mat image = frames[i].image;
+		update_valid_area(image);
+	}
+	
+	int threads = (config.threads > 0) ? config.threads : (int)std::thread::hardware_concurrency();
+	threads = std::max(1, std::min(threads, (int)frames.size()));
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.emplace_back([&]() {
+			for (size_t i = next++; i < frames.size(); i = next++)
+			{
+				features[i].time = frames[i].time;
+				memcpy(features[i].attitude, frames[i].attitude, sizeof(features[i].attitude));
+				if ((valid_area_frames > 0) && (frames[i].image.size() == valid_area_frame_size))
+					compute_features(frames[i].image(valid_area), features[i]);
+			}
+		});
+	for (auto &w : workers) w.join();
+	offline = was_offline;
+}
+
+void localize_features(const std::vector<localization_features> &features, const int thresholds[6],
+                       std::vector<localization_result> &results)
+{
+	int was_offline = offline;
+	offline = 1;
+	offline_thresholds = thresholds;
+	results.assign(features.size(), localization_result());
+	cv::Mat none;
+	std::vector<localization_priors> priors(features.size());
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (size_t i = 0; i < features.size(); i++)
+		{
+			if (pass && !needs_priors(results[i], priors[i])) continue;
+			offline_features = &features[i];
+			float ms = pass ? results[i].ms : 0;
+			double started = current_millis_time();
+			set_attitude(features[i].attitude);
+			localize(none, 0, priors[i], features[i].time, results[i]);
+			results[i].ms = ms + (float)(current_millis_time() - started);
+			results[i].time = features[i].time;
+			memcpy(results[i].filtered_pose, results[i].pose, sizeof(results[i].pose));
+		}
+		if (!pass) ordered_priors(results, priors);
+	}
+	offline_features = 0;
+	offline_thresholds = 0;
+	offline = was_offline;
+}
+
+
+/*** calibration preview ***/
+
+// while a threshold is tuned with the slider, only the mask of that one threshold is needed: it is computed
+// here in a single pass over every step-th pixel of every step-th row, with the same (saturated 8-bit)
+// arithmetic as in localization, so the preview shows exactly what localization will see, but without
+// the other masks, the contours and the pose
+
+// value = the quantity compared with the threshold of the tuned color (the FEATURE_ of color_lut.h),
+// mask = 200 where the pixel belongs to the color (by the table of color_lut.cpp when it is used);
+// histogram[256] of the value, stats = [sampled pixels, mask pixels, p5, p50, p95 of the value]
+// returns the threshold in force
+int calibration_mask(const cv::Mat &input, int what, int step, cv::Mat &value, cv::Mat &mask, int *histogram, int *stats)
+{
+	static const uint8_t feature_class[6] = { COLOR_CLASS_RED, COLOR_CLASS_GREEN, COLOR_CLASS_BLUE, COLOR_CLASS_YELLOW,
+	                                          COLOR_CLASS_BLACK, COLOR_CLASS_BLACK };
+	const int thresholds[6] = { red_t, green_t, blue_t, yellow_t, black_maxRGB_t, black_chroma_t };
+	int use_lut = color_lut_prepare();
+	int rows = (input.rows + step - 1) / step;
+	int cols = (input.cols + step - 1) / step;
+	value.create(rows, cols, CV_8UC1);
+	mask.create(rows, cols, CV_8UC1);
+	memset(histogram, 0, 256 * sizeof(int));
+
+	int ch = input.channels();
+	int masked = 0;
+	uint8_t f[6];
+	for (int y = 0; y < rows; y++)
+	{
+		const uchar *in = input.ptr<uchar>(y * step);
+		uchar *v = value.ptr<uchar>(y);
+		uchar *m = mask.ptr<uchar>(y);
+		for (int x = 0; x < cols; x++, in += step * ch)
+		{
+			color_features(in[0], in[1], in[2], f);
+			uint8_t classes = use_lut ? color_lut_lookup(in[0], in[1], in[2]) : classes_by_thresholds(f, thresholds);
+			int in_mask = (classes >> feature_class[what]) & 1;
+			v[x] = f[what];
+			m[x] = in_mask ? 200 : 0;
+			masked += in_mask;
+			histogram[f[what]]++;
+		}
+	}
+
+	int sampled = rows * cols;
+	stats[0] = sampled;
+	stats[1] = masked;
+	const float quantiles[3] = { 0.05f, 0.5f, 0.95f };
+	for (int q = 0, acc = 0, i = 0; q < 3; q++)
+	{
+		while ((i < 255) && (acc + histogram[i] <= quantiles[q] * sampled)) acc += histogram[i++];
+		stats[2 + q] = i;
+	}
+	return thresholds[what];
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_sk_uniba_krucena_NativeBridge_calibrationPreview(JNIEnv *env,
+													  jobject,
+													  jlong matAddrInput,
+													  jint what,
+													  jint step,
+													  jintArray stats,
+													  jintArray histogram)
+{
+	static cv::Mat value, mask, shown_mask, shown_rest;
+	int hist[256], st[5];
+	cv::Mat &frame = *(cv::Mat *) matAddrInput;
+	if ((frame.channels() < 3) || (what < FEATURE_RED) || (what > FEATURE_BK_CHROMA)) return -1;
+	if (step < 1) step = 1;
+
+	overlay_clear_debug();
+	if (!update_valid_area(frame)) return -1;
+	cv::Mat input = frame(valid_area);    // the borders would count as black
+	int threshold = calibration_mask(input, what, step, value, mask, hist, st);
+
+	// the preview: the mask in red over the tuned quantity in grey (dimmed)
+	shown_mask.create(value.size(), CV_8UC1);
+	shown_rest.create(value.size(), CV_8UC1);
+	for (int y = 0; y < value.rows; y++)
+	{
+		const uchar *v = value.ptr<uchar>(y), *m = mask.ptr<uchar>(y);
+		uchar *r = shown_mask.ptr<uchar>(y), *gb = shown_rest.ptr<uchar>(y);
+		for (int x = 0; x < value.cols; x++)
+		{
+			r[x] = m[x] ? 255 : v[x] / 2;
+			gb[x] = m[x] ? 0 : v[x] / 2;
+		}
+	}
+	overlay_show_planes(shown_mask, shown_rest, shown_rest, valid_area);
+
+	if (stats != NULL) env->SetIntArrayRegion(stats, 0, std::min(5, (int)env->GetArrayLength(stats)), st);
+	if (histogram != NULL) env->SetIntArrayRegion(histogram, 0, std::min(256, (int)env->GetArrayLength(histogram)), hist);
+	return threshold;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef FASTIMGLIB_H
+#define FASTIMGLIB_H
+
+// localization of recorded frames (offline analysis and tuning on a PC): the frames are localized in parallel,
+// each worker thread with its own buffers, by the same pipeline as the live frames of NativeBridge.localization,
+// but without its side effects (controller, swarm exchange, overlay, debug logs, governor); the temporal filters
+// of the pose then run over the results in order
+//
+// on a PC, compile fastimglib.cpp with -DFASTIMGLIB_NO_JNI (and with the other sources of the library)
+
+#include <opencv2/opencv.hpp>
+#include <math.h>
+#include <vector>
+
+struct localization_frame
+{
+	cv::Mat image;          // RGB or RGBA, the whole frame (with the letterbox borders), all of the same size
+	double time;            // ms
+	// [roll, pitch, yaw, compass heading, gimbal roll, gimbal pitch] in degrees as for localizationWithAttitude,
+	// NaN = not available (all NaN: localized without the attitude)
+	float attitude[6] = { NAN, NAN, NAN, NAN, NAN, NAN };
+};
+
+struct localization_batch_config
+{
+	int thresholds[6] = { 25, 25, 15, 41, 130, 103 };  // [red, green, blue, yellow, black max, black chroma] as in config.txt
+	int color_lut = 0;                                   // 1 = classify by the lookup table (color_lut.h)
+	const char *color_samples = "";                      // of the lookup table
+	float camera[9] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };    // [fx, fy, cx, cy, k1, k2, p1, p2, k3] as in config.txt, fx = 0: uncalibrated
+	int threads = 0;                                     // 0 = all cores
+	int filtered = 1;                                    // run the temporal filters over the results
+};
+
+struct localization_result
+{
+	double time;            // ms, of the frame
+	float pose[4];          // [x, y, height, yaw] from this frame alone (m, rad), 999 = not found
+	float filtered_pose[4]; // after the temporal filters (the same as pose without them)
+	int rejected;           // by the coarse pre-pass: fewer than two colors of the mat seen
+	float coverage[5];      // of the colors in the coarse pre-pass (COLOR ENCODING)
+	int corners;            // found in the frame
+	int identified;         // of them, with an ID
+	float pair_height;      // m, the height from the pairs of corners of this frame, 0 = none (the prior or no pose)
+	float heading_offset;   // rad, the yaw from the pairs - the yaw by the compass, NaN = not measured
+	float ms;               // of processing
+};
+
+// results[i] is of frames[i]; the configuration (and the valid area, detected from the first frames) is shared
+// with the live localization, so the two must not run at the same time; the frames are in the order of their time:
+// with the attitude, a frame with a single identified corner takes the height (and the compass its offset)
+// from the frames before it, as the live frames do
+void localize_batch(const std::vector<localization_frame> &frames, const localization_batch_config &config,
+                    std::vector<localization_result> &results);
+
+// threshold tuning localizes the same frames with many thresholds: the color features (color_features of color_lut.h)
+// of each frame are computed once, as planes of its valid area (FEATURE_RED ... FEATURE_BK_CHROMA), and only
+// thresholded for each candidate; they take 6 bytes per pixel
+struct localization_features
+{
+	cv::Mat planes[6];      // empty if the frame is outside the valid area
+	double time;            // ms
+	float attitude[6];      // of the frame
+};
+
+// detects the valid area and sets the camera calibration (config.camera, config.threads) as localize_batch does,
+// then computes the features of the frames in parallel
+void localization_features_batch(const std::vector<localization_frame> &frames, const localization_batch_config &config,
+                                 std::vector<localization_features> &features);
+
+// localizes the frames from their features with thresholds[6] (the order of localization_batch_config) on the calling
+// thread, without the lookup table and without the temporal filters; after localization_features_batch, several threads
+// may call it at once, each with other thresholds
+void localize_features(const std::vector<localization_features> &features, const int thresholds[6],
+                       std::vector<localization_result> &results);
+
+#endif
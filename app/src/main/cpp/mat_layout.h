@@ -0,0 +1,49 @@
+#ifndef MAT_LAYOUT_H
+#define MAT_LAYOUT_H
+
+// geometry and colors of the printed localization mat (floor banner), in meters, the center of the mat is [0,0],
+// y grows to the north (up in the picture below), shared by fastimglib and the Linux tools in tools/
+//
+// COLOR ENCODING: blue = 0, black = 1, red = 2, green = 3, yellow = 4
+// actual layout:
+//  BE BE BK BK
+//  BE BE BK BK
+//   G  G  R  R
+//   G  G  R  R
+//
+// vertex IDs:
+//
+//  0  1  2  3
+//  4  5  6  7
+//  8  9 10 11
+// 12 13 14 15
+//
+// yellow then follow from up-to down from left-to right 16..19
+
+#define MAT_COLOR_BLUE    0
+#define MAT_COLOR_BLACK   1
+#define MAT_COLOR_RED     2
+#define MAT_COLOR_GREEN   3
+#define MAT_COLOR_YELLOW  4
+
+// the four colored squares span from MAT_INNER_EDGE to MAT_OUTER_EDGE in both axes (white gap in between)
+#define MAT_OUTER_EDGE    1.05f
+#define MAT_INNER_EDGE    0.10f
+
+// one yellow square in each colored square: its corner 16..19 is in the center of that square,
+// and it extends from there towards the center of the mat (see yellow_outgoing_x/y in fastimglib)
+#define MAT_YELLOW_CORNER 0.575f
+
+// world locations of the verteces - indexed with corner ID, usable as an initializer of any 2D vector type
+#define MAT_WORLD_COORDINATES { \
+	{-1.05f, 1.05f},  {-0.10f, 1.05f},   {0.10f, 1.05f},   {1.05f, 1.05f},  \
+	{-1.05f, 0.10f},  {-0.10f, 0.10f},   {0.10f, 0.10f},   {1.05f, 0.10f},  \
+	{-1.05f, -0.10f}, {-0.10f, -0.10f},  {0.10f, -0.10f},  {1.05f, -0.10f}, \
+	{-1.05f, -1.05f}, {-0.10f, -1.05f},  {0.10f, -1.05f},  {1.05f, -1.05f}, \
+	{-0.575f, 0.575f}, {0.575f, 0.575f}, {-0.575f, -0.575f}, {0.575f, -0.575f} \
+}
+
+// corner IDs of each color (in the order of color encoding above)
+#define MAT_COLOR_IDS { {0, 1, 4, 5}, {2, 3, 6, 7}, {10, 11, 14, 15}, {8, 9, 12, 13}, {16, 17, 18, 19} }
+
+#endif
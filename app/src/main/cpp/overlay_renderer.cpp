@@ -0,0 +1,164 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#include <android/bitmap.h>
+#endif
+#include <algorithm>
+#include "overlay_renderer.h"
+
+static std::vector<overlay_primitive> debug_layer;
+static cv::Mat shown_planes[3];
+static cv::Rect planes_area;
+static int planes_shown = 0;
+static cv::Point debug_origin(0, 0);
+
+void overlay_clear_debug()
+{
+	debug_layer.clear();   // keeps the capacity
+	planes_shown = 0;
+	debug_origin = cv::Point(0, 0);
+}
+
+void overlay_set_origin(cv::Point origin)
+{
+	debug_origin = origin;
+}
+
+void overlay_debug_line(cv::Point a, cv::Point b, const cv::Scalar &color, int thickness)
+{
+	debug_layer.push_back(overlay_primitive{ 0, a + debug_origin, b + debug_origin, color, thickness });
+}
+
+void overlay_debug_box(cv::Point a, cv::Point b, const cv::Scalar &color, int thickness)
+{
+	debug_layer.push_back(overlay_primitive{ 1, a + debug_origin, b + debug_origin, color, thickness });
+}
+
+void overlay_show_planes(const cv::Mat &r, const cv::Mat &g, const cv::Mat &b, const cv::Rect &area)
+{
+	planes_area = area;
+	shown_planes[0] = r;
+	shown_planes[1] = g;
+	shown_planes[2] = b;
+	planes_shown = 1;
+}
+
+static void draw(cv::Mat &target, const overlay_primitive &p)
+{
+	cv::Scalar opaque(p.color[0], p.color[1], p.color[2], 255);
+	if (p.box) cv::rectangle(target, p.a, p.b, opaque, p.thickness);
+	else cv::line(target, p.a, p.b, opaque, p.thickness, cv::LINE_4);
+}
+
+void overlay_render(const cv::Mat &frame, cv::Mat &target, const std::vector<overlay_primitive> &gui,
+                    const std::vector<overlay_text> &texts)
+{
+	// the background straight into the target: the frame, and the planes over their area
+	cv::Rect full(0, 0, target.cols, target.rows);
+	cv::Rect area = planes_area.empty() ? full : (planes_area & full);
+	int planes = planes_shown && !shown_planes[0].empty() && !area.empty();
+	if (!planes || (area != full))
+	{
+		if (frame.channels() == 4) frame.copyTo(target);
+		else if (frame.channels() == 3) cv::cvtColor(frame, target, cv::COLOR_RGB2RGBA);
+	}
+	if (planes)
+	{
+		static const int from_to[] = { 0, 0, 1, 1, 2, 2 };
+		static cv::Mat enlarged[3];
+		cv::Mat sources[3] = { shown_planes[0], shown_planes[1], shown_planes[2] };
+		cv::Mat destination = target(area);
+		// reduced planes (calibration preview) are enlarged without interpolation, so the mask stays sharp
+		if (shown_planes[0].size() != area.size())
+			for (int i = 0; i < 3; i++)
+			{
+				if ((i > 0) && (shown_planes[i].data == shown_planes[i - 1].data)) sources[i] = sources[i - 1];
+				else
+				{
+					cv::resize(shown_planes[i], enlarged[i], area.size(), 0, 0, cv::INTER_NEAREST);
+					sources[i] = enlarged[i];
+				}
+			}
+		cv::mixChannels(sources, 3, &destination, 1, from_to, 3);
+		static const int alpha_from_to[] = { 0, 3 };
+		static cv::Mat opaque;
+		if (opaque.size() != area.size()) opaque = cv::Mat(area.size(), CV_8UC1, cv::Scalar(255));
+		cv::mixChannels(&opaque, 1, &destination, 1, alpha_from_to, 1);
+	}
+
+	for (const overlay_primitive &p : debug_layer) draw(target, p);
+	for (const overlay_primitive &p : gui) draw(target, p);
+	for (const overlay_text &t : texts)
+		cv::putText(target, t.text, t.at, cv::FONT_HERSHEY_COMPLEX, 1.0, cv::Scalar(t.color[0], t.color[1], t.color[2], 255),
+		            t.thickness, cv::LINE_8);
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+static cv::Scalar unpack_color(jint rgb)
+{
+	return cv::Scalar((rgb >> 16) & 255, (rgb >> 8) & 255, rgb & 255);
+}
+
+// boxes = [x1, y1, x2, y2, 0xRRGGBB, thickness (-1 = filled)] for each of the boxCount boxes,
+// textAttributes = [x, y, 0xRRGGBB, thickness] for each of the texts,
+// the bitmap (ARGB_8888, the size of the frame) stays locked only while it is drawn into
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_renderOverlay(JNIEnv *env,
+                                                 jobject,
+                                                 jlong matAddrFrame,
+                                                 jobject bitmap,
+                                                 jintArray boxes,
+                                                 jint boxCount,
+                                                 jobjectArray texts,
+                                                 jintArray textAttributes)
+{
+	static std::vector<overlay_primitive> gui;
+	static std::vector<overlay_text> gui_texts;
+	const cv::Mat &frame = *(const cv::Mat *)matAddrFrame;
+
+	AndroidBitmapInfo info;
+	if ((AndroidBitmap_getInfo(env, bitmap, &info) != ANDROID_BITMAP_RESULT_SUCCESS) ||
+	    (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) || ((int)info.width != frame.cols) || ((int)info.height != frame.rows))
+		return JNI_FALSE;
+
+	gui.clear();
+	if (boxCount > 0)
+	{
+		jint *b = env->GetIntArrayElements(boxes, 0);
+		for (int i = 0; (i < boxCount) && (6 * i + 5 < env->GetArrayLength(boxes)); i++)
+		{
+			const jint *v = b + 6 * i;
+			gui.push_back(overlay_primitive{ 1, cv::Point(v[0], v[1]), cv::Point(v[2], v[3]), unpack_color(v[4]), v[5] });
+		}
+		env->ReleaseIntArrayElements(boxes, b, JNI_ABORT);
+	}
+	int n_texts = std::min((int)env->GetArrayLength(texts), (int)env->GetArrayLength(textAttributes) / 4);
+	gui_texts.resize(n_texts);
+	if (n_texts > 0)
+	{
+		jint *a = env->GetIntArrayElements(textAttributes, 0);
+		for (int i = 0; i < n_texts; i++)
+		{
+			jstring s = (jstring)env->GetObjectArrayElement(texts, i);
+			const char *chars = env->GetStringUTFChars(s, 0);
+			gui_texts[i].text = chars;
+			env->ReleaseStringUTFChars(s, chars);
+			env->DeleteLocalRef(s);
+			const jint *v = a + 4 * i;
+			gui_texts[i].at = cv::Point(v[0], v[1]);
+			gui_texts[i].color = unpack_color(v[2]);
+			gui_texts[i].thickness = v[3];
+		}
+		env->ReleaseIntArrayElements(textAttributes, a, JNI_ABORT);
+	}
+
+	void *pixels;
+	if (AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS) return JNI_FALSE;
+	cv::Mat target(info.height, info.width, CV_8UC4, pixels, info.stride);
+	overlay_render(frame, target, gui, gui_texts);
+	AndroidBitmap_unlockPixels(env, bitmap);
+	return JNI_TRUE;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef OVERLAY_RENDERER_H
+#define OVERLAY_RENDERER_H
+
+// the image shown over the camera view: the camera frame (or the visualization planes of localization),
+// the debug layer recorded by localization (contours, corner segments, corner points), and the status text
+// and the buttons of the GUI, rendered straight into a persistent bitmap, so that no bitmap is allocated and
+// converted for each frame, and the frames that are not shown are not drawn into at all
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// a line, or a box (a = one corner, b = the opposite one) filled when thickness is cv::FILLED
+struct overlay_primitive
+{
+	int box;
+	cv::Point a, b;
+	cv::Scalar color;
+	int thickness;
+};
+
+struct overlay_text
+{
+	std::string text;
+	cv::Point at;            // left end of the base line
+	cv::Scalar color;
+	int thickness;
+};
+
+// the debug layer of the current frame, recorded during localization
+void overlay_clear_debug();
+// the position of the processed image in the frame, added to the debug primitives recorded after it
+// (localization works on the valid area only), reset by overlay_clear_debug
+void overlay_set_origin(cv::Point origin);
+void overlay_debug_line(cv::Point a, cv::Point b, const cv::Scalar &color, int thickness);
+void overlay_debug_box(cv::Point a, cv::Point b, const cv::Scalar &color, int thickness);
+// the visualization planes (R, G, B, 8 bit) replace the camera image in area (empty = the whole frame) until
+// overlay_clear_debug (not copied), planes smaller than the area are scaled up to it
+void overlay_show_planes(const cv::Mat &r, const cv::Mat &g, const cv::Mat &b, const cv::Rect &area = cv::Rect());
+
+// renders into target (RGBA, the size of frame): the frame or the planes, the debug layer, the GUI on top
+void overlay_render(const cv::Mat &frame, cv::Mat &target, const std::vector<overlay_primitive> &gui,
+                    const std::vector<overlay_text> &texts);
+
+#endif
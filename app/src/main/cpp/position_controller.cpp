@@ -0,0 +1,332 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#endif
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "position_controller.h"
+#include "clock_sync.h"
+
+static float clamp(float v, float limit)
+{
+	if (v > limit) return limit;
+	if (v < -limit) return -limit;
+	return v;
+}
+
+void position_controller::reset()
+{
+	ix = iy = iz = 0;
+	last_ex = last_ey = 0;
+	last_vx = last_vy = last_vz = 0;
+	has_last = 0;
+}
+
+stick_command position_controller::step(const trajectory_pose &measured, const trajectory_state &target,
+                                        const controller_limits &limits, float dt, const float *measured_velocity)
+{
+	// horizontal, in world coordinates
+	float ex = target.x - measured.x;
+	float ey = target.y - measured.y;
+	float dex = has_last ? (ex - last_ex) / dt : 0.0f;
+	float dey = has_last ? (ey - last_ey) / dt : 0.0f;
+	if (measured_velocity)
+	{
+		dex = target.vx - measured_velocity[0];
+		dey = target.vy - measured_velocity[1];
+	}
+	last_ex = ex;
+	last_ey = ey;
+
+	float new_ix = clamp(ix + ex * dt, gains.integral_limit_xy);
+	float new_iy = clamp(iy + ey * dt, gains.integral_limit_xy);
+	float vx = target.vx + gains.kp_xy * ex + gains.ki_xy * new_ix + gains.kd_xy * dex;
+	float vy = target.vy + gains.kp_xy * ey + gains.ki_xy * new_iy + gains.kd_xy * dey;
+
+	// anti-windup: the integral does not grow while the output is saturated in the direction of the error
+	float speed = sqrtf(vx * vx + vy * vy);
+	if ((speed > limits.horizontal_speed) && (ex * vx + ey * vy > 0))
+	{
+		vx -= gains.ki_xy * (new_ix - ix);
+		vy -= gains.ki_xy * (new_iy - iy);
+		speed = sqrtf(vx * vx + vy * vy);
+	}
+	else
+	{
+		ix = new_ix;
+		iy = new_iy;
+	}
+	if (speed > limits.horizontal_speed)
+	{
+		vx *= limits.horizontal_speed / speed;
+		vy *= limits.horizontal_speed / speed;
+	}
+
+	// vertical
+	float ez = target.z - measured.z;
+	float new_iz = clamp(iz + ez * dt, gains.integral_limit_z);
+	float vz = target.vz + gains.kp_z * ez + gains.ki_z * new_iz;
+	if ((fabsf(vz) > limits.vertical_speed) && (ez * vz > 0)) vz -= gains.ki_z * (new_iz - iz);
+	else iz = new_iz;
+	vz = clamp(vz, limits.vertical_speed);
+
+	// rate limits (smooth changes of the commanded velocity)
+	if (has_last)
+	{
+		float max_dv = gains.max_accel_xy * dt;
+		float dvx = vx - last_vx, dvy = vy - last_vy;
+		float dv = sqrtf(dvx * dvx + dvy * dvy);
+		if (dv > max_dv)
+		{
+			vx = last_vx + dvx * max_dv / dv;
+			vy = last_vy + dvy * max_dv / dv;
+		}
+		vz = last_vz + clamp(vz - last_vz, gains.max_accel_z * dt);
+	}
+	last_vx = vx;
+	last_vy = vy;
+	last_vz = vz;
+	has_last = 1;
+
+	// yaw: our coordinate system is alpha positive CCW, but for SDK, yaw is positive CW (as in posCommand)
+	float delta_yaw = remainderf(measured.yaw - target.yaw, 2 * M_PI) / M_PI * 180.0f;
+	float yaw_rate = gains.kp_yaw * delta_yaw - target.yaw_rate / M_PI * 180.0f;
+
+	stick_command cmd;
+	// rotate to the body coordinates (the same as in posCommand)
+	float c = cosf(-measured.yaw), s = sinf(-measured.yaw);
+	cmd.pitch = vy * c + vx * s;
+	cmd.roll = -vy * s + vx * c;
+	cmd.yaw_rate = clamp(yaw_rate, gains.max_yaw_rate);
+	cmd.vertical = vz;
+	return cmd;
+}
+
+/********************************************************** control thread **************************************/
+
+// pose older than this is not used (the drone then only hovers)
+static const int64_t POSE_TIMEOUT_MS = 400;
+// measured velocity older than this is not used
+static const int64_t VELOCITY_TIMEOUT_MS = 200;
+static const int CONTROLLER_THREAD_NICE = -10;
+
+static std::mutex controller_mutex;      // protects everything below, except the thread itself
+static trajectory_pose newest_pose;
+static int64_t newest_pose_time = 0;     // monotonic ms, 0 = none yet
+static float newest_velocity[2];
+static int64_t newest_velocity_time = 0; // monotonic ms, 0 = none yet
+static trajectory_curve followed_curve;
+static int64_t follow_start_time;        // synchronized wall clock ms (clock_sync.h)
+static controller_limits follow_limits;
+static int following = 0;
+static int follow_generation = 0;        // new target => the controller state is reset
+
+static std::thread controller_thread;
+static std::atomic<int> controller_running(0);
+
+static int64_t monotonic_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void controller_update_pose(const float pose[4])
+{
+	if (pose[0] > 900.0f) return;   // position not available
+	std::lock_guard<std::mutex> lock(controller_mutex);
+	newest_pose = trajectory_pose{ pose[0], pose[1], pose[2], pose[3] };
+	newest_pose_time = monotonic_ms();
+}
+
+void controller_update_velocity(const float velocity[2])
+{
+	std::lock_guard<std::mutex> lock(controller_mutex);
+	newest_velocity[0] = velocity[0];
+	newest_velocity[1] = velocity[1];
+	newest_velocity_time = monotonic_ms();
+}
+
+void controller_pose_lost()
+{
+	std::lock_guard<std::mutex> lock(controller_mutex);
+	newest_pose_time = 0;
+	newest_velocity_time = 0;
+}
+
+void controller_follow(const trajectory_curve &curve, int64_t start_time_ms, const controller_limits &limits)
+{
+	std::lock_guard<std::mutex> lock(controller_mutex);
+	followed_curve = curve;
+	followed_curve.cursor = 0;
+	follow_start_time = start_time_ms;
+	follow_limits = limits;
+	following = 1;
+	follow_generation++;
+}
+
+void controller_idle()
+{
+	std::lock_guard<std::mutex> lock(controller_mutex);
+	following = 0;
+}
+
+static void control_loop(float rate_hz, std::function<void(const stick_command &)> sink)
+{
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), CONTROLLER_THREAD_NICE);   // may fail without permission, then it runs at normal priority
+
+	position_controller controller;
+	int generation = -1;
+	int64_t period_ns = (int64_t)(1e9 / rate_hz);
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	double last_step = 0;
+
+	while (controller_running)
+	{
+		// absolute deadlines, so that the rate does not drift with the time spent in the step
+		next.tv_nsec += period_ns;
+		while (next.tv_nsec >= 1000000000L)
+		{
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0);
+		if (!controller_running) break;
+
+		stick_command cmd;
+		{
+			std::lock_guard<std::mutex> lock(controller_mutex);
+			if (!following) continue;
+			if (generation != follow_generation)
+			{
+				controller.reset();
+				generation = follow_generation;
+			}
+
+			int64_t now = monotonic_ms();
+			if ((newest_pose_time == 0) || (now - newest_pose_time > POSE_TIMEOUT_MS))
+			{
+				controller.reset();
+				cmd = stick_command{ 0, 0, 0, 0 };    // lost: hover
+			}
+			else
+			{
+				float dt = (last_step > 0) ? (float)((now - last_step) / 1000.0) : 1.0f / rate_hz;
+				if ((dt <= 0) || (dt > 0.5f)) dt = 1.0f / rate_hz;
+				trajectory_state target = followed_curve.evaluate(clock_sync_now_ms() - follow_start_time);
+				if ((newest_velocity_time > 0) && (now - newest_velocity_time <= VELOCITY_TIMEOUT_MS))
+				{
+					// the pose is where the drone was when the frame was localized, it has moved on since
+					trajectory_pose measured = newest_pose;
+					float age = (now - newest_pose_time) / 1000.0f;
+					measured.x += newest_velocity[0] * age;
+					measured.y += newest_velocity[1] * age;
+					cmd = controller.step(measured, target, follow_limits, dt, newest_velocity);
+				}
+				else cmd = controller.step(newest_pose, target, follow_limits, dt);
+			}
+			last_step = now;
+		}
+		sink(cmd);
+	}
+}
+
+int controller_start(float rate_hz, std::function<void(const stick_command &)> sink)
+{
+	if (controller_running || (rate_hz <= 0)) return 0;
+	controller_running = 1;
+	controller_thread = std::thread(control_loop, rate_hz, sink);
+	return 1;
+}
+
+void controller_stop()
+{
+	if (!controller_running) return;
+	controller_running = 0;
+	if (controller_thread.joinable()) controller_thread.join();
+	controller_idle();
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+static JavaVM *controller_vm = 0;
+static jobject controller_sink = 0;
+static jmethodID controller_sink_method = 0;
+
+// the commands are delivered to sink.onStickCommand(roll, pitch, yawRate, vertical) on the control thread
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_controllerStart(JNIEnv *env,
+                                                   jobject,
+                                                   jfloat rateHz,
+                                                   jobject sink)
+{
+	if (controller_sink) return JNI_FALSE;
+	env->GetJavaVM(&controller_vm);
+	controller_sink = env->NewGlobalRef(sink);
+	controller_sink_method = env->GetMethodID(env->GetObjectClass(sink), "onStickCommand", "(FFFF)V");
+	if (!controller_sink_method)
+	{
+		env->DeleteGlobalRef(controller_sink);
+		controller_sink = 0;
+		return JNI_FALSE;
+	}
+
+	// the thread is attached on its first command and detached when it ends
+	int ok = controller_start(rateHz, [](const stick_command &cmd) {
+		thread_local struct attached_env
+		{
+			JNIEnv *env = 0;
+			~attached_env() { if (env) controller_vm->DetachCurrentThread(); }
+		} attached;
+		if (!attached.env && (controller_vm->AttachCurrentThread(&attached.env, 0) != JNI_OK)) return;
+		attached.env->CallVoidMethod(controller_sink, controller_sink_method, cmd.roll, cmd.pitch, cmd.yaw_rate, cmd.vertical);
+		if (attached.env->ExceptionCheck()) attached.env->ExceptionClear();
+	});
+	return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_controllerStop(JNIEnv *env,
+                                                  jobject)
+{
+	controller_stop();
+	if (controller_sink) env->DeleteGlobalRef(controller_sink);
+	controller_sink = 0;
+}
+
+// follow the trajectory (from trajectoryFromBundle/FromSamples), startTimeMs = clockSyncTime() (clock_sync_now_ms) at its time 0
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_controllerFollow(JNIEnv *env,
+                                                    jobject,
+                                                    jint handle,
+                                                    jlong startTimeMs,
+                                                    jfloat horizontalSpeedLimit,
+                                                    jfloat verticalSpeedLimit)
+{
+	trajectory_curve curve;
+	if (!trajectory_copy(handle, curve)) return JNI_FALSE;
+	controller_limits limits;
+	limits.horizontal_speed = horizontalSpeedLimit;
+	limits.vertical_speed = verticalSpeedLimit;
+	controller_follow(curve, startTimeMs, limits);
+	return JNI_TRUE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_controllerIdle(JNIEnv *env,
+                                                  jobject)
+{
+	controller_idle();
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef POSITION_CONTROLLER_H
+#define POSITION_CONTROLLER_H
+
+// position controller for POS trajectories: PID with feed-forward velocity from the target trajectory,
+// anti-windup and acceleration limits, running on its own thread at fixed rate (independent of the UI looper),
+// the virtual stick commands are delivered to a callback
+
+#include <stdint.h>
+#include <functional>
+#include "trajectory_interpolator.h"
+
+struct controller_gains
+{
+	float kp_xy = 1.0f, ki_xy = 0.15f, kd_xy = 0.0f;      // m/s per m, per m.s, per m/s
+	float kp_z = 1.0f, ki_z = 0.1f;
+	float kp_yaw = 1.0f;                                  // deg/s per deg
+	float integral_limit_xy = 0.5f, integral_limit_z = 0.5f;   // m.s
+	float max_accel_xy = 1.0f, max_accel_z = 1.5f;        // m/s^2, rate limit of the commanded velocity
+	float max_yaw_rate = 60.0f;                           // deg/s
+};
+
+struct controller_limits
+{
+	float horizontal_speed = 0.3f;   // m/s, the same meaning as HSPEED / VSPEED in the dance
+	float vertical_speed = 1.0f;
+};
+
+// the same as VirtualStickFlightControlParam in posCommand (velocity modes, BODY coordinates)
+struct stick_command
+{
+	float roll;       // m/s to the right
+	float pitch;      // m/s forward
+	float yaw_rate;   // deg/s, positive is clockwise (as in the SDK)
+	float vertical;   // m/s up
+};
+
+struct position_controller
+{
+	controller_gains gains;
+	float ix = 0, iy = 0, iz = 0;        // integrated errors (world)
+	float last_ex = 0, last_ey = 0;
+	float last_vx = 0, last_vy = 0, last_vz = 0;   // last commanded velocity (world), for rate limiting
+	int has_last = 0;
+
+	void reset();
+	// measured: pose from localization, dt: seconds since the last step, measured_velocity: [vx, vy] (world, m/s)
+	// when known, then the derivative term uses it instead of the differences of the errors
+	stick_command step(const trajectory_pose &measured, const trajectory_state &target, const controller_limits &limits, float dt,
+	                   const float *measured_velocity = 0);
+};
+
+// the control thread, sink is called from it
+int controller_start(float rate_hz, std::function<void(const stick_command &)> sink);
+void controller_stop();
+// newest pose from localization ([x, y, z, yaw], 999 = unknown)
+void controller_update_pose(const float pose[4]);
+// newest horizontal velocity measured by localization ([vx, vy], world, m/s), the poses are extrapolated by it
+// between the frames
+void controller_update_velocity(const float velocity[2]);
+// the mat is not in view at all: hover now instead of after the pose timeout
+void controller_pose_lost();
+// start following the curve (copied), start_time_ms is the synchronized wall clock time (ms, clock_sync_now_ms)
+// of the trajectory time 0
+void controller_follow(const trajectory_curve &curve, int64_t start_time_ms, const controller_limits &limits);
+// stop following (no more commands are sent)
+void controller_idle();
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#endif
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "separation_monitor.h"
+#include "swarm_exchange.h"
+
+static int64_t cell_key(int64_t cx, int64_t cy, int64_t cz)
+{
+	return (cx & 0x1FFFFF) | ((cy & 0x1FFFFF) << 21) | ((cz & 0x1FFFFF) << 42);
+}
+
+// the closest approach of two drones moving with constant velocities within the horizon
+static void closest_approach(const monitor_state &a, const monitor_state &b, const monitor_config &config,
+                             monitor_conflict &c)
+{
+	float px = b.x - a.x, py = b.y - a.y, pz = b.z - a.z;
+	float vx = b.vx - a.vx, vy = b.vy - a.vy, vz = b.vz - a.vz;
+	float pv = px * vx + py * vy + pz * vz, vv = vx * vx + vy * vy + vz * vz, pp = px * px + py * py + pz * pz;
+	float t = (vv > 1e-9f) ? std::min(std::max(-pv / vv, 0.0f), config.horizon) : 0.0f;
+	float dx = px + vx * t, dy = py + vy * t, dz = pz + vz * t;
+	c.distance = sqrtf(pp);
+	c.min_distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+	// when they get closer than the minimum distance: |p + v t| = min_distance
+	float r2 = config.min_distance * config.min_distance;
+	if (pp <= r2) c.time = 0;
+	else
+	{
+		float disc = pv * pv - vv * (pp - r2);
+		c.time = (disc > 0) ? (-pv - sqrtf(disc)) / vv : t;
+	}
+}
+
+int separation_monitor::check(const monitor_state *states, int n, std::vector<monitor_conflict> &conflicts)
+{
+	conflicts.clear();
+
+	// the states at the present time, with limited speeds
+	present.clear();
+	float fastest = 0;
+	for (int i = 0; i < n; i++)
+	{
+		monitor_state s = states[i];
+		if ((s.age > config.max_age) || (s.age < 0)) continue;
+		float speed = sqrtf(s.vx * s.vx + s.vy * s.vy + s.vz * s.vz);
+		if (speed > config.max_speed)
+		{
+			float k = config.max_speed / speed;
+			s.vx *= k;
+			s.vy *= k;
+			s.vz *= k;
+			speed = config.max_speed;
+		}
+		float age = s.age / 1000.0f;
+		s.x += s.vx * age;
+		s.y += s.vy * age;
+		s.z += s.vz * age;
+		s.age = 0;
+		fastest = std::max(fastest, speed);
+		present.push_back(s);
+	}
+
+	// two drones can only meet within the horizon if they are now closer than this, so only the neighbouring cells matter
+	float cell = config.min_distance + 2 * fastest * config.horizon;
+	int worst = MONITOR_OK;
+	int n_present = present.size();
+	cells.resize(n_present);
+	for (int i = 0; i < n_present; i++)
+	{
+		const monitor_state &s = present[i];
+		cells[i] = { cell_key((int64_t)floorf(s.x / cell), (int64_t)floorf(s.y / cell), (int64_t)floorf(s.z / cell)), i };
+	}
+	std::sort(cells.begin(), cells.end());
+
+	for (int i = 0; i < n_present; i++)
+	{
+		const monitor_state &s = present[i];
+		int64_t cx = (int64_t)floorf(s.x / cell), cy = (int64_t)floorf(s.y / cell), cz = (int64_t)floorf(s.z / cell);
+		for (int dx = -1; dx <= 1; dx++)
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dz = -1; dz <= 1; dz++)
+				{
+					int64_t key = cell_key(cx + dx, cy + dy, cz + dz);
+					auto it = std::lower_bound(cells.begin(), cells.end(), std::make_pair(key, 0));
+					for (; (it != cells.end()) && (it->first == key); ++it)
+					{
+						int j = it->second;
+						if (j <= i) continue;   // each pair once
+						monitor_conflict c;
+						closest_approach(s, present[j], config, c);
+						if (c.min_distance >= config.min_distance) continue;
+						c.a = std::min(present[j].drone_id, s.drone_id);
+						c.b = std::max(present[j].drone_id, s.drone_id);
+						c.action = ((c.distance < config.emergency_distance) ||
+						            ((c.min_distance < config.emergency_distance) && (c.time < config.emergency_time)))
+						           ? MONITOR_EMERGENCY : MONITOR_HOLD;
+						worst = std::max(worst, c.action);
+						conflicts.push_back(c);
+					}
+				}
+	}
+	return worst;
+}
+
+/********************************************************** monitor thread **************************************/
+
+static const int MONITOR_THREAD_NICE = -10;
+
+static std::thread monitor_thread;
+static std::atomic<int> monitor_running(0);
+
+static void monitor_loop(float rate_hz, int own_id, int all, monitor_config config,
+                         std::function<void(const monitor_conflict &)> callback)
+{
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), MONITOR_THREAD_NICE);   // may fail without permission
+
+	separation_monitor monitor;
+	monitor.config = config;
+	std::vector<monitor_conflict> conflicts;
+	swarm_peer peers[SWARM_MAX_DRONES + 1];
+	monitor_state states[SWARM_MAX_DRONES + 1];
+	int64_t period_ns = (int64_t)(1e9 / rate_hz);
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (monitor_running)
+	{
+		next.tv_nsec += period_ns;
+		while (next.tv_nsec >= 1000000000L)
+		{
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0);
+		if (!monitor_running) break;
+
+		int n = swarm_peers(peers, SWARM_MAX_DRONES, config.max_age);
+		if (swarm_own_state(&peers[n])) n++;
+		int valid = 0;
+		for (int i = 0; i < n; i++)
+		{
+			const swarm_peer &p = peers[i];
+			if (!p.valid) continue;
+			states[valid++] = monitor_state{ p.drone_id, p.x, p.y, p.z, p.vx, p.vy, p.vz, p.age };
+		}
+		monitor.check(states, valid, conflicts);
+
+		// the worst conflict of this drone, and with all also the worst one of the swarm (when it is another one),
+		// so that a hold of this drone is not hidden by a worse conflict of others
+		const monitor_conflict *own = 0, *any = 0;
+		auto worse = [](const monitor_conflict &c, const monitor_conflict *w) {
+			return !w || (c.action > w->action) || ((c.action == w->action) && (c.time < w->time));
+		};
+		for (const monitor_conflict &c : conflicts)
+		{
+			if (((c.a == own_id) || (c.b == own_id)) && worse(c, own)) own = &c;
+			if (worse(c, any)) any = &c;
+		}
+		if (own) callback(*own);
+		if (all && any && (any != own)) callback(*any);
+	}
+}
+
+int monitor_start(float rate_hz, int own_id, int all, const monitor_config &config,
+                  std::function<void(const monitor_conflict &)> callback)
+{
+	if (monitor_running || (rate_hz <= 0)) return 0;
+	monitor_running = 1;
+	monitor_thread = std::thread(monitor_loop, rate_hz, own_id, all, config, callback);
+	return 1;
+}
+
+void monitor_stop()
+{
+	if (!monitor_running) return;
+	monitor_running = 0;
+	if (monitor_thread.joinable()) monitor_thread.join();
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+static JavaVM *monitor_vm = 0;
+static jobject monitor_sink = 0;
+static jmethodID monitor_sink_method = 0;
+
+// conflicts are delivered to sink.onConflict(droneA, droneB, distance, minDistance, time, action) on the monitor thread
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_monitorStart(JNIEnv *env,
+                                                jobject,
+                                                jfloat rateHz,
+                                                jint ownId,
+                                                jint all,
+                                                jfloat minDistance,
+                                                jfloat emergencyDistance,
+                                                jfloat horizon,
+                                                jobject sink)
+{
+	if (monitor_sink) return JNI_FALSE;
+	env->GetJavaVM(&monitor_vm);
+	monitor_sink = env->NewGlobalRef(sink);
+	monitor_sink_method = env->GetMethodID(env->GetObjectClass(sink), "onConflict", "(IIFFFI)V");
+	if (!monitor_sink_method)
+	{
+		env->DeleteGlobalRef(monitor_sink);
+		monitor_sink = 0;
+		return JNI_FALSE;
+	}
+
+	monitor_config config;
+	config.min_distance = minDistance;
+	config.emergency_distance = emergencyDistance;
+	config.horizon = horizon;
+	int ok = monitor_start(rateHz, ownId, all, config, [](const monitor_conflict &c) {
+		thread_local struct attached_env
+		{
+			JNIEnv *env = 0;
+			~attached_env() { if (env) monitor_vm->DetachCurrentThread(); }
+		} attached;
+		if (!attached.env && (monitor_vm->AttachCurrentThread(&attached.env, 0) != JNI_OK)) return;
+		attached.env->CallVoidMethod(monitor_sink, monitor_sink_method, c.a, c.b, c.distance, c.min_distance, c.time, c.action);
+		if (attached.env->ExceptionCheck()) attached.env->ExceptionClear();
+	});
+	return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_monitorStop(JNIEnv *env,
+                                               jobject)
+{
+	monitor_stop();
+	if (monitor_sink) env->DeleteGlobalRef(monitor_sink);
+	monitor_sink = 0;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SEPARATION_MONITOR_H
+#define SEPARATION_MONITOR_H
+
+// runtime separation monitor: the states of all drones (from the swarm exchange) are propagated with their
+// velocities a short horizon ahead and every pair that will get closer than the minimum distance is reported,
+// the candidate pairs come from a uniform grid, so the cost grows about linearly with the number of drones
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#define MONITOR_OK          0
+#define MONITOR_HOLD        1     // stop and hover until the conflict is gone
+#define MONITOR_EMERGENCY   2     // too close or too late to stop: the emergency of MainActivity
+
+struct monitor_config
+{
+	float min_distance = 0.8f;         // m, predicted distance under this is a conflict (hold)
+	float emergency_distance = 0.5f;   // m, present distance under this is an emergency
+	float horizon = 2.0f;              // s, how far ahead the states are propagated
+	float emergency_time = 0.5f;       // s, a conflict sooner than this is an emergency
+	int max_age = 500;                 // ms, older states are not used
+	float max_speed = 3.0f;            // m/s, faster states are taken as this fast (the size of the grid cells)
+};
+
+struct monitor_state
+{
+	int drone_id;
+	float x, y, z;
+	float vx, vy, vz;
+	int age;                           // ms, the state is first moved to the present
+};
+
+struct monitor_conflict
+{
+	int a, b;                          // drone ids, a < b
+	float distance;                    // m, now
+	float min_distance;                // m, the closest predicted approach
+	float time;                        // s, until they are closer than config.min_distance (0 = already)
+	int action;                        // MONITOR_HOLD or MONITOR_EMERGENCY
+};
+
+struct separation_monitor
+{
+	monitor_config config;
+
+	// finds the conflicts among the states (replaces the contents of conflicts), returns the worst action
+	int check(const monitor_state *states, int n, std::vector<monitor_conflict> &conflicts);
+
+private:
+	// (cell, index into present) sorted by the cell, kept between the checks so that nothing is allocated
+	std::vector<std::pair<int64_t, int>> cells;
+	std::vector<monitor_state> present;
+};
+
+// the monitor thread checks the swarm exchange (swarm_exchange.h) at rate_hz, the callback gets the worst
+// conflict of own_id at every check while there is any, and when all != 0 also the worst conflict of the swarm
+// (in a separate call, if it is not the one of own_id)
+int monitor_start(float rate_hz, int own_id, int all, const monitor_config &config,
+                  std::function<void(const monitor_conflict &)> callback);
+void monitor_stop();
+
+#endif
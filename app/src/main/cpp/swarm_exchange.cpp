@@ -0,0 +1,419 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#endif
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "swarm_exchange.h"
+#include "clock_sync.h"
+
+// own velocity: low-pass of the differences of the poses, restarted after a gap
+static const float VELOCITY_FILTER = 0.5f;
+static const int64_t VELOCITY_GAP_MS = 500;
+// a sequence number this much lower than the last one means the sender restarted
+static const uint32_t SEQUENCE_RESTART = 1000;
+static const int SWARM_THREAD_NICE = -10;
+
+static int64_t monotonic_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// the master clock when the drones are synchronized, so the latencies over the network can be measured
+static int64_t wall_clock_ms()
+{
+	return (int64_t)floor(clock_sync_now_ms());
+}
+
+/********************************************************** peer table ******************************************/
+
+// the record is stored as words, written only by the network thread, read by anyone:
+// the version is odd while the record is written, a reader retries when it changed during its copy
+struct peer_record
+{
+	swarm_peer peer;
+	int64_t received_mono;
+	int32_t pose_age;
+	int32_t used;
+};
+
+static const int RECORD_WORDS = (sizeof(peer_record) + 3) / 4;
+
+struct peer_slot
+{
+	std::atomic<uint32_t> version;
+	std::atomic<uint32_t> words[RECORD_WORDS];
+};
+
+static peer_slot peer_table[SWARM_MAX_DRONES];
+
+static void write_slot(peer_slot &slot, const peer_record &r)
+{
+	uint32_t w[RECORD_WORDS] = { 0 };
+	memcpy(w, &r, sizeof(r));
+	uint32_t v = slot.version.load(std::memory_order_relaxed);
+	slot.version.store(v + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int i = 0; i < RECORD_WORDS; i++) slot.words[i].store(w[i], std::memory_order_relaxed);
+	slot.version.store(v + 2, std::memory_order_release);
+}
+
+static void read_slot(const peer_slot &slot, peer_record &r)
+{
+	uint32_t w[RECORD_WORDS];
+	for (;;)
+	{
+		uint32_t v1 = slot.version.load(std::memory_order_acquire);
+		if (v1 & 1) continue;
+		for (int i = 0; i < RECORD_WORDS; i++) w[i] = slot.words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.version.load(std::memory_order_relaxed) == v1) break;
+	}
+	memcpy(&r, w, sizeof(r));
+}
+
+int swarm_peers(swarm_peer *peers, int max_peers, int max_age)
+{
+	int n = 0;
+	int64_t now = monotonic_ms();
+	for (int id = 0; (id < SWARM_MAX_DRONES) && (n < max_peers); id++)
+	{
+		peer_record r;
+		read_slot(peer_table[id], r);
+		if (!r.used) continue;
+		r.peer.age = r.pose_age + (int)(now - r.received_mono);
+		if ((max_age > 0) && (r.peer.age > max_age)) continue;
+		peers[n++] = r.peer;
+	}
+	return n;
+}
+
+/********************************************************** own pose ********************************************/
+
+static std::mutex own_mutex;
+static float own_pose[4], own_velocity[3];
+static int own_valid = 0;
+static int64_t own_pose_time = 0;     // monotonic ms
+static int own_id = -1;
+
+void swarm_update_pose(const float pose[4])
+{
+	int64_t now = monotonic_ms();
+	std::lock_guard<std::mutex> lock(own_mutex);
+	if (pose[0] > 900.0f)   // position not available
+	{
+		own_valid = 0;
+		return;
+	}
+	float dt = (now - own_pose_time) / 1000.0f;
+	if (own_valid && (dt > 0) && (now - own_pose_time < VELOCITY_GAP_MS))
+		for (int i = 0; i < 3; i++)
+			own_velocity[i] += VELOCITY_FILTER * ((pose[i] - own_pose[i]) / dt - own_velocity[i]);
+	else own_velocity[0] = own_velocity[1] = own_velocity[2] = 0;
+	memcpy(own_pose, pose, sizeof(own_pose));
+	own_pose_time = now;
+	own_valid = 1;
+}
+
+int swarm_own_state(swarm_peer *own)
+{
+	std::lock_guard<std::mutex> lock(own_mutex);
+	if (!own_valid || (own_id < 0)) return 0;
+	own->drone_id = own_id;
+	own->valid = 1;
+	own->x = own_pose[0];
+	own->y = own_pose[1];
+	own->z = own_pose[2];
+	own->yaw = own_pose[3];
+	own->vx = own_velocity[0];
+	own->vy = own_velocity[1];
+	own->vz = own_velocity[2];
+	own->age = (int)(monotonic_ms() - own_pose_time);
+	own->sent_time = own->received_time = wall_clock_ms();
+	own->sequence = 0;
+	return 1;
+}
+
+/********************************************************** network thread **************************************/
+
+static std::thread swarm_thread;
+static std::atomic<int> swarm_running(0);
+static int swarm_socket = -1;
+static std::vector<sockaddr_in> destinations;
+
+static std::atomic<uint32_t> stat_sent(0), stat_received(0), stat_lost(0), stat_reordered(0), stat_rejected(0);
+
+swarm_stats swarm_get_stats()
+{
+	return swarm_stats{ stat_sent, stat_received, stat_lost, stat_reordered, stat_rejected };
+}
+
+void swarm_add_destination(const char *address, int port)
+{
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(port);
+	if (inet_pton(AF_INET, address, &a.sin_addr) != 1) return;
+	if (!swarm_running) destinations.push_back(a);
+}
+
+static void send_pose(int drone_id, uint32_t sequence)
+{
+	swarm_packet p;
+	memset(&p, 0, sizeof(p));
+	p.magic = SWARM_MAGIC;
+	p.version = SWARM_VERSION;
+	p.drone_id = drone_id;
+	p.sequence = sequence;
+	{
+		std::lock_guard<std::mutex> lock(own_mutex);
+		int64_t age = monotonic_ms() - own_pose_time;
+		if (own_valid)
+		{
+			p.flags = SWARM_POSE_VALID;
+			p.pose_age = (age > 65535) ? 65535 : (uint16_t)age;
+			p.x = own_pose[0];
+			p.y = own_pose[1];
+			p.z = own_pose[2];
+			p.yaw = own_pose[3];
+			p.vx = own_velocity[0];
+			p.vy = own_velocity[1];
+			p.vz = own_velocity[2];
+		}
+	}
+	p.sent_time = wall_clock_ms();
+	for (const sockaddr_in &d : destinations)
+		if (sendto(swarm_socket, &p, sizeof(p), 0, (const sockaddr *)&d, sizeof(d)) == sizeof(p)) stat_sent++;
+}
+
+static void receive_pose(int self, uint32_t last_sequence[], int heard[])
+{
+	swarm_packet p;
+	ssize_t len = recv(swarm_socket, &p, sizeof(p), MSG_DONTWAIT);
+	if (len < 0) return;
+	if ((len != sizeof(p)) || (p.magic != SWARM_MAGIC) || (p.version != SWARM_VERSION) || (p.drone_id >= SWARM_MAX_DRONES))
+	{
+		stat_rejected++;
+		return;
+	}
+	if (p.drone_id == self) return;   // our own broadcast
+	stat_received++;
+
+	// only newer packets are used, the late ones would move the peer back
+	int id = p.drone_id;
+	if (heard[id])
+	{
+		uint32_t expected = last_sequence[id] + 1;
+		if ((int32_t)(p.sequence - expected) < 0)
+		{
+			if (last_sequence[id] - p.sequence < SEQUENCE_RESTART)
+			{
+				stat_reordered++;
+				return;
+			}
+		}
+		else stat_lost += p.sequence - expected;
+	}
+	heard[id] = 1;
+	last_sequence[id] = p.sequence;
+
+	peer_record r;
+	memset(&r, 0, sizeof(r));
+	r.peer.drone_id = id;
+	r.peer.valid = (p.flags & SWARM_POSE_VALID) ? 1 : 0;
+	r.peer.x = p.x;
+	r.peer.y = p.y;
+	r.peer.z = p.z;
+	r.peer.yaw = p.yaw;
+	r.peer.vx = p.vx;
+	r.peer.vy = p.vy;
+	r.peer.vz = p.vz;
+	r.peer.sent_time = p.sent_time;
+	r.peer.received_time = wall_clock_ms();
+	r.peer.sequence = p.sequence;
+	r.received_mono = monotonic_ms();
+	r.pose_age = p.pose_age;
+	r.used = 1;
+	write_slot(peer_table[id], r);
+}
+
+// sends at the fixed rate and receives in between (poll until the next deadline)
+static void swarm_loop(int drone_id, float rate_hz)
+{
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), SWARM_THREAD_NICE);   // may fail without permission
+
+	uint32_t last_sequence[SWARM_MAX_DRONES] = { 0 };
+	int heard[SWARM_MAX_DRONES] = { 0 };
+	uint32_t sequence = 0;
+	int64_t period_us = (int64_t)(1e6 / rate_hz);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	int64_t next_send = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	while (swarm_running)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		int64_t now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+		if (now >= next_send)
+		{
+			send_pose(drone_id, sequence++);
+			next_send += period_us;
+			if (next_send < now) next_send = now + period_us;   // do not burst after a stall
+			continue;
+		}
+		struct pollfd pfd = { swarm_socket, POLLIN, 0 };
+		int wait_ms = (int)((next_send - now + 999) / 1000);
+		if (poll(&pfd, 1, wait_ms) > 0)
+			while (swarm_running && (pfd.revents & POLLIN))
+			{
+				receive_pose(drone_id, last_sequence, heard);
+				if (poll(&pfd, 1, 0) <= 0) break;
+			}
+	}
+}
+
+int swarm_start(int drone_id, int port, float rate_hz)
+{
+	if (swarm_running || (rate_hz <= 0) || (drone_id < 0) || (drone_id >= SWARM_MAX_DRONES)) return 0;
+
+	swarm_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (swarm_socket < 0) return 0;
+	int on = 1;
+	setsockopt(swarm_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	setsockopt(swarm_socket, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(port);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(swarm_socket, (const sockaddr *)&local, sizeof(local)) < 0)
+	{
+		close(swarm_socket);
+		swarm_socket = -1;
+		return 0;
+	}
+	if (destinations.empty())
+	{
+		sockaddr_in b = local;
+		b.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+		destinations.push_back(b);
+	}
+
+	for (int id = 0; id < SWARM_MAX_DRONES; id++) write_slot(peer_table[id], peer_record{});
+	{
+		std::lock_guard<std::mutex> lock(own_mutex);
+		own_id = drone_id;
+	}
+	swarm_running = 1;
+	swarm_thread = std::thread(swarm_loop, drone_id, rate_hz);
+	return 1;
+}
+
+void swarm_stop()
+{
+	if (!swarm_running) return;
+	swarm_running = 0;
+	if (swarm_thread.joinable()) swarm_thread.join();
+	close(swarm_socket);
+	swarm_socket = -1;
+	destinations.clear();
+	std::lock_guard<std::mutex> lock(own_mutex);
+	own_id = -1;
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+// destinations: "" to broadcast on the port, or "address:port,address:port,..."
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_swarmStart(JNIEnv *env,
+                                              jobject,
+                                              jint droneId,
+                                              jint port,
+                                              jfloat rateHz,
+                                              jstring destinationList)
+{
+	const char *list = env->GetStringUTFChars(destinationList, 0);
+	std::string s(list);
+	env->ReleaseStringUTFChars(destinationList, list);
+	size_t from = 0;
+	while (from < s.size())
+	{
+		size_t comma = s.find(',', from);
+		std::string item = s.substr(from, (comma == std::string::npos) ? std::string::npos : comma - from);
+		size_t colon = item.find(':');
+		if (colon != std::string::npos) swarm_add_destination(item.substr(0, colon).c_str(), atoi(item.c_str() + colon + 1));
+		if (comma == std::string::npos) break;
+		from = comma + 1;
+	}
+	return swarm_start(droneId, port, rateHz) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_swarmStop(JNIEnv *env,
+                                             jobject)
+{
+	swarm_stop();
+}
+
+// peers = [id, valid, x, y, z, yaw, vx, vy, vz, age_ms] for each peer heard within maxAgeMs, returns their count
+extern "C"
+JNIEXPORT jint JNICALL
+Java_sk_uniba_krucena_NativeBridge_swarmPeers(JNIEnv *env,
+                                              jobject,
+                                              jint maxAgeMs,
+                                              jfloatArray peers)
+{
+	swarm_peer p[SWARM_MAX_DRONES];
+	int capacity = env->GetArrayLength(peers) / 10;
+	int n = swarm_peers(p, (capacity < SWARM_MAX_DRONES) ? capacity : SWARM_MAX_DRONES, maxAgeMs);
+	float out[10 * SWARM_MAX_DRONES];
+	for (int i = 0; i < n; i++)
+	{
+		float *o = out + 10 * i;
+		o[0] = p[i].drone_id;
+		o[1] = p[i].valid;
+		o[2] = p[i].x;
+		o[3] = p[i].y;
+		o[4] = p[i].z;
+		o[5] = p[i].yaw;
+		o[6] = p[i].vx;
+		o[7] = p[i].vy;
+		o[8] = p[i].vz;
+		o[9] = p[i].age;
+	}
+	if (n > 0) env->SetFloatArrayRegion(peers, 0, 10 * n, out);
+	return n;
+}
+
+// [sent, received, lost, reordered, rejected]
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_sk_uniba_krucena_NativeBridge_swarmStats(JNIEnv *env,
+                                              jobject)
+{
+	swarm_stats s = swarm_get_stats();
+	jint v[5] = { (jint)s.sent, (jint)s.received, (jint)s.lost, (jint)s.reordered, (jint)s.rejected };
+	jintArray result = env->NewIntArray(5);
+	if (result) env->SetIntArrayRegion(result, 0, 5, v);
+	return result;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SWARM_EXCHANGE_H
+#define SWARM_EXCHANGE_H
+
+// every drone broadcasts its newest pose and velocity over UDP at a fixed rate (compact binary packet with
+// a sequence number) and keeps the newest state of each peer in a lock-free table (seqlock per drone),
+// so the controller or the separation monitor can read the swarm without locks and without Kotlin threads
+
+#include <stdint.h>
+
+#define SWARM_MAX_DRONES    32
+#define SWARM_DEFAULT_PORT  8994     // next to DATAGRAM_MASTER_IP_ANNOUNCE_PORT of Communication.kt
+
+// what one drone sends, little endian (all our devices are)
+#pragma pack(push, 1)
+struct swarm_packet
+{
+	uint32_t magic;          // SWARM_MAGIC
+	uint8_t version;         // SWARM_VERSION
+	uint8_t drone_id;
+	uint16_t flags;          // SWARM_POSE_VALID
+	uint32_t sequence;       // +1 with every packet of the sender
+	uint16_t pose_age;       // ms from the localization of the pose to sending
+	uint16_t reserved;
+	int64_t sent_time;       // synchronized wall clock ms of the sender (clock_sync.h), for latency measurement
+	float x, y, z, yaw;      // m, rad, mat coordinates
+	float vx, vy, vz;        // m/s
+};
+#pragma pack(pop)
+
+#define SWARM_MAGIC        0x4d525753u   // "SWRM"
+#define SWARM_VERSION      1
+#define SWARM_POSE_VALID   1
+
+// consistent copy of one entry of the peer table
+struct swarm_peer
+{
+	int drone_id;
+	int valid;               // the peer knows its pose
+	float x, y, z, yaw, vx, vy, vz;
+	int age;                 // ms: age of the pose when it was sent + time since it was received
+	int64_t sent_time;       // synchronized wall clock ms of the sender
+	int64_t received_time;   // synchronized wall clock ms of the receiver
+	uint32_t sequence;
+};
+
+struct swarm_stats
+{
+	uint32_t sent, received, lost, reordered, rejected;
+};
+
+// sends to the destinations (broadcast address by default), listens on port, rate_hz packets per second,
+// returns 0 when the socket cannot be opened or it already runs
+int swarm_start(int drone_id, int port, float rate_hz);
+void swarm_stop();
+// the packets go to these address:port pairs instead of the broadcast (to be called before swarm_start)
+void swarm_add_destination(const char *address, int port);
+// newest pose from localization ([x, y, z, yaw], 999 = unknown)
+void swarm_update_pose(const float pose[4]);
+// peers heard within max_age ms (all if max_age <= 0), returns their count
+int swarm_peers(swarm_peer *peers, int max_peers, int max_age);
+// the state this drone sends (as the others see it), returns 0 before swarm_start or without a pose
+int swarm_own_state(swarm_peer *own);
+swarm_stats swarm_get_stats();
+
+#endif
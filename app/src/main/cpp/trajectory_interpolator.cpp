@@ -0,0 +1,248 @@
+#ifndef FASTIMGLIB_NO_JNI
+#include <jni.h>
+#endif
+#include <math.h>
+#include <mutex>
+#include "trajectory_interpolator.h"
+#include "dance_bundle.h"
+
+static float unwrap_yaw(float yaw, float previous)
+{
+	while (yaw - previous > M_PI) yaw -= 2 * M_PI;
+	while (yaw - previous < -M_PI) yaw += 2 * M_PI;
+	return yaw;
+}
+
+// Fritsch-Carlson: three-point tangent, limited so that the curve does not overshoot the samples
+static float monotone_tangent(float d0, float d1, float h0, float h1)
+{
+	if (d0 * d1 <= 0.0f) return 0.0f;
+	float m = (d0 * h1 + d1 * h0) / (h0 + h1);
+	float limit = 3.0f * fminf(fabsf(d0), fabsf(d1));
+	if (fabsf(m) > limit) m = copysignf(limit, m);
+	return m;
+}
+
+void trajectory_curve::build(const std::vector<int32_t> &times, const std::vector<trajectory_pose> &poses)
+{
+	t.clear();
+	p.clear();
+	m.clear();
+	cursor = 0;
+
+	for (size_t i = 0; i < times.size(); i++)
+	{
+		trajectory_pose q = poses[i];
+		if (!p.empty()) q.yaw = unwrap_yaw(q.yaw, p.back().yaw);
+		if (!t.empty() && (times[i] <= t.back())) p.back() = q;   // the same time, later command wins
+		else
+		{
+			t.push_back(times[i]);
+			p.push_back(q);
+		}
+	}
+
+	int n = t.size();
+	m.assign(n, trajectory_pose{ 0, 0, 0, 0 });
+	if (n < 2) return;
+
+	// secants per second
+	std::vector<trajectory_pose> d(n - 1);
+	std::vector<float> h(n - 1);
+	for (int i = 0; i < n - 1; i++)
+	{
+		h[i] = (t[i + 1] - t[i]) * 0.001f;
+		d[i] = trajectory_pose{ (p[i + 1].x - p[i].x) / h[i], (p[i + 1].y - p[i].y) / h[i],
+		                        (p[i + 1].z - p[i].z) / h[i], (p[i + 1].yaw - p[i].yaw) / h[i] };
+	}
+
+	// the drone starts and ends the procedure at rest
+	for (int i = 1; i < n - 1; i++)
+		m[i] = trajectory_pose{ monotone_tangent(d[i - 1].x, d[i].x, h[i - 1], h[i]),
+		                        monotone_tangent(d[i - 1].y, d[i].y, h[i - 1], h[i]),
+		                        monotone_tangent(d[i - 1].z, d[i].z, h[i - 1], h[i]),
+		                        monotone_tangent(d[i - 1].yaw, d[i].yaw, h[i - 1], h[i]) };
+}
+
+trajectory_state trajectory_curve::evaluate(double time_ms)
+{
+	int n = t.size();
+	if (n == 0) return trajectory_state{ 0, 0, 0, 0, 0, 0, 0, 0 };
+
+	if ((n == 1) || (time_ms <= t[0]))
+		return trajectory_state{ p[0].x, p[0].y, p[0].z, p[0].yaw, 0, 0, 0, 0 };
+	if (time_ms >= t[n - 1])
+		return trajectory_state{ p[n - 1].x, p[n - 1].y, p[n - 1].z, p[n - 1].yaw, 0, 0, 0, 0 };
+
+	// time mostly only grows, so the segment is found in a step or two
+	if ((cursor < 0) || (cursor > n - 2)) cursor = 0;
+	while (time_ms >= t[cursor + 1]) cursor++;
+	while (time_ms < t[cursor]) cursor--;
+
+	int i = cursor;
+	float hs = (t[i + 1] - t[i]) * 0.001f;
+	float s = (float)((time_ms - t[i]) / (t[i + 1] - t[i]));
+	float s2 = s * s, s3 = s2 * s;
+
+	float h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s, h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+	float d00 = 6 * s2 - 6 * s, d10 = 3 * s2 - 4 * s + 1, d01 = -6 * s2 + 6 * s, d11 = 3 * s2 - 2 * s;
+
+	const trajectory_pose &p0 = p[i], &p1 = p[i + 1], &m0 = m[i], &m1 = m[i + 1];
+	trajectory_state st;
+	st.x = h00 * p0.x + h10 * hs * m0.x + h01 * p1.x + h11 * hs * m1.x;
+	st.y = h00 * p0.y + h10 * hs * m0.y + h01 * p1.y + h11 * hs * m1.y;
+	st.z = h00 * p0.z + h10 * hs * m0.z + h01 * p1.z + h11 * hs * m1.z;
+	st.yaw = h00 * p0.yaw + h10 * hs * m0.yaw + h01 * p1.yaw + h11 * hs * m1.yaw;
+	st.vx = (d00 * p0.x + d01 * p1.x) / hs + d10 * m0.x + d11 * m1.x;
+	st.vy = (d00 * p0.y + d01 * p1.y) / hs + d10 * m0.y + d11 * m1.y;
+	st.vz = (d00 * p0.z + d01 * p1.z) / hs + d10 * m0.z + d11 * m1.z;
+	st.yaw_rate = (d00 * p0.yaw + d01 * p1.yaw) / hs + d10 * m0.yaw + d11 * m1.yaw;
+	return st;
+}
+
+trajectory_pose trajectory_resolve_relative(const trajectory_pose &pos, const trajectory_pose &reference, const trajectory_pose &relative)
+{
+	float delta_yaw = relative.yaw - reference.yaw;
+	float dx = pos.x - reference.x;
+	float dy = pos.y - reference.y;
+	return trajectory_pose{ relative.x + dx * cosf(delta_yaw) - dy * sinf(delta_yaw),
+	                        relative.y + dx * sinf(delta_yaw) + dy * cosf(delta_yaw),
+	                        relative.z + pos.z - reference.z,
+	                        relative.yaw + pos.yaw - reference.yaw };
+}
+
+int trajectory_from_bundle_block(int block, int relative_on, trajectory_pose relative, trajectory_pose reference, trajectory_curve &curve)
+{
+	const dance_bundle_block *b = dance_bundle_get_block(block);
+	if (!b) return 0;
+
+	const dance_record *records = dance_bundle_records();
+	const int32_t *times = dance_bundle_times();
+	std::vector<int32_t> sample_times;
+	std::vector<trajectory_pose> samples;
+
+	for (uint32_t r = b->first_record; r < b->first_record + b->num_records; r++)
+	{
+		const dance_record &rec = records[r];
+		trajectory_pose q{ rec.a[0], rec.a[1], rec.a[2], rec.a[3] };
+		switch (rec.kind)
+		{
+			case DANCE_REFPOINT: reference = q; break;
+			case DANCE_RELATIVE: relative = q; relative_on = 1; break;
+			case DANCE_ABSOLUTE: relative_on = 0; break;
+			case DANCE_POS:
+				sample_times.push_back(times[r]);
+				samples.push_back(relative_on ? trajectory_resolve_relative(q, reference, relative) : q);
+				break;
+		}
+	}
+
+	curve.build(sample_times, samples);
+	return curve.t.size();
+}
+
+#ifndef FASTIMGLIB_NO_JNI
+
+// curves used from Kotlin, referenced by index
+static const int MAX_TRAJECTORIES = 16;
+static std::mutex trajectories_mutex;    // protects both arrays, the curves are built outside of it
+static trajectory_curve trajectories[MAX_TRAJECTORIES];
+static int trajectory_used[MAX_TRAJECTORIES];
+
+// stores the curve at a free handle, -1 if there is none
+static int allocate_trajectory(trajectory_curve &curve)
+{
+	std::lock_guard<std::mutex> lock(trajectories_mutex);
+	for (int i = 0; i < MAX_TRAJECTORIES; i++)
+		if (!trajectory_used[i])
+		{
+			trajectory_used[i] = 1;
+			std::swap(trajectories[i], curve);
+			return i;
+		}
+	return -1;
+}
+
+static int valid_handle(int handle)
+{
+	return (handle >= 0) && (handle < MAX_TRAJECTORIES) && trajectory_used[handle];
+}
+
+int trajectory_copy(int handle, trajectory_curve &curve)
+{
+	std::lock_guard<std::mutex> lock(trajectories_mutex);
+	if (!valid_handle(handle)) return 0;
+	curve = trajectories[handle];
+	return 1;
+}
+
+// reference and relative: [x, y, z, yaw] state of the dance when the procedure starts, returns handle or -1
+extern "C"
+JNIEXPORT jint JNICALL
+Java_sk_uniba_krucena_NativeBridge_trajectoryFromBundle(JNIEnv *env,
+                                                        jobject,
+                                                        jint block,
+                                                        jint relativeOn,
+                                                        jfloatArray relative,
+                                                        jfloatArray reference)
+{
+	trajectory_pose rel, ref;
+	env->GetFloatArrayRegion(relative, 0, 4, &rel.x);
+	env->GetFloatArrayRegion(reference, 0, 4, &ref.x);
+
+	trajectory_curve curve;
+	if (trajectory_from_bundle_block(block, relativeOn, rel, ref, curve) == 0) return -1;
+	return allocate_trajectory(curve);
+}
+
+// times in ms, poses [x, y, z, yaw] for each time (already absolute)
+extern "C"
+JNIEXPORT jint JNICALL
+Java_sk_uniba_krucena_NativeBridge_trajectoryFromSamples(JNIEnv *env,
+                                                         jobject,
+                                                         jintArray times,
+                                                         jfloatArray poses)
+{
+	int n = env->GetArrayLength(times);
+	if ((n == 0) || (env->GetArrayLength(poses) < 4 * n)) return -1;
+
+	std::vector<int32_t> t(n);
+	std::vector<trajectory_pose> p(n);
+	env->GetIntArrayRegion(times, 0, n, t.data());
+	env->GetFloatArrayRegion(poses, 0, 4 * n, &p[0].x);
+
+	trajectory_curve curve;
+	curve.build(t, p);
+	return allocate_trajectory(curve);
+}
+
+// state: [x, y, z, yaw, vx, vy, vz, yaw_rate]
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_sk_uniba_krucena_NativeBridge_trajectoryEvaluate(JNIEnv *env,
+                                                      jobject,
+                                                      jint handle,
+                                                      jfloat timeMs,
+                                                      jfloatArray state)
+{
+	trajectory_state st;
+	{
+		std::lock_guard<std::mutex> lock(trajectories_mutex);
+		if (!valid_handle(handle)) return JNI_FALSE;
+		st = trajectories[handle].evaluate(timeMs);
+	}
+	env->SetFloatArrayRegion(state, 0, 8, &st.x);
+	return JNI_TRUE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_sk_uniba_krucena_NativeBridge_trajectoryRelease(JNIEnv *env,
+                                                     jobject,
+                                                     jint handle)
+{
+	std::lock_guard<std::mutex> lock(trajectories_mutex);
+	if (valid_handle(handle)) trajectory_used[handle] = 0;
+}
+
+#endif
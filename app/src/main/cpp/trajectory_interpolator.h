@@ -0,0 +1,48 @@
+#ifndef TRAJECTORY_INTERPOLATOR_H
+#define TRAJECTORY_INTERPOLATOR_H
+
+// continuous-time target trajectory through the POS samples of a procedure (cubic Hermite, monotone tangents),
+// evaluated with a cursor that moves from the last used segment, so that increasing time queries are O(1)
+
+#include <stdint.h>
+#include <vector>
+
+struct trajectory_pose
+{
+	float x, y, z, yaw;
+};
+
+// result of evaluation: position, velocity (m/s) and yaw rate (rad/s)
+struct trajectory_state
+{
+	float x, y, z, yaw;
+	float vx, vy, vz, yaw_rate;
+};
+
+struct trajectory_curve
+{
+	std::vector<int32_t> t;                // ms, strictly increasing
+	std::vector<trajectory_pose> p;        // yaw unwrapped (continuous)
+	std::vector<trajectory_pose> m;        // tangents, per second
+	int cursor = 0;                        // segment of the last evaluation
+
+	// samples with equal times are merged (the later wins)
+	void build(const std::vector<int32_t> &times, const std::vector<trajectory_pose> &poses);
+	// before the first sample and after the last one the curve stays at the end point with zero velocity
+	trajectory_state evaluate(double time_ms);
+	int32_t duration() const { return t.empty() ? 0 : t.back(); }
+};
+
+// the same transformation as posCommand in MainActivity: the POS relative to reference point
+// placed to the relative point (and rotated by their yaw difference)
+trajectory_pose trajectory_resolve_relative(const trajectory_pose &pos, const trajectory_pose &reference, const trajectory_pose &relative);
+
+// POS samples of a block of the dance bundle with REFPOINT/RELATIVE/ABSOLUTE applied,
+// reference and relative (if relative_on) are the state at the start of the block
+int trajectory_from_bundle_block(int block, int relative_on, trajectory_pose relative, trajectory_pose reference, trajectory_curve &curve);
+
+// copy of the curve created over JNI (trajectoryFromBundle / trajectoryFromSamples), 0 if the handle is not valid;
+// a copy, since the handle can be released or reused from another thread at any time (not in the FASTIMGLIB_NO_JNI build)
+int trajectory_copy(int handle, trajectory_curve &curve);
+
+#endif
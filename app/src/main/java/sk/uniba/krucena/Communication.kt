@@ -208,7 +208,8 @@ class Communication(mainActivity: MainActivity) {
         {
             Log.i("COMMDBG", "processing message start from server...")
             val danceNumber : Int = packet.get().toInt()
-            activity.startChoreography(danceNumber)
+            val startTime : Long = if (packet.remaining() >= 8) packet.getLong() else 0L   // master clock ms
+            activity.startChoreography(danceNumber, startTime)
         }
         else if (packetType == MESSAGE_EMERGENCY)
         {
@@ -263,6 +264,9 @@ class Communication(mainActivity: MainActivity) {
 
     private fun communicatingServer()
     {
+        if (activity.config.clock_sync != 0)
+            if (!NativeBridge.clockSyncServe(activity.config.clock_sync_port))
+                Log.e("COMMDBG", "clock synchronization not started")
         startBroadcastingIP()
         val selector = Selector.open()
         val serverChannel = ServerSocketChannel.open()
@@ -375,6 +379,9 @@ class Communication(mainActivity: MainActivity) {
                     else getBroadcastedIP()
 
                 Log.i("COMMDBG", "connectToServer() serverIP=$serverIp")
+                if ((activity.config.clock_sync != 0) && !activity.config.isServer && (serverIp != null))
+                    if (!NativeBridge.clockSyncFollow(serverIp, activity.config.clock_sync_port, activity.config.clock_sync_rate))
+                        Log.e("COMMDBG", "clock synchronization not started")
 
                 val socket = Socket()
                 Log.i("COMMDBG", "connectToServer() socket")
@@ -412,19 +419,22 @@ class Communication(mainActivity: MainActivity) {
 
     fun sendStartSignalToAllDronesNow(danceToStart : Int)
     {
+        // with synchronized clocks, everybody starts at the same master time, soon enough for START to arrive
+        val startTime : Long = if (activity.config.clock_sync != 0) activity.danceClock() + activity.config.start_lead else 0L
         val executor = Executors.newCachedThreadPool()
         for (channel in dronesConnected)
         {
             executor.execute {
                 Log.i("COMMDBG", "sending start packet to a client ${channel.key}...")
-                val startPacket : ByteBuffer = ByteBuffer.allocate(2)
+                val startPacket : ByteBuffer = ByteBuffer.allocate(10)
                 startPacket.put(MESSAGE_START)
                 startPacket.put(danceToStart.toByte())
+                startPacket.putLong(startTime)
                 Log.d("COMMDBG", "Channel open: ${channel.value.isOpen}, connected: ${channel.value.isConnected}")
                 sendPacketToClient(startPacket, channel.value)
             }
         }
-        activity.startChoreography(danceToStart)
+        activity.startChoreography(danceToStart, startTime)
     }
 
     fun sendStartSignalWhenReady(danceToStart : Int)
@@ -26,6 +26,35 @@ class Config(val ctx : Context) {
     var show_contours: Int = 1
     var cpp_debug: Int = 0
     var position_debug: Int = 0
+    var camera_fx: Float = 0.0f
+    var camera_fy: Float = 0.0f
+    var camera_cx: Float = 0.0f
+    var camera_cy: Float = 0.0f
+    var camera_k1: Float = 0.0f
+    var camera_k2: Float = 0.0f
+    var camera_p1: Float = 0.0f
+    var camera_p2: Float = 0.0f
+    var camera_k3: Float = 0.0f
+    var native_controller: Int = 0
+    var controller_rate: Float = 50.0f
+    var swarm_exchange: Int = 0
+    var swarm_port: Int = 8994
+    var swarm_rate: Float = 20.0f
+    var separation_monitor: Int = 0
+    var separation_min: Float = 0.8f
+    var separation_emergency: Float = 0.5f
+    var separation_horizon: Float = 2.0f
+    var clock_sync: Int = 0
+    var clock_sync_port: Int = 8995
+    var clock_sync_rate: Float = 4.0f
+    var start_lead: Int = 500
+    var overlay_rate: Float = 10.0f
+    var calibration_step: Int = 2
+    var color_lut: Int = 0
+    var latency_budget: Float = 100.0f
+    var governor_max_level: Int = 3
+    var corner_velocity: Int = 1
+    var attitude_aided: Int = 0
 
     fun readConfig() {
         for (i in 0 until 2) {
@@ -135,6 +164,151 @@ class Config(val ctx : Context) {
                             position_debug = Integer.parseInt(value)
                             Log.i("Config", "position_debug=${position_debug}")
                         }
+
+                        "camera_fx" -> {
+                            camera_fx = value.toFloat()
+                            Log.i("Config", "camera_fx=${camera_fx}")
+                        }
+
+                        "camera_fy" -> {
+                            camera_fy = value.toFloat()
+                            Log.i("Config", "camera_fy=${camera_fy}")
+                        }
+
+                        "camera_cx" -> {
+                            camera_cx = value.toFloat()
+                            Log.i("Config", "camera_cx=${camera_cx}")
+                        }
+
+                        "camera_cy" -> {
+                            camera_cy = value.toFloat()
+                            Log.i("Config", "camera_cy=${camera_cy}")
+                        }
+
+                        "camera_k1" -> {
+                            camera_k1 = value.toFloat()
+                            Log.i("Config", "camera_k1=${camera_k1}")
+                        }
+
+                        "camera_k2" -> {
+                            camera_k2 = value.toFloat()
+                            Log.i("Config", "camera_k2=${camera_k2}")
+                        }
+
+                        "camera_p1" -> {
+                            camera_p1 = value.toFloat()
+                            Log.i("Config", "camera_p1=${camera_p1}")
+                        }
+
+                        "camera_p2" -> {
+                            camera_p2 = value.toFloat()
+                            Log.i("Config", "camera_p2=${camera_p2}")
+                        }
+
+                        "camera_k3" -> {
+                            camera_k3 = value.toFloat()
+                            Log.i("Config", "camera_k3=${camera_k3}")
+                        }
+
+                        "native_controller" -> {
+                            native_controller = Integer.parseInt(value)
+                            Log.i("Config", "native_controller=${native_controller}")
+                        }
+
+                        "controller_rate" -> {
+                            controller_rate = value.toFloat()
+                            Log.i("Config", "controller_rate=${controller_rate}")
+                        }
+
+                        "swarm_exchange" -> {
+                            swarm_exchange = Integer.parseInt(value)
+                            Log.i("Config", "swarm_exchange=${swarm_exchange}")
+                        }
+
+                        "swarm_port" -> {
+                            swarm_port = Integer.parseInt(value)
+                            Log.i("Config", "swarm_port=${swarm_port}")
+                        }
+
+                        "swarm_rate" -> {
+                            swarm_rate = value.toFloat()
+                            Log.i("Config", "swarm_rate=${swarm_rate}")
+                        }
+
+                        "separation_monitor" -> {
+                            separation_monitor = Integer.parseInt(value)
+                            Log.i("Config", "separation_monitor=${separation_monitor}")
+                        }
+
+                        "separation_min" -> {
+                            separation_min = value.toFloat()
+                            Log.i("Config", "separation_min=${separation_min}")
+                        }
+
+                        "separation_emergency" -> {
+                            separation_emergency = value.toFloat()
+                            Log.i("Config", "separation_emergency=${separation_emergency}")
+                        }
+
+                        "separation_horizon" -> {
+                            separation_horizon = value.toFloat()
+                            Log.i("Config", "separation_horizon=${separation_horizon}")
+                        }
+
+                        "clock_sync" -> {
+                            clock_sync = Integer.parseInt(value)
+                            Log.i("Config", "clock_sync=${clock_sync}")
+                        }
+
+                        "clock_sync_port" -> {
+                            clock_sync_port = Integer.parseInt(value)
+                            Log.i("Config", "clock_sync_port=${clock_sync_port}")
+                        }
+
+                        "clock_sync_rate" -> {
+                            clock_sync_rate = value.toFloat()
+                            Log.i("Config", "clock_sync_rate=${clock_sync_rate}")
+                        }
+
+                        "start_lead" -> {
+                            start_lead = Integer.parseInt(value)
+                            Log.i("Config", "start_lead=${start_lead}")
+                        }
+
+                        "overlay_rate" -> {
+                            overlay_rate = value.toFloat()
+                            Log.i("Config", "overlay_rate=${overlay_rate}")
+                        }
+
+                        "calibration_step" -> {
+                            calibration_step = value.toInt()
+                            Log.i("Config", "calibration_step=${calibration_step}")
+                        }
+
+                        "color_lut" -> {
+                            color_lut = value.toInt()
+                            Log.i("Config", "color_lut=${color_lut}")
+                        }
+
+                        "latency_budget" -> {
+                            latency_budget = value.toFloat()
+                            Log.i("Config", "latency_budget=${latency_budget}")
+                        }
+
+                        "governor_max_level" -> {
+                            governor_max_level = value.toInt()
+                            Log.i("Config", "governor_max_level=${governor_max_level}")
+                        }
+
+                        "corner_velocity" -> {
+                            corner_velocity = value.toInt()
+                            Log.i("Config", "corner_velocity=${corner_velocity}")
+                        }
+
+                        "attitude_aided" -> {
+                            attitude_aided = value.toInt()
+                            Log.i("Config", "attitude_aided=${attitude_aided}")
+                        }
                     }
                 }
                 break
@@ -186,6 +360,35 @@ class Config(val ctx : Context) {
                 "show_contours" -> show_contours.toString()
                 "cpp_debug" -> cpp_debug.toString()
                 "position_debug" -> position_debug.toString()
+                "camera_fx" -> camera_fx.toString()
+                "camera_fy" -> camera_fy.toString()
+                "camera_cx" -> camera_cx.toString()
+                "camera_cy" -> camera_cy.toString()
+                "camera_k1" -> camera_k1.toString()
+                "camera_k2" -> camera_k2.toString()
+                "camera_p1" -> camera_p1.toString()
+                "camera_p2" -> camera_p2.toString()
+                "camera_k3" -> camera_k3.toString()
+                "native_controller" -> native_controller.toString()
+                "controller_rate" -> controller_rate.toString()
+                "swarm_exchange" -> swarm_exchange.toString()
+                "swarm_port" -> swarm_port.toString()
+                "swarm_rate" -> swarm_rate.toString()
+                "separation_monitor" -> separation_monitor.toString()
+                "separation_min" -> separation_min.toString()
+                "separation_emergency" -> separation_emergency.toString()
+                "separation_horizon" -> separation_horizon.toString()
+                "clock_sync" -> clock_sync.toString()
+                "clock_sync_port" -> clock_sync_port.toString()
+                "clock_sync_rate" -> clock_sync_rate.toString()
+                "start_lead" -> start_lead.toString()
+                "overlay_rate" -> overlay_rate.toString()
+                "calibration_step" -> calibration_step.toString()
+                "color_lut" -> color_lut.toString()
+                "latency_budget" -> latency_budget.toString()
+                "governor_max_level" -> governor_max_level.toString()
+                "corner_velocity" -> corner_velocity.toString()
+                "attitude_aided" -> attitude_aided.toString()
                 else -> null
             }
 
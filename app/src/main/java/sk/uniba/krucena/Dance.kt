@@ -3,6 +3,8 @@ package sk.uniba.krucena
 import android.content.Context
 import android.util.Log
 import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 
 /** holds data for one performance
  *  format of the dance config file (each performance has separate object):
@@ -107,14 +109,77 @@ class DanceCommand(val time : Int,
                    val arguments : DanceInstructionArguments? = null) {
 }
 
-class Dance
+/** commands of one block of the compiled dance bundle (dance_bundle.h), read directly from the memory-mapped file,
+ *  the last few decoded commands are kept, so that repeated POS gets the same arguments object (see posCommand),
+ *  names are the procedure names of the bundle by block (filled at load, only read here) */
+class BundleInstructions(private val records : ByteBuffer, private val times : ByteBuffer,
+                         private val first : Int, override val size : Int,
+                         private val names : Map<Int, String>) : AbstractMutableList<DanceCommand>()
+{
+    private val cacheIndex = IntArray(4) { -1 }
+    private val cache = arrayOfNulls<DanceCommand>(4)
+
+    override fun get(index: Int): DanceCommand {
+        if ((index < 0) || (index >= size)) throw IndexOutOfBoundsException("command $index of $size")
+        val slot = index and 3
+        if (cacheIndex[slot] == index) return cache[slot]!!
+        val cmd = decode(first + index)
+        cacheIndex[slot] = index
+        cache[slot] = cmd
+        return cmd
+    }
+
+    private fun decode(r : Int) : DanceCommand {
+        val base = r * RECORD_SIZE
+        val time = times.getInt(r * 4)
+        val kind = KINDS[records.get(base + 4).toInt()]
+        val flags = records.get(base + 5).toInt()
+        val aux = records.getShort(base + 6).toInt() and 0xFFFF
+        val a0 = records.getFloat(base + 8)
+        val a1 = records.getFloat(base + 12)
+        val a2 = records.getFloat(base + 16)
+        val a3 = records.getFloat(base + 20)
+
+        val args : DanceInstructionArguments? = when (kind) {
+            DanceInstructionKind.FLY -> FlyArguments(a0, a1, a2, a3,
+                                            POS_VALUES[flags and 1],
+                                            ANGULAR_VALUES[(flags shr 1) and 3],
+                                            ANGULAR_VALUES[(flags shr 3) and 3],
+                                            COORD_SYSTEMS[(flags shr 5) and 1])
+            DanceInstructionKind.POS, DanceInstructionKind.REFPOINT, DanceInstructionKind.RELATIVE -> PosArguments(a0, a1, a2, a3)
+            DanceInstructionKind.LEDS -> LedsArguments(flags != 0)
+            DanceInstructionKind.RUN -> RunArguments(if (aux == 0xFFFF) "" else names[aux] ?: NativeBridge.danceBundleName(aux))
+            DanceInstructionKind.HSPEED, DanceInstructionKind.VSPEED -> SpeedArguments(a0.toDouble())
+            DanceInstructionKind.NONE, DanceInstructionKind.TAKEOFF, DanceInstructionKind.LAND -> DanceInstructionArguments()
+            else -> null
+        }
+        return DanceCommand(time, kind, args)
+    }
+
+    override fun add(index: Int, element: DanceCommand) = throw UnsupportedOperationException("compiled dance is read only")
+    override fun removeAt(index: Int): DanceCommand = throw UnsupportedOperationException("compiled dance is read only")
+    override fun set(index: Int, element: DanceCommand): DanceCommand = throw UnsupportedOperationException("compiled dance is read only")
+
+    companion object {
+        const val RECORD_SIZE = 24
+
+        // values() allocates a new array on every call
+        private val KINDS = DanceInstructionKind.values()
+        private val POS_VALUES = InstructionPosValue.values()
+        private val ANGULAR_VALUES = InstructionAngularValue.values()
+        private val COORD_SYSTEMS = InstructionCoordSystem.values()
+    }
+}
+
+class Dance(val instructions : MutableList<DanceCommand> = ArrayList())
 {
-    val instructions : MutableList<DanceCommand> = ArrayList()
 
     val procedures : MutableMap<String, Dance> = HashMap()
 
     var landingTime : Int = 0
 
+    var bundleBlock : Int = -1    // index of the block in the dance bundle, if loaded from it
+
     fun append(instruction: DanceCommand) {
         instructions.add(instruction)
     }
@@ -272,12 +337,54 @@ class Dance
             return Pair(d, lnInd)
         }
 
+        // one block of the bundle: [first_record, num_records, landing_time, first_procedure, num_procedures]
+        private fun bundleBlock(block : Int, records : ByteBuffer, times : ByteBuffer, names : MutableMap<Int, String>,
+                                withProcedures : Boolean) : Dance?
+        {
+            val b = NativeBridge.danceBundleBlock(block) ?: return null
+            val d = Dance(BundleInstructions(records, times, b[0], b[1], names))
+            d.landingTime = b[2]
+            d.bundleBlock = block
+            if (withProcedures)
+                for (p in b[3] until b[3] + b[4])
+                    bundleBlock(p, records, times, names, false)?.let {
+                        d.procedures.put(names.getOrPut(p) { NativeBridge.danceBundleName(p) }, it)
+                    }
+            return d
+        }
+
+        // compiled dances of all drones in files/dances.bin (tools/dance_compiler), used instead of dance_K.txt when present
+        private fun loadBundle(context: Context, danceId : Int) : MutableList<Dance>
+        {
+            val dances : MutableList<Dance> = ArrayList()
+            val file = File(context.filesDir, "dances.bin")
+            if (!file.exists()) return dances
+
+            if (NativeBridge.openDanceBundle(file.absolutePath) <= 0)
+            {
+                Log.e("Config", "Failed to open dance bundle ${file.absolutePath}")
+                return dances
+            }
+            val performances = NativeBridge.danceBundlePerformances(danceId) ?: return dances
+            val records = NativeBridge.danceBundleRecords()?.order(ByteOrder.LITTLE_ENDIAN) ?: return dances
+            val times = NativeBridge.danceBundleTimes()?.order(ByteOrder.nativeOrder()) ?: return dances
+
+            val names : MutableMap<Int, String> = HashMap()
+            for (p in performances[0] until performances[0] + performances[1])
+                bundleBlock(p, records, times, names, true)?.let { dances.add(it) }
+            Log.i("Config", "dance bundle loaded: ${dances.size} performances")
+            return dances
+        }
+
         fun load(context: Context, droneId : Int) : MutableList<Dance>
         {
+            val danceId = if (practiceRun) 0 else droneId;
+            val compiled = loadBundle(context, danceId)
+            if (compiled.isNotEmpty()) return compiled
+
             val dances : MutableList<Dance> = ArrayList()
 
             try {
-                val danceId = if (practiceRun) 0 else droneId;
                 var file = File(context.filesDir, "dance_" + danceId + ".txt")
                 if (!file.exists()) file = File(context.filesDir, "dance_0.txt")
 
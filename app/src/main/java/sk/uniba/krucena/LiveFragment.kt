@@ -39,12 +39,7 @@ import dji.v5.manager.interfaces.ICameraStreamManager
 import dji.v5.utils.common.NumberUtils
 import org.opencv.android.Utils
 import org.opencv.core.Mat
-import org.opencv.core.Point
 import org.opencv.core.Rect
-import org.opencv.core.Scalar
-import org.opencv.imgproc.Imgproc
-import org.opencv.imgproc.Imgproc.FONT_HERSHEY_COMPLEX
-import org.opencv.imgproc.Imgproc.LINE_8
 import java.io.File
 import java.io.FileOutputStream
 import kotlin.reflect.KMutableProperty0
@@ -75,6 +70,13 @@ class LiveFragment : Fragment() {
     private var rootView: View? = null
 
     private var clicks : HashMap<Rect, Int> = HashMap()
+    private val scene = OverlayScene()
+    private val calibrationStats = IntArray(5)
+    private val calibrationHistogram = IntArray(256)
+    private val localizationStats = FloatArray(10)
+    private val localizationVelocity = FloatArray(4)
+    private var duplicateFrames = 0    // frames that were the same as the one before (or skipped), shown in the overlay
+    private val attitudeInput = FloatArray(6)
 
     //click actions
     private val ACTION_CONFIG : Int = -1
@@ -94,8 +96,14 @@ class LiveFragment : Fragment() {
     private val ACTION_CPPDEBUG : Int = -14
     private val ACTION_POSDEBUG : Int = -15
 
+    private val ACTION_CLEAR_SAMPLES : Int = -16
+    private val ACTION_SAMPLE_NONE : Int = -17
     private val ACTION_NONE : Int = -100000
 
+    // color samples for the lookup table: taps on the image while calibrating, taken over by the next frame
+    @Volatile private var pendingSample : IntArray? = null      // [x, y] in the frame
+    private var samplingNone : Boolean = false                  // the taps are samples of no color (background)
+
     private var sliderVar : KMutableProperty0<Int> = ::sliderNothing
     private var sliderMin : Double = 0.0
     private var sliderMax : Double = 1.0
@@ -162,12 +170,6 @@ class LiveFragment : Fragment() {
                                 act.guiState = GUIState.READY_TO_RUN
                             }
                         }
-                        when (action) {
-                            ACTION_RED, ACTION_GREEN, ACTION_BLUE -> NativeBridge.setMode(1, act.config.show_contours, act.config.cpp_debug, act.config.position_debug)
-                            ACTION_YELLOW -> NativeBridge.setMode(3, act.config.show_contours, act.config.cpp_debug, act.config.position_debug)
-                            ACTION_BKMAX, ACTION_BKCHROMA -> NativeBridge.setMode(2, act.config.show_contours, act.config.cpp_debug, act.config.position_debug)
-                        }
-
                         when (action) {
                             ACTION_MASTER -> act.config.isServer = !act.config.isServer
                             ACTION_DRONEID -> act.config.droneId = (act.config.droneId % act.config.maxDroneID) + 1
@@ -181,6 +183,16 @@ class LiveFragment : Fragment() {
                             NativeBridge.setMode(0, act.config.show_contours, act.config.cpp_debug, act.config.position_debug)
                             act.guiState = GUIState.IN_CONFIG
                         }
+                        else if ((action == ACTION_CLEAR_SAMPLES) && clicked) {
+                            NativeBridge.colorLutClearSamples(if (samplingNone) 5 else colorClassOf(act.guiState))
+                        }
+                        else if ((action == ACTION_SAMPLE_NONE) && clicked) {
+                            samplingNone = !samplingNone
+                        }
+                        else if ((event.y > 300) && clicked && (act.config.color_lut != 0)) {
+                            val overlay = rootView?.findViewById<OverlayView>(R.id.overlay)
+                            pendingSample = intArrayOf((event.x - (overlay?.LEFT_BORDER ?: 0f)).toInt(), event.y.toInt())
+                        }
                         else if ((event.y > 40) && (event.y < 220))
                         {
                             var newVal = ((event.x - sliderMin) / (sliderMax - sliderMin) * 255.0).toInt()
@@ -279,27 +291,48 @@ class LiveFragment : Fragment() {
         )
     }
 
-    fun drawButton(img : Mat, x : Int, y : Int, label : String) : Rect
+    // the class of color_lut.h calibrated in the state
+    fun colorClassOf(state : GUIState) : Int = when (state) {
+        GUIState.BLUE -> 0
+        GUIState.BKMAX, GUIState.BKCHROMA -> 1
+        GUIState.RED -> 2
+        GUIState.GREEN -> 3
+        GUIState.YELLOW -> 4
+        else -> 5
+    }
+
+    fun drawButton(scene : OverlayScene, x : Int, y : Int, label : String) : Rect
     {
         val width = 14 + label.length * 20
         val height = 52
-        Imgproc.rectangle(img, Point(x.toDouble(), y.toDouble()), Point((x + width).toDouble(), (y + height).toDouble() ), Scalar(200.0, 220.0, 180.0), -1 )
-        Imgproc.rectangle(img, Point(x.toDouble(), y.toDouble()), Point((x + width).toDouble(), (y + height).toDouble() ), Scalar(200.0, 0.0, 0.0), 2 )
-        Imgproc.putText(img, label, Point(x + 7.0, y + 37.0), FONT_HERSHEY_COMPLEX, 1.0, Scalar(0.0, 40.0, 90.0), 2, LINE_8)
+        scene.box(x, y, x + width, y + height, 0xC8DCB4, -1)
+        scene.box(x, y, x + width, y + height, 0xC80000, 2)
+        scene.text(x + 7, y + 37, label, 0x00285A, 2)
         return Rect(x, y, width, height )
     }
 
-    fun drawSlider(img : Mat, width : Int, sliderVariable : KMutableProperty0<Int>)
+    fun drawSlider(scene : OverlayScene, width : Int, sliderVariable : KMutableProperty0<Int>)
     {
         sliderMin = 100.0
         sliderMax = width - 100.0
         sliderPos = sliderMin + (sliderMax - sliderMin) * sliderVar.get() / 255.0
         sliderVar = sliderVariable
-        Imgproc.rectangle(img, Point(sliderMin, 100.0), Point(sliderMax, 130.0), Scalar(255.0, 255.0, 255.0), -1)
-        Imgproc.rectangle(img, Point(sliderMin, 100.0), Point(sliderMax, 130.0), Scalar(255.0, 0.0, 0.0), 2)
-        Imgproc.rectangle(img, Point(sliderPos - 10, 60.0), Point(sliderPos + 10, 170.0), Scalar(255.0, 0.0, 0.0), -1)
-        Imgproc.rectangle(img, Point(sliderPos - 10, 60.0), Point(sliderPos + 10, 170.0), Scalar(255.0, 255.0, 255.0), 2)
-        drawButton(img,(sliderPos - 50).toInt(), 220, sliderVar.get().toString())
+        // histogram of the thresholded value under the slider (64 bars, log scale), so the threshold can be put into a valley
+        val bars = 64
+        var highest = 1
+        for (i in 0 until bars) highest = maxOf(highest, (0..3).sumOf { calibrationHistogram[4 * i + it] })
+        for (i in 0 until bars) {
+            val n = (0..3).sumOf { calibrationHistogram[4 * i + it] }
+            if (n == 0) continue
+            val h = (40 * Math.log1p(n.toDouble()) / Math.log1p(highest.toDouble())).toInt()
+            val x = (sliderMin + (sliderMax - sliderMin) * i / bars).toInt()
+            scene.box(x, 98 - h, (x + (sliderMax - sliderMin) / bars).toInt() - 1, 98, 0xB4B4B4, -1)
+        }
+        scene.box(sliderMin.toInt(), 100, sliderMax.toInt(), 130, 0xFFFFFF, -1)
+        scene.box(sliderMin.toInt(), 100, sliderMax.toInt(), 130, 0xFF0000, 2)
+        scene.box((sliderPos - 10).toInt(), 60, (sliderPos + 10).toInt(), 170, 0xFF0000, -1)
+        scene.box((sliderPos - 10).toInt(), 60, (sliderPos + 10).toInt(), 170, 0xFFFFFF, 2)
+        drawButton(scene,(sliderPos - 50).toInt(), 220, sliderVar.get().toString())
     }
 
     fun rotateBitmapIfNeeded(bitmap: Bitmap): Bitmap {
@@ -333,15 +366,58 @@ class LiveFragment : Fragment() {
                 val attitude = activity.config.northCorrection - att.yaw
                 Log.i("heading", "att=${"%.2f".format(attitude)}, cmps=${"%.2f".format(cmps)}")
             }
+            if (activity.config.attitude_aided != 0) {
+                val gimbalAtt = keyManager?.getValue(KeyTools.createKey(GimbalKey.KeyGimbalAttitude, 0))
+                attitudeInput[0] = if (att is Attitude) att.roll.toFloat() else Float.NaN
+                attitudeInput[1] = if (att is Attitude) att.pitch.toFloat() else Float.NaN
+                attitudeInput[2] = if (att is Attitude) att.yaw.toFloat() else Float.NaN
+                attitudeInput[3] = cmps?.toFloat() ?: Float.NaN
+                attitudeInput[4] = if (gimbalAtt is Attitude) gimbalAtt.roll.toFloat() else Float.NaN
+                attitudeInput[5] = if (gimbalAtt is Attitude) gimbalAtt.pitch.toFloat() else Float.NaN
+            }
 
-            NativeBridge.localization(frameAsMat.nativeObjAddr,
-                cameraPosition, activity.config.droneId)
+            val calibrating = when (activity.guiState) {
+                GUIState.RED -> 0
+                GUIState.GREEN -> 1
+                GUIState.BLUE -> 2
+                GUIState.YELLOW -> 3
+                GUIState.BKMAX -> 4
+                GUIState.BKCHROMA -> 5
+                else -> -1
+            }
+            if (calibrating >= 0) {
+                pendingSample?.let { tap ->
+                    NativeBridge.colorLutAddSamples(frameAsMat.nativeObjAddr, tap[0], tap[1], 3,
+                                                                  if (samplingNone) 5 else colorClassOf(activity.guiState))
+                    pendingSample = null
+                }
+                // while a slider is shown, only its mask is computed (the drone is on the ground, no pose needed)
+                NativeBridge.calibrationPreview(frameAsMat.nativeObjAddr, calibrating, activity.config.calibration_step,
+                                                calibrationStats, calibrationHistogram)
+                cameraPosition[0] = 999f
+            }
+            else {
+                if (activity.config.attitude_aided != 0)
+                    NativeBridge.localizationWithAttitude(frameAsMat.nativeObjAddr,
+                        cameraPosition, activity.config.droneId, attitudeInput)
+                else
+                    NativeBridge.localization(frameAsMat.nativeObjAddr,
+                        cameraPosition, activity.config.droneId)
                 activity.cameraPosition = cameraPosition
+                NativeBridge.localizationStats(localizationStats)
+                NativeBridge.localizationVelocity(localizationVelocity)
+                if (localizationStats[6] > 0) duplicateFrames++
+            }
 
             val yaw_deg = cameraPosition[3] / Math.PI * 180.0;
 
             Log.i("heading", "yaw=${"%.2f".format(yaw_deg)}")
 
+            // the localization runs on every frame, the overlay (and the buttons that can be clicked) only at overlay_rate
+            val overlay = rootView?.findViewById<OverlayView>(R.id.overlay)
+            if ((overlay == null) || !overlay.due(activity.config.overlay_rate)) return@let
+            scene.clear()
+
             var Y1 : Int = 100
             var Y2 : Int = 300
             var Y3 : Int = 500
@@ -357,12 +433,22 @@ class LiveFragment : Fragment() {
 
             var pose = ""
             if (Math.abs(cameraPosition[0] - 999.0) < 1)     // 999f means not found
-                pose = "[unavailable]";
+                pose = if ((calibrating < 0) && (localizationStats[0] > 0))
+                           "[no mat: b%.1f k%.1f r%.1f g%.1f y%.1f%%]".format(100 * localizationStats[1], 100 * localizationStats[2],
+                               100 * localizationStats[3], 100 * localizationStats[4], 100 * localizationStats[5])
+                       else "[unavailable]"
             else
                 pose = "[x=%6.2f, y=%6.2f, z=%6.2f, a=%6.1f]".format(cameraPosition[0], cameraPosition[1], cameraPosition[2], yaw_deg)
             if (activity.config.isServer) pose += ", d: ${1 + activity.comm.dronesConnected.size}"
-            Imgproc.putText(frameAsMat, pose, Point(5.0, 40.0), FONT_HERSHEY_COMPLEX, 1.0, Scalar(255.0, 255.0, 255.0), 2, LINE_8);
-            Imgproc.putText(frameAsMat, "#${activity.agendaIndex} ${if (activity.emergency) "emergency" else ""}", Point(5.0, 70.0), FONT_HERSHEY_COMPLEX, 1.0, Scalar(255.0, 255.0, 255.0), 2, LINE_8);
+            if (localizationStats[8] > 0) pose += ", q%d %.0fms".format(localizationStats[8].toInt(), localizationStats[9])
+            if (duplicateFrames > 0) pose += ", dup %d".format(duplicateFrames)
+            if (localizationVelocity[2] > 0) pose += ", v=(%.2f, %.2f)".format(localizationVelocity[0], localizationVelocity[1])
+            scene.text(5, 40, pose, 0xFFFFFF, 2)
+            if (calibrating >= 0)
+                scene.text(5, 70, "mask %.2f%% (%d of %d px), p5=%d p50=%d p95=%d".format(100.0 * calibrationStats[1] / maxOf(1, calibrationStats[0]),
+                           calibrationStats[1], calibrationStats[0], calibrationStats[2], calibrationStats[3], calibrationStats[4]), 0xFFFFFF, 2)
+            else
+                scene.text(5, 70, "#${activity.agendaIndex} ${if (activity.emergency) "emergency" else ""}", 0xFFFFFF, 2)
 
             when (activity.guiState) {
                 GUIState.READY_TO_RUN -> {
@@ -377,49 +463,52 @@ class LiveFragment : Fragment() {
                     synchronized(clicks) {
                         clicks.clear()
                         for (i in 0..n - 1)
-                            clicks.put(drawButton(frameAsMat,i * step + offset,Y1,"Dance ${i + 1}"), i + 1)
-                        clicks.put(drawButton(frameAsMat, btmpOK.width / 2 - 80, Y2, "Config"), ACTION_CONFIG)
+                            clicks.put(drawButton(scene,i * step + offset,Y1,"Dance ${i + 1}"), i + 1)
+                        clicks.put(drawButton(scene, btmpOK.width / 2 - 80, Y2, "Config"), ACTION_CONFIG)
                     }
                 }
                 GUIState.IN_CONFIG -> {
                     synchronized(clicks) {
                         clicks.clear()
-                        clicks.put(drawButton(frameAsMat, 110, Y2, "Red  "), ACTION_RED)
-                        clicks.put(drawButton(frameAsMat, 270, Y2, "Green"), ACTION_GREEN)
-                        clicks.put(drawButton(frameAsMat, 440, Y2, "Blue "), ACTION_BLUE)
-                        clicks.put(drawButton(frameAsMat, 600, Y2, "Yellow"), ACTION_YELLOW)
-                        clicks.put(drawButton(frameAsMat, 775, Y2, "BkMax "), ACTION_BKMAX)
-                        clicks.put(drawButton(frameAsMat, 945, Y2, "BkChroma "), ACTION_BKCHROMA)
-                        clicks.put(drawButton(frameAsMat, btmpOK.width / 2 - 80, Y3, "   DONE   "), ACTION_DONE)
-
-                        clicks.put(drawButton(frameAsMat, 110, Y4, if (activity.config.isServer) "Master" else "Slave"), ACTION_MASTER)
-                        clicks.put(drawButton(frameAsMat, 280, Y4, "ID: ${activity.config.droneId.toString()}"), ACTION_DRONEID)
-                        clicks.put(drawButton(frameAsMat, 450, Y4, "Drones: ${activity.config.expectedNumberOfDrones.toString()}"), ACTION_NUMDRONES)
-                        clicks.put(drawButton(frameAsMat, 660, Y4, if (activity.config.show_contours == 1) "draw" else "noDraw"), ACTION_CONTOURS)
-                        clicks.put(drawButton(frameAsMat, 825, Y4, if (activity.config.cpp_debug == 1) "cppDBG " else "noCppDbg"), ACTION_CPPDEBUG)
-                        clicks.put(drawButton(frameAsMat, 1020, Y4, if (activity.config.position_debug == 1) "posDBG " else "noPosDbg"), ACTION_POSDEBUG)
+                        clicks.put(drawButton(scene, 110, Y2, "Red  "), ACTION_RED)
+                        clicks.put(drawButton(scene, 270, Y2, "Green"), ACTION_GREEN)
+                        clicks.put(drawButton(scene, 440, Y2, "Blue "), ACTION_BLUE)
+                        clicks.put(drawButton(scene, 600, Y2, "Yellow"), ACTION_YELLOW)
+                        clicks.put(drawButton(scene, 775, Y2, "BkMax "), ACTION_BKMAX)
+                        clicks.put(drawButton(scene, 945, Y2, "BkChroma "), ACTION_BKCHROMA)
+                        clicks.put(drawButton(scene, btmpOK.width / 2 - 80, Y3, "   DONE   "), ACTION_DONE)
+
+                        clicks.put(drawButton(scene, 110, Y4, if (activity.config.isServer) "Master" else "Slave"), ACTION_MASTER)
+                        clicks.put(drawButton(scene, 280, Y4, "ID: ${activity.config.droneId.toString()}"), ACTION_DRONEID)
+                        clicks.put(drawButton(scene, 450, Y4, "Drones: ${activity.config.expectedNumberOfDrones.toString()}"), ACTION_NUMDRONES)
+                        clicks.put(drawButton(scene, 660, Y4, if (activity.config.show_contours == 1) "draw" else "noDraw"), ACTION_CONTOURS)
+                        clicks.put(drawButton(scene, 825, Y4, if (activity.config.cpp_debug == 1) "cppDBG " else "noCppDbg"), ACTION_CPPDEBUG)
+                        clicks.put(drawButton(scene, 1020, Y4, if (activity.config.position_debug == 1) "posDBG " else "noPosDbg"), ACTION_POSDEBUG)
                     }
                 }
                 GUIState.RED, GUIState.GREEN, GUIState.BLUE, GUIState.BKMAX, GUIState.BKCHROMA, GUIState.YELLOW -> {
                     synchronized(clicks) {
                         clicks.clear()
-                        clicks.put(drawButton(frameAsMat, btmpOK.width / 2 - 80, Y2, "    OK    "), ACTION_OK)
+                        clicks.put(drawButton(scene, btmpOK.width / 2 - 80, Y2, "    OK    "), ACTION_OK)
+                        if (activity.config.color_lut != 0) {
+                            clicks.put(drawButton(scene, 110, Y3, if (samplingNone) "Tap: none " else "Tap: color"), ACTION_SAMPLE_NONE)
+                            clicks.put(drawButton(scene, 340, Y3, "Clear"), ACTION_CLEAR_SAMPLES)
+                        }
                     }
                     when (activity.guiState) {
-                        GUIState.RED -> drawSlider(frameAsMat, btmpOK.width, activity.config::red_t)
-                        GUIState.GREEN -> drawSlider(frameAsMat, btmpOK.width, activity.config::green_t)
-                        GUIState.BLUE -> drawSlider(frameAsMat, btmpOK.width, activity.config::blue_t)
-                        GUIState.YELLOW -> drawSlider(frameAsMat, btmpOK.width, activity.config::yellow_t)
-                        GUIState.BKMAX -> drawSlider(frameAsMat, btmpOK.width, activity.config::black_maxRGB_t)
-                        GUIState.BKCHROMA -> drawSlider(frameAsMat, btmpOK.width, activity.config::black_chroma_t)
+                        GUIState.RED -> drawSlider(scene, btmpOK.width, activity.config::red_t)
+                        GUIState.GREEN -> drawSlider(scene, btmpOK.width, activity.config::green_t)
+                        GUIState.BLUE -> drawSlider(scene, btmpOK.width, activity.config::blue_t)
+                        GUIState.YELLOW -> drawSlider(scene, btmpOK.width, activity.config::yellow_t)
+                        GUIState.BKMAX -> drawSlider(scene, btmpOK.width, activity.config::black_maxRGB_t)
+                        GUIState.BKCHROMA -> drawSlider(scene, btmpOK.width, activity.config::black_chroma_t)
                         else -> {}
                     }
                 }
                 GUIState.RUNNING -> { }
             }
 
-            val overlay = rootView?.findViewById<OverlayView>(R.id.overlay)
-            overlay?.updateBitmap(frameAsMat)
+            overlay.render(frameAsMat, scene)
         }
         startGrabbing()
     }
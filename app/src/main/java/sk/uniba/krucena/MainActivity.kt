@@ -34,6 +34,7 @@ import dji.sdk.keyvalue.value.flightcontroller.FlightMode
 import dji.sdk.keyvalue.value.flightcontroller.LEDsSettings
 
 import org.opencv.android.OpenCVLoader
+import java.io.File
 import kotlin.system.exitProcess
 
 enum class GUIState {
@@ -81,6 +82,55 @@ class MainActivity : AppCompatActivity() {
     var horizontalSpeedLimit : Double = 0.3
     var verticalSpeedLimit : Double = 1.0
 
+    var nativeTrajectory : Int = -1    // procedure followed by the native position controller, -1 = none
+
+    @Volatile var separationHoldUntil : Long = 0    // the separation monitor wants this drone to hover until then
+
+    // after the last conflict, the drone keeps hovering this long
+    val SEPARATION_HOLD_MS = 1000
+
+    fun separationHold() : Boolean = System.currentTimeMillis() < separationHoldUntil
+
+    // zero velocities: hover in place
+    fun hoverParam() : VirtualStickFlightControlParam = VirtualStickFlightControlParam(0.0, 0.0, 0.0, 0.0,
+        VerticalControlMode.VELOCITY, RollPitchControlMode.VELOCITY, YawControlMode.ANGULAR_VELOCITY, FlightCoordinateSystem.BODY)
+
+    // conflicts of the native separation monitor, sent from its thread
+    val separationSink = object : SeparationSink {
+        override fun onConflict(droneA: Int, droneB: Int, distance: Float, minDistance: Float, time: Float, action: Int) {
+            val own = (droneA == config.droneId) || (droneB == config.droneId)
+            if (action == 2)
+                Handler(Looper.getMainLooper()).post {
+                    if (!emergency && hasTakenOff) {
+                        Log.e("Dance", "separation emergency: drones ${droneA} and ${droneB} ${distance} m apart, ${minDistance} m in ${time} s")
+                        emergencyStop()
+                    }
+                }
+            else if (own) {
+                if (!separationHold())
+                    Log.w("Dance", "separation hold: drones ${droneA} and ${droneB} ${distance} m apart, ${minDistance} m in ${time} s")
+                separationHoldUntil = System.currentTimeMillis() + SEPARATION_HOLD_MS
+            }
+        }
+    }
+
+    // commands of the native position controller, sent directly from its thread
+    val stickSink = object : StickSink {
+        override fun onStickCommand(roll: Float, pitch: Float, yawRate: Float, vertical: Float) {
+            if (!flyingAllowed || emergency || !hasTakenOff || hasLanded) return
+            val controlParam = if (separationHold()) hoverParam() else VirtualStickFlightControlParam(
+                roll.toDouble(),
+                pitch.toDouble(),
+                yawRate.toDouble(),
+                vertical.toDouble(),
+                VerticalControlMode.VELOCITY,
+                RollPitchControlMode.VELOCITY,
+                YawControlMode.ANGULAR_VELOCITY,
+                FlightCoordinateSystem.BODY)
+            VirtualStickManager.getInstance().sendVirtualStickAdvancedParam(controlParam)
+        }
+    }
+
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
 
@@ -101,6 +151,23 @@ class MainActivity : AppCompatActivity() {
             NativeBridge.setMode(0, config.show_contours, config.cpp_debug, config.position_debug)
             NativeBridge.setupColors(config.black_maxRGB_t, config.black_chroma_t, config.red_t,
                                      config.green_t, config.blue_t, config.yellow_t)
+            NativeBridge.setupColorLut(config.color_lut, File(filesDir, "color_samples.bin").absolutePath)
+            NativeBridge.setupGovernor(config.latency_budget, config.governor_max_level)
+            NativeBridge.setupVelocity(config.corner_velocity)
+            NativeBridge.setupAttitude(config.northCorrection)
+            NativeBridge.setupCamera(config.camera_fx, config.camera_fy, config.camera_cx, config.camera_cy,
+                                     config.camera_k1, config.camera_k2, config.camera_p1, config.camera_p2, config.camera_k3)
+            if (config.native_controller != 0)
+                if (!NativeBridge.controllerStart(config.controller_rate, stickSink))
+                    Log.e("Dance", "native position controller not started")
+            if (config.swarm_exchange != 0)
+                if (!NativeBridge.swarmStart(config.droneId, config.swarm_port, config.swarm_rate, ""))
+                    Log.e("Dance", "swarm pose exchange not started")
+                else if (config.separation_monitor != 0)
+                    if (!NativeBridge.monitorStart(config.swarm_rate, config.droneId, if (config.isServer) 1 else 0,
+                                                   config.separation_min, config.separation_emergency,
+                                                   config.separation_horizon, separationSink))
+                        Log.e("Dance", "separation monitor not started")
             comm.setupCommunication()
             dances = Dance.load(this, config.droneId)
             proceed()
@@ -113,20 +180,40 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
-    /** called by the client communication thread when server says START, and by master on button click */
-    fun startChoreography(danceNumber : Int)
+    /** time of the dance timeline in ms: the master clock when the drones are synchronized (clock_sync),
+     *  the wall clock otherwise */
+    fun danceClock() : Long = NativeBridge.clockSyncTime()
+
+    /** called by the client communication thread when server says START, and by master on button click,
+     *  startTime > 0 is the master clock time when all the drones begin */
+    fun startChoreography(danceNumber : Int, startTime : Long = 0)
     {
         selectedDance = danceNumber
         performanceCompleted = false
         agendaIndex = 0
         saveAgendaIndex = -1
+        NativeBridge.clockSyncDanceRunning(true)    // the dance clock keeps its source from now on
+        if (startTime > 0)
+        {
+            val status = NativeBridge.clockSyncStatus()
+            if (config.isServer || ((status != null) && (status[0] != 0.0f)))
+            {
+                Handler(Looper.getMainLooper()).postDelayed({
+                    if (config.isServer) comm.startPlayingMusic(danceNumber) {}
+                    timeStarted = startTime
+                    Log.i("Dance", "time synchronized start t=${timeStarted}, ${danceClock() - startTime} ms late")
+                }, maxOf(0L, startTime - danceClock()))
+                return
+            }
+            Log.w("Dance", "clock not synchronized, starting at the arrival of START")
+        }
         if (config.isServer)
             comm.startPlayingMusic(danceNumber) {
-                timeStarted = System.currentTimeMillis()
+                timeStarted = danceClock()
                 Log.i("Dance", "time master start t=${timeStarted}")
             }
         else {
-            timeStarted = System.currentTimeMillis()
+            timeStarted = danceClock()
             Log.i("Dance", "time slave start t=${timeStarted}")
 
         }
@@ -169,7 +256,8 @@ class MainActivity : AppCompatActivity() {
 
     fun emergencyStop()
     {
-        timeStarted = System.currentTimeMillis() - (currentDance?.landingTime ?: 86400000)
+        stopNativeTrajectory()
+        timeStarted = danceClock() - (currentDance?.landingTime ?: 86400000)
         if (config.isServer)
         {
             emergency = true
@@ -210,7 +298,7 @@ class MainActivity : AppCompatActivity() {
      *    and then either proceed to the next instruction if it is already time before next repetition would be done,
      *    or we just return the wait time commandRepeatDelay */
     private fun howMuchToWaitForNextCommand() : Long {
-        var currentSimulationTime = System.currentTimeMillis() - timeStarted
+        var currentSimulationTime = danceClock() - timeStarted
         var advanceToNextInstruction = false
         var mayBeEndOfProcedure = false
         var delayToReturn = 500L  // when no more instructions, we just continue to idle slowly
@@ -250,7 +338,7 @@ class MainActivity : AppCompatActivity() {
             var returnFromProcedure = false
             if (numberOfRemainingRepeatsOfThisCommand > 0)
             {
-                val currentMainSimulationTime = System.currentTimeMillis() - saveTimeStarted
+                val currentMainSimulationTime = danceClock() - saveTimeStarted
                 val nextInstructionAfterProcedure = saveCurrentDance?.instructions?.getOrNull(saveAgendaIndex + 1);
                 if (nextInstructionAfterProcedure != null) {
                     if (currentMainSimulationTime + commandRepeatDelay >= nextInstructionAfterProcedure.time) {
@@ -269,13 +357,14 @@ class MainActivity : AppCompatActivity() {
             if (returnFromProcedure)
             {
                 //Log.d("Dance","return")
+                stopNativeTrajectory()
                 currentDance = saveCurrentDance
                 agendaIndex = saveAgendaIndex
                 timeStarted = saveTimeStarted
                 saveAgendaIndex = -1
                 advanceToNextInstruction = true
                 if (emergency)
-                    timeStarted = System.currentTimeMillis() - (currentDance?.landingTime ?: 86400000)
+                    timeStarted = danceClock() - (currentDance?.landingTime ?: 86400000)
             }
         }
 
@@ -283,7 +372,7 @@ class MainActivity : AppCompatActivity() {
         {
             agendaIndex++;
             numberOfRemainingRepeatsOfThisCommand = 1
-            currentSimulationTime = System.currentTimeMillis() - timeStarted
+            currentSimulationTime = danceClock() - timeStarted
             Log.d("Dance", "agendaIndex=${agendaIndex}")
             val nextInstruction = currentDance?.instructions?.getOrNull(agendaIndex);
             if (nextInstruction != null)
@@ -416,6 +505,8 @@ class MainActivity : AppCompatActivity() {
         commandRepeatDelay = 100 // we repeat the pos command every 100 ms until the next command
         numberOfRemainingRepeatsOfThisCommand ++;  // pos command is repeated again and again
 
+        if (nativeTrajectory >= 0) return   // the native controller flies the whole procedure
+
         if (args !== lastArgs)
         {
             if (relativeON)
@@ -489,7 +580,7 @@ class MainActivity : AppCompatActivity() {
         handler.post(object : Runnable {
             override fun run() {
                 // Create and send control data
-                val controlParam = VirtualStickFlightControlParam(
+                val controlParam = if (separationHold()) hoverParam() else VirtualStickFlightControlParam(
                     delta_roll / 1.0,
                     delta_pitch / 1.0,
                     delta_yaw.toDouble() / 1.0,
@@ -508,6 +599,7 @@ class MainActivity : AppCompatActivity() {
     {
         Log.d("Dance","fly command" )
         if (!flyingAllowed || emergency || !hasTakenOff || (args==null)) return
+        stopNativeTrajectory()
         val handler = Handler(Looper.getMainLooper())
         commandRepeatDelay = 100 // we repeat the fly command every 100 ms until the next command
         numberOfRemainingRepeatsOfThisCommand ++;  // fly command is repeated again and again
@@ -515,7 +607,7 @@ class MainActivity : AppCompatActivity() {
         handler.post(object : Runnable {
             override fun run() {
                 // Create and send control data
-                val controlParam = VirtualStickFlightControlParam(
+                val controlParam = if (separationHold()) hoverParam() else VirtualStickFlightControlParam(
                         args.roll.toDouble(),
                         args.pitch.toDouble(),
                         args.yaw.toDouble(),
@@ -552,9 +644,37 @@ class MainActivity : AppCompatActivity() {
         saveCurrentDance = currentDance
         saveAgendaIndex = agendaIndex
         saveTimeStarted = timeStarted
-        timeStarted = System.currentTimeMillis()
+        timeStarted = danceClock()
         agendaIndex = 0
         currentDance = currentDance?.procedures?.get(args?.name)
+        startNativeTrajectory()
+    }
+
+    // the POS commands of the procedure are joined into one smooth trajectory (compiled dances only)
+    private fun startNativeTrajectory()
+    {
+        stopNativeTrajectory()
+        val block = currentDance?.bundleBlock ?: -1
+        if ((config.native_controller == 0) || (block < 0)) return
+
+        val handle = NativeBridge.trajectoryFromBundle(block, if (relativeON) 1 else 0,
+            floatArrayOf(relativePos.x, relativePos.y, relativePos.z, relativePos.yaw),
+            floatArrayOf(referencePoint.x, referencePoint.y, referencePoint.z, referencePoint.yaw))
+        if (handle < 0) return   // no POS commands
+        if (NativeBridge.controllerFollow(handle, timeStarted, horizontalSpeedLimit.toFloat(), verticalSpeedLimit.toFloat()))
+        {
+            nativeTrajectory = handle
+            Log.d("Dance", "native trajectory ${handle} for block ${block}")
+        }
+        else NativeBridge.trajectoryRelease(handle)
+    }
+
+    private fun stopNativeTrajectory()
+    {
+        if (nativeTrajectory < 0) return
+        NativeBridge.controllerIdle()
+        NativeBridge.trajectoryRelease(nativeTrajectory)
+        nativeTrajectory = -1
     }
 
     private fun performCommand()
@@ -588,6 +708,7 @@ class MainActivity : AppCompatActivity() {
                 DanceInstructionKind.END -> {
                     if (hasTakenOff && !hasLanded) landCommand()
                     performanceCompleted = true
+                    NativeBridge.clockSyncDanceRunning(false)
                     Log.i("Dance", "Performance completed")
 
                     runOnUiThread {
@@ -1,5 +1,18 @@
 package sk.uniba.krucena
 
+import android.graphics.Bitmap
+import java.nio.ByteBuffer
+
+// receives the virtual stick commands of the native position controller (on its own thread)
+interface StickSink {
+    fun onStickCommand(roll : Float, pitch : Float, yawRate : Float, vertical : Float)
+}
+
+// receives the conflicts of the separation monitor (on its own thread), action 1 = hold, 2 = emergency
+interface SeparationSink {
+    fun onConflict(droneA : Int, droneB : Int, distance : Float, minDistance : Float, time : Float, action : Int)
+}
+
 object NativeBridge {
     init {
         System.loadLibrary("fastimglib") // this matches CMake target name
@@ -7,16 +20,109 @@ object NativeBridge {
 
     external fun localization(matAddrInput: Long,
                             cameraPosition : FloatArray, droneId: Int)
+    // the same, aided by attitude = [roll, pitch, yaw, compass heading, gimbal roll, gimbal pitch] (degrees, as
+    // the SDK gives them, NaN = not available): the tilt of the camera is compensated, the heading is a prior
+    // of the yaw, and one identified corner is enough for a pose (with the height of the last frames)
+    external fun localizationWithAttitude(matAddrInput: Long,
+                                          cameraPosition : FloatArray, droneId: Int, attitude : FloatArray)
+    // northCorrection = the compass heading (degrees) when facing the +y of the mat
+    external fun setupAttitude(northCorrection : Float)
+    // [rejected, coverage of blue, black, red, green, yellow, duplicate, poseAgeMs, qualityLevel, processingMs]
+    // of the last localization: rejected = 1 when a coarse pass saw fewer than two colors of the mat and the frame
+    // was not processed further, duplicate = 1 when the frame was the same as the previous one (2 = skipped by
+    // the governor) and the pose (poseAgeMs old) was returned again
+    external fun localizationStats(stats : FloatArray)
+    // keeps the processing time of a frame under budgetMs by lowering the quality (0 = full resolution,
+    // 1 = half resolution, 2 = around the last corners only, 3 = every other frame), budgetMs = 0 turns it off
+    external fun setupGovernor(budgetMs : Float, maxLevel : Int)
+    // velocity = [vx, vy (world, m/s), points, ageMs] measured by tracking the corners from frame to frame
+    // (points = 0 when unknown), it is also handed to the native position controller
+    external fun localizationVelocity(velocity : FloatArray)
+    external fun setupVelocity(enabled : Int)
+
+    // calibration: only the mask of the tuned threshold (0 = red, 1 = green, 2 = blue, 3 = yellow, 4 = black max,
+    // 5 = black chroma) from every step-th pixel, shown by the overlay instead of the frame, localization is skipped;
+    // stats = [sampled pixels, mask pixels, p5, p50, p95 of the thresholded value], histogram[256] of that value,
+    // returns the threshold or -1
+    external fun calibrationPreview(matAddrInput : Long, what : Int, step : Int, stats : IntArray, histogram : IntArray) : Int
 
     external fun setMode(visualization_mode : Int,
                          show_contours : Int,
                          cpp_debug : Int,
                          position_debug : Int)
 
+    // draws the frame (or the visualization planes), the debug layer of the last localization and the GUI
+    // into the bitmap (ARGB_8888, the size of the frame), see overlay_renderer.h
+    external fun renderOverlay(matAddrFrame : Long, bitmap : Bitmap, boxes : IntArray, boxCount : Int,
+                               texts : Array<String>, textAttributes : IntArray) : Boolean
+
     external fun setupColors(new_black_maxRGB_t : Int,
                               new_black_chroma_t : Int,
                               new_red_t : Int,
                               new_green_t : Int,
                               new_blue_t : Int,
                               new_yellow_t : Int)
-}
\ No newline at end of file
+
+    // classification of the colors by a lookup table (color_lut.h) built from the thresholds and the samples
+    // stored in samplesPath, instead of the arithmetic of the thresholds (enabled = 0)
+    external fun setupColorLut(enabled : Int, samplesPath : String)
+    // the pixels around (x, y) of the frame are samples of colorClass (0 = blue, 1 = black, 2 = red, 3 = green,
+    // 4 = yellow, 5 = none of them), call on the thread of localization, returns the number of samples
+    external fun colorLutAddSamples(matAddrInput : Long, x : Int, y : Int, radius : Int, colorClass : Int) : Int
+    // -1 = all
+    external fun colorLutClearSamples(colorClass : Int)
+
+    // fx, fy, cx, cy relative to the width of the image, fx <= 0 turns the lens correction off
+    external fun setupCamera(fx : Float, fy : Float, cx : Float, cy : Float,
+                             k1 : Float, k2 : Float, p1 : Float, p2 : Float, k3 : Float)
+
+    // compiled dances (dances.bin from tools/dance_compiler), see dance_bundle.h
+    external fun openDanceBundle(path : String) : Int
+    external fun danceBundlePerformances(droneId : Int) : IntArray?
+    external fun danceBundleBlock(block : Int) : IntArray?
+    external fun danceBundleName(block : Int) : String
+    external fun danceBundleRecords() : ByteBuffer?
+    external fun danceBundleTimes() : ByteBuffer?
+
+    // continuous target trajectory through POS samples (trajectory_interpolator.h), returns handle or -1
+    // relative/reference are [x, y, z, yaw] of RELATIVE and REFPOINT in force when the procedure starts
+    external fun trajectoryFromBundle(block : Int, relativeOn : Int, relative : FloatArray, reference : FloatArray) : Int
+    external fun trajectoryFromSamples(times : IntArray, poses : FloatArray) : Int
+    // state = [x, y, z, yaw, vx, vy, vz, yawRate] at timeMs from the procedure start
+    external fun trajectoryEvaluate(handle : Int, timeMs : Float, state : FloatArray) : Boolean
+    external fun trajectoryRelease(handle : Int)
+
+    // position controller on a native thread at rateHz (position_controller.h), fed by localization
+    external fun controllerStart(rateHz : Float, sink : StickSink) : Boolean
+    external fun controllerStop()
+    // follow the trajectory, startTimeMs = clockSyncTime() at its time 0
+    external fun controllerFollow(handle : Int, startTimeMs : Long, horizontalSpeedLimit : Float, verticalSpeedLimit : Float) : Boolean
+    external fun controllerIdle()
+
+    // pose exchange with the other drones over UDP (swarm_exchange.h), destinations "" = broadcast on port
+    external fun swarmStart(droneId : Int, port : Int, rateHz : Float, destinations : String) : Boolean
+    external fun swarmStop()
+    // peers = [id, valid, x, y, z, yaw, vx, vy, vz, ageMs] for each peer heard within maxAgeMs, returns their count
+    external fun swarmPeers(maxAgeMs : Int, peers : FloatArray) : Int
+    // [sent, received, lost, reordered, rejected]
+    external fun swarmStats() : IntArray?
+
+    // predicts the conflicts of the swarm exchange states horizon seconds ahead (separation_monitor.h),
+    // the sink gets the worst conflict of ownId at every check while there is any, and when all != 0 also
+    // the worst conflict of all drones (in another call, unless it is the same one)
+    external fun monitorStart(rateHz : Float, ownId : Int, all : Int, minDistance : Float, emergencyDistance : Float,
+                              horizon : Float, sink : SeparationSink) : Boolean
+    external fun monitorStop()
+
+    // synchronized dance clock (clock_sync.h): the master answers on port, the other drones follow it
+    external fun clockSyncServe(port : Int) : Boolean
+    // following the same master again (a reconnect) keeps the running synchronization
+    external fun clockSyncFollow(masterAddress : String, port : Int, rateHz : Float) : Boolean
+    external fun clockSyncStop()
+    // master wall clock in ms (the local wall clock on the master and until synchronized), never goes back
+    external fun clockSyncTime() : Long
+    // while the dance runs, an unsynchronized drone does not switch from its wall clock to the master clock
+    external fun clockSyncDanceRunning(running : Boolean)
+    // [synchronized, samples, offsetMs, driftPpm, delayMs, errorMs]
+    external fun clockSyncStatus() : FloatArray?
+}
@@ -5,12 +5,41 @@ import android.graphics.Bitmap
 import android.graphics.Canvas
 import android.graphics.Color
 import android.graphics.Paint
+import android.os.SystemClock
 import android.util.AttributeSet
 import android.view.View
 
-import org.opencv.android.Utils
 import org.opencv.core.Mat
 
+/** what the GUI draws over the frame (boxes and texts), handed to the native overlay renderer at once,
+ *  the arrays are reused from frame to frame */
+class OverlayScene {
+    var boxes = IntArray(6 * 32)        // [x1, y1, x2, y2, 0xRRGGBB, thickness (-1 = filled)]
+    var boxCount = 0
+    val texts = ArrayList<String>()
+    var textAttributes = IntArray(4 * 8) // [x, y, 0xRRGGBB, thickness]
+
+    fun clear()
+    {
+        boxCount = 0
+        texts.clear()
+    }
+
+    fun box(x1 : Int, y1 : Int, x2 : Int, y2 : Int, rgb : Int, thickness : Int)
+    {
+        if (6 * (boxCount + 1) > boxes.size) boxes = boxes.copyOf(2 * boxes.size)
+        val i = 6 * boxCount++
+        boxes[i] = x1; boxes[i + 1] = y1; boxes[i + 2] = x2; boxes[i + 3] = y2; boxes[i + 4] = rgb; boxes[i + 5] = thickness
+    }
+
+    fun text(x : Int, y : Int, text : String, rgb : Int, thickness : Int)
+    {
+        if (4 * (texts.size + 1) > textAttributes.size) textAttributes = textAttributes.copyOf(2 * textAttributes.size)
+        val i = 4 * texts.size
+        textAttributes[i] = x; textAttributes[i + 1] = y; textAttributes[i + 2] = rgb; textAttributes[i + 3] = thickness
+        texts.add(text)
+    }
+}
 
 class OverlayView @JvmOverloads constructor(
     context: Context,
@@ -23,22 +52,33 @@ class OverlayView @JvmOverloads constructor(
         style = Paint.Style.STROKE
     }
 
-    private val emptyBitmap = Bitmap.createBitmap(1, 1, Bitmap.Config.ARGB_8888)
-    private var btmp : Bitmap = emptyBitmap
-    private val LEFT_BORDER = 31.0f
+    private var btmp : Bitmap? = null    // persistent, drawn into by the native overlay renderer
+    private var lastRender : Long = 0
+    val LEFT_BORDER = 31.0f
+
+    /** the overlay is rendered at most rateHz times per second (every frame when rateHz <= 0),
+     *  independently of how often the frames are localized */
+    fun due(rateHz : Float) : Boolean = (rateHz <= 0) || (SystemClock.uptimeMillis() - lastRender >= 1000.0f / rateHz)
 
-    fun updateBitmap(bmp: Mat)
+    fun render(frame : Mat, scene : OverlayScene)
     {
-        val bitmap = Bitmap.createBitmap(bmp.cols(), bmp.rows(), Bitmap.Config.ARGB_8888)
-        Utils.matToBitmap(bmp, bitmap)
-        btmp = bitmap
-        invalidate()
+        synchronized(this) {
+            var bitmap = btmp
+            if ((bitmap == null) || (bitmap.width != frame.cols()) || (bitmap.height != frame.rows())) {
+                bitmap = Bitmap.createBitmap(frame.cols(), frame.rows(), Bitmap.Config.ARGB_8888)
+                btmp = bitmap
+            }
+            NativeBridge.renderOverlay(frame.nativeObjAddr, bitmap!!, scene.boxes, scene.boxCount,
+                                       scene.texts.toTypedArray(), scene.textAttributes)
+            lastRender = SystemClock.uptimeMillis()
+        }
+        postInvalidate()
     }
 
     override fun onDraw(canvas: Canvas) {
         super.onDraw(canvas)
-        canvas.drawBitmap(btmp, LEFT_BORDER, 0.0f, paint)  //this may need to be tuned for each drone
-        btmp.recycle()
-        btmp = emptyBitmap
+        synchronized(this) {
+            btmp?.let { canvas.drawBitmap(it, LEFT_BORDER, 0.0f, paint) }  //this may need to be tuned for each drone
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,167 @@
+// runs the localization of fastimglib (localize_batch of fastimglib.h) over a dataset of mat_renderer
+// (or over recorded frames in the same layout) in parallel, and reports the errors against the ground truth
+// and the time of processing
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o batch_localizer batch_localizer.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/fastimglib.cpp ../app/src/main/cpp/color_lut.cpp ../app/src/main/cpp/overlay_renderer.cpp
+//               ../app/src/main/cpp/position_controller.cpp ../app/src/main/cpp/trajectory_interpolator.cpp
+//               ../app/src/main/cpp/dance_bundle.cpp ../app/src/main/cpp/swarm_exchange.cpp
+//               ../app/src/main/cpp/separation_monitor.cpp ../app/src/main/cpp/clock_sync.cpp
+//               `pkg-config --cflags --libs opencv4` -lpthread
+//
+// usage:    batch_localizer [options] dataset_dir
+//
+//   dataset_dir     with ground_truth.csv and the frames listed in it (mat_renderer -count N -o dataset_dir)
+//   -threads N      default: all cores
+//   -colors r,g,b,y,k,c   red_t, green_t, blue_t, yellow_t, black_maxRGB_t, black_chroma_t of config.txt,
+//                   default 25,25,15,41,130,103
+//   -lut file       classify the colors by the lookup table with the samples file (color_lut.h)
+//   -camera fx,fy,cx,cy,k1,k2,p1,p2,k3   camera_fx ... camera_k3 of config.txt, default uncalibrated
+//   -filter 1       run the temporal filters over the frames in order (for recorded sequences), default 0
+//   -fps F          frame rate of the sequence for the timestamps, default 30
+//   -o file         csv with the pose of each frame
+
+#include <opencv2/opencv.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "fastimglib.h"
+
+struct truth
+{
+	std::string file;
+	double x, y, height, yaw;
+};
+
+static int load_ground_truth(const char *dir, std::vector<truth> &frames)
+{
+	std::string name = std::string(dir) + "/ground_truth.csv";
+	FILE *f = fopen(name.c_str(), "r");
+	if (!f)
+	{
+		perror("Cannot open ground truth file");
+		return 0;
+	}
+	char line[512], file[256];
+	int index, device;
+	truth t;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "%d,%255[^,],%d,%lf,%lf,%lf,%lf", &index, file, &device, &t.x, &t.y, &t.height, &t.yaw) == 7)
+		{
+			t.file = std::string(dir) + "/" + file;
+			frames.push_back(t);
+		}
+	fclose(f);
+	return 1;
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+	if (v.empty()) return 0;
+	size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+	std::nth_element(v.begin(), v.begin() + k, v.end());
+	return v[k];
+}
+
+int main(int argc, char **argv)
+{
+	localization_batch_config config;
+	config.filtered = 0;
+	const char *dataset = 0, *output = 0;
+	double fps = 30;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-threads") == 0) config.threads = atoi(val);
+			else if (strcmp(opt, "-colors") == 0)
+				sscanf(val, "%d,%d,%d,%d,%d,%d", &config.thresholds[0], &config.thresholds[1], &config.thresholds[2],
+				       &config.thresholds[3], &config.thresholds[4], &config.thresholds[5]);
+			else if (strcmp(opt, "-lut") == 0)
+			{
+				config.color_lut = 1;
+				config.color_samples = val;
+			}
+			else if (strcmp(opt, "-camera") == 0)
+				sscanf(val, "%f,%f,%f,%f,%f,%f,%f,%f,%f", &config.camera[0], &config.camera[1], &config.camera[2],
+				       &config.camera[3], &config.camera[4], &config.camera[5], &config.camera[6], &config.camera[7],
+				       &config.camera[8]);
+			else if (strcmp(opt, "-filter") == 0) config.filtered = atoi(val);
+			else if (strcmp(opt, "-fps") == 0) fps = atof(val);
+			else if (strcmp(opt, "-o") == 0) output = val;
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else dataset = argv[i];
+	}
+	if (!dataset || (fps <= 0))
+	{
+		fprintf(stderr, "usage: batch_localizer [-threads N] [-colors r,g,b,y,k,c] [-lut file] [-camera fx,fy,cx,cy,k1,k2,p1,p2,k3] "
+		                "[-filter 0|1] [-fps F] [-o file] dataset_dir\n");
+		return 1;
+	}
+
+	std::vector<truth> truths;
+	if (!load_ground_truth(dataset, truths)) return 1;
+	std::vector<localization_frame> frames(truths.size());
+	for (size_t i = 0; i < truths.size(); i++)
+	{
+		cv::Mat bgr = cv::imread(truths[i].file, cv::IMREAD_COLOR);
+		if (bgr.empty())
+		{
+			fprintf(stderr, "could not read %s\n", truths[i].file.c_str());
+			return 1;
+		}
+		cv::cvtColor(bgr, frames[i].image, cv::COLOR_BGR2RGBA);    // the same as the frames of the app
+		frames[i].time = i * 1000.0 / fps;
+	}
+	if (frames.empty())
+	{
+		fprintf(stderr, "no frames in %s\n", dataset);
+		return 1;
+	}
+
+	std::vector<localization_result> results;
+	auto t0 = std::chrono::steady_clock::now();
+	localize_batch(frames, config, results);
+	double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	FILE *f = 0;
+	if (output && !(f = fopen(output, "w+"))) perror("Cannot open output file");
+	if (f) fprintf(f, "frame,x,y,height,yaw,rejected,corners,identified,ms\n");
+	std::vector<double> position_errors, height_errors, yaw_errors, times;
+	int found = 0, rejected = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const localization_result &r = results[i];
+		const float *pose = config.filtered ? r.filtered_pose : r.pose;
+		if (f) fprintf(f, "%d,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%.2f\n", (int)i, pose[0], pose[1], pose[2], pose[3], r.rejected,
+		               r.corners, r.identified, r.ms);
+		times.push_back(r.ms);
+		rejected += r.rejected;
+		if (pose[0] > 900.0f) continue;
+		found++;
+		position_errors.push_back(hypot(pose[0] - truths[i].x, pose[1] - truths[i].y));
+		height_errors.push_back(fabs(pose[2] - truths[i].height));
+		yaw_errors.push_back(fabs(remainder(pose[3] - truths[i].yaw, 2 * M_PI)) * 180 / M_PI);
+	}
+	if (f) fclose(f);
+
+	printf("%d frames, %d localized (%.1f%%), %d rejected by the pre-pass\n", (int)results.size(), found,
+	       100.0 * found / results.size(), rejected);
+	printf("position error [m]  median %.4f  95%% %.4f  max %.4f\n", percentile(position_errors, 0.5),
+	       percentile(position_errors, 0.95), percentile(position_errors, 1));
+	printf("height error [m]    median %.4f  95%% %.4f  max %.4f\n", percentile(height_errors, 0.5),
+	       percentile(height_errors, 0.95), percentile(height_errors, 1));
+	printf("yaw error [deg]     median %.2f  95%% %.2f  max %.2f\n", percentile(yaw_errors, 0.5),
+	       percentile(yaw_errors, 0.95), percentile(yaw_errors, 1));
+	printf("frame time [ms]     median %.2f  95%% %.2f  max %.2f,  %.1f frames/s in total\n", percentile(times, 0.5),
+	       percentile(times, 0.95), percentile(times, 1), 1000.0 * results.size() / wall);
+	return 0;
+}
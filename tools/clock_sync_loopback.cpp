@@ -0,0 +1,301 @@
+// runs the clock synchronization (clock_sync.cpp) on localhost: a master process and several drone processes
+// with shifted and drifting clocks, all the packets go through a relay that delays them (base + random jitter,
+// optionally asymmetric) and drops some; each drone compares its synchronized clock with the real master clock,
+// and the skew of starting at the arrival of the START message over the same network is printed for comparison
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o clock_sync_loopback clock_sync_loopback.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/clock_sync.cpp -lpthread
+//
+// usage:    clock_sync_loopback [options]
+//
+//   -drones N       drone processes besides the master, default 4
+//   -port P         master port, the relay uses P+1..P+N, default 9100
+//   -duration s     default 30
+//   -rate Hz        requests per second of each drone, default 4
+//   -delay ms       one-way delay of every packet, default 2
+//   -jitter ms      mean of the random extra delay (exponential, as Wi-Fi retransmissions), default 5
+//   -asymmetry ms   extra delay of the requests only, default 0
+//   -loss f         fraction of the packets dropped, default 0.05
+//   -offset ms      the drone clocks are up to this far from the master, default 500
+//   -drift ppm      and up to this much faster or slower, default 100
+//   -tolerance ms   largest acceptable p95 error of a synchronized drone, default 2
+//   -seed S
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <vector>
+#include "clock_sync.h"
+
+static int drones = 4, port = 9100, seed = 1;
+static float duration = 30, rate = 4, base_delay = 2, jitter = 5, asymmetry = 0, loss = 0.05f;
+static float max_offset = 500, max_drift = 100, tolerance = 2;
+
+static int64_t monotonic_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double wall_clock_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int udp_socket(int bind_port)
+{
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(bind_port);
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((s < 0) || (bind(s, (const sockaddr *)&a, sizeof(a)) < 0))
+	{
+		perror("relay socket");
+		exit(1);
+	}
+	return s;
+}
+
+// one-way delay of a packet in ms, < 0 = lost
+static float network_delay(std::mt19937 &rng, int request)
+{
+	if (std::uniform_real_distribution<float>(0, 1)(rng) < loss) return -1;
+	float extra = (jitter > 0) ? std::exponential_distribution<float>(1.0f / jitter)(rng) : 0;
+	return base_delay + extra + (request ? asymmetry : 0);
+}
+
+// a drone: its clock is shifted and drifts, it follows the master through its relay port
+static int run_drone(int k)
+{
+	std::mt19937 rng(seed * 1000 + k);
+	double offset = std::uniform_real_distribution<double>(-max_offset, max_offset)(rng);
+	double drift = std::uniform_real_distribution<double>(-max_drift, max_drift)(rng);
+	clock_sync_simulate(offset, drift);
+	if (!clock_sync_follow("127.0.0.1", port + 1 + k, rate))
+	{
+		fprintf(stderr, "drone %d: clock sync not started\n", k);
+		return 1;
+	}
+
+	// the master runs the real wall clock, so the error is the synchronized time - the real one
+	std::vector<double> errors;
+	double synchronized_after = -1;
+	int64_t start = monotonic_us();
+	while (monotonic_us() - start < (int64_t)(duration * 1e6))
+	{
+		usleep(20000);
+		clock_sync_status s = clock_sync_get_status();
+		double t = (monotonic_us() - start) / 1e6;
+		if (!s.synchronized) continue;
+		if (synchronized_after < 0) synchronized_after = t;
+		if (t > synchronized_after + 2) errors.push_back(clock_sync_now_ms() - wall_clock_ms());
+	}
+	clock_sync_status s = clock_sync_get_status();
+	clock_sync_stop();
+	if (errors.empty())
+	{
+		printf("drone %d: NOT SYNCHRONIZED (%u requests, %u replies)\n", k, s.requests, s.replies);
+		return 1;
+	}
+
+	std::vector<double> magnitude;
+	double mean = 0;
+	for (double e : errors)
+	{
+		mean += e;
+		magnitude.push_back(fabs(e));
+	}
+	mean /= errors.size();
+	std::sort(magnitude.begin(), magnitude.end());
+	double p95 = magnitude[(size_t)(0.95 * (magnitude.size() - 1))];
+	printf("drone %d: clock %+.1f ms %+.0f ppm, synchronized after %.2f s, error mean %+.3f ms, p95 %.3f ms, max %.3f ms, "
+	       "drift %+.0f ppm, %d of %u replies used, shortest round trip %.2f ms\n", k, offset, drift, synchronized_after,
+	       mean, p95, magnitude.back(), -s.drift_ppm, s.samples, s.replies, s.delay_ms);
+	fflush(stdout);
+	return (p95 > tolerance) ? 1 : 0;
+}
+
+struct delayed_packet
+{
+	int64_t due;
+	int fd;
+	sockaddr_in to;
+	clock_sync_packet p;
+	bool operator<(const delayed_packet &o) const { return due > o.due; }
+};
+
+// the network: requests from drone k come to port+1+k and go on to the master from its own socket,
+// so that the replies find the way back
+static void run_relay()
+{
+	std::mt19937 rng(seed);
+	std::vector<int> drone_side(drones), master_side(drones);
+	std::vector<sockaddr_in> drone_address(drones);
+	std::vector<int> heard(drones, 0);
+	for (int k = 0; k < drones; k++)
+	{
+		drone_side[k] = udp_socket(port + 1 + k);
+		master_side[k] = udp_socket(0);
+	}
+	sockaddr_in master;
+	memset(&master, 0, sizeof(master));
+	master.sin_family = AF_INET;
+	master.sin_port = htons(port);
+	master.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	std::priority_queue<delayed_packet> queue;
+	std::vector<pollfd> fds;
+	for (int k = 0; k < drones; k++)
+	{
+		fds.push_back(pollfd{ drone_side[k], POLLIN, 0 });
+		fds.push_back(pollfd{ master_side[k], POLLIN, 0 });
+	}
+	int64_t end = monotonic_us() + (int64_t)((duration + 1) * 1e6);
+	while (monotonic_us() < end)
+	{
+		int64_t now = monotonic_us();
+		while (!queue.empty() && (queue.top().due <= now))
+		{
+			const delayed_packet &d = queue.top();
+			sendto(d.fd, &d.p, sizeof(d.p), 0, (const sockaddr *)&d.to, sizeof(d.to));
+			queue.pop();
+		}
+		int wait_ms = queue.empty() ? 10 : (int)std::min<int64_t>(10, (queue.top().due - now + 999) / 1000);
+		if (poll(fds.data(), fds.size(), wait_ms) <= 0) continue;
+		for (int k = 0; k < drones; k++)
+		{
+			for (int side = 0; side < 2; side++)
+			{
+				if (!(fds[2 * k + side].revents & POLLIN)) continue;
+				delayed_packet d;
+				sockaddr_in from;
+				socklen_t from_len = sizeof(from);
+				if (recvfrom(fds[2 * k + side].fd, &d.p, sizeof(d.p), 0, (sockaddr *)&from, &from_len) != sizeof(d.p)) continue;
+				float delay = network_delay(rng, side == 0);
+				if (delay < 0) continue;
+				d.due = monotonic_us() + (int64_t)(delay * 1000);
+				if (side == 0)
+				{
+					drone_address[k] = from;
+					heard[k] = 1;
+					d.fd = master_side[k];
+					d.to = master;
+				}
+				else
+				{
+					if (!heard[k]) continue;
+					d.fd = drone_side[k];
+					d.to = drone_address[k];
+				}
+				queue.push(d);
+			}
+		}
+	}
+	for (int k = 0; k < drones; k++)
+	{
+		close(drone_side[k]);
+		close(master_side[k]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] != '-') || (i + 1 >= argc))
+		{
+			fprintf(stderr, "usage: clock_sync_loopback [-drones N] [-port P] [-duration s] [-rate Hz] [-delay ms] [-jitter ms] "
+			                "[-asymmetry ms] [-loss f] [-offset ms] [-drift ppm] [-tolerance ms] [-seed S]\n");
+			return 1;
+		}
+		const char *opt = argv[i], *val = argv[++i];
+		if (strcmp(opt, "-drones") == 0) drones = atoi(val);
+		else if (strcmp(opt, "-port") == 0) port = atoi(val);
+		else if (strcmp(opt, "-duration") == 0) duration = atof(val);
+		else if (strcmp(opt, "-rate") == 0) rate = atof(val);
+		else if (strcmp(opt, "-delay") == 0) base_delay = atof(val);
+		else if (strcmp(opt, "-jitter") == 0) jitter = atof(val);
+		else if (strcmp(opt, "-asymmetry") == 0) asymmetry = atof(val);
+		else if (strcmp(opt, "-loss") == 0) loss = atof(val);
+		else if (strcmp(opt, "-offset") == 0) max_offset = atof(val);
+		else if (strcmp(opt, "-drift") == 0) max_drift = atof(val);
+		else if (strcmp(opt, "-tolerance") == 0) tolerance = atof(val);
+		else if (strcmp(opt, "-seed") == 0) seed = atoi(val);
+		else fprintf(stderr, "unknown option %s\n", opt);
+	}
+	if ((drones < 1) || (duration < 5) || (rate <= 0))
+	{
+		fprintf(stderr, "need at least 1 drone, 5 s and a positive rate\n");
+		return 1;
+	}
+
+	// starting at the arrival of START: each drone gets it after its own one-way delay (TCP retransmits instead of losing)
+	std::mt19937 rng(seed + 7);
+	std::vector<double> skews;
+	for (int start = 0; start < 1000; start++)
+	{
+		float lo = INFINITY, hi = -INFINITY;
+		for (int k = 0; k < drones; k++)
+		{
+			float d;
+			do d = network_delay(rng, 0); while (d < 0);
+			lo = std::min(lo, d);
+			hi = std::max(hi, d);
+		}
+		skews.push_back(hi - lo);
+	}
+	std::sort(skews.begin(), skews.end());
+	printf("start at the arrival of START: skew between the drones median %.1f ms, p95 %.1f ms\n",
+	       skews[skews.size() / 2], skews[(size_t)(0.95 * (skews.size() - 1))]);
+	fflush(stdout);
+
+	pid_t master = fork();
+	if (master == 0)
+	{
+		if (!clock_sync_serve(port))
+		{
+			fprintf(stderr, "master: clock sync not started\n");
+			_exit(1);
+		}
+		usleep((useconds_t)((duration + 2) * 1e6));
+		clock_sync_stop();
+		_exit(0);
+	}
+	std::vector<pid_t> children;
+	for (int k = 0; k < drones; k++)
+	{
+		pid_t pid = fork();
+		if (pid == 0) _exit(run_drone(k));
+		children.push_back(pid);
+	}
+	run_relay();
+
+	int failed = 0;
+	for (pid_t pid : children)
+	{
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) failed++;
+	}
+	kill(master, SIGTERM);
+	waitpid(master, 0, 0);
+	printf("%d of %d drones synchronized within %.1f ms (p95)\n", drones - failed, drones, tolerance);
+	return failed ? 1 : 0;
+}
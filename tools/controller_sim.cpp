@@ -0,0 +1,230 @@
+// point-mass drone simulation of the native position controller (position_controller.cpp) following a procedure,
+// compared with the P-control of posCommand in MainActivity (latest POS sample every 100 ms)
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o controller_sim controller_sim.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/position_controller.cpp ../app/src/main/cpp/trajectory_interpolator.cpp
+//               ../app/src/main/cpp/dance_bundle.cpp ../app/src/main/cpp/clock_sync.cpp -lpthread
+//
+// usage:    controller_sim [options] procedure_file
+//
+//   procedure_file: one procedure in the dance format (e.g. trajectory-generation/nes/VERTICAL_LOOP_NORTH),
+//                   POS commands are taken as absolute positions
+//   -rate Hz        rate of the native controller, default 50
+//   -latency ms     age of the pose when it arrives from localization, default 100
+//   -fps F          localization frames per second, default 15
+//   -noise m        standard deviation of the position noise, default 0.02
+//   -jitter ms      random delay of the main looper (UI load) for the legacy control, default 0
+//   -hspeed m/s     horizontal speed limit, default 0.3 (as in MainActivity)
+//   -vspeed m/s     vertical speed limit, default 1.0
+//   -trace file     csv with time, target and both simulated positions
+//   -seed S
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "position_controller.h"
+
+// velocity loop of the drone: the velocity follows the command as a first order system
+static const double VELOCITY_TIME_CONSTANT = 0.35;   // s
+static const double YAW_RATE_TIME_CONSTANT = 0.2;    // s
+static const double SIM_STEP = 0.001;                // s
+
+struct sim_drone
+{
+	double x, y, z, yaw;
+	double vx = 0, vy = 0, vz = 0, yaw_rate = 0;   // world, rad/s CCW
+
+	void apply(const stick_command &cmd, double dt)
+	{
+		// body -> world (inverse of the rotation in posCommand)
+		double c = cos(-yaw), s = sin(-yaw);
+		double wvx = cmd.pitch * s + cmd.roll * c;
+		double wvy = cmd.pitch * c - cmd.roll * s;
+		double target_yaw_rate = -cmd.yaw_rate * M_PI / 180.0;
+
+		double a = dt / VELOCITY_TIME_CONSTANT;
+		vx += (wvx - vx) * a;
+		vy += (wvy - vy) * a;
+		vz += (cmd.vertical - vz) * a;
+		yaw_rate += (target_yaw_rate - yaw_rate) * dt / YAW_RATE_TIME_CONSTANT;
+		x += vx * dt;
+		y += vy * dt;
+		z += vz * dt;
+		yaw += yaw_rate * dt;
+	}
+};
+
+// posCommand of MainActivity (without the relative mode)
+static stick_command legacy_command(const trajectory_pose &camera, const trajectory_pose &target, double horizontal_speed, double vertical_speed)
+{
+	double delta_yaw = camera.yaw - target.yaw;
+	if (delta_yaw > M_PI * 2) delta_yaw -= M_PI * 2;
+	if (delta_yaw < 0) delta_yaw += M_PI * 2;
+	if (delta_yaw > M_PI) delta_yaw -= M_PI * 2;
+	delta_yaw = delta_yaw / M_PI * 180.0;
+
+	double delta_alt = target.z - camera.z;
+	if (delta_alt > vertical_speed) delta_alt = vertical_speed;
+	else if (delta_alt < -vertical_speed) delta_alt = -vertical_speed;
+
+	double world_vely = target.y - camera.y;
+	double world_velx = target.x - camera.x;
+	double delta_pitch = world_vely * cos(-camera.yaw) + world_velx * sin(-camera.yaw);
+	double delta_roll = -world_vely * sin(-camera.yaw) + world_velx * cos(-camera.yaw);
+	delta_pitch = fmax(-horizontal_speed, fmin(horizontal_speed, delta_pitch));
+	delta_roll = fmax(-horizontal_speed, fmin(horizontal_speed, delta_roll));
+
+	if ((fabs(delta_pitch) > horizontal_speed / 2.0) || (fabs(delta_roll) > horizontal_speed / 2.0))
+		delta_yaw = fmax(-30.0, fmin(30.0, delta_yaw));
+	else delta_yaw = fmax(-60.0, fmin(60.0, delta_yaw));
+
+	return stick_command{ (float)delta_roll, (float)delta_pitch, (float)delta_yaw, (float)delta_alt };
+}
+
+static int load_procedure(const char *filename, std::vector<int32_t> &times, std::vector<trajectory_pose> &poses)
+{
+	FILE *f = fopen(filename, "r");
+	if (!f)
+	{
+		perror("Cannot open procedure file");
+		return 0;
+	}
+	char ln[1000];
+	while (fgets(ln, 1000, f))
+	{
+		int t;
+		char cmd[100];
+		trajectory_pose p;
+		if ((sscanf(ln, "%d %99s %f %f %f %f", &t, cmd, &p.x, &p.y, &p.z, &p.yaw) == 6) && (strcasecmp(cmd, "POS") == 0))
+		{
+			times.push_back(t);
+			poses.push_back(p);
+		}
+	}
+	fclose(f);
+	return times.size();
+}
+
+struct error_stats
+{
+	double sum2 = 0, max = 0;
+	long n = 0;
+	void add(double e) { sum2 += e * e; if (e > max) max = e; n++; }
+	double rms() const { return n ? sqrt(sum2 / n) : 0; }
+};
+
+int main(int argc, char **argv)
+{
+	double rate = 50, latency = 100, fps = 15, noise = 0.02, jitter = 0;
+	controller_limits limits;
+	const char *trace_file = 0;
+	const char *procedure = 0;
+	unsigned seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *val = argv[++i];
+			if (strcmp(argv[i - 1], "-rate") == 0) rate = atof(val);
+			else if (strcmp(argv[i - 1], "-latency") == 0) latency = atof(val);
+			else if (strcmp(argv[i - 1], "-fps") == 0) fps = atof(val);
+			else if (strcmp(argv[i - 1], "-noise") == 0) noise = atof(val);
+			else if (strcmp(argv[i - 1], "-jitter") == 0) jitter = atof(val);
+			else if (strcmp(argv[i - 1], "-hspeed") == 0) limits.horizontal_speed = atof(val);
+			else if (strcmp(argv[i - 1], "-vspeed") == 0) limits.vertical_speed = atof(val);
+			else if (strcmp(argv[i - 1], "-trace") == 0) trace_file = val;
+			else if (strcmp(argv[i - 1], "-seed") == 0) seed = atoi(val);
+		}
+		else procedure = argv[i];
+	}
+	if (!procedure)
+	{
+		fprintf(stderr, "usage: controller_sim [-rate Hz] [-latency ms] [-fps F] [-noise m] [-jitter ms] [-hspeed m/s] [-vspeed m/s] [-trace file] [-seed S] procedure_file\n");
+		return 1;
+	}
+
+	std::vector<int32_t> times;
+	std::vector<trajectory_pose> poses;
+	if (!load_procedure(procedure, times, poses))
+	{
+		fprintf(stderr, "no POS commands in %s\n", procedure);
+		return 1;
+	}
+	trajectory_curve curve;
+	curve.build(times, poses);
+
+	std::mt19937 rng(seed);
+	std::normal_distribution<double> position_noise(0.0, noise);
+	std::normal_distribution<double> yaw_noise(0.0, 1.0 * M_PI / 180.0);
+	std::uniform_real_distribution<double> looper_delay(0.0, jitter);
+
+	FILE *trace = trace_file ? fopen(trace_file, "w+") : 0;
+	if (trace) fprintf(trace, "t,target_x,target_y,target_z,native_x,native_y,native_z,legacy_x,legacy_y,legacy_z\n");
+
+	// both drones start at rest in the first point, 2 s of hovering after the end
+	sim_drone drones[2];
+	for (sim_drone &d : drones) { d.x = poses[0].x; d.y = poses[0].y; d.z = poses[0].z; d.yaw = poses[0].yaw; }
+	stick_command commands[2] = { { 0, 0, 0, 0 }, { 0, 0, 0, 0 } };
+	position_controller controller;
+	error_stats errors[2];
+
+	// measured poses are delayed by the latency of the camera stream and localization
+	std::deque<std::pair<double, trajectory_pose>> pending[2];
+	trajectory_pose measured[2] = { poses[0], poses[0] };
+	double next_frame = 0, next_native = 0, next_legacy = 0;
+	double end = curve.duration() / 1000.0 + 2.0;
+
+	for (double t = 0; t < end; t += SIM_STEP)
+	{
+		if (t >= next_frame)
+		{
+			for (int k = 0; k < 2; k++)
+				pending[k].push_back({ t + latency / 1000.0, trajectory_pose{ (float)(drones[k].x + position_noise(rng)), (float)(drones[k].y + position_noise(rng)),
+				                                                              (float)(drones[k].z + position_noise(rng)), (float)(drones[k].yaw + yaw_noise(rng)) } });
+			next_frame += 1.0 / fps;
+		}
+		for (int k = 0; k < 2; k++)
+			while (!pending[k].empty() && (pending[k].front().first <= t))
+			{
+				measured[k] = pending[k].front().second;
+				pending[k].pop_front();
+			}
+
+		if (t >= next_native)
+		{
+			commands[0] = controller.step(measured[0], curve.evaluate(t * 1000.0), limits, 1.0 / rate);
+			next_native += 1.0 / rate;
+		}
+		if (t >= next_legacy)
+		{
+			// the latest POS sample whose time has come
+			size_t i = 0;
+			while ((i + 1 < times.size()) && (times[i + 1] <= t * 1000.0)) i++;
+			commands[1] = legacy_command(measured[1], poses[i], limits.horizontal_speed, limits.vertical_speed);
+			next_legacy += 0.1 + looper_delay(rng) / 1000.0;
+		}
+
+		for (int k = 0; k < 2; k++) drones[k].apply(commands[k], SIM_STEP);
+
+		trajectory_state target = curve.evaluate(t * 1000.0);
+		for (int k = 0; k < 2; k++)
+		{
+			double dx = drones[k].x - target.x, dy = drones[k].y - target.y, dz = drones[k].z - target.z;
+			errors[k].add(sqrt(dx * dx + dy * dy + dz * dz));
+		}
+		if (trace && (fmod(t, 0.02) < SIM_STEP))
+			fprintf(trace, "%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", t, target.x, target.y, target.z,
+			        drones[0].x, drones[0].y, drones[0].z, drones[1].x, drones[1].y, drones[1].z);
+	}
+	if (trace) fclose(trace);
+
+	printf("%s: %d POS, %.1f s\n", procedure, (int)times.size(), curve.duration() / 1000.0);
+	printf("native controller %5.0f Hz: rms error %.3f m, max %.3f m\n", rate, errors[0].rms(), errors[0].max);
+	printf("legacy posCommand    10 Hz: rms error %.3f m, max %.3f m\n", errors[1].rms(), errors[1].max);
+	return 0;
+}
@@ -0,0 +1,321 @@
+// predicts where the localization loses the mat along the planned flight: for each time step it projects
+// the mat corners into the camera (the model of mat_renderer) and applies the conditions of fastimglib
+// (at least two corners with a two-color pair for the yaw, at least two height candidates
+// with the corners MIN_CORNER_DISTANCE apart), the spans without a pose or with a poor one are reported
+//
+// compile:  g++ -O3 -std=c++17 -o coverage_analyzer coverage_analyzer.cpp dance_sim.cpp dance_file.cpp -I../app/src/main/cpp -lpthread
+//
+// usage:    coverage_analyzer [options] dance_1.txt dance_2.txt ...
+//           coverage_analyzer [options] -procedure file ...
+//
+//   dance files are simulated by the dance simulator (dance_sim.h), procedure files (trajectory-generation)
+//   are taken as absolute POS samples joined by straight lines
+//   -p N            performance of the dance files, default 0
+//   -start file     starting positions "K x y yaw"
+//   -device D       screen geometry of drone D (1..5, as in fastimglib.cpp), default 2
+//   -border F       corners closer to the frame edge than F * width are not counted, default 0.025
+//   -low m          flying lower than this is poor, default 1.6 (see README)
+//   -herr m         poor when the predicted height error (1 pixel corner error) is above, default 0.05
+//   -step ms        time step, default 20
+//   -min ms         report only spans at least this long, default 100
+//   -threads N      default: all cores
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "dance_sim.h"
+#include "mat_layout.h"
+
+// the same camera model as fastimglib and mat_renderer
+static const double camera_focal_length = 0.0067;   // m
+static const double default_pixel_size = 0.0000075;  // m
+static const int REFERENCE_VALID_WIDTH = 1185;
+
+// valid area (without letterbox borders) of the devices in mat_renderer
+static const int valid_sizes[][2] = { { 1770, 996 }, { 1185, 667 }, { 1770, 996 }, { 1133, 638 }, { 1717, 966 } };
+
+static const int NUM_CORNERS = 20;
+static const float world_coordinates[NUM_CORNERS][2] = MAT_WORLD_COORDINATES;
+static const int color_ids[5][4] = MAT_COLOR_IDS;
+static int corner_color[NUM_CORNERS];
+
+enum coverage { COVERAGE_OK, COVERAGE_POOR, COVERAGE_LOST, COVERAGE_NONE };
+static const char *coverage_names[] = { "ok", "poor", "no pose", "" };
+
+struct flight
+{
+	std::string name;
+	const dance_file *dance = 0;
+	std::vector<sim_sample> samples;           // only the time, pose, procedure and line are used for procedure files
+
+	// structure of arrays for the projection
+	std::vector<float> x, y, z, cos_yaw, sin_yaw;
+	std::vector<uint8_t> airborne;
+	std::vector<uint8_t> status;
+	std::vector<uint8_t> visible_corners;
+	std::vector<float> height_error;
+};
+
+static int valid_width = 1185, valid_height = 667;
+static float border = 0.025f, low = 1.6f, max_height_error = 0.05f;
+static int performance = 0;
+
+// pixels per meter at 1 m height
+static float camera_scale()
+{
+	return camera_focal_length / (default_pixel_size * REFERENCE_VALID_WIDTH / valid_width);
+}
+
+static void analyze(flight &f)
+{
+	int n = f.x.size();
+	float scale = camera_scale();
+	float half_w = valid_width * (0.5f - border), half_h = valid_height * 0.5f - valid_width * border;
+	float min_corner_distance = 0.02f * valid_width;   // MIN_CORNER_DISTANCE
+
+	// projections of all corners at all times, corner by corner (the inner loop vectorizes)
+	std::vector<float> u(NUM_CORNERS * n), v(NUM_CORNERS * n);
+	std::vector<uint32_t> visible(n, 0);
+	for (int c = 0; c < NUM_CORNERS; c++)
+	{
+		float gx = world_coordinates[c][0], gy = world_coordinates[c][1];
+		float *uc = &u[c * n], *vc = &v[c * n];
+		for (int k = 0; k < n; k++)
+		{
+			float dx = gx - f.x[k], dy = gy - f.y[k];
+			float s = scale / fmaxf(f.z[k], 0.05f);
+			uc[k] = (f.cos_yaw[k] * dx + f.sin_yaw[k] * dy) * s;
+			vc[k] = (-f.sin_yaw[k] * dx + f.cos_yaw[k] * dy) * s;
+		}
+		for (int k = 0; k < n; k++)
+			visible[k] |= (uint32_t)((fabsf(uc[k]) < half_w) & (fabsf(vc[k]) < half_h)) << c;
+	}
+
+	f.status.assign(n, COVERAGE_NONE);
+	f.visible_corners.assign(n, 0);
+	f.height_error.assign(n, 0);
+	for (int k = 0; k < n; k++)
+	{
+		if (!f.airborne[k]) continue;
+		uint32_t m = visible[k];
+		int count = __builtin_popcount(m);
+		f.visible_corners[k] = count;
+
+		int colors = 0, height_candidates = 0;
+		float longest = 0;
+		for (int i = 0; i < NUM_CORNERS; i++)
+		{
+			if (!(m & (1u << i))) continue;
+			colors |= 1 << corner_color[i];
+			for (int j = i + 1; j < NUM_CORNERS; j++)
+			{
+				if (!(m & (1u << j))) continue;
+				float du = u[i * n + k] - u[j * n + k], dv = v[i * n + k] - v[j * n + k];
+				float d = sqrtf(du * du + dv * dv);
+				if (d >= min_corner_distance) height_candidates++;
+				if (d > longest) longest = d;
+			}
+		}
+
+		int two_colors = (colors & (colors - 1)) != 0;
+		if ((count < 2) || !two_colors || (height_candidates < 2))
+		{
+			f.status[k] = COVERAGE_LOST;
+			continue;
+		}
+		// height = focal * world distance / sensor distance: one pixel on the longest baseline
+		f.height_error[k] = f.z[k] / longest;
+		f.status[k] = ((f.z[k] < low) || (f.height_error[k] > max_height_error) || (count < 3)) ? COVERAGE_POOR : COVERAGE_OK;
+	}
+}
+
+static void prepare(flight &f)
+{
+	int n = f.samples.size();
+	f.x.resize(n);
+	f.y.resize(n);
+	f.z.resize(n);
+	f.cos_yaw.resize(n);
+	f.sin_yaw.resize(n);
+	f.airborne.resize(n);
+	for (int k = 0; k < n; k++)
+	{
+		const sim_sample &s = f.samples[k];
+		f.x[k] = s.x;
+		f.y[k] = s.y;
+		f.z[k] = s.z;
+		f.cos_yaw[k] = cosf(s.yaw);
+		f.sin_yaw[k] = sinf(s.yaw);
+		f.airborne[k] = (s.phase == SIM_FLYING);
+	}
+}
+
+static bool load_procedure(const char *path, int step, flight &f)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+	{
+		perror("Cannot open procedure file");
+		return false;
+	}
+	std::vector<sim_sample> pos;
+	char ln[1000];
+	int line = 0;
+	while (fgets(ln, 1000, fp))
+	{
+		line++;
+		int t;
+		char cmd[100];
+		sim_sample s;
+		memset(&s, 0, sizeof(s));
+		if ((sscanf(ln, "%d %99s %f %f %f %f", &t, cmd, &s.x, &s.y, &s.z, &s.yaw) == 6) && (strcasecmp(cmd, "POS") == 0))
+		{
+			s.t = t;
+			s.line = line;
+			s.procedure = -1;
+			s.phase = SIM_FLYING;
+			pos.push_back(s);
+		}
+	}
+	fclose(fp);
+	if (pos.empty()) return false;
+
+	f.name = path;
+	size_t i = 0;
+	for (int t = pos[0].t; t <= pos.back().t; t += step)
+	{
+		while ((i + 1 < pos.size()) && (pos[i + 1].t <= t)) i++;
+		sim_sample s = pos[i];
+		if (i + 1 < pos.size())
+		{
+			float a = (float)(t - pos[i].t) / (pos[i + 1].t - pos[i].t);
+			s.x += (pos[i + 1].x - s.x) * a;
+			s.y += (pos[i + 1].y - s.y) * a;
+			s.z += (pos[i + 1].z - s.z) * a;
+			s.yaw += remainderf(pos[i + 1].yaw - s.yaw, 2 * M_PI) * a;
+		}
+		s.t = t;
+		f.samples.push_back(s);
+	}
+	return true;
+}
+
+static void report(const flight &f, int step, int min_span)
+{
+	int n = f.samples.size(), flying = 0, counts[3] = { 0, 0, 0 };
+	for (int k = 0; k < n; k++)
+		if (f.status[k] != COVERAGE_NONE)
+		{
+			flying++;
+			counts[f.status[k]]++;
+		}
+	printf("%s: %.1f s in the air, pose ok %.1f %%, poor %.1f %%, none %.1f %%\n", f.name.c_str(), flying * step / 1000.0,
+	       flying ? 100.0 * counts[COVERAGE_OK] / flying : 0.0, flying ? 100.0 * counts[COVERAGE_POOR] / flying : 0.0,
+	       flying ? 100.0 * counts[COVERAGE_LOST] / flying : 0.0);
+
+	for (int k = 0; k < n;)
+	{
+		int e = k;
+		while ((e < n) && (f.status[e] == f.status[k])) e++;
+		if (((f.status[k] == COVERAGE_POOR) || (f.status[k] == COVERAGE_LOST)) && ((e - k) * step >= min_span))
+		{
+			// the worst moment of the span
+			int w = k;
+			for (int j = k; j < e; j++)
+				if ((f.visible_corners[j] < f.visible_corners[w]) ||
+				    ((f.visible_corners[j] == f.visible_corners[w]) && (f.z[j] < f.z[w]))) w = j;
+			const sim_sample &s = f.samples[w];
+			std::string where = f.dance ? sim_source(*f.dance, performance, s) + ", " + f.dance->path : f.name;
+			printf("  %.2f - %.2f s: %s, %d corners at [%.2f, %.2f, %.2f], %s:%d\n", f.samples[k].t / 1000.0,
+			       (f.samples[e - 1].t + step) / 1000.0, coverage_names[f.status[k]], f.visible_corners[w],
+			       s.x, s.y, s.z, where.c_str(), s.line);
+		}
+		k = e;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	sim_model model;
+	int threads = 0, min_span = 100, device = 2;
+	const char *start_file = 0;
+	std::vector<const char *> dance_inputs, procedure_inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-p") == 0) performance = atoi(val);
+			else if (strcmp(opt, "-start") == 0) start_file = val;
+			else if (strcmp(opt, "-device") == 0) device = atoi(val);
+			else if (strcmp(opt, "-border") == 0) border = atof(val);
+			else if (strcmp(opt, "-low") == 0) low = atof(val);
+			else if (strcmp(opt, "-herr") == 0) max_height_error = atof(val);
+			else if (strcmp(opt, "-step") == 0) model.trace_step = atoi(val);
+			else if (strcmp(opt, "-min") == 0) min_span = atoi(val);
+			else if (strcmp(opt, "-threads") == 0) threads = atoi(val);
+			else if (strcmp(opt, "-procedure") == 0) procedure_inputs.push_back(val);
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else dance_inputs.push_back(argv[i]);
+	}
+	if ((dance_inputs.empty() && procedure_inputs.empty()) || (device < 1) || (device > 5) || (model.trace_step <= 0))
+	{
+		fprintf(stderr, "usage: coverage_analyzer [-p N] [-start file] [-device D] [-border F] [-low m] [-herr m] [-step ms] [-min ms] [-threads N] "
+		                "dance_1.txt ... | -procedure file ...\n");
+		return 1;
+	}
+	valid_width = valid_sizes[device - 1][0];
+	valid_height = valid_sizes[device - 1][1];
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	for (int c = 0; c < 5; c++)
+		for (int i = 0; i < 4; i++) corner_color[color_ids[c][i]] = c;
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::vector<dance_file> dances(dance_inputs.size());
+	for (size_t i = 0; i < dance_inputs.size(); i++)
+		if (!load_dance_file(dance_inputs[i], dances[i])) return 1;
+	std::map<int, sim_start> starts;
+	if (start_file && !load_starting_positions(start_file, starts)) return 1;
+
+	std::vector<flight> flights(dances.size());
+	std::vector<sim_result> results = simulate_all(dances, performance, starts, model, threads);
+	for (size_t i = 0; i < dances.size(); i++)
+	{
+		flights[i].name = "drone " + std::to_string(dances[i].drone_id);
+		flights[i].dance = &dances[i];
+		flights[i].samples.swap(results[i].trace);
+	}
+	for (const char *p : procedure_inputs)
+	{
+		flights.emplace_back();
+		if (!load_procedure(p, model.trace_step, flights.back()))
+		{
+			fprintf(stderr, "no POS commands in %s\n", p);
+			return 1;
+		}
+	}
+
+	std::atomic<int> next(0);
+	std::vector<std::thread> pool;
+	for (int k = 0; k < threads; k++)
+		pool.emplace_back([&]() {
+			for (int i = next++; i < (int)flights.size(); i = next++)
+			{
+				prepare(flights[i]);
+				analyze(flights[i]);
+			}
+		});
+	for (std::thread &th : pool) th.join();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	for (const flight &f : flights) report(f, model.trace_step, min_span);
+	printf("%d flights, %.3f s\n", (int)flights.size(), elapsed);
+	return 0;
+}
@@ -0,0 +1,156 @@
+// compiles dance_K.txt files (format described in Dance.kt) into one binary bundle (format in dance_bundle.h)
+// that the app memory-maps instead of parsing the text files at startup
+//
+// compile:  g++ -O2 -std=c++17 -o dance_compiler dance_compiler.cpp dance_file.cpp -I../app/src/main/cpp
+//
+// usage:    dance_compiler -o dances.bin dance_0.txt dance_1.txt ... dance_6.txt
+//
+//   the drone id K is taken from the file name (dance_K.txt), then install like the text files:
+//     adb push dances.bin /data/local/tmp/
+//     adb shell "run-as sk.uniba.krucena cp /data/local/tmp/dances.bin files/"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "dance_file.h"
+
+static const char *file_name;   // of the dance being written, for messages
+
+static uint32_t add_string(std::vector<char> &strings, const std::string &s)
+{
+	uint32_t offset = strings.size();
+	strings.insert(strings.end(), s.begin(), s.end());
+	strings.push_back(0);
+	return offset;
+}
+
+static void add_block(const dance_block &b, std::vector<dance_bundle_block> &blocks, std::vector<dance_record> &records,
+                      std::vector<char> &strings, const std::map<std::string, int> &procedure_blocks)
+{
+	dance_bundle_block bb;
+	bb.first_record = records.size();
+	bb.num_records = b.records.size();
+	bb.landing_time = b.landing_time;
+	bb.name = b.name.empty() ? DANCE_BUNDLE_NO_NAME : add_string(strings, b.name);
+	bb.first_procedure = 0;
+	bb.num_procedures = 0;
+
+	int previous = 0;
+	for (size_t i = 0; i < b.records.size(); i++)
+	{
+		dance_record r = b.records[i];
+		r.dt = b.times[i] - previous;
+		previous = b.times[i];
+		if (r.kind == DANCE_RUN)
+		{
+			// procedures inside procedures are not supported (Dance.kt looks them up in the procedure itself)
+			auto it = procedure_blocks.find(b.run_names[i]);
+			if (b.name.empty() && (it != procedure_blocks.end())) r.aux = it->second;
+			else
+			{
+				r.aux = DANCE_BUNDLE_UNRESOLVED;
+				fprintf(stderr, "%s: unresolved RUN %s in %s\n", file_name, b.run_names[i].c_str(), b.name.empty() ? "performance" : b.name.c_str());
+			}
+		}
+		records.push_back(r);
+	}
+	blocks.push_back(bb);
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = 0;
+	std::vector<const char *> inputs;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) output = argv[++i];
+		else inputs.push_back(argv[i]);
+	}
+	if (!output || inputs.empty())
+	{
+		fprintf(stderr, "usage: dance_compiler -o dances.bin dance_0.txt dance_1.txt ...\n");
+		return 1;
+	}
+
+	std::vector<dance_file> files(inputs.size());
+	int failed = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+		if (!load_dance_file(inputs[i], files[i])) failed++;
+	if (failed || dance_file_errors())
+	{
+		fprintf(stderr, "%d errors, no output written\n", failed + dance_file_errors());
+		return 1;
+	}
+
+	std::vector<dance_bundle_dance> dances;
+	std::vector<dance_bundle_block> blocks;
+	std::vector<dance_record> records;
+	std::vector<char> strings;
+
+	for (dance_file &d : files)
+	{
+		file_name = inputs[&d - &files[0]];
+
+		// performances first (consecutive blocks), then the procedures of each
+		dance_bundle_dance bd = { d.drone_id, (uint32_t)blocks.size(), (uint32_t)d.performances.size(), 0 };
+		dances.push_back(bd);
+
+		uint32_t next_block = blocks.size() + d.performances.size();
+		std::vector<uint32_t> first_procedure;
+		std::vector<std::map<std::string, int>> procedure_blocks(d.performances.size());
+		for (size_t p = 0; p < d.performances.size(); p++)
+		{
+			first_procedure.push_back(next_block);
+			// when a procedure is defined twice, the later definition wins (as in the HashMap of Dance.kt)
+			for (size_t j = 0; j < d.performances[p].procedures.size(); j++)
+				procedure_blocks[p][d.performances[p].procedures[j].name] = next_block + j;
+			next_block += d.performances[p].procedures.size();
+		}
+
+		for (size_t p = 0; p < d.performances.size(); p++)
+		{
+			add_block(d.performances[p].main, blocks, records, strings, procedure_blocks[p]);
+			blocks.back().first_procedure = first_procedure[p];
+			blocks.back().num_procedures = d.performances[p].procedures.size();
+		}
+		for (size_t p = 0; p < d.performances.size(); p++)
+			for (const dance_block &b : d.performances[p].procedures)
+				add_block(b, blocks, records, strings, procedure_blocks[p]);
+	}
+
+	if (blocks.size() > DANCE_BUNDLE_UNRESOLVED)
+	{
+		fprintf(stderr, "too many procedures\n");
+		return 1;
+	}
+
+	dance_bundle_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, DANCE_BUNDLE_MAGIC, 4);
+	h.version = DANCE_BUNDLE_VERSION;
+	h.num_dances = dances.size();
+	h.num_blocks = blocks.size();
+	h.num_records = records.size();
+	h.strings_size = strings.size();
+
+	FILE *f = fopen(output, "wb");
+	if (!f)
+	{
+		perror("Cannot open output file");
+		return 1;
+	}
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(dances.data(), sizeof(dance_bundle_dance), dances.size(), f);
+	fwrite(blocks.data(), sizeof(dance_bundle_block), blocks.size(), f);
+	fwrite(records.data(), sizeof(dance_record), records.size(), f);
+	fwrite(strings.data(), 1, strings.size(), f);
+	fclose(f);
+
+	printf("%s: %d dances, %d blocks, %d commands, %ld bytes\n", output, (int)dances.size(), (int)blocks.size(), (int)records.size(),
+	       (long)(sizeof(h) + dances.size() * sizeof(dance_bundle_dance) + blocks.size() * sizeof(dance_bundle_block) +
+	              records.size() * sizeof(dance_record) + strings.size()));
+	return 0;
+}
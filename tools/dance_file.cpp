@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "dance_file.h"
+
+static const char *file_name;
+static int line_number;
+static int errors = 0;
+
+int dance_file_errors()
+{
+	return errors;
+}
+
+static void warning(const char *msg, const std::string &what)
+{
+	fprintf(stderr, "%s:%d: %s %s\n", file_name, line_number, msg, what.c_str());
+}
+
+static void error(const char *msg, const std::string &what)
+{
+	warning(msg, what);
+	errors++;
+}
+
+static std::vector<std::string> split_upper(const std::string &line)
+{
+	std::vector<std::string> tokens;
+	std::string tok;
+	for (char c : line)
+	{
+		if (isspace((unsigned char)c))
+		{
+			if (!tok.empty()) tokens.push_back(tok);
+			tok.clear();
+		}
+		else tok += toupper((unsigned char)c);
+	}
+	if (!tok.empty()) tokens.push_back(tok);
+	return tokens;
+}
+
+static int to_int(const std::string &s, int default_value)
+{
+	char *end;
+	long v = strtol(s.c_str(), &end, 10);
+	if (s.empty() || *end) return default_value;
+	return (int)v;
+}
+
+static float arg(const std::vector<std::string> &ln, size_t i)
+{
+	if (i >= ln.size())
+	{
+		error("missing argument of", ln[1]);
+		return 0.0f;
+	}
+	char *end;
+	float v = strtof(ln[i].c_str(), &end);
+	if (*end) error("not a number:", ln[i]);
+	return v;
+}
+
+// each dance and procedure starts with None command so that the processCommand has something to do (as in Dance.kt)
+static void start_block(dance_block &b)
+{
+	dance_record none = { 0, DANCE_NONE, 0, 0, { 0, 0, 0, 0 } };
+	b.records.push_back(none);
+	b.times.push_back(0);
+	b.run_names.push_back("");
+	b.lines.push_back(0);
+}
+
+static void append(dance_block &b, int time, uint8_t kind, uint8_t flags = 0, float a0 = 0, float a1 = 0, float a2 = 0, float a3 = 0)
+{
+	dance_record r = { 0, kind, flags, 0, { a0, a1, a2, a3 } };
+	b.records.push_back(r);
+	b.times.push_back(time);
+	b.run_names.push_back("");
+	b.lines.push_back(line_number);
+}
+
+// mirrors Dance.loadDance(): reads one performance, up to its END command
+static bool load_performance(const std::vector<std::string> &lines, size_t &lnInd, dance_performance &perf)
+{
+	start_block(perf.main);
+	dance_block *current = &perf.main;
+	int last_time = 0, save_last_time = 0;
+
+	while (lnInd < lines.size())
+	{
+		line_number = lnInd + 1;
+		const std::string &line = lines[lnInd++];
+		if (line.empty() || (line[0] == '#')) continue;
+
+		std::vector<std::string> ln = split_upper(line);
+		if (ln.empty()) continue;
+
+		int step_time = to_int(ln[0], -1);
+		if ((step_time < last_time) && (step_time >= 0)) warning("time is decreasing", "");
+		last_time = step_time;
+
+		if (ln[0] == "PROCEDURE")
+		{
+			if (ln.size() < 2) { error("missing name of", "PROCEDURE"); continue; }
+			perf.procedures.emplace_back();
+			current = &perf.procedures.back();
+			current->name = ln[1];
+			start_block(*current);
+			save_last_time = last_time;
+			last_time = 0;
+			continue;
+		}
+		if (ln[0] == "ENDP")
+		{
+			current = &perf.main;
+			last_time += save_last_time;
+			continue;
+		}
+		if (ln.size() < 2) { error("missing command", ""); continue; }
+
+		const std::string &cmd = ln[1];
+		if (cmd == "LEDS")
+			append(*current, step_time, DANCE_LEDS, (ln.size() > 2) && (ln[2] == "ON"));
+		else if ((cmd == "POS") || (cmd == "REFPOINT") || (cmd == "RELATIVE"))
+			append(*current, step_time, (cmd == "POS") ? DANCE_POS : (cmd == "REFPOINT") ? DANCE_REFPOINT : DANCE_RELATIVE, 0,
+			       arg(ln, 2), arg(ln, 3), arg(ln, 4), arg(ln, 5));
+		else if (cmd == "FLY")
+		{
+			if (ln.size() < 10) { error("FLY needs 8 arguments", ""); continue; }
+			int alt_mode = (ln[6] == "ALT_M") ? 0 : 1;
+			int rp_mode = (ln[7] == "RP_DEG") ? 0 : (ln[7] == "RP_VELO") ? 1 : 2;
+			int yaw_mode = (ln[8] == "Y_DEG") ? 0 : 1;
+			int coord_system = (ln[9] == "GROUND") ? 0 : 1;
+			append(*current, step_time, DANCE_FLY, DANCE_FLY_FLAGS(alt_mode, rp_mode, yaw_mode, coord_system),
+			       arg(ln, 2), arg(ln, 3), arg(ln, 4), arg(ln, 5));
+		}
+		else if (cmd == "TAKEOFF") append(*current, step_time, DANCE_TAKEOFF);
+		else if (cmd == "LAND")
+		{
+			append(*current, step_time, DANCE_LAND);
+			current->landing_time = step_time;
+		}
+		else if (cmd == "RUN")
+		{
+			if (ln.size() < 3) { error("missing procedure name of", "RUN"); continue; }
+			append(*current, step_time, DANCE_RUN);
+			current->run_names.back() = ln[2];
+		}
+		else if (cmd == "ABSOLUTE") append(*current, step_time, DANCE_ABSOLUTE);
+		else if (cmd == "HSPEED") append(*current, step_time, DANCE_HSPEED, 0, arg(ln, 2));
+		else if (cmd == "VSPEED") append(*current, step_time, DANCE_VSPEED, 0, arg(ln, 2));
+		else if (cmd == "END")
+		{
+			append(*current, step_time, DANCE_END);
+			return true;
+		}
+		else warning("ignoring unrecognized command", cmd);
+	}
+	error("missing END of performance", "");
+	return false;
+}
+
+bool load_dance_file(const char *path, dance_file &d)
+{
+	file_name = path;
+	d.path = path;
+	const char *base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	if (sscanf(base, "dance_%d", &d.drone_id) != 1)
+	{
+		fprintf(stderr, "%s: file name should be dance_K.txt\n", path);
+		return false;
+	}
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror("Cannot open dance file");
+		return false;
+	}
+	std::vector<std::string> lines;
+	char buf[4096];
+	while (fgets(buf, sizeof(buf), f))
+	{
+		std::string s(buf);
+		while (!s.empty() && ((s.back() == '\n') || (s.back() == '\r'))) s.pop_back();
+		lines.push_back(s);
+	}
+	fclose(f);
+
+	size_t lnInd = 0;
+	int number_of_performances = -1;
+	while (lnInd < lines.size())
+	{
+		line_number = lnInd + 1;
+		std::vector<std::string> first = split_upper(lines[lnInd++]);
+		if (first.empty() || (first[0][0] == '#')) continue;
+		if ((first.size() < 3) || (first[0] != "NUMBER_OF_PERFORMANCES") || (first[1] != "="))
+		{
+			error("dance file should start with 'number_of_performances = N'", "");
+			return false;
+		}
+		number_of_performances = to_int(first[2], -1);
+		break;
+	}
+	if (number_of_performances < 0) return false;
+
+	for (int perf = 0; perf < number_of_performances; perf++)
+	{
+		d.performances.emplace_back();
+		if (!load_performance(lines, lnInd, d.performances.back())) return false;
+	}
+	return true;
+}
+
+const dance_block *dance_performance::find_procedure(const std::string &name) const
+{
+	for (size_t i = procedures.size(); i > 0; i--)
+		if (procedures[i - 1].name == name) return &procedures[i - 1];
+	return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef DANCE_FILE_H
+#define DANCE_FILE_H
+
+// parser of dance_K.txt files (format described in Dance.kt), shared by the Linux tools,
+// the commands are stored as records of the dance bundle (dance_bundle.h)
+
+#include <string>
+#include <vector>
+#include "dance_bundle.h"
+
+struct dance_block
+{
+	std::vector<dance_record> records;
+	std::vector<int> times;              // absolute (ms from the start of the block)
+	std::vector<std::string> run_names;  // procedure names of RUN records (by record index)
+	std::vector<int> lines;              // line numbers in the dance file (by record index, 0 for the initial NONE)
+	int landing_time = 0;
+	std::string name;                    // procedure name, empty for a performance
+};
+
+struct dance_performance
+{
+	dance_block main;
+	std::vector<dance_block> procedures;
+
+	// when a procedure is defined twice, the later definition wins (as in the HashMap of Dance.kt)
+	const dance_block *find_procedure(const std::string &name) const;
+};
+
+struct dance_file
+{
+	int drone_id;
+	std::string path;
+	std::vector<dance_performance> performances;
+};
+
+// the drone id K is taken from the file name (dance_K.txt), errors and warnings are printed to stderr
+bool load_dance_file(const char *path, dance_file &d);
+// number of errors in all the files loaded so far
+int dance_file_errors();
+
+#endif
@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <deque>
+#include <set>
+#include <thread>
+#include "dance_sim.h"
+
+struct sim_pose
+{
+	float x, y, z, yaw;
+};
+
+// what is sent in VirtualStickFlightControlParam
+struct sim_command
+{
+	float roll = 0, pitch = 0, yaw = 0, vertical = 0;
+	int alt_position = 0, rp_angle = 0, yaw_angle = 0, ground = 0;
+};
+
+// commands not repeated for this long are not followed anymore by the aircraft (it hovers)
+static const int STICK_TIMEOUT = 500;      // ms
+// a command executed later than this after its time is reported
+static const int LATE_COMMAND = 150;       // ms
+
+static float clamp(float v, float limit)
+{
+	if (v > limit) return limit;
+	if (v < -limit) return -limit;
+	return v;
+}
+
+// posCommand of MainActivity: P-control clamped by HSPEED/VSPEED, yaw rate limited while moving fast
+static sim_command pos_command(const sim_pose &camera, const sim_pose &target, double horizontal_speed, double vertical_speed)
+{
+	float delta_yaw = camera.yaw - target.yaw;
+	if (delta_yaw > M_PI * 2) delta_yaw -= M_PI * 2;
+	if (delta_yaw < 0) delta_yaw += M_PI * 2;
+	if (delta_yaw > M_PI) delta_yaw -= M_PI * 2;
+	delta_yaw = delta_yaw / M_PI * 180.0f;
+
+	float world_vely = target.y - camera.y;
+	float world_velx = target.x - camera.x;
+
+	sim_command cmd;
+	cmd.vertical = clamp(target.z - camera.z, vertical_speed);
+	cmd.pitch = clamp(world_vely * cosf(-camera.yaw) + world_velx * sinf(-camera.yaw), horizontal_speed);
+	cmd.roll = clamp(-world_vely * sinf(-camera.yaw) + world_velx * cosf(-camera.yaw), horizontal_speed);
+	if ((fabsf(cmd.pitch) > horizontal_speed / 2.0) || (fabsf(cmd.roll) > horizontal_speed / 2.0))
+		cmd.yaw = clamp(delta_yaw, 30.0f);
+	else cmd.yaw = clamp(delta_yaw, 60.0f);
+	return cmd;
+}
+
+// RELATIVE mode of posCommand: the displacement from the REFPOINT is rotated and moved to the RELATIVE position
+static sim_pose resolve_relative(const sim_pose &pos, const sim_pose &reference, const sim_pose &relative)
+{
+	float delta_yaw = relative.yaw - reference.yaw;
+	float dx = pos.x - reference.x;
+	float dy = pos.y - reference.y;
+	return sim_pose{ relative.x + dx * cosf(delta_yaw) - dy * sinf(delta_yaw),
+	                 relative.y + dx * sinf(delta_yaw) + dy * cosf(delta_yaw),
+	                 relative.z + pos.z - reference.z,
+	                 relative.yaw + pos.yaw - reference.yaw };
+}
+
+struct sim_drone
+{
+	double x, y, z = 0, yaw;
+	double vx = 0, vy = 0, vz = 0, yaw_rate = 0;   // world, yaw rate in rad/s CCW
+	int phase = SIM_GROUND;
+
+	void step(const sim_command &cmd, int command_valid, const sim_model &m, double dt)
+	{
+		double wvx = 0, wvy = 0, wvz = 0, target_yaw_rate = 0;
+		if (phase == SIM_TAKEOFF) wvz = (z < m.takeoff_height) ? m.takeoff_speed : 0;
+		else if (phase == SIM_LANDING) wvz = -m.landing_speed;
+		else if ((phase == SIM_FLYING) && command_valid)
+		{
+			double roll = cmd.rp_angle ? cmd.roll * m.angle_speed : cmd.roll;
+			double pitch = cmd.rp_angle ? cmd.pitch * m.angle_speed : cmd.pitch;
+			if (cmd.ground)
+			{
+				wvx = roll;
+				wvy = pitch;
+			}
+			else
+			{
+				// body -> world (inverse of the rotation in posCommand)
+				double c = cos(-yaw), s = sin(-yaw);
+				wvx = pitch * s + roll * c;
+				wvy = pitch * c - roll * s;
+			}
+			wvz = cmd.alt_position ? clamp(cmd.vertical - z, m.max_vertical_speed) : cmd.vertical;
+			// SDK yaw is positive CW
+			if (cmd.yaw_angle) target_yaw_rate = clamp(remainder(-cmd.yaw * M_PI / 180.0 - yaw, 2 * M_PI) * 2.0, M_PI / 2);
+			else target_yaw_rate = -cmd.yaw * M_PI / 180.0;
+		}
+		if (phase == SIM_GROUND)
+		{
+			vx = vy = vz = yaw_rate = 0;
+			return;
+		}
+
+		double a = dt / m.velocity_time_constant;
+		vx += (wvx - vx) * a;
+		vy += (wvy - vy) * a;
+		vz += (wvz - vz) * dt / m.vertical_time_constant;
+		yaw_rate += (target_yaw_rate - yaw_rate) * dt / m.yaw_rate_time_constant;
+		x += vx * dt;
+		y += vy * dt;
+		z += vz * dt;
+		yaw += yaw_rate * dt;
+
+		if (z <= 0)
+		{
+			z = 0;
+			if (phase == SIM_LANDING)
+			{
+				phase = SIM_GROUND;
+				vx = vy = vz = yaw_rate = 0;
+			}
+			else if (vz < 0) vz = 0;
+		}
+	}
+};
+
+// the dance agenda of MainActivity (performCommand + howMuchToWaitForNextCommand), in simulated time
+struct sim_executor
+{
+	const dance_file &d;
+	const dance_performance &perf;
+	const sim_model &m;
+	sim_result &result;
+	sim_drone drone;
+
+	const dance_block *current_dance;
+	int current_procedure = -1;
+	int agenda_index = 0;
+	int remaining_repeats = 0;
+	int command_repeat_delay = 0;
+	const dance_block *save_current_dance = 0;
+	int save_procedure = -1;
+	int save_agenda_index = -1;
+	double save_time_started = 0;
+	double time_started = 0;
+	int performance_completed = 0;
+
+	int has_taken_off = 0, has_landed = 0;
+	double takeoff_time = 0;
+	int relative_on = 0;
+	sim_pose relative_pos = { 0, 0, 0, 0 }, reference_point = { 0, 0, 0, 0 };
+	double horizontal_speed_limit = 0.3, vertical_speed_limit = 1.0;
+	const dance_record *last_args = 0;
+	sim_pose current_absolute = { 0, 0, 0, 0 };
+	int flying_to_pos = 0;
+	int leds = 1;
+
+	sim_command command;
+	double command_time = -1e9;
+	int has_pose = 0;
+	sim_pose camera_position = { 0, 0, 0, 0 };
+	std::set<std::pair<const dance_block *, int>> reported;
+
+	sim_executor(const dance_file &d, const dance_performance &perf, const sim_model &m, sim_result &result)
+		: d(d), perf(perf), m(m), result(result), current_dance(&perf.main) {}
+
+	int size() const { return current_dance ? current_dance->records.size() : 0; }
+	const dance_record *instruction(int i) const { return ((i >= 0) && (i < size())) ? &current_dance->records[i] : 0; }
+
+	int line() const { return (agenda_index < size()) ? current_dance->lines[agenda_index] : 0; }
+
+	// each problem is reported only once per command
+	void report(double t, const char *msg)
+	{
+		if (!reported.insert({ current_dance, agenda_index }).second) return;
+		char buf[300];
+		snprintf(buf, sizeof(buf), "%s:%d: t=%.1f s: %s", d.path.c_str(), line(), t / 1000.0, msg);
+		result.messages.push_back(buf);
+	}
+
+	void pos(const dance_record &r, double t)
+	{
+		if (!has_taken_off)
+		{
+			report(t, "POS before the takeoff is completed, ignored");
+			return;
+		}
+		command_repeat_delay = 100;
+		remaining_repeats++;
+
+		if (&r != last_args)
+		{
+			sim_pose p = { r.a[0], r.a[1], r.a[2], r.a[3] };
+			current_absolute = relative_on ? resolve_relative(p, reference_point, relative_pos) : p;
+			last_args = &r;
+		}
+		flying_to_pos = 1;
+		if (!has_pose) return;   // position not available
+		command = pos_command(camera_position, current_absolute, horizontal_speed_limit, vertical_speed_limit);
+		command_time = t;
+	}
+
+	void fly(const dance_record &r, double t)
+	{
+		if (!has_taken_off)
+		{
+			report(t, "FLY before the takeoff is completed, ignored");
+			return;
+		}
+		command_repeat_delay = 100;
+		remaining_repeats++;
+		flying_to_pos = 0;
+
+		command.pitch = r.a[0];
+		command.roll = r.a[1];
+		command.yaw = r.a[2];
+		command.vertical = r.a[3];
+		command.alt_position = DANCE_FLY_ALT_MODE(r.flags) == 0;
+		command.rp_angle = DANCE_FLY_RP_MODE(r.flags) == 0;   // position mode is not simulated, taken as velocity
+		command.yaw_angle = DANCE_FLY_YAW_MODE(r.flags) == 0;
+		command.ground = DANCE_FLY_COORD_SYSTEM(r.flags) == 0;
+		command_time = t;
+	}
+
+	void land()
+	{
+		if ((drone.phase == SIM_FLYING) || (drone.phase == SIM_TAKEOFF)) drone.phase = SIM_LANDING;
+		flying_to_pos = 0;
+	}
+
+	void run(const std::string &name, double t)
+	{
+		save_current_dance = current_dance;
+		save_procedure = current_procedure;
+		save_agenda_index = agenda_index;
+		save_time_started = time_started;
+		time_started = t;
+		agenda_index = 0;
+		current_dance = perf.find_procedure(name);
+		current_procedure = current_dance ? current_dance - &perf.procedures[0] : -1;
+		if (!current_dance)
+		{
+			std::string msg = "RUN of undefined procedure " + name;
+			char buf[300];
+			snprintf(buf, sizeof(buf), "%s:%d: t=%.1f s: %s", d.path.c_str(), save_current_dance->lines[save_agenda_index], t / 1000.0, msg.c_str());
+			result.messages.push_back(buf);
+		}
+	}
+
+	void perform_command(double t)
+	{
+		const dance_record *cmd = instruction(agenda_index);
+		if ((remaining_repeats <= 0) || !cmd) return;
+		remaining_repeats--;
+		switch (cmd->kind)
+		{
+			case DANCE_LEDS: leds = cmd->flags; break;
+			case DANCE_TAKEOFF:
+				if (drone.phase == SIM_GROUND)
+				{
+					drone.phase = SIM_TAKEOFF;
+					takeoff_time = t;
+				}
+				break;
+			case DANCE_LAND: land(); break;
+			case DANCE_POS: pos(*cmd, t); break;
+			case DANCE_RUN: run(current_dance->run_names[agenda_index], t); break;
+			case DANCE_RELATIVE:
+				relative_pos = sim_pose{ cmd->a[0], cmd->a[1], cmd->a[2], cmd->a[3] };
+				relative_on = 1;
+				break;
+			case DANCE_REFPOINT: reference_point = sim_pose{ cmd->a[0], cmd->a[1], cmd->a[2], cmd->a[3] }; break;
+			case DANCE_ABSOLUTE: relative_on = 0; break;
+			case DANCE_HSPEED: horizontal_speed_limit = cmd->a[0]; break;
+			case DANCE_VSPEED: vertical_speed_limit = cmd->a[0]; break;
+			case DANCE_END:
+				if (has_taken_off && !has_landed) land();
+				performance_completed = 1;
+				result.end_time = t;
+				break;
+			case DANCE_FLY: fly(*cmd, t); break;
+		}
+	}
+
+	double how_much_to_wait_for_next_command(double t)
+	{
+		double current_simulation_time = t - time_started;
+		int advance_to_next_instruction = 0;
+		int may_be_end_of_procedure = 0;
+		double delay_to_return = 500;
+
+		if (remaining_repeats > 0)
+		{
+			if (agenda_index < size() - 1)
+			{
+				if (current_simulation_time + command_repeat_delay >= current_dance->times[agenda_index + 1])
+					advance_to_next_instruction = 1;
+				else return command_repeat_delay;
+			}
+			else
+			{
+				delay_to_return = command_repeat_delay;
+				may_be_end_of_procedure = 1;
+			}
+		}
+		else if (agenda_index < size() - 1) advance_to_next_instruction = 1;
+		else may_be_end_of_procedure = 1;
+
+		if (may_be_end_of_procedure && (save_agenda_index > -1))
+		{
+			int return_from_procedure = 0;
+			if (remaining_repeats > 0)
+			{
+				double current_main_simulation_time = t - save_time_started;
+				if ((save_agenda_index + 1 < (int)save_current_dance->records.size()) &&
+				    (current_main_simulation_time + command_repeat_delay >= save_current_dance->times[save_agenda_index + 1]))
+					return_from_procedure = 1;
+			}
+			else return_from_procedure = 1;
+
+			if (return_from_procedure)
+			{
+				current_dance = save_current_dance;
+				current_procedure = save_procedure;
+				agenda_index = save_agenda_index;
+				time_started = save_time_started;
+				save_agenda_index = -1;
+				advance_to_next_instruction = 1;
+			}
+		}
+
+		if (advance_to_next_instruction)
+		{
+			agenda_index++;
+			remaining_repeats = 1;
+			current_simulation_time = t - time_started;
+			if (agenda_index < size())
+			{
+				double next_time = current_dance->times[agenda_index];
+				if (current_simulation_time >= next_time)
+				{
+					if (current_simulation_time - next_time > LATE_COMMAND)
+					{
+						char msg[100];
+						snprintf(msg, sizeof(msg), "command is late by %.0f ms (the previous ones take longer)", current_simulation_time - next_time);
+						report(t, msg);
+					}
+					return 0;   // we are behind the agenda
+				}
+				else return next_time - current_simulation_time;
+			}
+		}
+		return delay_to_return;
+	}
+
+	sim_sample sample(double t) const
+	{
+		sim_sample s;
+		s.t = (int)lround(t);
+		s.x = drone.x;
+		s.y = drone.y;
+		s.z = drone.z;
+		s.yaw = remainder(drone.yaw, 2 * M_PI);
+		s.vx = drone.vx;
+		s.vy = drone.vy;
+		s.vz = drone.vz;
+		for (int i = 0; i < 4; i++) s.target[i] = flying_to_pos ? (&current_absolute.x)[i] : NAN;
+		s.phase = drone.phase;
+		s.leds = leds;
+		s.procedure = current_procedure;
+		s.line = line();
+		return s;
+	}
+};
+
+sim_result simulate_performance(const dance_file &d, int performance, const sim_start &start, const sim_model &m)
+{
+	sim_result result;
+	result.drone_id = d.drone_id;
+	result.end_time = m.max_time;
+	if ((performance < 0) || (performance >= (int)d.performances.size()))
+	{
+		result.end_time = 0;
+		result.messages.push_back(d.path + ": no such performance");
+		return result;
+	}
+
+	sim_executor ex(d, d.performances[performance], m, result);
+	ex.drone.x = start.x;
+	ex.drone.y = start.y;
+	ex.drone.yaw = start.yaw;
+
+	double dt = 1000.0 / m.rate;
+	double next_wake = ex.how_much_to_wait_for_next_command(0);
+	double next_frame = 0, next_sample = 0;
+	std::deque<std::pair<double, sim_pose>> pending;
+
+	// after END, the simulation continues until the drone lands
+	for (long step = 0;; step++)
+	{
+		double t = step * dt;
+		if ((t > m.max_time) || (ex.performance_completed && (ex.drone.phase == SIM_GROUND))) break;
+
+		// localization: a frame is taken now and its pose is available pose_latency later
+		if (t >= next_frame)
+		{
+			pending.push_back({ t + m.pose_latency, sim_pose{ (float)ex.drone.x, (float)ex.drone.y, (float)ex.drone.z, (float)ex.drone.yaw } });
+			next_frame += 1000.0 / m.pose_fps;
+		}
+		while (!pending.empty() && (pending.front().first <= t))
+		{
+			ex.camera_position = pending.front().second;
+			ex.has_pose = (ex.drone.phase != SIM_GROUND);   // the mat is not visible from the ground
+			pending.pop_front();
+		}
+
+		if (!ex.has_taken_off && (ex.drone.phase == SIM_TAKEOFF) && (t - ex.takeoff_time >= m.takeoff_delay))
+		{
+			ex.has_taken_off = 1;
+			ex.drone.phase = SIM_FLYING;
+		}
+		if (ex.has_taken_off && (ex.drone.phase == SIM_GROUND))
+		{
+			ex.has_landed = 1;
+			ex.has_taken_off = 0;
+		}
+
+		for (int guard = 0; (guard < 10000) && !ex.performance_completed && (t >= next_wake); guard++)
+		{
+			ex.perform_command(t);
+			if (!ex.performance_completed) next_wake = t + ex.how_much_to_wait_for_next_command(t);
+		}
+
+		if (t >= next_sample)
+		{
+			result.trace.push_back(ex.sample(t));
+			next_sample += m.trace_step;
+		}
+		ex.drone.step(ex.command, t - ex.command_time < STICK_TIMEOUT, m, dt / 1000.0);
+	}
+	return result;
+}
+
+std::vector<sim_result> simulate_all(const std::vector<dance_file> &dances, int performance,
+                                     const std::map<int, sim_start> &starts, const sim_model &model, int threads)
+{
+	std::vector<sim_result> results(dances.size());
+	if (threads <= 0) threads = std::thread::hardware_concurrency();
+	if (threads <= 0) threads = 1;
+
+	// the drones are independent, one by one from a shared counter
+	std::atomic<int> next(0);
+	auto worker = [&]() {
+		for (int i = next++; i < (int)dances.size(); i = next++)
+		{
+			auto it = starts.find(dances[i].drone_id);
+			sim_start start = (it != starts.end()) ? it->second :
+			                  ((performance >= 0) && (performance < (int)dances[i].performances.size())) ?
+			                  default_start(dances[i].performances[performance]) : sim_start{ 0, 0, 0 };
+			results[i] = simulate_performance(dances[i], performance, start, model);
+		}
+	};
+	std::vector<std::thread> pool;
+	for (int k = 0; k < threads; k++) pool.emplace_back(worker);
+	for (std::thread &th : pool) th.join();
+	return results;
+}
+
+bool load_starting_positions(const char *path, std::map<int, sim_start> &starts)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror("Cannot open starting positions");
+		return false;
+	}
+	char ln[1000];
+	while (fgets(ln, 1000, f))
+	{
+		int id;
+		sim_start s;
+		if ((ln[0] != '#') && (sscanf(ln, "%d %f %f %f", &id, &s.x, &s.y, &s.yaw) == 4)) starts[id] = s;
+	}
+	fclose(f);
+	return true;
+}
+
+// the first POS as the executor would resolve it (RELATIVE/REFPOINT in force at that time)
+static int first_pos(const dance_block &b, const dance_performance &perf, sim_start &s, int depth,
+                     int &relative_on, sim_pose &relative, sim_pose &reference)
+{
+	for (size_t i = 0; i < b.records.size(); i++)
+	{
+		const dance_record &r = b.records[i];
+		sim_pose p = { r.a[0], r.a[1], r.a[2], r.a[3] };
+		switch (r.kind)
+		{
+			case DANCE_RELATIVE: relative = p; relative_on = 1; break;
+			case DANCE_REFPOINT: reference = p; break;
+			case DANCE_ABSOLUTE: relative_on = 0; break;
+			case DANCE_POS:
+				if (relative_on) p = resolve_relative(p, reference, relative);
+				s = sim_start{ p.x, p.y, p.yaw };
+				return 1;
+			case DANCE_RUN:
+				if (depth == 0)
+				{
+					const dance_block *proc = perf.find_procedure(b.run_names[i]);
+					if (proc && first_pos(*proc, perf, s, 1, relative_on, relative, reference)) return 1;
+				}
+				break;
+		}
+	}
+	return 0;
+}
+
+sim_start default_start(const dance_performance &perf)
+{
+	sim_start s = { 0, 0, 0 };
+	int relative_on = 0;
+	sim_pose relative = { 0, 0, 0, 0 }, reference = { 0, 0, 0, 0 };
+	first_pos(perf.main, perf, s, 0, relative_on, relative, reference);
+	return s;
+}
+
+std::string sim_source(const dance_file &d, int performance, const sim_sample &s)
+{
+	if ((s.procedure >= 0) && (performance >= 0) && (performance < (int)d.performances.size()) &&
+	    (s.procedure < (int)d.performances[performance].procedures.size()))
+		return d.performances[performance].procedures[s.procedure].name;
+	return "performance " + std::to_string(performance);
+}
@@ -0,0 +1,72 @@
+#ifndef DANCE_SIM_H
+#define DANCE_SIM_H
+
+// simulation of the drones performing their dances: the commands are executed with the same
+// timing rules as in MainActivity (agenda, 100 ms repetition of POS and FLY, procedures with their own time),
+// the drone is a simple first order model of the velocity loop, localization is delayed and sampled
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "dance_file.h"
+
+struct sim_model
+{
+	double rate = 1000.0;                  // Hz, integration steps
+	double velocity_time_constant = 0.35;  // s, horizontal velocity follows the command
+	double vertical_time_constant = 0.3;   // s
+	double yaw_rate_time_constant = 0.2;   // s
+	double max_vertical_speed = 2.0;       // m/s, for FLY with ALT_M
+	double angle_speed = 0.1;              // m/s per degree of pitch/roll, for FLY with RP_DEG
+	double takeoff_height = 1.2;           // m
+	double takeoff_speed = 0.5;            // m/s
+	double landing_speed = 0.5;            // m/s
+	int takeoff_delay = 5000;              // ms until the virtual stick is enabled (initAfterTakeoff)
+	double pose_fps = 15.0;                // localization frames per second
+	int pose_latency = 100;                // ms, age of the pose when posCommand uses it
+	int trace_step = 20;                   // ms between samples of the trace
+	int max_time = 900000;                 // ms, stop when END does not come
+};
+
+enum sim_phase { SIM_GROUND, SIM_TAKEOFF, SIM_FLYING, SIM_LANDING };
+
+struct sim_sample
+{
+	int t;                      // ms from the start of the performance
+	float x, y, z, yaw;
+	float vx, vy, vz;
+	float target[4];            // POS setpoint in force (absolute), NAN when not flying to a POS
+	uint8_t phase;              // sim_phase
+	uint8_t leds;
+	int16_t procedure;          // index into dance_performance::procedures, -1 = the performance itself
+	int line;                   // line in the dance file of the command in force
+};
+
+struct sim_start
+{
+	float x, y, yaw;
+};
+
+struct sim_result
+{
+	int drone_id;
+	int end_time;                        // ms, END of the performance (or max_time)
+	std::vector<sim_sample> trace;
+	std::vector<std::string> messages;   // timing problems and ignored commands, "file:line: message"
+};
+
+// where the drone stands at the start: starting_positions file "K x y yaw" (yaw in radians),
+// drones missing there start under their first POS of the performance
+bool load_starting_positions(const char *path, std::map<int, sim_start> &starts);
+sim_start default_start(const dance_performance &perf);
+
+sim_result simulate_performance(const dance_file &d, int performance, const sim_start &start, const sim_model &model);
+// all drones in parallel, threads <= 0 means all cores
+std::vector<sim_result> simulate_all(const std::vector<dance_file> &dances, int performance,
+                                     const std::map<int, sim_start> &starts, const sim_model &model, int threads);
+
+// name of the procedure of the sample (or "performance N")
+std::string sim_source(const dance_file &d, int performance, const sim_sample &s);
+
+#endif
@@ -0,0 +1,117 @@
+// simulates all drones performing their dance_K.txt files (much faster than real time), to find timing
+// and REFPOINT/RELATIVE mistakes before flying, see dance_sim.h for the model
+//
+// compile:  g++ -O2 -std=c++17 -o dance_simulator dance_simulator.cpp dance_sim.cpp dance_file.cpp -I../app/src/main/cpp -lpthread
+//
+// usage:    dance_simulator [options] dance_1.txt dance_2.txt ...
+//
+//   -p N            performance (index as selected on the master), default 0
+//   -start file     starting positions, lines "K x y yaw", default: under the first POS of each drone
+//   -o dir          write the trace of each drone to dir/trace_K.csv
+//   -step ms        time between the samples of the trace, default 20
+//   -rate Hz        simulation steps per second, default 1000
+//   -tau s          time constant of the velocity loop of the drone, default 0.35
+//   -latency ms     age of the pose from localization, default 100
+//   -fps F          localization frames per second, default 15
+//   -threads N      default: all cores
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include "dance_sim.h"
+
+static void write_trace(const char *dir, const dance_file &d, int performance, const sim_result &r)
+{
+	char path[1000];
+	snprintf(path, sizeof(path), "%s/trace_%d.csv", dir, r.drone_id);
+	FILE *f = fopen(path, "w+");
+	if (!f)
+	{
+		perror("Cannot write trace");
+		return;
+	}
+	static const char *phases[] = { "ground", "takeoff", "flying", "landing" };
+	fprintf(f, "t,x,y,z,yaw,vx,vy,vz,target_x,target_y,target_z,target_yaw,phase,leds,procedure,line\n");
+	for (const sim_sample &s : r.trace)
+	{
+		fprintf(f, "%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,", s.t, s.x, s.y, s.z, s.yaw, s.vx, s.vy, s.vz);
+		if (isnan(s.target[0])) fprintf(f, ",,,,");
+		else fprintf(f, "%.4f,%.4f,%.4f,%.4f,", s.target[0], s.target[1], s.target[2], s.target[3]);
+		fprintf(f, "%s,%d,%s,%d\n", phases[s.phase], s.leds, sim_source(d, performance, s).c_str(), s.line);
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	sim_model model;
+	int performance = 0, threads = 0;
+	const char *start_file = 0, *output_dir = 0;
+	std::vector<const char *> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-p") == 0) performance = atoi(val);
+			else if (strcmp(opt, "-start") == 0) start_file = val;
+			else if (strcmp(opt, "-o") == 0) output_dir = val;
+			else if (strcmp(opt, "-step") == 0) model.trace_step = atoi(val);
+			else if (strcmp(opt, "-rate") == 0) model.rate = atof(val);
+			else if (strcmp(opt, "-tau") == 0) model.velocity_time_constant = atof(val);
+			else if (strcmp(opt, "-latency") == 0) model.pose_latency = atoi(val);
+			else if (strcmp(opt, "-fps") == 0) model.pose_fps = atof(val);
+			else if (strcmp(opt, "-threads") == 0) threads = atoi(val);
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else inputs.push_back(argv[i]);
+	}
+	if (inputs.empty() || (model.rate <= 0) || (model.trace_step <= 0) || (model.pose_fps <= 0))
+	{
+		fprintf(stderr, "usage: dance_simulator [-p N] [-start file] [-o dir] [-step ms] [-rate Hz] [-tau s] [-latency ms] [-fps F] [-threads N] dance_1.txt ...\n");
+		return 1;
+	}
+
+	std::vector<dance_file> dances(inputs.size());
+	for (size_t i = 0; i < inputs.size(); i++)
+		if (!load_dance_file(inputs[i], dances[i])) return 1;
+	if (dance_file_errors()) fprintf(stderr, "%d errors in the dance files, simulating anyway\n", dance_file_errors());
+
+	std::map<int, sim_start> starts;
+	if (start_file && !load_starting_positions(start_file, starts)) return 1;
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::vector<sim_result> results = simulate_all(dances, performance, starts, model, threads);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	double simulated = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const sim_result &r = results[i];
+		simulated += r.end_time / 1000.0;
+
+		// how well the drone follows its POS setpoints (the sample of the setpoint is a step, so this includes the lag)
+		double max_height = 0, distance = 0, max_error = 0;
+		for (size_t k = 0; k < r.trace.size(); k++)
+		{
+			const sim_sample &s = r.trace[k];
+			if (s.z > max_height) max_height = s.z;
+			if (k > 0) distance += hypot(hypot(s.x - r.trace[k - 1].x, s.y - r.trace[k - 1].y), s.z - r.trace[k - 1].z);
+			if (!isnan(s.target[0]))
+			{
+				double e = hypot(hypot(s.x - s.target[0], s.y - s.target[1]), s.z - s.target[2]);
+				if (e > max_error) max_error = e;
+			}
+		}
+		printf("drone %d: %.1f s, flown %.1f m, max height %.2f m, max distance from POS %.2f m, %d messages\n",
+		       r.drone_id, r.end_time / 1000.0, distance, max_height, max_error, (int)r.messages.size());
+		for (const std::string &msg : r.messages) printf("  %s\n", msg.c_str());
+
+		if (output_dir) write_trace(output_dir, dances[i], performance, r);
+	}
+	printf("simulated %.0f s of flight in %.3f s\n", simulated, elapsed);
+	return 0;
+}
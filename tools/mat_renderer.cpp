@@ -0,0 +1,357 @@
+// synthetic frames of the localization mat as seen by the downward facing camera of a drone
+// at a known pose - ground truth for benchmarking and checking fastimglib changes on Linux
+//
+// compile:  g++ -O2 -std=c++17 -o mat_renderer mat_renderer.cpp -I../app/src/main/cpp `pkg-config --cflags --libs opencv4` -lpthread
+//
+// usage:
+//   mat_renderer -pose x,y,height,yaw[,roll,pitch] [options] -o frame.png
+//       renders one frame
+//   mat_renderer -count N [options] -o output_dir
+//       renders N frames with random poses (in parallel), output_dir/frame_NNNNNN.png and output_dir/ground_truth.csv
+//
+// options:
+//   -device D         screen geometry of drone D (1..5, as in fastimglib.cpp), default 2
+//   -threads T        number of worker threads, default: number of cores
+//   -seed S           random seed, the dataset is reproducible for the same seed (and any number of threads)
+//   -range R          random x,y in [-R,R] m, default 1.0
+//   -height H1,H2     random height in [H1,H2] m, default 1.6,4.0
+//   -tilt T           random roll and pitch in [-T,T] deg, default 3
+//   -noise S          gaussian noise, standard deviation S (in 0..255), default 0
+//   -blur B           gaussian blur, sigma B pixels, default 0
+//   -vignetting V     brightness drop V (0..1) in the image corners, default 0
+//   -glare G          one glare spot of intensity G (0..255) at random place, default 0
+//   -yellow S         side of the yellow squares in m, default 0.2
+//   -format F         png or ppm, default png
+//
+// pose convention is the same as the output of the localization: [x,y] in meters relative to the center of the mat,
+// height in meters, yaw in radians, roll and pitch are small rotations of the camera in degrees (not reported by localization)
+
+#include <opencv2/opencv.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mat_layout.h"
+
+// the same camera model as fastimglib: focal length and pixel size measured for the reference valid width
+static const double camera_focal_length = 0.0067;   // m
+static const double default_pixel_size = 0.0000075;  // m
+static const int REFERENCE_VALID_WIDTH = 1185;
+
+// number of samples per pixel in each axis (antialiasing of the edges)
+static const int SUPERSAMPLING = 3;
+
+struct device_geometry
+{
+	const char *name;
+	int width, height;                    // size of the live video frame passed to localization
+	int valid_x, valid_y, valid_width, valid_height;   // without the letterbox borders
+};
+
+// see the device list at the beginning of fastimglib.cpp
+static const device_geometry devices[] = {
+	{ "Samsung A40", 2014, 996,  122, 0,  1770, 996 },
+	{ "Samsung A30", 1397, 667,  106, 0,  1185, 667 },
+	{ "Galaxy S8",   1980, 996,  105, 0,  1770, 996 },
+	{ "Huawei",      1133, 664,  0,   13, 1133, 638 },
+	{ "Xiaomi",      2079, 966,  181, 0,  1717, 966 }
+};
+static const int NUM_DEVICES = sizeof(devices) / sizeof(devices[0]);
+
+// RGB of the printout and the floor around
+static const cv::Vec3f mat_colors[5] = { {30, 60, 190}, {25, 25, 30}, {200, 35, 35}, {30, 150, 70}, {235, 215, 45} };
+static const cv::Vec3f white_color(235, 235, 230);
+static const cv::Vec3f floor_color(140, 125, 110);
+
+struct pose
+{
+	double x, y, height, yaw;
+	double roll, pitch;   // deg
+};
+
+struct render_options
+{
+	int device = 2;
+	double noise = 0;
+	double blur = 0;
+	double vignetting = 0;
+	double glare = 0;
+	double yellow_size = 0.2;
+};
+
+// color of the mat (or floor) at world point [x,y]
+static cv::Vec3f mat_color_at(double x, double y, double yellow_size)
+{
+	double ax = fabs(x);
+	double ay = fabs(y);
+	if ((ax > MAT_OUTER_EDGE) || (ay > MAT_OUTER_EDGE))
+	{
+		// the white banner is a bit larger than the squares
+		if ((ax < MAT_OUTER_EDGE + 0.2) && (ay < MAT_OUTER_EDGE + 0.26)) return white_color;
+		return floor_color;
+	}
+	if ((ax < MAT_INNER_EDGE) || (ay < MAT_INNER_EDGE)) return white_color;
+
+	// yellow square from the center of the colored square towards the center of the mat
+	if ((ax <= MAT_YELLOW_CORNER) && (ax >= MAT_YELLOW_CORNER - yellow_size) &&
+	    (ay <= MAT_YELLOW_CORNER) && (ay >= MAT_YELLOW_CORNER - yellow_size))
+		return mat_colors[MAT_COLOR_YELLOW];
+
+	if (y > 0) return mat_colors[(x < 0) ? MAT_COLOR_BLUE : MAT_COLOR_BLACK];
+	return mat_colors[(x < 0) ? MAT_COLOR_GREEN : MAT_COLOR_RED];
+}
+
+// renders the valid area of the frame (without borders), RGB 8-bit
+//   pixel offset (U-C) = (a,b) from the camera center sees the ground point P + R(yaw) * (a, -b) * pixel_size * height / focal_length
+//   when the camera is level - the inverse of the position calculation in fastimglib
+static void render_valid_area(cv::Mat &image, const pose &p, const render_options &opt)
+{
+	int w = image.cols;
+	int h = image.rows;
+	double pixel_size = default_pixel_size * REFERENCE_VALID_WIDTH / w;
+	double cx = w / 2;
+	double cy = h / 2;
+
+	double cos_yaw = cos(p.yaw), sin_yaw = sin(p.yaw);
+	double roll = p.roll * M_PI / 180.0;
+	double pitch = p.pitch * M_PI / 180.0;
+
+	// camera axes in world: right, up (in image), forward (down to the floor), then tilted
+	cv::Matx33d yaw_rotation(cos_yaw, -sin_yaw, 0, sin_yaw, cos_yaw, 0, 0, 0, 1);
+	cv::Matx33d roll_rotation(1, 0, 0, 0, cos(roll), -sin(roll), 0, sin(roll), cos(roll));
+	cv::Matx33d pitch_rotation(cos(pitch), 0, sin(pitch), 0, 1, 0, -sin(pitch), 0, cos(pitch));
+	cv::Matx33d camera_rotation = yaw_rotation * roll_rotation * pitch_rotation;
+
+	for (int v = 0; v < h; v++)
+	{
+		cv::Vec3b *row = image.ptr<cv::Vec3b>(v);
+		for (int u = 0; u < w; u++)
+		{
+			cv::Vec3f sum(0, 0, 0);
+			for (int sy = 0; sy < SUPERSAMPLING; sy++)
+				for (int sx = 0; sx < SUPERSAMPLING; sx++)
+				{
+					double a = (u + (sx + 0.5) / SUPERSAMPLING - 0.5 - cx) * pixel_size;
+					double b = (v + (sy + 0.5) / SUPERSAMPLING - 0.5 - cy) * pixel_size;
+					cv::Vec3d ray = camera_rotation * cv::Vec3d(a, -b, -camera_focal_length);
+					if (ray[2] >= -1e-9)   // looking above the horizon
+					{
+						sum += floor_color;
+						continue;
+					}
+					double t = p.height / -ray[2];
+					sum += mat_color_at(p.x + t * ray[0], p.y + t * ray[1], opt.yellow_size);
+				}
+			sum *= 1.0f / (SUPERSAMPLING * SUPERSAMPLING);
+			row[u] = cv::Vec3b(cv::saturate_cast<uchar>(sum[0]), cv::saturate_cast<uchar>(sum[1]), cv::saturate_cast<uchar>(sum[2]));
+		}
+	}
+}
+
+// camera imperfections, applied in this order: vignetting, glare, blur, noise
+static void apply_effects(cv::Mat &image, const render_options &opt, std::mt19937 &rng)
+{
+	if ((opt.vignetting <= 0) && (opt.glare <= 0) && (opt.blur <= 0) && (opt.noise <= 0)) return;
+
+	cv::Mat f;
+	image.convertTo(f, CV_32FC3);
+	int w = f.cols;
+	int h = f.rows;
+
+	if (opt.vignetting > 0)
+	{
+		double max_r2 = (w * w + h * h) / 4.0;
+		for (int v = 0; v < h; v++)
+		{
+			cv::Vec3f *row = f.ptr<cv::Vec3f>(v);
+			for (int u = 0; u < w; u++)
+			{
+				double du = u - w / 2.0, dv = v - h / 2.0;
+				row[u] *= (float)(1.0 - opt.vignetting * (du * du + dv * dv) / max_r2);
+			}
+		}
+	}
+
+	if (opt.glare > 0)
+	{
+		std::uniform_real_distribution<double> where(0.0, 1.0);
+		double gx = where(rng) * w, gy = where(rng) * h;
+		double sigma = (0.03 + 0.07 * where(rng)) * w;
+		for (int v = 0; v < h; v++)
+		{
+			cv::Vec3f *row = f.ptr<cv::Vec3f>(v);
+			for (int u = 0; u < w; u++)
+			{
+				double d2 = (u - gx) * (u - gx) + (v - gy) * (v - gy);
+				float g = (float)(opt.glare * exp(-d2 / (2 * sigma * sigma)));
+				row[u] += cv::Vec3f(g, g, g);
+			}
+		}
+	}
+
+	if (opt.blur > 0)
+		cv::GaussianBlur(f, f, cv::Size(0, 0), opt.blur);
+
+	if (opt.noise > 0)
+	{
+		std::normal_distribution<float> gauss(0.0f, (float)opt.noise);
+		for (int v = 0; v < h; v++)
+		{
+			float *row = f.ptr<float>(v);
+			for (int i = 0; i < w * 3; i++)
+				row[i] += gauss(rng);
+		}
+	}
+
+	f.convertTo(image, CV_8UC3);
+}
+
+// the whole frame as passed to localization: black letterbox borders around the valid area
+static cv::Mat render_frame(const pose &p, const render_options &opt, std::mt19937 &rng)
+{
+	const device_geometry &d = devices[opt.device - 1];
+	cv::Mat frame(d.height, d.width, CV_8UC3, cv::Scalar(0, 0, 0));
+	cv::Mat valid = frame(cv::Rect(d.valid_x, d.valid_y, d.valid_width, d.valid_height));
+	render_valid_area(valid, p, opt);
+	apply_effects(valid, opt, rng);
+	return frame;
+}
+
+// imwrite expects BGR
+static int save_frame(const cv::Mat &frame, const std::string &filename)
+{
+	cv::Mat bgr;
+	cv::cvtColor(frame, bgr, cv::COLOR_RGB2BGR);
+	return cv::imwrite(filename, bgr);
+}
+
+static void usage()
+{
+	printf("usage: mat_renderer -pose x,y,height,yaw[,roll,pitch] [options] -o frame.png\n");
+	printf("       mat_renderer -count N [options] -o output_dir\n");
+	printf("options: -device D -threads T -seed S -range R -height H1,H2 -tilt T -noise S -blur B -vignetting V -glare G -yellow S -format png|ppm\n");
+	printf("devices:\n");
+	for (int i = 0; i < NUM_DEVICES; i++)
+		printf("  %d: %-12s %dx%d, valid %dx%d at [%d,%d]\n", i + 1, devices[i].name, devices[i].width, devices[i].height,
+		       devices[i].valid_width, devices[i].valid_height, devices[i].valid_x, devices[i].valid_y);
+}
+
+int main(int argc, char **argv)
+{
+	render_options opt;
+	pose single_pose = { 0, 0, 2.0, 0, 0, 0 };
+	int have_pose = 0;
+	int count = 0;
+	int threads = std::thread::hardware_concurrency();
+	unsigned seed = 1;
+	double range = 1.0;
+	double min_height = 1.6, max_height = 4.0;
+	double tilt = 3.0;
+	const char *format = "png";
+	const char *output = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc) { usage(); return 1; }
+		const char *arg = argv[i];
+		const char *val = argv[++i];
+		if (strcmp(arg, "-pose") == 0)
+		{
+			int n = sscanf(val, "%lf,%lf,%lf,%lf,%lf,%lf", &single_pose.x, &single_pose.y, &single_pose.height, &single_pose.yaw,
+			               &single_pose.roll, &single_pose.pitch);
+			if (n < 4) { usage(); return 1; }
+			have_pose = 1;
+		}
+		else if (strcmp(arg, "-count") == 0) count = atoi(val);
+		else if (strcmp(arg, "-device") == 0) opt.device = atoi(val);
+		else if (strcmp(arg, "-threads") == 0) threads = atoi(val);
+		else if (strcmp(arg, "-seed") == 0) seed = (unsigned)atol(val);
+		else if (strcmp(arg, "-range") == 0) range = atof(val);
+		else if (strcmp(arg, "-height") == 0) sscanf(val, "%lf,%lf", &min_height, &max_height);
+		else if (strcmp(arg, "-tilt") == 0) tilt = atof(val);
+		else if (strcmp(arg, "-noise") == 0) opt.noise = atof(val);
+		else if (strcmp(arg, "-blur") == 0) opt.blur = atof(val);
+		else if (strcmp(arg, "-vignetting") == 0) opt.vignetting = atof(val);
+		else if (strcmp(arg, "-glare") == 0) opt.glare = atof(val);
+		else if (strcmp(arg, "-yellow") == 0) opt.yellow_size = atof(val);
+		else if (strcmp(arg, "-format") == 0) format = val;
+		else if (strcmp(arg, "-o") == 0) output = val;
+		else { usage(); return 1; }
+	}
+
+	if ((output == 0) || (have_pose == (count > 0)) || (opt.device < 1) || (opt.device > NUM_DEVICES))
+	{
+		usage();
+		return 1;
+	}
+	if (threads < 1) threads = 1;
+
+	if (have_pose)
+	{
+		std::mt19937 rng(seed);
+		if (!save_frame(render_frame(single_pose, opt, rng), output))
+		{
+			fprintf(stderr, "could not write %s\n", output);
+			return 1;
+		}
+		return 0;
+	}
+
+	// all poses are drawn up front, so that the dataset does not depend on the number of threads
+	std::vector<pose> poses(count);
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> position(-range, range);
+	std::uniform_real_distribution<double> height(min_height, max_height);
+	std::uniform_real_distribution<double> yaw(-M_PI, M_PI);
+	std::uniform_real_distribution<double> tilt_angle(-tilt, tilt);
+	for (int i = 0; i < count; i++)
+	{
+		poses[i].x = position(rng);
+		poses[i].y = position(rng);
+		poses[i].height = height(rng);
+		poses[i].yaw = yaw(rng);
+		poses[i].roll = tilt_angle(rng);
+		poses[i].pitch = tilt_angle(rng);
+	}
+
+	std::atomic<int> next_frame(0);
+	std::atomic<int> failed(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.emplace_back([&]() {
+			char filename[1000];
+			int i;
+			while ((i = next_frame++) < count)
+			{
+				std::mt19937 frame_rng(seed * 7919u + i);    // effects are reproducible per frame
+				sprintf(filename, "%s/frame_%06d.%s", output, i, format);
+				if (!save_frame(render_frame(poses[i], opt, frame_rng), filename))
+				{
+					fprintf(stderr, "could not write %s\n", filename);
+					failed++;
+				}
+			}
+		});
+	for (auto &w : workers) w.join();
+
+	std::string csv_name = std::string(output) + "/ground_truth.csv";
+	FILE *f = fopen(csv_name.c_str(), "w+");
+	if (!f)
+	{
+		perror("Cannot open ground truth file");
+		return 1;
+	}
+	fprintf(f, "frame,file,device,x,y,height,yaw,roll,pitch\n");
+	for (int i = 0; i < count; i++)
+		fprintf(f, "%d,frame_%06d.%s,%d,%.6lf,%.6lf,%.6lf,%.6lf,%.4lf,%.4lf\n", i, i, format, opt.device,
+		        poses[i].x, poses[i].y, poses[i].height, poses[i].yaw, poses[i].roll, poses[i].pitch);
+	fclose(f);
+
+	printf("%d frames rendered to %s (%d failed)\n", count, output, (int)failed);
+	return failed ? 1 : 0;
+}
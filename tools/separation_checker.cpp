@@ -0,0 +1,226 @@
+// checks that the drones keep a safe distance from each other and stay above the mat during the whole performance,
+// the dances are executed by the dance simulator (dance_sim.h) and compared on a common time grid
+//
+// compile:  g++ -O2 -std=c++17 -o separation_checker separation_checker.cpp dance_sim.cpp dance_file.cpp -I../app/src/main/cpp -lpthread
+//
+// usage:    separation_checker [options] dance_1.txt dance_2.txt ...
+//
+//   -p N            performance, default 0
+//   -start file     starting positions "K x y yaw", default: under the first POS of each drone
+//   -min m          minimum distance of two drones, default 0.8
+//   -arena m        the drones must stay within [-m, m] in x and y, default: the edge of the mat
+//   -ceiling m      and below this height, default 5
+//   -planned        check the POS setpoints instead of the simulated flight (FLY parts are still simulated)
+//   -step ms        time grid, default 20
+//   -gap ms         violations of the same drones less than this apart are one window (a close pass that
+//                   flickers around the limit is reported once), default 500
+//   -threads N      default: all cores
+//
+//   exit code is 1 when there is any violation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include "dance_sim.h"
+#include "mat_layout.h"
+
+struct violation
+{
+	int a, b;           // indices of the drones, b = -1 for leaving the arena
+	int first, last;    // time grid indices
+	float worst;        // smallest distance, or largest distance outside of the arena
+	int worst_index;
+};
+
+static float arena = MAT_OUTER_EDGE, ceiling = 5.0f, min_distance = 0.8f;
+static int planned = 0;
+
+static std::vector<sim_result> results;
+
+// position of the drone at the time grid index, 0 when it is on the ground (not checked)
+static int position(int drone, int k, float p[3])
+{
+	const std::vector<sim_sample> &tr = results[drone].trace;
+	if (k >= (int)tr.size()) return 0;
+	const sim_sample &s = tr[k];
+	if (s.phase == SIM_GROUND) return 0;
+	if (planned && !isnan(s.target[0])) memcpy(p, s.target, 3 * sizeof(float));
+	else
+	{
+		p[0] = s.x;
+		p[1] = s.y;
+		p[2] = s.z;
+	}
+	return 1;
+}
+
+static void add_violation(std::vector<violation> &found, std::map<std::pair<int, int>, int> &open, int a, int b, int k, float value)
+{
+	auto it = open.find({ a, b });
+	if ((it != open.end()) && (found[it->second].last == k - 1))
+	{
+		violation &v = found[it->second];
+		v.last = k;
+		if (((b >= 0) && (value < v.worst)) || ((b < 0) && (value > v.worst)))
+		{
+			v.worst = value;
+			v.worst_index = k;
+		}
+		return;
+	}
+	open[{ a, b }] = found.size();
+	found.push_back(violation{ a, b, k, k, value, k });
+}
+
+// one thread checks the time grid indices [from, to)
+static void check_range(int from, int to, std::vector<violation> &found)
+{
+	int n = results.size();
+	std::map<std::pair<int, int>, int> open;
+	std::unordered_map<int64_t, std::vector<int>> cells;
+	std::vector<float> pos(3 * n);
+	std::vector<int> airborne(n);
+
+	for (int k = from; k < to; k++)
+	{
+		// spatial hash with cells of the minimum distance: only the drones in the neighbouring cells can be too close
+		cells.clear();
+		for (int i = 0; i < n; i++)
+		{
+			float *p = &pos[3 * i];
+			airborne[i] = position(i, k, p);
+			if (!airborne[i]) continue;
+
+			float outside = fmaxf(fmaxf(fabsf(p[0]) - arena, fabsf(p[1]) - arena), p[2] - ceiling);
+			if (outside > 0) add_violation(found, open, i, -1, k, outside);
+
+			int64_t cx = (int64_t)floorf(p[0] / min_distance), cy = (int64_t)floorf(p[1] / min_distance), cz = (int64_t)floorf(p[2] / min_distance);
+			for (int dx = -1; dx <= 1; dx++)
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dz = -1; dz <= 1; dz++)
+					{
+						auto it = cells.find(((cx + dx) & 0x1FFFFF) | (((cy + dy) & 0x1FFFFF) << 21) | (((cz + dz) & 0x1FFFFF) << 42));
+						if (it == cells.end()) continue;
+						for (int j : it->second)
+						{
+							const float *q = &pos[3 * j];
+							float d = sqrtf((p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]));
+							if (d < min_distance) add_violation(found, open, std::min(i, j), std::max(i, j), k, d);
+						}
+					}
+			cells[(cx & 0x1FFFFF) | ((cy & 0x1FFFFF) << 21) | ((cz & 0x1FFFFF) << 42)].push_back(i);
+		}
+	}
+}
+
+static void print_source(const std::vector<dance_file> &dances, int performance, int drone, int k)
+{
+	const sim_sample &s = results[drone].trace[k];
+	printf("      drone %d at [%.2f, %.2f, %.2f] in %s, %s:%d\n", results[drone].drone_id, s.x, s.y, s.z,
+	       sim_source(dances[drone], performance, s).c_str(), dances[drone].path.c_str(), s.line);
+}
+
+int main(int argc, char **argv)
+{
+	sim_model model;
+	int performance = 0, threads = 0, gap = 500;
+	const char *start_file = 0;
+	std::vector<const char *> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-planned") == 0) planned = 1;
+		else if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-p") == 0) performance = atoi(val);
+			else if (strcmp(opt, "-start") == 0) start_file = val;
+			else if (strcmp(opt, "-min") == 0) min_distance = atof(val);
+			else if (strcmp(opt, "-arena") == 0) arena = atof(val);
+			else if (strcmp(opt, "-ceiling") == 0) ceiling = atof(val);
+			else if (strcmp(opt, "-step") == 0) model.trace_step = atoi(val);
+			else if (strcmp(opt, "-gap") == 0) gap = atoi(val);
+			else if (strcmp(opt, "-threads") == 0) threads = atoi(val);
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else inputs.push_back(argv[i]);
+	}
+	if (inputs.empty() || (min_distance <= 0) || (model.trace_step <= 0) || (gap < 0))
+	{
+		fprintf(stderr, "usage: separation_checker [-p N] [-start file] [-min m] [-arena m] [-ceiling m] [-planned] [-step ms] [-gap ms] [-threads N] dance_1.txt ...\n");
+		return 1;
+	}
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<dance_file> dances(inputs.size());
+	for (size_t i = 0; i < inputs.size(); i++)
+		if (!load_dance_file(inputs[i], dances[i])) return 1;
+	std::map<int, sim_start> starts;
+	if (start_file && !load_starting_positions(start_file, starts)) return 1;
+
+	auto t0 = std::chrono::steady_clock::now();
+	results = simulate_all(dances, performance, starts, model, threads);
+
+	// the traces are sampled at the same times, so the index into the trace is the time grid
+	int steps = 0;
+	for (const sim_result &r : results) steps = std::max(steps, (int)r.trace.size());
+
+	std::vector<std::vector<violation>> found(threads);
+	std::vector<std::thread> pool;
+	int chunk = (steps + threads - 1) / threads;
+	for (int k = 0; k < threads; k++)
+		pool.emplace_back(check_range, std::min(steps, k * chunk), std::min(steps, (k + 1) * chunk), std::ref(found[k]));
+	for (std::thread &th : pool) th.join();
+
+	// windows split at the chunk borders, or by less than the gap, are joined again
+	std::vector<violation> all;
+	for (int k = 0; k < threads; k++) all.insert(all.end(), found[k].begin(), found[k].end());
+	std::sort(all.begin(), all.end(), [](const violation &x, const violation &y) {
+		if (x.a != y.a) return x.a < y.a;
+		if (x.b != y.b) return x.b < y.b;
+		return x.first < y.first;
+	});
+	int gap_steps = gap / model.trace_step;
+	std::vector<violation> windows;
+	for (const violation &v : all)
+	{
+		if (!windows.empty() && (windows.back().a == v.a) && (windows.back().b == v.b) && (windows.back().last + 1 + gap_steps >= v.first))
+		{
+			violation &w = windows.back();
+			w.last = std::max(w.last, v.last);
+			if (((v.b >= 0) && (v.worst < w.worst)) || ((v.b < 0) && (v.worst > w.worst)))
+			{
+				w.worst = v.worst;
+				w.worst_index = v.worst_index;
+			}
+		}
+		else windows.push_back(v);
+	}
+	std::sort(windows.begin(), windows.end(), [](const violation &x, const violation &y) { return x.first < y.first; });
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	for (const violation &w : windows)
+	{
+		double from = w.first * model.trace_step / 1000.0, to = (w.last + 1) * model.trace_step / 1000.0;
+		if (w.b < 0)
+		{
+			printf("%.2f - %.2f s: drone %d leaves the arena by %.2f m\n", from, to, results[w.a].drone_id, w.worst);
+			print_source(dances, performance, w.a, w.worst_index);
+		}
+		else
+		{
+			printf("%.2f - %.2f s: drones %d and %d closer than %.2f m (%.2f m)\n", from, to,
+			       results[w.a].drone_id, results[w.b].drone_id, min_distance, w.worst);
+			print_source(dances, performance, w.a, w.worst_index);
+			print_source(dances, performance, w.b, w.worst_index);
+		}
+	}
+	printf("%d drones, %d time steps of %d ms, %d violations, %.3f s\n", (int)results.size(), steps, model.trace_step,
+	       (int)windows.size(), elapsed);
+	return windows.empty() ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+// replays recorded or simulated telemetry of all drones through the runtime separation monitor
+// (separation_monitor.cpp) at its real update rate, prints its alerts and how early they came before the drones
+// really got too close, and measures the time of one check (also for large swarms made of shifted copies)
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o separation_replay separation_replay.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/separation_monitor.cpp ../app/src/main/cpp/swarm_exchange.cpp
+//               ../app/src/main/cpp/clock_sync.cpp -lpthread
+//
+// usage:    separation_replay [options] trace_1.csv trace_2.csv ...
+//
+//   the traces are csv files with a header and at least the columns t (ms), x, y, z, vx, vy, vz,
+//   e.g. from dance_simulator -o dir; rows with phase "ground" are left out
+//
+//   -rate Hz        monitor updates per second, default 20
+//   -min m          minimum distance, default 0.8
+//   -emergency m    emergency distance, default 0.5
+//   -horizon s      prediction horizon, default 2
+//   -latency ms     age of the states (as over the network), default 100
+//   -noise m        position noise of the states, default 0
+//   -copies N       the swarm is repeated N times (20 m apart) to measure the time for large swarms, default 1
+//   -seed S
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "separation_monitor.h"
+
+struct telemetry
+{
+	int id;
+	std::vector<int> t;
+	std::vector<float> x, y, z, vx, vy, vz;
+	std::vector<char> flying;
+
+	// linear interpolation at time ms, returns 0 outside of the trace or on the ground
+	int at(int ms, float s[6]) const
+	{
+		if (t.empty() || (ms < t.front()) || (ms > t.back())) return 0;
+		size_t k = std::upper_bound(t.begin(), t.end(), ms) - t.begin();
+		if (k == 0) k = 1;
+		if (k >= t.size()) k = t.size() - 1;
+		if (!flying[k - 1] || !flying[k]) return 0;
+		float f = (t[k] > t[k - 1]) ? (float)(ms - t[k - 1]) / (t[k] - t[k - 1]) : 0.0f;
+		const std::vector<float> *c[6] = { &x, &y, &z, &vx, &vy, &vz };
+		for (int i = 0; i < 6; i++) s[i] = (*c[i])[k - 1] + ((*c[i])[k] - (*c[i])[k - 1]) * f;
+		return 1;
+	}
+};
+
+// drone id from the file name (trace_K.csv), or its index
+static int drone_id_of(const char *path, int index)
+{
+	const char *u = strrchr(path, '_');
+	if (u && (sscanf(u + 1, "%d", &index) == 1)) return index;
+	return index;
+}
+
+static bool load_trace(const char *path, telemetry &tr)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+	char ln[2000];
+	std::map<std::string, int> column;
+	if (fgets(ln, sizeof(ln), f))
+	{
+		int i = 0;
+		for (char *tok = strtok(ln, ",\r\n"); tok; tok = strtok(0, ",\r\n")) column[tok] = i++;
+	}
+	const char *needed[] = { "t", "x", "y", "z", "vx", "vy", "vz" };
+	for (const char *c : needed)
+		if (!column.count(c))
+		{
+			fprintf(stderr, "%s: no column %s\n", path, c);
+			fclose(f);
+			return false;
+		}
+	int phase = column.count("phase") ? column["phase"] : -1;
+
+	while (fgets(ln, sizeof(ln), f))
+	{
+		std::vector<std::string> fields;
+		char *p = ln;
+		for (;;)
+		{
+			char *comma = strpbrk(p, ",\r\n");
+			fields.push_back(std::string(p, comma ? comma - p : strlen(p)));
+			if (!comma || (*comma != ',')) break;
+			p = comma + 1;
+		}
+		if ((int)fields.size() < (int)column.size()) continue;
+		tr.t.push_back(atoi(fields[column["t"]].c_str()));
+		tr.x.push_back(atof(fields[column["x"]].c_str()));
+		tr.y.push_back(atof(fields[column["y"]].c_str()));
+		tr.z.push_back(atof(fields[column["z"]].c_str()));
+		tr.vx.push_back(atof(fields[column["vx"]].c_str()));
+		tr.vy.push_back(atof(fields[column["vy"]].c_str()));
+		tr.vz.push_back(atof(fields[column["vz"]].c_str()));
+		tr.flying.push_back((phase < 0) || (fields[phase] != "ground"));
+	}
+	fclose(f);
+	return !tr.t.empty();
+}
+
+// one pair of drones over the replay
+struct pair_events
+{
+	int alert_since = -1;      // ms, start of the ongoing alert
+	int emergency = 0;         // the ongoing alert is an emergency
+	int violation = 0;         // the drones are now closer than the minimum distance
+	int warned = 0;            // there was a violation during the ongoing alert
+	int last_seen = 0;         // ms, the last update with the conflict
+};
+
+// drones that hover right at the minimum distance would start a new violation (and alert) at every update,
+// a violation ends only this much further apart, an alert after this long without the conflict (as the hold)
+static const float VIOLATION_HYSTERESIS = 0.1f;
+static const int ALERT_GAP = 1000;
+
+int main(int argc, char **argv)
+{
+	separation_monitor monitor;
+	float rate = 20, noise = 0;
+	int latency = 100, copies = 1, seed = 1;
+	std::vector<const char *> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-rate") == 0) rate = atof(val);
+			else if (strcmp(opt, "-min") == 0) monitor.config.min_distance = atof(val);
+			else if (strcmp(opt, "-emergency") == 0) monitor.config.emergency_distance = atof(val);
+			else if (strcmp(opt, "-horizon") == 0) monitor.config.horizon = atof(val);
+			else if (strcmp(opt, "-latency") == 0) latency = atoi(val);
+			else if (strcmp(opt, "-noise") == 0) noise = atof(val);
+			else if (strcmp(opt, "-copies") == 0) copies = atoi(val);
+			else if (strcmp(opt, "-seed") == 0) seed = atoi(val);
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else inputs.push_back(argv[i]);
+	}
+	if (inputs.empty() || (rate <= 0) || (copies < 1))
+	{
+		fprintf(stderr, "usage: separation_replay [-rate Hz] [-min m] [-emergency m] [-horizon s] [-latency ms] [-noise m] [-copies N] [-seed S] trace_1.csv ...\n");
+		return 1;
+	}
+
+	std::vector<telemetry> traces(inputs.size());
+	int end = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		traces[i].id = drone_id_of(inputs[i], i);
+		if (!load_trace(inputs[i], traces[i])) return 1;
+		end = std::max(end, traces[i].t.back());
+	}
+
+	std::mt19937 rng(seed);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+	int n = traces.size();
+	int side = (int)ceil(sqrt((double)copies));
+	std::vector<monitor_state> states;
+	std::vector<monitor_conflict> conflicts;
+	std::map<std::pair<int, int>, pair_events> events;
+	std::vector<double> check_us;
+	int warned = 0, missed = 0, false_alarms = 0;
+	int step = (int)lround(1000 / rate);
+
+	for (int ms = 0; ms <= end; ms += step)
+	{
+		// the states as they arrive: latency ms old, with noise, the copies shifted 20 m apart
+		states.clear();
+		for (int c = 0; c < copies; c++)
+			for (int i = 0; i < n; i++)
+			{
+				float s[6];
+				if (!traces[i].at(ms - latency, s)) continue;
+				float ox = 20.0f * (c % side), oy = 20.0f * (c / side);
+				states.push_back(monitor_state{ c * 1000 + traces[i].id, s[0] + ox + noise * gauss(rng), s[1] + oy + noise * gauss(rng),
+				                                s[2] + noise * gauss(rng), s[3], s[4], s[5], latency });
+			}
+
+		auto t0 = std::chrono::steady_clock::now();
+		monitor.check(states.data(), states.size(), conflicts);
+		check_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+
+		for (const monitor_conflict &c : conflicts)
+		{
+			if ((c.a >= 1000) || (c.b >= 1000)) continue;   // the copies only add work
+			pair_events &e = events[{ c.a, c.b }];
+			e.last_seen = ms;
+			if ((e.alert_since < 0) || ((c.action == MONITOR_EMERGENCY) && !e.emergency))
+				printf("%.2f s: drones %d and %d %s, %.2f m apart, %.2f m in %.2f s\n", ms / 1000.0, c.a, c.b,
+				       (c.action == MONITOR_EMERGENCY) ? "EMERGENCY" : "hold", c.distance, c.min_distance, c.time);
+			if (e.alert_since < 0) e.alert_since = ms;
+			if (c.action == MONITOR_EMERGENCY) e.emergency = 1;
+		}
+
+		// the true distances (without latency and noise), to see how early the alerts come
+		for (int i = 0; i < n; i++)
+			for (int j = i + 1; j < n; j++)
+			{
+				float a[6], b[6];
+				int lo = std::min(traces[i].id, traces[j].id), hi = std::max(traces[i].id, traces[j].id);
+				auto it = events.find({ lo, hi });
+				float d = INFINITY;
+				if (traces[i].at(ms, a) && traces[j].at(ms, b))
+					d = sqrtf((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+				if ((d < monitor.config.min_distance) && ((it == events.end()) || !it->second.violation))
+				{
+					pair_events &e = events[{ lo, hi }];
+					e.violation = 1;
+					if (e.alert_since >= 0)
+					{
+						printf("        drones %d and %d closer than %.2f m, alert %.2f s before\n", lo, hi, monitor.config.min_distance,
+						       (ms - e.alert_since) / 1000.0);
+						e.warned = 1;
+						warned++;
+					}
+					else
+					{
+						printf("        drones %d and %d closer than %.2f m WITHOUT AN ALERT\n", lo, hi, monitor.config.min_distance);
+						missed++;
+					}
+				}
+				else if ((d >= monitor.config.min_distance + VIOLATION_HYSTERESIS) && (it != events.end())) it->second.violation = 0;
+			}
+
+		// the alerts that ended
+		for (auto &it : events)
+		{
+			pair_events &e = it.second;
+			if ((e.alert_since < 0) || (ms - e.last_seen <= ALERT_GAP)) continue;
+			if (!e.warned) false_alarms++;
+			e.alert_since = -1;
+			e.emergency = e.warned = 0;
+		}
+	}
+
+	std::sort(check_us.begin(), check_us.end());
+	double mean = 0;
+	for (double us : check_us) mean += us;
+	mean /= std::max((size_t)1, check_us.size());
+	printf("%d drones, %d updates, check mean %.1f us, p99 %.1f us, max %.1f us\n", n * copies, (int)check_us.size(), mean,
+	       check_us[(size_t)(0.99 * (check_us.size() - 1))], check_us.back());
+	printf("%d violations with an alert before, %d without, %d alerts without a violation\n", warned, missed, false_alarms);
+	return missed ? 1 : 0;
+}
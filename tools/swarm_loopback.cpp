@@ -0,0 +1,145 @@
+// runs several instances of the swarm pose exchange (swarm_exchange.cpp) as separate processes on localhost,
+// each flies a synthetic circle, and checks that every instance sees all the others with the right poses;
+// prints the transport latency (sent -> received) and the age of the peer states when they are read
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o swarm_loopback swarm_loopback.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/swarm_exchange.cpp ../app/src/main/cpp/clock_sync.cpp -lpthread
+//
+// usage:    swarm_loopback [options]
+//
+//   -n N            number of drones (processes), default 6
+//   -port P         drone K listens on P + K, default 18994
+//   -rate Hz        packets per second, default 20
+//   -fps F          localization frames per second (pose updates), default 15
+//   -time s         duration of the test, default 5
+//
+//   exit code is 1 when some instance misses a peer or receives a wrong pose
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <vector>
+#include "swarm_exchange.h"
+
+// poses of the synthetic flight are this close to the exact ones
+static const float POSE_TOLERANCE = 0.01f;   // m
+
+static int64_t wall_clock_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// drone K flies a circle of its own, t in wall clock ms
+static void synthetic_pose(int k, int64_t t, float pose[4])
+{
+	double a = (t % 100000) / 1000.0 * 0.5 + k;
+	pose[0] = 1.0f * k + 0.5f * cos(a);
+	pose[1] = 0.5f * sin(a);
+	pose[2] = 2.0f + 0.1f * k;
+	pose[3] = fmod(a, 2 * M_PI);
+}
+
+static int run_drone(int k, int n, int port, float rate, float fps, float seconds)
+{
+	for (int j = 0; j < n; j++)
+		if (j != k) swarm_add_destination("127.0.0.1", port + j);
+	if (!swarm_start(k, port + k, rate))
+	{
+		fprintf(stderr, "drone %d: cannot open port %d\n", k, port + k);
+		return 1;
+	}
+
+	std::vector<int> latencies, ages;
+	std::vector<int> seen(n, 0);
+	int wrong = 0;
+	int64_t start = wall_clock_ms(), next_frame = start;
+	while (wall_clock_ms() - start < seconds * 1000)
+	{
+		int64_t now = wall_clock_ms();
+		if (now >= next_frame)
+		{
+			float pose[4];
+			synthetic_pose(k, now, pose);
+			swarm_update_pose(pose);
+			next_frame += (int64_t)(1000 / fps);
+		}
+
+		// read the table as a consumer would (every 5 ms)
+		swarm_peer peers[SWARM_MAX_DRONES];
+		int count = swarm_peers(peers, SWARM_MAX_DRONES, 0);
+		for (int i = 0; i < count; i++)
+		{
+			const swarm_peer &p = peers[i];
+			if ((p.drone_id >= n) || !p.valid) continue;
+			if (seen[p.drone_id] != (int)p.sequence + 1)
+			{
+				// a new packet: the pose must be the one of the sender at the time of its localization
+				seen[p.drone_id] = p.sequence + 1;
+				latencies.push_back((int)(p.received_time - p.sent_time));
+				float exact[4];
+				synthetic_pose(p.drone_id, p.sent_time - (p.age - (wall_clock_ms() - p.received_time)), exact);
+				if (fabsf(exact[0] - p.x) + fabsf(exact[1] - p.y) + fabsf(exact[2] - p.z) > POSE_TOLERANCE) wrong++;
+			}
+			ages.push_back(p.age);
+		}
+		usleep(5000);
+	}
+	swarm_stats s = swarm_get_stats();
+	swarm_stop();
+
+	int missing = 0;
+	for (int j = 0; j < n; j++)
+		if ((j != k) && !seen[j]) missing++;
+	std::sort(latencies.begin(), latencies.end());
+	std::sort(ages.begin(), ages.end());
+	auto percentile = [](const std::vector<int> &v, double q) { return v.empty() ? -1 : v[(size_t)(q * (v.size() - 1))]; };
+	printf("drone %d: sent %u, received %u, lost %u, reordered %u, latency median %d ms max %d ms, state age median %d ms p99 %d ms, %d peers missing, %d wrong poses\n",
+	       k, s.sent, s.received, s.lost, s.reordered, percentile(latencies, 0.5), percentile(latencies, 1.0),
+	       percentile(ages, 0.5), percentile(ages, 0.99), missing, wrong);
+	return (missing || wrong) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int n = 6, port = 18994;
+	float rate = 20, fps = 15, seconds = 5;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "-n") == 0) n = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-port") == 0) port = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-rate") == 0) rate = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-fps") == 0) fps = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-time") == 0) seconds = atof(argv[i + 1]);
+		else fprintf(stderr, "unknown option %s\n", argv[i]);
+	}
+	if ((n < 2) || (n > SWARM_MAX_DRONES) || (rate <= 0) || (fps <= 0))
+	{
+		fprintf(stderr, "usage: swarm_loopback [-n N] [-port P] [-rate Hz] [-fps F] [-time s]\n");
+		return 1;
+	}
+
+	fflush(stdout);
+	std::vector<pid_t> children;
+	for (int k = 0; k < n; k++)
+	{
+		pid_t pid = fork();
+		if (pid == 0) exit(run_drone(k, n, port, rate, fps, seconds));
+		children.push_back(pid);
+	}
+	int failed = 0;
+	for (pid_t pid : children)
+	{
+		int status;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) failed++;
+	}
+	printf("%d of %d instances %s\n", n - failed, n, failed ? "failed" : "ok");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+// searches the six color thresholds of the localization (the camera color detection block of config.txt)
+// on recorded frames or on a mat_renderer dataset: the color features of each frame are computed once
+// (localization_features_batch of fastimglib.h), and the candidate thresholds are evaluated in parallel, each
+// by localizing all the frames from their features; the search is a coarse-to-fine grid around the best
+// thresholds so far (steps 32 ... 1), scored by the frames localized at the right pose
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o threshold_tuner threshold_tuner.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/fastimglib.cpp ../app/src/main/cpp/color_lut.cpp ../app/src/main/cpp/overlay_renderer.cpp
+//               ../app/src/main/cpp/position_controller.cpp ../app/src/main/cpp/trajectory_interpolator.cpp
+//               ../app/src/main/cpp/dance_bundle.cpp ../app/src/main/cpp/swarm_exchange.cpp
+//               ../app/src/main/cpp/separation_monitor.cpp ../app/src/main/cpp/clock_sync.cpp
+//               `pkg-config --cflags --libs opencv4` -lpthread
+//
+// usage:    threshold_tuner [options] dataset_dir
+//
+//   dataset_dir     with ground_truth.csv (mat_renderer -count N -o dataset_dir): a frame is a success when its pose
+//                   is within -tol of the ground truth; without ground_truth.csv, all the .png and .jpg frames of
+//                   the directory are taken as one recorded sequence (in the order of their names), and a frame is
+//                   a success when its pose is within -tol of the consensus of its neighbours (the median
+//                   of the poses found in the -window frames before and after it)
+//   -colors r,g,b,y,k,c   thresholds to start from: red_t, green_t, blue_t, yellow_t, black_maxRGB_t, black_chroma_t
+//                   of config.txt, default 25,25,15,41,130,103
+//   -camera fx,fy,cx,cy,k1,k2,p1,p2,k3   camera_fx ... camera_k3 of config.txt, default uncalibrated
+//   -frames N       at most N frames (evenly spaced) are used, default 150; each takes 6 bytes per pixel
+//   -tol m          position tolerance, default 0.10 (the yaw tolerance is 10 deg)
+//   -window N       of the consensus, default 3
+//   -threads N      default: all cores
+//   -o file         write the config.txt block there instead of printing it
+
+#include <opencv2/opencv.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "fastimglib.h"
+
+typedef std::array<int, 6> thresholds_t;     // [red, green, blue, yellow, black max, black chroma]
+
+static const int STEPS[] = { 32, 16, 8, 4, 2, 1 };
+static const int MAX_MOVES = 12;             // at one step
+static const float YAW_TOLERANCE = 10 * M_PI / 180;
+
+static double tolerance = 0.10;
+static int window = 3;
+
+struct truth
+{
+	std::string file;
+	double x, y, height, yaw;
+};
+
+struct score
+{
+	double value;            // successes + the fraction of the identified corners as a tie-break
+	int successes, found;
+};
+
+static int load_dataset(const char *dir, std::vector<truth> &frames)
+{
+	std::string name = std::string(dir) + "/ground_truth.csv";
+	FILE *f = fopen(name.c_str(), "r");
+	if (f)
+	{
+		char line[512], file[256];
+		int index, device;
+		truth t;
+		while (fgets(line, sizeof(line), f))
+			if (sscanf(line, "%d,%255[^,],%d,%lf,%lf,%lf,%lf", &index, file, &device, &t.x, &t.y, &t.height, &t.yaw) == 7)
+			{
+				t.file = std::string(dir) + "/" + file;
+				frames.push_back(t);
+			}
+		fclose(f);
+		return 1;
+	}
+	std::vector<cv::String> files, jpg;
+	cv::glob(std::string(dir) + "/*.png", files, false);
+	cv::glob(std::string(dir) + "/*.jpg", jpg, false);
+	files.insert(files.end(), jpg.begin(), jpg.end());
+	std::sort(files.begin(), files.end());
+	for (const cv::String &file : files) frames.push_back(truth{ file, 0, 0, 0, 0 });
+	return 0;
+}
+
+static int near_pose(const float *pose, double x, double y, double yaw)
+{
+	return (hypot(pose[0] - x, pose[1] - y) <= tolerance) && (fabs(remainder(pose[3] - yaw, 2 * M_PI)) <= YAW_TOLERANCE);
+}
+
+static double median(std::vector<double> &v)
+{
+	std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+	return v[v.size() / 2];
+}
+
+static score evaluate(const std::vector<localization_features> &features, const std::vector<truth> &truths, int known,
+                      const thresholds_t &t)
+{
+	std::vector<localization_result> results;
+	localize_features(features, t.data(), results);
+	score s = { 0, 0, 0 };
+	double identified = 0;
+	int n = (int)results.size();
+	for (int i = 0; i < n; i++)
+	{
+		const float *pose = results[i].pose;
+		if (results[i].corners > 0) identified += results[i].identified / (double)results[i].corners;
+		if (pose[0] > 900.0f) continue;
+		s.found++;
+		if (known)
+		{
+			s.successes += near_pose(pose, truths[i].x, truths[i].y, truths[i].yaw);
+			continue;
+		}
+		// the consensus of the neighbours; the yaw by its median sine and cosine is good enough for a tolerance
+		std::vector<double> x, y, c, sn;
+		for (int j = std::max(0, i - window); j <= std::min(n - 1, i + window); j++)
+			if ((j != i) && (results[j].pose[0] < 900.0f))
+			{
+				x.push_back(results[j].pose[0]);
+				y.push_back(results[j].pose[1]);
+				c.push_back(cos(results[j].pose[3]));
+				sn.push_back(sin(results[j].pose[3]));
+			}
+		if (x.size() < 2) continue;
+		s.successes += near_pose(pose, median(x), median(y), atan2(median(sn), median(c)));
+	}
+	s.value = s.successes + (n ? identified / n : 0);
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	localization_batch_config config;
+	thresholds_t current = { config.thresholds[0], config.thresholds[1], config.thresholds[2],
+	                         config.thresholds[3], config.thresholds[4], config.thresholds[5] };
+	const char *dataset = 0, *output = 0;
+	int max_frames = 150;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-colors") == 0)
+				sscanf(val, "%d,%d,%d,%d,%d,%d", &current[0], &current[1], &current[2], &current[3], &current[4], &current[5]);
+			else if (strcmp(opt, "-camera") == 0)
+				sscanf(val, "%f,%f,%f,%f,%f,%f,%f,%f,%f", &config.camera[0], &config.camera[1], &config.camera[2],
+				       &config.camera[3], &config.camera[4], &config.camera[5], &config.camera[6], &config.camera[7],
+				       &config.camera[8]);
+			else if (strcmp(opt, "-frames") == 0) max_frames = atoi(val);
+			else if (strcmp(opt, "-tol") == 0) tolerance = atof(val);
+			else if (strcmp(opt, "-window") == 0) window = atoi(val);
+			else if (strcmp(opt, "-threads") == 0) config.threads = atoi(val);
+			else if (strcmp(opt, "-o") == 0) output = val;
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else dataset = argv[i];
+	}
+	if (!dataset || (max_frames <= 0) || (tolerance <= 0) || (window < 1))
+	{
+		fprintf(stderr, "usage: threshold_tuner [-colors r,g,b,y,k,c] [-camera fx,fy,cx,cy,k1,k2,p1,p2,k3] [-frames N] [-tol m] "
+		                "[-window N] [-threads N] [-o file] dataset_dir\n");
+		return 1;
+	}
+	int threads = (config.threads > 0) ? config.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<truth> all, truths;
+	int known = load_dataset(dataset, all);
+	size_t used = std::min(all.size(), (size_t)max_frames);
+	for (size_t i = 0; i < used; i++) truths.push_back(all[i * all.size() / used]);
+	if (truths.empty())
+	{
+		fprintf(stderr, "no frames in %s\n", dataset);
+		return 1;
+	}
+	std::vector<localization_frame> frames(truths.size());
+	for (size_t i = 0; i < truths.size(); i++)
+	{
+		cv::Mat bgr = cv::imread(truths[i].file, cv::IMREAD_COLOR);
+		if (bgr.empty())
+		{
+			fprintf(stderr, "could not read %s\n", truths[i].file.c_str());
+			return 1;
+		}
+		cv::cvtColor(bgr, frames[i].image, cv::COLOR_BGR2RGBA);    // the same as the frames of the app
+		frames[i].time = i;
+	}
+	std::vector<localization_features> features;
+	localization_features_batch(frames, config, features);
+	frames.clear();
+	printf("%d frames of %s, %s\n", (int)features.size(), dataset, known ? "against the ground truth" : "against the consensus of the neighbours");
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::map<thresholds_t, score> scores;
+	scores[current] = evaluate(features, truths, known, current);
+	score start = scores[current];
+	int evaluations = 1;
+	for (int step : STEPS)
+		for (int move = 0; move < MAX_MOVES; move++)
+		{
+			// one threshold changed by -2 .. 2 steps, all of them at once on all cores
+			std::vector<thresholds_t> candidates;
+			for (int d = 0; d < 6; d++)
+				for (int k = -2; k <= 2; k++)
+				{
+					thresholds_t c = current;
+					c[d] = std::min(255, std::max(0, c[d] + k * step));
+					if (!scores.count(c) && (std::find(candidates.begin(), candidates.end(), c) == candidates.end()))
+						candidates.push_back(c);
+				}
+			std::vector<score> results(candidates.size());
+			std::atomic<size_t> next(0);
+			std::vector<std::thread> workers;
+			for (int t = 0; t < std::min(threads, (int)candidates.size()); t++)
+				workers.emplace_back([&]() {
+					for (size_t i = next++; i < candidates.size(); i = next++)
+						results[i] = evaluate(features, truths, known, candidates[i]);
+				});
+			for (auto &w : workers) w.join();
+			evaluations += (int)candidates.size();
+
+			thresholds_t best = current;
+			for (size_t i = 0; i < candidates.size(); i++)
+			{
+				scores[candidates[i]] = results[i];
+				if (results[i].value > scores[best].value) best = candidates[i];
+			}
+			if (best == current) break;
+			current = best;
+			printf("step %2d: %d,%d,%d,%d,%d,%d  %d of %d frames (%d with a pose)\n", step, current[0], current[1], current[2],
+			       current[3], current[4], current[5], scores[current].successes, (int)features.size(), scores[current].found);
+		}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	score best = scores[current];
+	printf("%d thresholds evaluated in %.1f s (%.1f ms each on %d threads)\n", evaluations, seconds,
+	       1000.0 * seconds * threads / evaluations, threads);
+	printf("successes %d -> %d of %d frames\n\n", start.successes, best.successes, (int)features.size());
+
+	FILE *f = output ? fopen(output, "w+") : stdout;
+	if (!f)
+	{
+		perror("Cannot open output file");
+		return 1;
+	}
+	fprintf(f, "# camera color detection (threshold_tuner on %s: %d of %d frames)\n\n", dataset, best.successes, (int)features.size());
+	fprintf(f, "black_maxRGB_t=%d\nblack_chroma_t=%d\nred_t=%d\ngreen_t=%d\nblue_t=%d\nyellow_t=%d\n",
+	        current[4], current[5], current[0], current[1], current[2], current[3]);
+	if (output) fclose(f);
+	return 0;
+}
@@ -0,0 +1,231 @@
+// checks the signs of the attitude aided localization (set_attitude of fastimglib.cpp) on tilted frames of mat_renderer:
+// the frames are localized without the attitude, with their tilt as the attitude of the aircraft and as the angles
+// of the gimbal (both as the SDK gives them), and with the signs of the roll or the pitch flipped (or the two swapped);
+// the attitude with the right signs must give the smallest errors; with it, the frames with a single identified
+// corner must get their pose from the height of the frames before them (the dataset is taken as a sequence at 30 fps)
+//
+// compile:  g++ -O2 -std=c++17 -DFASTIMGLIB_NO_JNI -o tilt_check tilt_check.cpp -I../app/src/main/cpp
+//               ../app/src/main/cpp/fastimglib.cpp ../app/src/main/cpp/color_lut.cpp ../app/src/main/cpp/overlay_renderer.cpp
+//               ../app/src/main/cpp/position_controller.cpp ../app/src/main/cpp/trajectory_interpolator.cpp
+//               ../app/src/main/cpp/dance_bundle.cpp ../app/src/main/cpp/swarm_exchange.cpp
+//               ../app/src/main/cpp/separation_monitor.cpp ../app/src/main/cpp/clock_sync.cpp
+//               `pkg-config --cflags --libs opencv4` -lpthread
+//
+// usage:    tilt_check [options] dataset_dir
+//
+//   dataset_dir     mat_renderer -count N -tilt T -height H,H -o dataset_dir (e.g. N = 300, T = 8, H = 1.6): all frames
+//                   at one height, so that the height of the frames before is right for the frames with a single corner
+//   -tol m          position tolerance of the frames with a single corner (their median error), default 0.10
+//   -threads N      default: all cores
+//   -colors r,g,b,y,k,c   red_t, green_t, blue_t, yellow_t, black_maxRGB_t, black_chroma_t of config.txt,
+//                   default 25,25,15,41,130,103
+//
+//   exit code is 1 when the attitude with the right signs is not the best one, or when a frame with a single
+//   identified corner gets no pose with it (or there is no such frame)
+//
+// the camera of mat_renderer looks down with the top of the image forward; its roll turns the optical axis
+// towards the top of the image (the aircraft pitching up) and its pitch towards the left of the image (the aircraft
+// rolling right), and they are applied in this order, as the yaw-pitch-roll angles of the SDK: so the attitude
+// of the aircraft is [pitch, roll] of ground_truth.csv, the gimbal [pitch, roll - 90]; the compass heading is
+// the true yaw in all the runs
+
+#include <opencv2/opencv.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "fastimglib.h"
+
+struct truth
+{
+	std::string file;
+	double x, y, height, yaw, roll, pitch;
+};
+
+enum attitude_kind { NO_ATTITUDE, AIRCRAFT, GIMBAL, ROLL_FLIPPED, PITCH_FLIPPED, SWAPPED, KINDS };
+
+static const char *kind_names[KINDS] = { "no attitude", "aircraft attitude", "gimbal angles",
+                                         "roll flipped", "pitch flipped", "roll and pitch swapped" };
+
+static int load_ground_truth(const char *dir, std::vector<truth> &frames)
+{
+	std::string name = std::string(dir) + "/ground_truth.csv";
+	FILE *f = fopen(name.c_str(), "r");
+	if (!f)
+	{
+		perror("Cannot open ground truth file");
+		return 0;
+	}
+	char line[512], file[256];
+	int index, device;
+	truth t;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "%d,%255[^,],%d,%lf,%lf,%lf,%lf,%lf,%lf", &index, file, &device, &t.x, &t.y, &t.height, &t.yaw,
+		           &t.roll, &t.pitch) == 9)
+		{
+			t.file = std::string(dir) + "/" + file;
+			frames.push_back(t);
+		}
+	fclose(f);
+	return 1;
+}
+
+// [roll, pitch, yaw, compass heading, gimbal roll, gimbal pitch] of the frame as the SDK would give it
+static void attitude_of(const truth &t, int kind, float attitude[6])
+{
+	for (int i = 0; i < 6; i++) attitude[i] = NAN;
+	if (kind == NO_ATTITUDE) return;
+	attitude[3] = (float)(-t.yaw * 180 / M_PI);     // heading is clockwise, with north_correction 0
+	float roll = (float)t.pitch, pitch = (float)t.roll;
+	switch (kind)
+	{
+		case ROLL_FLIPPED: roll = -roll; break;
+		case PITCH_FLIPPED: pitch = -pitch; break;
+		case SWAPPED: std::swap(roll, pitch); break;
+	}
+	if (kind == GIMBAL)
+	{
+		attitude[4] = roll;
+		attitude[5] = pitch - 90;
+	}
+	else
+	{
+		attitude[0] = roll;
+		attitude[1] = pitch;
+	}
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+	if (v.empty()) return 0;
+	size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+	std::nth_element(v.begin(), v.begin() + k, v.end());
+	return v[k];
+}
+
+int main(int argc, char **argv)
+{
+	localization_batch_config config;
+	config.filtered = 0;
+	const char *dataset = 0;
+	double tolerance = 0.10;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *opt = argv[i], *val = argv[++i];
+			if (strcmp(opt, "-threads") == 0) config.threads = atoi(val);
+			else if (strcmp(opt, "-tol") == 0) tolerance = atof(val);
+			else if (strcmp(opt, "-colors") == 0)
+				sscanf(val, "%d,%d,%d,%d,%d,%d", &config.thresholds[0], &config.thresholds[1], &config.thresholds[2],
+				       &config.thresholds[3], &config.thresholds[4], &config.thresholds[5]);
+			else fprintf(stderr, "unknown option %s\n", opt);
+		}
+		else dataset = argv[i];
+	}
+	if (!dataset || (tolerance <= 0))
+	{
+		fprintf(stderr, "usage: tilt_check [-tol m] [-threads N] [-colors r,g,b,y,k,c] dataset_dir\n");
+		return 1;
+	}
+
+	std::vector<truth> truths;
+	if (!load_ground_truth(dataset, truths)) return 1;
+	std::vector<localization_frame> frames(truths.size());
+	double tilt = 0, min_height = 1e9, max_height = 0;
+	for (size_t i = 0; i < truths.size(); i++)
+	{
+		cv::Mat bgr = cv::imread(truths[i].file, cv::IMREAD_COLOR);
+		if (bgr.empty())
+		{
+			fprintf(stderr, "could not read %s\n", truths[i].file.c_str());
+			return 1;
+		}
+		cv::cvtColor(bgr, frames[i].image, cv::COLOR_BGR2RGBA);    // the same as the frames of the app
+		frames[i].time = i * 1000.0 / 30;
+		tilt = std::max(tilt, std::max(fabs(truths[i].roll), fabs(truths[i].pitch)));
+		min_height = std::min(min_height, truths[i].height);
+		max_height = std::max(max_height, truths[i].height);
+	}
+	if (frames.empty())
+	{
+		fprintf(stderr, "no frames in %s (with the roll and pitch columns)\n", dataset);
+		return 1;
+	}
+	if (tilt < 1) fprintf(stderr, "the frames are not tilted (mat_renderer -tilt), nothing to tell the signs apart\n");
+	if (max_height - min_height > 0.01)
+		fprintf(stderr, "the frames are at different heights (mat_renderer -height H,H), the frames with a single corner "
+		                "take a wrong one\n");
+
+	double median[KINDS];
+	std::vector<localization_result> results[KINDS];
+	for (int kind = 0; kind < KINDS; kind++)
+	{
+		for (size_t i = 0; i < frames.size(); i++) attitude_of(truths[i], kind, frames[i].attitude);
+		localize_batch(frames, config, results[kind]);
+
+		std::vector<double> errors;
+		for (size_t i = 0; i < results[kind].size(); i++)
+		{
+			const float *pose = results[kind][i].pose;
+			if (pose[0] < 900.0f) errors.push_back(hypot(pose[0] - truths[i].x, pose[1] - truths[i].y));
+		}
+		median[kind] = errors.empty() ? 1e9 : percentile(errors, 0.5);
+		printf("%-24s %d of %d localized, position error [m] median %.4f  95%% %.4f\n", kind_names[kind], (int)errors.size(),
+		       (int)frames.size(), percentile(errors, 0.5), percentile(errors, 0.95));
+	}
+
+	// the gimbal angles are the same tilt, so the poses must be the same
+	int ok = 1;
+	for (size_t i = 0; i < frames.size(); i++)
+		if (memcmp(results[AIRCRAFT][i].pose, results[GIMBAL][i].pose, sizeof(results[AIRCRAFT][i].pose)) != 0)
+		{
+			printf("FAILED: frame %d gives another pose with the gimbal angles than with the aircraft attitude\n", (int)i);
+			ok = 0;
+			break;
+		}
+	for (int kind = 0; kind < KINDS; kind++)
+		if ((kind != AIRCRAFT) && (kind != GIMBAL) && (median[kind] <= median[AIRCRAFT]))
+		{
+			printf("FAILED: %s is not worse than the attitude with the right signs\n", kind_names[kind]);
+			ok = 0;
+		}
+
+	// a single identified corner is enough with the attitude, with the height of a frame with a pair of corners
+	// less than a second before
+	std::vector<double> single_errors;
+	int singles = 0;
+	double pair_time = -1e9;
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		if (results[AIRCRAFT][i].pair_height > 0) pair_time = frames[i].time;
+		if ((results[AIRCRAFT][i].identified != 1) || (frames[i].time - pair_time >= 1000)) continue;
+		singles++;
+		const float *pose = results[AIRCRAFT][i].pose;
+		if (pose[0] < 900.0f) single_errors.push_back(hypot(pose[0] - truths[i].x, pose[1] - truths[i].y));
+	}
+	printf("single corner            %d of %d localized, position error [m] median %.4f  95%% %.4f\n",
+	       (int)single_errors.size(), singles, percentile(single_errors, 0.5), percentile(single_errors, 0.95));
+	if (singles == 0)
+	{
+		printf("FAILED: no frame with a single identified corner, render the frames lower (-height) or farther (-range)\n");
+		ok = 0;
+	}
+	else if ((int)single_errors.size() < singles)
+	{
+		printf("FAILED: %d frames with a single identified corner got no pose\n", singles - (int)single_errors.size());
+		ok = 0;
+	}
+	else if (percentile(single_errors, 0.5) > tolerance)
+	{
+		printf("FAILED: the frames with a single identified corner are more than %.2f m off\n", tolerance);
+		ok = 0;
+	}
+	printf("%s (tilt up to %.1f deg)\n", ok ? "the signs of the attitude are right, a single corner gives the pose"
+	                                     : "the attitude aided localization is WRONG", tilt);
+	return ok ? 0 : 1;
+}
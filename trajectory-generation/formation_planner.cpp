@@ -0,0 +1,406 @@
+// plans the transition of all drones from one formation to another: assigns the drones to the slots of the new
+// formation (Hungarian method, minimum sum of squared distances), moves them along synchronized straight lines
+// (which cannot collide when the slots are far enough apart, about 2.8 x the half of the minimum distance),
+// lifts or lowers the drones that would still get too close, and writes one procedure for each dance_K.txt
+//
+// compile:  g++ -O2 -std=c++17 -o formation_planner formation_planner.cpp trajectory.cpp
+//
+// usage:    formation_planner [options] from.txt to.txt
+//
+//   from.txt        drones, lines "K x y z [yaw]" (K as in dance_K.txt, yaw in radians)
+//   to.txt          slots, lines "x y z [yaw]", at least as many as the drones (without yaw the drone keeps its yaw)
+//
+//   -name NAME      procedure name, default FORMATION
+//   -d dir          the procedure of drone K is written to dir/NAME_K (to paste into dance_K.txt), default: .
+//   -duration ms    duration of the transition, default: the shortest within the speed limits
+//   -speed h,v      horizontal and vertical speed limits in m/s, default 0.3,1
+//   -min m          minimum distance of two drones, default 0.8
+//   -layer m        height of the detours of the drones that would get too close, default: the minimum distance
+//   -zmin m, -zmax m    the detours stay within these heights, default 1, 5
+//   -tol m, -yawtol deg, -interp hold|linear, -maxstep ms    sampling of the POS commands, as in trajgen
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "trajectory.h"
+
+static double tolerance = 0.03;               // m
+static double yaw_tolerance = 3.0 * M_PI / 180.0;   // rad
+static int interpolation = TRAJ_HOLD;
+static int max_step = 1000;                   // ms
+
+static double min_distance = 0.8, layer = -1, zmin = 1.0, zmax = 5.0;
+static double speed_h = 0.3, speed_v = 1.0;
+
+// samples of the normalized time used for the checks
+static const int CHECK_STEPS = 200;
+
+struct drone
+{
+	int id;
+	traj_pose from, to;
+	int detour;         // the path is lifted by detour * layer in the middle
+};
+
+struct slot
+{
+	traj_pose pose;
+	int has_yaw;
+};
+
+static void usage()
+{
+	fprintf(stderr, "usage: formation_planner [-name NAME] [-d dir] [-duration ms] [-speed h,v] [-min m] [-layer m] [-zmin m] [-zmax m] [-tol m] [-yawtol deg] [-interp hold|linear] [-maxstep ms] from.txt to.txt\n");
+	exit(1);
+}
+
+// lines of numbers, # comments
+static bool load_rows(const char *path, std::vector<std::vector<double>> &rows)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+	char ln[1000];
+	while (fgets(ln, 1000, f))
+	{
+		char *hash = strchr(ln, '#');
+		if (hash) *hash = 0;
+		std::vector<double> row;
+		for (char *tok = strtok(ln, " \t\r\n,"); tok; tok = strtok(0, " \t\r\n,"))
+			row.push_back(atof(tok));
+		if (!row.empty()) rows.push_back(row);
+	}
+	fclose(f);
+	return true;
+}
+
+// the position of the drone at the fraction s (already warped) of the transition
+static traj_pose path_at(const drone &d, double s)
+{
+	traj_pose p;
+	p.x = d.from.x + s * (d.to.x - d.from.x);
+	p.y = d.from.y + s * (d.to.y - d.from.y);
+	p.z = d.from.z + s * (d.to.z - d.from.z) + d.detour * layer * sin(M_PI * s);
+	p.yaw = d.from.yaw + s * remainder(d.to.yaw - d.from.yaw, 2 * M_PI);
+	return p;
+}
+
+static double ease(double f)
+{
+	return f * f * (3.0 - 2.0 * f);
+}
+
+// assignment of n rows to m >= n columns with the minimum sum of costs (Hungarian method with potentials, O(n^2 m))
+static std::vector<int> hungarian(const std::vector<std::vector<double>> &cost)
+{
+	int n = cost.size(), m = cost[0].size();
+	std::vector<double> u(n + 1), v(m + 1);
+	std::vector<int> p(m + 1), way(m + 1);
+	for (int i = 1; i <= n; i++)
+	{
+		p[0] = i;
+		int j0 = 0;
+		std::vector<double> minv(m + 1, INFINITY);
+		std::vector<char> used(m + 1, 0);
+		do
+		{
+			used[j0] = 1;
+			int i0 = p[j0], j1 = 0;
+			double delta = INFINITY;
+			for (int j = 1; j <= m; j++)
+				if (!used[j])
+				{
+					double cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+					if (cur < minv[j])
+					{
+						minv[j] = cur;
+						way[j] = j0;
+					}
+					if (minv[j] < delta)
+					{
+						delta = minv[j];
+						j1 = j;
+					}
+				}
+			for (int j = 0; j <= m; j++)
+				if (used[j])
+				{
+					u[p[j]] += delta;
+					v[j] -= delta;
+				}
+				else minv[j] -= delta;
+			j0 = j1;
+		} while (p[j0] != 0);
+		do
+		{
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while (j0);
+	}
+	std::vector<int> assigned(n);
+	for (int j = 1; j <= m; j++)
+		if (p[j]) assigned[p[j] - 1] = j - 1;
+	return assigned;
+}
+
+// the smallest distance of the two drones during the transition
+static double closest(const drone &a, const drone &b)
+{
+	// the paths stay within their boxes (and the detours), no need to sample the ones far apart
+	double gap = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		double a0 = (&a.from.x)[axis], a1 = (&a.to.x)[axis], b0 = (&b.from.x)[axis], b1 = (&b.to.x)[axis];
+		double lift = (axis == 2) ? (abs(a.detour) + abs(b.detour)) * layer : 0;
+		double g = std::max(std::min(b0, b1) - std::max(a0, a1), std::min(a0, a1) - std::max(b0, b1)) - lift;
+		gap = std::max(gap, g);
+	}
+	if (gap >= min_distance) return gap;
+
+	double d = INFINITY;
+	for (int k = 0; k <= CHECK_STEPS; k++)
+	{
+		double s = (double)k / CHECK_STEPS;
+		traj_pose p = path_at(a, s), q = path_at(b, s);
+		d = std::min(d, sqrt((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y) + (p.z - q.z) * (p.z - q.z)));
+	}
+	return d;
+}
+
+// closest distances of all pairs, updated one drone at a time
+struct distances
+{
+	int n;
+	std::vector<double> d;
+
+	distances(const std::vector<drone> &drones) : n(drones.size()), d(n * n, INFINITY)
+	{
+		for (int i = 0; i < n; i++) update(drones, i);
+	}
+
+	void update(const std::vector<drone> &drones, int i)
+	{
+		for (int j = 0; j < n; j++)
+			if (j != i) d[i * n + j] = d[j * n + i] = closest(drones[i], drones[j]);
+	}
+
+	int conflicts(int i) const
+	{
+		int count = 0;
+		for (int j = 0; j < n; j++)
+			if (d[i * n + j] < min_distance) count++;
+		return count;
+	}
+};
+
+static bool detour_allowed(const drone &d)
+{
+	double top = std::max(d.from.z, d.to.z), bottom = std::min(d.from.z, d.to.z);
+	if (d.detour > 0) return top + d.detour * layer <= zmax;
+	return bottom + d.detour * layer >= zmin;
+}
+
+// gives detours to the drones with conflicts (the one with most conflicts first)
+static void resolve(std::vector<drone> &drones, distances &dist)
+{
+	int n = drones.size();
+	for (int round = 0; round < n; round++)
+	{
+		int worst = -1, most = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (drones[i].detour != 0) continue;
+			int c = dist.conflicts(i);
+			if (c > most)
+			{
+				most = c;
+				worst = i;
+			}
+		}
+		if (worst < 0) break;
+
+		// the smallest detour that removes the most conflicts: up 1, down 1, up 2, down 2, ...
+		int best = 0, best_count = most;
+		for (int level = 1; (level <= 3) && best_count; level++)
+			for (int sign = 1; sign >= -1; sign -= 2)
+			{
+				drones[worst].detour = sign * level;
+				if (!detour_allowed(drones[worst])) continue;
+				dist.update(drones, worst);
+				int c = dist.conflicts(worst);
+				if (c < best_count)
+				{
+					best_count = c;
+					best = sign * level;
+				}
+			}
+		drones[worst].detour = best;
+		dist.update(drones, worst);
+		if (best == 0) break;   // nothing helps, the remaining conflicts are reported
+	}
+}
+
+// the shortest duration (ms) that keeps the speed limits with the ease timing
+static int shortest_duration(const std::vector<drone> &drones)
+{
+	double t = 0;
+	for (const drone &d : drones)
+		for (int k = 0; k < CHECK_STEPS; k++)
+		{
+			double f0 = (double)k / CHECK_STEPS, f1 = (double)(k + 1) / CHECK_STEPS;
+			traj_pose p = path_at(d, ease(f0)), q = path_at(d, ease(f1));
+			// time needed for this step if the whole transition took 1 s
+			double h = hypot(q.x - p.x, q.y - p.y) / (f1 - f0), v = fabs(q.z - p.z) / (f1 - f0);
+			t = std::max(t, std::max(h / speed_h, v / speed_v));
+		}
+	return std::max(1, (int)ceil(t * 1000));
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = "FORMATION", *output_dir = ".";
+	const char *inputs[2] = { 0, 0 };
+	int n_inputs = 0, duration = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *val = argv[i + 1];
+			if (strcmp(argv[i], "-name") == 0) name = val;
+			else if (strcmp(argv[i], "-d") == 0) output_dir = val;
+			else if (strcmp(argv[i], "-duration") == 0) duration = atoi(val);
+			else if (strcmp(argv[i], "-speed") == 0)
+			{
+				if (sscanf(val, "%lf,%lf", &speed_h, &speed_v) != 2) usage();
+			}
+			else if (strcmp(argv[i], "-min") == 0) min_distance = atof(val);
+			else if (strcmp(argv[i], "-layer") == 0) layer = atof(val);
+			else if (strcmp(argv[i], "-zmin") == 0) zmin = atof(val);
+			else if (strcmp(argv[i], "-zmax") == 0) zmax = atof(val);
+			else if (strcmp(argv[i], "-tol") == 0) tolerance = atof(val);
+			else if (strcmp(argv[i], "-yawtol") == 0) yaw_tolerance = atof(val) * M_PI / 180.0;
+			else if (strcmp(argv[i], "-interp") == 0) interpolation = (strcmp(val, "linear") == 0) ? TRAJ_LINEAR : TRAJ_HOLD;
+			else if (strcmp(argv[i], "-maxstep") == 0) max_step = atoi(val);
+			else usage();
+			i++;
+		}
+		else if (n_inputs < 2) inputs[n_inputs++] = argv[i];
+		else usage();
+	}
+	if ((n_inputs < 2) || (min_distance <= 0) || (speed_h <= 0) || (speed_v <= 0) || (tolerance <= 0) || (yaw_tolerance <= 0)) usage();
+	if (layer <= 0) layer = min_distance;
+
+	std::vector<std::vector<double>> from_rows, to_rows;
+	if (!load_rows(inputs[0], from_rows) || !load_rows(inputs[1], to_rows)) return 1;
+
+	std::vector<drone> drones;
+	for (const std::vector<double> &r : from_rows)
+	{
+		if (r.size() < 4)
+		{
+			fprintf(stderr, "%s: drones need K x y z [yaw]\n", inputs[0]);
+			return 1;
+		}
+		drones.push_back(drone{ (int)r[0], traj_pose{ r[1], r[2], r[3], (r.size() > 4) ? r[4] : 0.0 }, traj_pose(), 0 });
+	}
+	std::vector<slot> slots;
+	for (const std::vector<double> &r : to_rows)
+	{
+		if (r.size() < 3)
+		{
+			fprintf(stderr, "%s: slots need x y z [yaw]\n", inputs[1]);
+			return 1;
+		}
+		slots.push_back(slot{ traj_pose{ r[0], r[1], r[2], (r.size() > 3) ? r[3] : 0.0 }, r.size() > 3 });
+	}
+	if (drones.empty() || (slots.size() < drones.size()))
+	{
+		fprintf(stderr, "%d drones and %d slots\n", (int)drones.size(), (int)slots.size());
+		return 1;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	// minimum sum of squared distances: with synchronized straight lines the paths of any two drones stay apart
+	// if the drones are apart at the start and at the end by enough (see Turpin, Michael, Kumar: CAPT)
+	std::vector<std::vector<double>> cost(drones.size(), std::vector<double>(slots.size()));
+	for (size_t i = 0; i < drones.size(); i++)
+		for (size_t j = 0; j < slots.size(); j++)
+		{
+			const traj_pose &a = drones[i].from, &b = slots[j].pose;
+			cost[i][j] = (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z);
+		}
+	std::vector<int> assigned = hungarian(cost);
+	for (size_t i = 0; i < drones.size(); i++)
+	{
+		const slot &s = slots[assigned[i]];
+		drones[i].to = s.pose;
+		if (!s.has_yaw) drones[i].to.yaw = drones[i].from.yaw;
+	}
+
+	// pairs too close already in one of the formations cannot be helped by the paths
+	int n = drones.size(), formation_conflicts = 0;
+	for (int i = 0; i < n; i++)
+		for (int j = i + 1; j < n; j++)
+		{
+			const drone &a = drones[i], &b = drones[j];
+			double start = sqrt((a.from.x - b.from.x) * (a.from.x - b.from.x) + (a.from.y - b.from.y) * (a.from.y - b.from.y) + (a.from.z - b.from.z) * (a.from.z - b.from.z));
+			double end = sqrt((a.to.x - b.to.x) * (a.to.x - b.to.x) + (a.to.y - b.to.y) * (a.to.y - b.to.y) + (a.to.z - b.to.z) * (a.to.z - b.to.z));
+			if (std::min(start, end) < min_distance)
+			{
+				printf("drones %d and %d are %.2f m apart %s\n", a.id, b.id, std::min(start, end), (start < end) ? "at the start" : "in the new formation");
+				formation_conflicts++;
+			}
+		}
+
+	distances dist(drones);
+	resolve(drones, dist);
+	int shortest = shortest_duration(drones);
+	if (duration <= 0) duration = shortest;
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	for (const drone &d : drones)
+	{
+		traj_segment seg = { duration, [d](double s) { return path_at(d, s); }, nullptr };
+		traj_time_warp(seg, "ease");
+		trajectory t;
+		t.segments.push_back(seg);
+		std::vector<traj_sample> samples = traj_sample_adaptive(t, tolerance, yaw_tolerance, interpolation, max_step);
+
+		std::string filename = std::string(output_dir) + "/" + name + "_" + std::to_string(d.id);
+		FILE *f = fopen(filename.c_str(), "w+");
+		if (!f)
+		{
+			perror("Cannot open output file");
+			return 1;
+		}
+		traj_write_procedure(f, name, &d.from, samples);
+		fclose(f);
+
+		printf("drone %d: [%.2f, %.2f, %.2f] -> [%.2f, %.2f, %.2f]", d.id, d.from.x, d.from.y, d.from.z, d.to.x, d.to.y, d.to.z);
+		if (d.detour) printf(", %s by %.2f m", (d.detour > 0) ? "over" : "under", fabs(d.detour * layer));
+		printf(", %d POS\n", (int)samples.size());
+	}
+
+	int left = 0;
+	for (int i = 0; i < n; i++)
+		for (int j = i + 1; j < n; j++)
+			if (dist.d[i * n + j] < min_distance)
+			{
+				printf("drones %d and %d get %.2f m close\n", drones[i].id, drones[j].id, dist.d[i * n + j]);
+				left++;
+			}
+	if (duration < shortest) printf("%d ms is faster than the speed limits allow (%d ms)\n", duration, shortest);
+	printf("%d drones, %d ms, %d conflicts left (%d in the formations), planned in %.1f ms\n", n, duration, left, formation_conflicts, elapsed * 1000);
+	return left ? 1 : 0;
+}
@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <memory>
+#include "retime.h"
+
+// the yaw counts in the length of the path as if it moved a point at this distance
+static const double YAW_RADIUS = 0.3;         // m
+// distance of the points of the speed profile along the path
+static const double GRID_STEP = 0.005;        // m
+// time step of the smoothing of the speed profile
+static const double TIME_STEP = 0.005;        // s
+// where the limits are exceeded, the speed is capped this far around
+static const double SLOW_REACH = 0.05;        // m
+static const double MIN_SPEED = 0.005;        // m/s
+static const double SLACK = 1.02;             // the limits are checked with this tolerance
+static const int SLOW_ITERATIONS = 60;
+static const int SYNC_ROUNDS = 4;
+static const int BISECTION_STEPS = 40;
+static const int RESAMPLE_ITERATIONS = 4;
+
+static double axis(const traj_pose &p, int a) { return (&p.x)[a]; }
+static double &axis(traj_pose &p, int a) { return (&p.x)[a]; }
+
+// the path on a regular grid of its parameter s (chord length), with derivatives by s
+struct retime_path
+{
+	double h;
+	std::vector<traj_pose> q, d1, d2;
+	std::vector<int> sample_index;     // grid index of each input sample
+};
+
+static double chord(const traj_pose &a, const traj_pose &b)
+{
+	double dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z, dyaw = (b.yaw - a.yaw) * YAW_RADIUS;
+	return sqrt(dx * dx + dy * dy + dz * dz + dyaw * dyaw);
+}
+
+// cubic spline through the samples (parameterized by the chord length, continuous second derivative
+// so that the jerk is finite) evaluated on the grid
+static bool build_path(const std::vector<traj_pose> &samples, retime_path &path)
+{
+	std::vector<traj_pose> p;
+	std::vector<double> c;
+	std::vector<double> sample_param;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		traj_pose s = samples[i];
+		if (!p.empty()) s.yaw = p.back().yaw + remainder(s.yaw - p.back().yaw, 2 * M_PI);
+		double length = p.empty() ? 0 : chord(p.back(), s);
+		if (p.empty() || (length > 1e-6))
+		{
+			c.push_back(p.empty() ? 0 : c.back() + length);
+			p.push_back(s);
+		}
+		sample_param.push_back(c.back());
+	}
+	int n = p.size();
+	if (n < 2) return false;
+
+	// second derivatives at the samples (natural spline, tridiagonal system solved by the Thomas algorithm)
+	std::vector<traj_pose> m(n, traj_pose{ 0, 0, 0, 0 });
+	std::vector<double> diag(n), upper(n);
+	std::vector<traj_pose> rhs(n, traj_pose{ 0, 0, 0, 0 });
+	diag[0] = 1;
+	upper[0] = 0;
+	for (int i = 1; i < n - 1; i++)
+	{
+		double h0 = c[i] - c[i - 1], h1 = c[i + 1] - c[i];
+		double lower = h0 / 6, w = (h0 + h1) / 3 - lower * upper[i - 1] / diag[i - 1];
+		diag[i] = w;
+		upper[i] = h1 / 6;
+		for (int a = 0; a < 4; a++)
+			axis(rhs[i], a) = (axis(p[i + 1], a) - axis(p[i], a)) / h1 - (axis(p[i], a) - axis(p[i - 1], a)) / h0
+			                  - lower * axis(rhs[i - 1], a) / diag[i - 1];
+	}
+	for (int i = n - 2; i >= 1; i--)
+		for (int a = 0; a < 4; a++)
+			axis(m[i], a) = (axis(rhs[i], a) - upper[i] * axis(m[i + 1], a)) / diag[i];
+
+	double length = c.back();
+	int points = (int)ceil(length / GRID_STEP) + 1;
+	if (points < 3) points = 3;
+	path.h = length / (points - 1);
+	path.q.resize(points);
+	path.d1.resize(points);
+	path.d2.resize(points);
+	int seg = 0;
+	for (int k = 0; k < points; k++)
+	{
+		double s = std::min(k * path.h, length);
+		while ((seg < n - 2) && (s > c[seg + 1])) seg++;
+		double hs = c[seg + 1] - c[seg], l = c[seg + 1] - s, r = s - c[seg];
+		for (int a = 0; a < 4; a++)
+		{
+			double m0 = axis(m[seg], a), m1 = axis(m[seg + 1], a), y0 = axis(p[seg], a), y1 = axis(p[seg + 1], a);
+			axis(path.q[k], a) = (m0 * l * l * l + m1 * r * r * r) / (6 * hs) + (y0 / hs - m0 * hs / 6) * l + (y1 / hs - m1 * hs / 6) * r;
+			axis(path.d1[k], a) = (m1 * r * r - m0 * l * l) / (2 * hs) + (y1 - y0) / hs - (m1 - m0) * hs / 6;
+			axis(path.d2[k], a) = (m0 * l + m1 * r) / hs;
+		}
+	}
+
+	for (double sp : sample_param) path.sample_index.push_back((int)lround(sp / path.h));
+	return true;
+}
+
+// u = (ds/dt)^2 at each grid point, t in seconds
+struct retime_profile
+{
+	std::vector<double> u, t;
+};
+
+struct retime_problem
+{
+	const retime_path &path;
+	const retime_limits &limits;
+	std::vector<double> cap;           // speed cap (ds/dt) of each grid point, for the sync points
+	std::vector<double> slow;          // speed cap where the smoothed profile was over a limit
+	std::vector<double> mvc;           // the largest u allowed at each point
+	double window;                     // s, of the moving average that limits the jerk
+
+	retime_problem(const retime_path &p, const retime_limits &l) : path(p), limits(l)
+	{
+		cap.assign(p.q.size(), 1e9);
+		slow.assign(p.q.size(), 1e9);
+		// the path acceleration averaged over this time cannot jump from -a to a faster than the jerk limit
+		window = 0;
+		for (int a = 0; a < 4; a++) window = std::max(window, 2 * l.acceleration[a] / l.jerk[a]);
+	}
+
+	// interval of the allowed path acceleration d2s/dt2 at point k with speed u
+	bool accel_interval(int k, double u, double &lo, double &hi) const
+	{
+		lo = -1e18;
+		hi = 1e18;
+		for (int a = 0; a < 4; a++)
+		{
+			double amax = limits.acceleration[a];
+			double qd = axis(path.d1[k], a), centripetal = axis(path.d2[k], a) * u;
+			if (fabs(qd) < 1e-9)
+			{
+				if (fabs(centripetal) > amax) return false;
+				continue;
+			}
+			double l = (-amax - centripetal) / qd, r = (amax - centripetal) / qd;
+			if (l > r) std::swap(l, r);
+			lo = std::max(lo, l);
+			hi = std::min(hi, r);
+		}
+		return lo <= hi;
+	}
+
+	// maximum velocity curve: the velocity limits and the largest u for which some acceleration is allowed
+	void compute_mvc()
+	{
+		int n = path.q.size();
+		mvc.resize(n);
+		for (int k = 0; k < n; k++)
+		{
+			double u = 1e18;
+			for (int a = 0; a < 4; a++)
+			{
+				double qd = fabs(axis(path.d1[k], a));
+				if (qd > 1e-9) u = std::min(u, pow(limits.velocity[a] / qd, 2));
+			}
+			double lo, hi;
+			if (!accel_interval(k, u, lo, hi))
+			{
+				double good = 0, bad = u;
+				for (int i = 0; i < BISECTION_STEPS; i++)
+				{
+					double mid = 0.5 * (good + bad);
+					if (accel_interval(k, mid, lo, hi)) good = mid;
+					else bad = mid;
+				}
+				u = good;
+			}
+			mvc[k] = u;
+		}
+	}
+
+	// backward pass (decelerate to rest at the end), then forward pass (accelerate from rest)
+	void solve(retime_profile &p) const
+	{
+		int n = path.q.size();
+		double h = path.h;
+		p.u.resize(n);
+		p.t.resize(n);
+
+		p.u[n - 1] = 0;
+		for (int k = n - 2; k >= 0; k--)
+		{
+			double lo, hi, c = std::min(cap[k], slow[k]);
+			if (!accel_interval(k + 1, p.u[k + 1], lo, hi)) lo = 0;
+			p.u[k] = std::min(std::min(mvc[k], c * c), p.u[k + 1] - 2 * h * lo);
+		}
+		p.u[0] = 0;
+		for (int k = 0; k < n - 1; k++)
+		{
+			double lo, hi;
+			if (!accel_interval(k, p.u[k], lo, hi)) hi = 0;
+			p.u[k + 1] = std::min(p.u[k + 1], std::max(0.0, p.u[k] + 2 * h * hi));
+		}
+
+		p.t[0] = 0;
+		for (int k = 0; k < n - 1; k++)
+			p.t[k + 1] = p.t[k] + 2 * h / std::max(sqrt(p.u[k]) + sqrt(p.u[k + 1]), 1e-6);
+	}
+
+	// the path speed of the solution averaged over the window (in time), which bounds the jerk along the path,
+	// the profile gets longer by the window
+	void smooth(retime_profile &p) const
+	{
+		int n = path.q.size();
+		double length = (n - 1) * path.h;
+		int steps = (int)ceil(p.t.back() / TIME_STEP) + 1;
+		int w = std::max(1, (int)lround(window / TIME_STEP));
+
+		// ds/dt in regular time steps, it is linear in time between the grid points (constant d2s/dt2)
+		std::vector<double> v(steps);
+		int k = 0;
+		for (int j = 0; j < steps; j++)
+		{
+			double tj = j * TIME_STEP;
+			while ((k < n - 2) && (p.t[k + 1] < tj)) k++;
+			double f = std::min(1.0, (tj - p.t[k]) / std::max(p.t[k + 1] - p.t[k], 1e-12));
+			v[j] = sqrt(p.u[k]) + (sqrt(p.u[k + 1]) - sqrt(p.u[k])) * f;
+		}
+
+		// moving average and its integral
+		int total = steps + w - 1;
+		std::vector<double> vs(total), s(total);
+		double sum = 0;
+		for (int j = 0; j < total; j++)
+		{
+			if (j < steps) sum += v[j];
+			if (j >= w) sum -= v[j - w];
+			vs[j] = std::max(0.0, sum / w);
+			s[j] = (j > 0) ? s[j - 1] + 0.5 * (vs[j - 1] + vs[j]) * TIME_STEP : 0;
+		}
+		double scale = (s.back() > 0) ? length / s.back() : 1;
+
+		// back to the grid of the path
+		int j = 0;
+		for (k = 0; k < n; k++)
+		{
+			double sk = k * path.h / scale;
+			while ((j < total - 2) && (s[j + 1] < sk)) j++;
+			double f = std::min(1.0, std::max(0.0, (sk - s[j]) / std::max(s[j + 1] - s[j], 1e-12)));
+			double speed = (vs[j] + (vs[j + 1] - vs[j]) * f) * scale;
+			p.t[k] = (j + f) * TIME_STEP;
+			p.u[k] = speed * speed;
+		}
+		p.u[0] = p.u[n - 1] = 0;
+		p.t[n - 1] = (total - 1) * TIME_STEP;
+	}
+
+	void profile(retime_profile &p) const
+	{
+		solve(p);
+		smooth(p);
+	}
+};
+
+// velocity and acceleration of the axes at the grid points (the acceleration on the interval that follows)
+static void derivatives(const retime_path &path, const retime_profile &p, int k, double vel[4], double acc[4])
+{
+	int n = path.q.size();
+	double sdd = (k < n - 1) ? (p.u[k + 1] - p.u[k]) / (2 * path.h) : 0;
+	double sd = sqrt(std::max(0.0, p.u[k]));
+	for (int a = 0; a < 4; a++)
+	{
+		vel[a] = axis(path.d1[k], a) * sd;
+		acc[a] = (k < n - 1) ? axis(path.d1[k], a) * sdd + axis(path.d2[k], a) * p.u[k] : 0;
+	}
+}
+
+// the largest velocity, acceleration and jerk of the profile and the grid points where some limit is exceeded
+static int measure(const retime_problem &problem, const retime_profile &p, retime_report &report, std::vector<int> *over)
+{
+	int n = problem.path.q.size(), violations = 0;
+	const retime_limits &l = problem.limits;
+	double vel[4], acc[4], previous[4] = { 0, 0, 0, 0 };
+	for (int a = 0; a < 4; a++) report.max_velocity[a] = report.max_acceleration[a] = report.max_jerk[a] = 0;
+	for (int k = 0; k < n; k++)
+	{
+		derivatives(problem.path, p, k, vel, acc);
+		double dt = std::max((k > 0) ? p.t[k] - p.t[k - 1] : p.t[1] - p.t[0], TIME_STEP);
+		int bad = 0;
+		for (int a = 0; a < 4; a++)
+		{
+			double jerk = fabs(acc[a] - previous[a]) / dt;
+			report.max_velocity[a] = std::max(report.max_velocity[a], fabs(vel[a]));
+			report.max_acceleration[a] = std::max(report.max_acceleration[a], fabs(acc[a]));
+			report.max_jerk[a] = std::max(report.max_jerk[a], jerk);
+			if ((fabs(vel[a]) > l.velocity[a] * SLACK) || (fabs(acc[a]) > l.acceleration[a] * SLACK) || (jerk > l.jerk[a] * SLACK)) bad = 1;
+			previous[a] = acc[a];
+		}
+		if (bad)
+		{
+			violations++;
+			if (over) over->push_back(k);
+		}
+	}
+	return violations;
+}
+
+// slows down around the places where the smoothed profile is over the limits, returns false when there are none
+static bool slow_down(retime_problem &problem, const retime_profile &p)
+{
+	retime_report r;
+	std::vector<int> over;
+	if (!measure(problem, p, r, &over)) return false;
+	int n = problem.path.q.size(), reach = (int)lround(SLOW_REACH / problem.path.h);
+	for (int k : over)
+	{
+		double c = std::max(MIN_SPEED, 0.9 * sqrt(p.u[k]));
+		for (int j = std::max(0, k - reach); j <= std::min(n - 1, k + reach); j++) problem.slow[j] = std::min(problem.slow[j], c);
+	}
+	return true;
+}
+
+// the speed cap of each segment between sync points is found by bisection so that the segment takes its time
+static void fit_sync(retime_problem &problem, retime_profile &p, const std::vector<std::pair<int, double>> &sync)
+{
+	for (int round = 0; round < SYNC_ROUNDS; round++)
+		for (size_t j = 1; j < sync.size(); j++)
+		{
+			int from = sync[j - 1].first, to = sync[j].first;
+			double wanted = sync[j].second - sync[j - 1].second;
+			auto set_cap = [&](double c) { for (int k = from; k <= to; k++) problem.cap[k] = c; };
+
+			set_cap(1e9);
+			problem.profile(p);
+			if (p.t[to] - p.t[from] >= wanted) continue;   // cannot be faster
+
+			double top = 0;
+			for (int k = from; k <= to; k++) top = std::max(top, sqrt(problem.mvc[k]));
+			double lo = MIN_SPEED, hi = top;
+			for (int i = 0; i < BISECTION_STEPS; i++)
+			{
+				double mid = sqrt(lo * hi);
+				set_cap(mid);
+				problem.profile(p);
+				if (p.t[to] - p.t[from] > wanted) lo = mid;
+				else hi = mid;
+			}
+			set_cap(hi);
+		}
+	problem.profile(p);
+}
+
+// the retimed path, shared by the copies of the segment
+struct retimed_curve
+{
+	std::vector<double> t;   // s
+	std::vector<traj_pose> q;
+
+	traj_pose at(double time) const
+	{
+		if (time <= t.front()) return q.front();
+		if (time >= t.back()) return q.back();
+		size_t k = std::upper_bound(t.begin(), t.end(), time) - t.begin() - 1;
+		double f = (time - t[k]) / std::max(t[k + 1] - t[k], 1e-12);
+		traj_pose p;
+		for (int a = 0; a < 4; a++) axis(p, a) = axis(q[k], a) + (axis(q[k + 1], a) - axis(q[k], a)) * f;
+		return p;
+	}
+};
+
+trajectory retime(const std::vector<traj_pose> &samples, const retime_limits &limits,
+                  const std::vector<retime_sync> &sync, retime_report &report)
+{
+	report = retime_report();
+	trajectory result;
+	retime_path path;
+	if (!build_path(samples, path))
+	{
+		report.duration = 0;
+		report.messages.push_back("the path has no length, nothing to retime");
+		if (!samples.empty()) result.segments.push_back(traj_hold(0, samples[0]));
+		return result;
+	}
+
+	// sync points as grid indices; the first sample is at time 0 unless it has its own time
+	std::vector<std::pair<int, double>> grid_sync;
+	grid_sync.push_back({ 0, 0.0 });
+	double start_time = 0;
+	std::vector<retime_sync> sorted(sync);
+	std::sort(sorted.begin(), sorted.end(), [](const retime_sync &a, const retime_sync &b) { return a.sample < b.sample; });
+	for (const retime_sync &s : sorted)
+	{
+		if ((s.sample < 0) || (s.sample >= (int)path.sample_index.size()))
+		{
+			report.messages.push_back("sync sample " + std::to_string(s.sample) + " is not in the path");
+			continue;
+		}
+		if (s.sample == 0)
+		{
+			start_time = s.time / 1000.0;
+			continue;
+		}
+		double t = s.time / 1000.0 - start_time;
+		if ((t <= grid_sync.back().second) || (path.sample_index[s.sample] <= grid_sync.back().first))
+		{
+			report.messages.push_back("sync sample " + std::to_string(s.sample) + " is not after the previous one");
+			continue;
+		}
+		grid_sync.push_back({ path.sample_index[s.sample], t });
+	}
+
+	retime_problem problem(path, limits);
+	problem.compute_mvc();
+	retime_profile p;
+	for (int i = 0; i < SLOW_ITERATIONS; i++)
+	{
+		if (grid_sync.size() > 1) fit_sync(problem, p, grid_sync);
+		else problem.profile(p);
+		if (!slow_down(problem, p)) break;
+	}
+
+	// what was achieved
+	measure(problem, p, report, 0);
+	static const char *names[4] = { "x", "y", "z", "yaw" };
+	for (int a = 0; a < 4; a++)
+	{
+		char msg[200];
+		if (report.max_velocity[a] > limits.velocity[a] * SLACK)
+			snprintf(msg, sizeof(msg), "velocity of %s is %.3g, over the limit %.3g", names[a], report.max_velocity[a], limits.velocity[a]);
+		else if (report.max_acceleration[a] > limits.acceleration[a] * SLACK)
+			snprintf(msg, sizeof(msg), "acceleration of %s is %.3g, over the limit %.3g", names[a], report.max_acceleration[a], limits.acceleration[a]);
+		else if (report.max_jerk[a] > limits.jerk[a] * SLACK)
+			snprintf(msg, sizeof(msg), "jerk of %s is %.3g, over the limit %.3g", names[a], report.max_jerk[a], limits.jerk[a]);
+		else continue;
+		report.messages.push_back(msg);
+	}
+	for (size_t j = 1; j < grid_sync.size(); j++)
+	{
+		double reached = p.t[grid_sync[j].first] - grid_sync[j].second;
+		if (fabs(reached) > 0.01)
+		{
+			char msg[200];
+			snprintf(msg, sizeof(msg), "sync point %d reached %d ms %s", (int)j, (int)lround(fabs(reached) * 1000), (reached > 0) ? "late (too fast for the limits)" : "early");
+			report.messages.push_back(msg);
+		}
+	}
+
+	std::shared_ptr<retimed_curve> curve = std::make_shared<retimed_curve>();
+	curve->t = p.t;
+	curve->q = path.q;
+	double duration = p.t.back();
+
+	if (start_time > 0) result.segments.push_back(traj_hold((int)lround(start_time * 1000), path.q.front()));
+	traj_segment seg;
+	seg.duration = (int)lround(duration * 1000);
+	seg.shape = [curve, duration](double s) { return curve->at(s * duration); };
+	result.segments.push_back(seg);
+	report.duration = result.duration();
+	return result;
+}
+
+// the largest velocity of each axis between consecutive samples
+static void sampled_velocity(const std::vector<traj_sample> &samples, double velocity[4])
+{
+	for (int a = 0; a < 4; a++) velocity[a] = 0;
+	for (size_t i = 1; i < samples.size(); i++)
+	{
+		double dt = (samples[i].time - samples[i - 1].time) / 1000.0;
+		if (dt <= 0) continue;
+		for (int a = 0; a < 4; a++)
+			velocity[a] = std::max(velocity[a], fabs(axis(samples[i].pose, a) - axis(samples[i - 1].pose, a)) / dt);
+	}
+}
+
+std::vector<traj_sample> retime_sampled(const std::vector<traj_pose> &path, const retime_limits &limits,
+                                        const std::vector<retime_sync> &sync, double tolerance, double yaw_tolerance,
+                                        int interpolation, int max_step, retime_report &report)
+{
+	static const char *names[4] = { "x", "y", "z", "yaw" };
+	retime_limits lowered = limits;
+	std::vector<traj_sample> samples;
+	double velocity[4];
+	for (int i = 0; i < RESAMPLE_ITERATIONS; i++)
+	{
+		trajectory t = retime(path, lowered, sync, report);
+		samples = traj_sample_adaptive(t, tolerance, yaw_tolerance, interpolation, max_step);
+		sampled_velocity(samples, velocity);
+		int over = 0;
+		for (int a = 0; a < 4; a++)
+		{
+			velocity[a] = std::max(velocity[a], report.max_velocity[a]);
+			if (velocity[a] > limits.velocity[a])
+			{
+				lowered.velocity[a] *= 0.995 * limits.velocity[a] / velocity[a];
+				over = 1;
+			}
+		}
+		if (!over) break;
+	}
+
+	for (int a = 0; a < 4; a++)
+	{
+		report.max_velocity[a] = velocity[a];
+		if (velocity[a] > limits.velocity[a])
+		{
+			char msg[200];
+			snprintf(msg, sizeof(msg), "velocity of %s between the samples is %.3g, over the limit %.3g", names[a], velocity[a], limits.velocity[a]);
+			report.messages.push_back(msg);
+		}
+	}
+	return samples;
+}
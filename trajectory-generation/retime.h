@@ -0,0 +1,53 @@
+#ifndef RETIME_H
+#define RETIME_H
+
+// time-optimal retiming of a geometric path: the fastest timing that keeps the velocity, acceleration
+// and jerk of each axis (x, y, z, yaw) under the limits, or the timing that reaches given samples
+// at given times (music beats) as smoothly as the limits allow
+//
+// the speed along the path is computed by the forward/backward passes of time-optimal path parameterization
+// (velocity and acceleration limits), then averaged over 2 * acceleration / jerk in time, which limits the jerk
+// along the path; where the averaged profile still breaks a limit (tight curves) the speed is lowered and
+// the profile computed again, so the jerk limit is kept only approximately
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include "trajectory.h"
+
+struct retime_limits
+{
+	// x, y, z in m, m/s, ..., yaw in rad, rad/s, ...
+	double velocity[4] = { 0.3, 0.3, 1.0, 30.0 * M_PI / 180.0 };      // HSPEED/VSPEED defaults, yaw as posCommand when moving
+	double acceleration[4] = { 0.5, 0.5, 0.5, 60.0 * M_PI / 180.0 };
+	double jerk[4] = { 2.0, 2.0, 2.0, 180.0 * M_PI / 180.0 };
+};
+
+// sample (index into the path) that must be reached at time (ms)
+struct retime_sync
+{
+	int sample;
+	int time;
+};
+
+struct retime_report
+{
+	int duration;                         // ms
+	double max_velocity[4], max_acceleration[4], max_jerk[4];
+	std::vector<std::string> messages;    // limits or sync points that could not be met
+};
+
+// path: the poses in order (POS samples, or a trajectory sampled densely), it starts and ends at rest,
+// the samples are joined by a smooth curve through them (stops inside the path are not kept);
+// the result has one segment with the new timing (and a hold before it when sample 0 has a sync time)
+trajectory retime(const std::vector<traj_pose> &path, const retime_limits &limits,
+                  const std::vector<retime_sync> &sync, retime_report &report);
+
+// retime followed by traj_sample_adaptive: the velocity between consecutive samples (what the drone is asked to fly)
+// can be over the limit of the smooth profile, so the path is retimed again with the limits lowered by the overshoot,
+// what is still over the limits is reported; max_velocity in the report is the larger of the profile and the samples
+std::vector<traj_sample> retime_sampled(const std::vector<traj_pose> &path, const retime_limits &limits,
+                                        const std::vector<retime_sync> &sync, double tolerance, double yaw_tolerance,
+                                        int interpolation, int max_step, retime_report &report);
+
+#endif
@@ -0,0 +1,156 @@
+// retimes a procedure: keeps the path of its POS commands and replaces their times by the fastest timing
+// within the limits (see retime.h), or by the timing that reaches the given samples at the music beats
+//
+// compile:  g++ -O2 -std=c++17 -o retimer retimer.cpp retime.cpp trajectory.cpp
+//
+// usage:    retimer [options] procedure_file
+//
+//   -v xy,z,yaw     velocity limits in m/s and deg/s, default 0.3,1,30
+//   -a xy,z,yaw     acceleration limits in m/s2 and deg/s2, default 0.5,0.5,60
+//   -j xy,z,yaw     jerk limits in m/s3 and deg/s3, default 2,2,180
+//   -sync i=ms      the i-th POS of the procedure (from 0) is reached at ms, may be repeated
+//   -duration ms    the last POS is reached at ms (same as -sync with the last index)
+//   -tol m, -yawtol deg, -interp hold|linear, -maxstep ms    sampling of the result, as in trajgen
+//   -o file         output file, default: standard output
+//
+//   the procedure file holds one PROCEDURE (with an optional REFPOINT and its POS lines) as written by trajgen
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "retime.h"
+
+static double tolerance = 0.03;               // m
+static double yaw_tolerance = 3.0 * M_PI / 180.0;   // rad
+static int interpolation = TRAJ_HOLD;
+static int max_step = 1000;                   // ms
+
+static void usage()
+{
+	fprintf(stderr, "usage: retimer [-v xy,z,yaw] [-a xy,z,yaw] [-j xy,z,yaw] [-sync i=ms ...] [-duration ms] [-tol m] [-yawtol deg] [-interp hold|linear] [-maxstep ms] [-o file] procedure_file\n");
+	exit(1);
+}
+
+// "xy,z,yaw" with yaw in degrees
+static void parse_limit(const char *val, double limit[4])
+{
+	double xy, z, yaw;
+	if (sscanf(val, "%lf,%lf,%lf", &xy, &z, &yaw) != 3) usage();
+	limit[0] = limit[1] = xy;
+	limit[2] = z;
+	limit[3] = yaw * M_PI / 180.0;
+}
+
+static bool load_procedure(const char *path, std::string &name, traj_pose &refpoint, int &has_refpoint, std::vector<traj_pose> &poses)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror("Cannot open input file");
+		return false;
+	}
+	char ln[1000], cmd[100];
+	int time;
+	traj_pose p;
+	while (fgets(ln, 1000, f))
+	{
+		char word[100];
+		if (sscanf(ln, "PROCEDURE %99s", word) == 1)
+		{
+			if (!name.empty())
+			{
+				fprintf(stderr, "%s: only the first procedure is retimed\n", path);
+				break;
+			}
+			name = word;
+		}
+		else if (sscanf(ln, "%d %99s %lf %lf %lf %lf", &time, cmd, &p.x, &p.y, &p.z, &p.yaw) == 6)
+		{
+			if (strcmp(cmd, "POS") == 0) poses.push_back(p);
+			else if (strcmp(cmd, "REFPOINT") == 0)
+			{
+				refpoint = p;
+				has_refpoint = 1;
+			}
+		}
+	}
+	fclose(f);
+	if (name.empty() || poses.empty())
+	{
+		fprintf(stderr, "%s: no procedure with POS commands\n", path);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	retime_limits limits;
+	std::vector<retime_sync> sync;
+	int duration = 0;
+	const char *input = 0, *output_file = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *val = argv[i + 1];
+			if (strcmp(argv[i], "-v") == 0) parse_limit(val, limits.velocity);
+			else if (strcmp(argv[i], "-a") == 0) parse_limit(val, limits.acceleration);
+			else if (strcmp(argv[i], "-j") == 0) parse_limit(val, limits.jerk);
+			else if (strcmp(argv[i], "-sync") == 0)
+			{
+				retime_sync s;
+				if (sscanf(val, "%d=%d", &s.sample, &s.time) != 2) usage();
+				sync.push_back(s);
+			}
+			else if (strcmp(argv[i], "-duration") == 0) duration = atoi(val);
+			else if (strcmp(argv[i], "-tol") == 0) tolerance = atof(val);
+			else if (strcmp(argv[i], "-yawtol") == 0) yaw_tolerance = atof(val) * M_PI / 180.0;
+			else if (strcmp(argv[i], "-interp") == 0) interpolation = (strcmp(val, "linear") == 0) ? TRAJ_LINEAR : TRAJ_HOLD;
+			else if (strcmp(argv[i], "-maxstep") == 0) max_step = atoi(val);
+			else if (strcmp(argv[i], "-o") == 0) output_file = val;
+			else usage();
+			i++;
+		}
+		else if (!input) input = argv[i];
+		else usage();
+	}
+	if (!input || (tolerance <= 0) || (yaw_tolerance <= 0)) usage();
+	for (int a = 0; a < 4; a++)
+		if ((limits.velocity[a] <= 0) || (limits.acceleration[a] <= 0) || (limits.jerk[a] <= 0)) usage();
+
+	std::string name;
+	traj_pose refpoint;
+	int has_refpoint = 0;
+	std::vector<traj_pose> poses;
+	if (!load_procedure(input, name, refpoint, has_refpoint, poses)) return 1;
+	if (duration > 0) sync.push_back(retime_sync{ (int)poses.size() - 1, duration });
+
+	retime_report report;
+	std::vector<traj_sample> samples = retime_sampled(poses, limits, sync, tolerance, yaw_tolerance, interpolation, max_step, report);
+
+	FILE *out = stdout;
+	if (output_file)
+	{
+		out = fopen(output_file, "w+");
+		if (!out)
+		{
+			perror("Cannot open output file");
+			return 1;
+		}
+	}
+	traj_write_procedure(out, name.c_str(), has_refpoint ? &refpoint : 0, samples);
+	if (output_file) fclose(out);
+
+	fprintf(stderr, "%s: %d ms, %d POS, max velocity %.2f %.2f %.2f m/s %.0f deg/s, max acceleration %.2f %.2f %.2f m/s2 %.0f deg/s2, max jerk %.2f %.2f %.2f m/s3 %.0f deg/s3\n",
+	        name.c_str(), report.duration, (int)samples.size(),
+	        report.max_velocity[0], report.max_velocity[1], report.max_velocity[2], report.max_velocity[3] * 180.0 / M_PI,
+	        report.max_acceleration[0], report.max_acceleration[1], report.max_acceleration[2], report.max_acceleration[3] * 180.0 / M_PI,
+	        report.max_jerk[0], report.max_jerk[1], report.max_jerk[2], report.max_jerk[3] * 180.0 / M_PI);
+	for (const std::string &msg : report.messages) fprintf(stderr, "  %s\n", msg.c_str());
+	return 0;
+}
@@ -0,0 +1,222 @@
+#include "trajectory.h"
+#include <math.h>
+#include <string.h>
+
+static double deg2rad(double deg)
+{
+	return deg * M_PI / 180.0;
+}
+
+traj_segment traj_arc(int duration, double cx, double cy, double r, double from_deg, double sweep_deg,
+                      double z, double rise, double yaw, double spin)
+{
+	double from = deg2rad(from_deg);
+	double sweep = deg2rad(sweep_deg);
+	return { duration, [=](double s) {
+		double angle = from + s * sweep;
+		return traj_pose{ cx + r * cos(angle), cy + r * sin(angle), z + s * rise, yaw + spin * s * sweep };
+	}, nullptr };
+}
+
+traj_segment traj_vertical_loop(int duration, double x, double y, double z, double r, double heading_deg,
+                                double sweep_deg, double yaw)
+{
+	double hx = cos(deg2rad(heading_deg));
+	double hy = sin(deg2rad(heading_deg));
+	double sweep = deg2rad(sweep_deg);
+	return { duration, [=](double s) {
+		double angle = s * sweep;
+		double forward = r * sin(angle);
+		return traj_pose{ x + hx * forward, y + hy * forward, z - r + r * cos(angle), yaw };
+	}, nullptr };
+}
+
+traj_segment traj_line(int duration, const traj_pose &from, const traj_pose &to)
+{
+	return { duration, [=](double s) {
+		return traj_pose{ from.x + s * (to.x - from.x), from.y + s * (to.y - from.y),
+		                  from.z + s * (to.z - from.z), from.yaw + s * (to.yaw - from.yaw) };
+	}, nullptr };
+}
+
+traj_segment traj_lemniscate(int duration, double cx, double cy, double size, double rotate_deg,
+                             double sweep_deg, double z, double yaw)
+{
+	double c = cos(deg2rad(rotate_deg));
+	double sn = sin(deg2rad(rotate_deg));
+	double sweep = deg2rad(sweep_deg);
+	return { duration, [=](double s) {
+		double t = s * sweep;
+		double d = 1.0 + sin(t) * sin(t);
+		double lx = size * cos(t) / d;
+		double ly = size * sin(t) * cos(t) / d;
+		return traj_pose{ cx + lx * c - ly * sn, cy + lx * sn + ly * c, z, yaw };
+	}, nullptr };
+}
+
+traj_segment traj_hold(int duration, const traj_pose &p)
+{
+	return { duration, [=](double) { return p; }, nullptr };
+}
+
+traj_segment traj_turn(const traj_segment &s, double turn)
+{
+	traj_segment turned = s;
+	std::function<traj_pose(double)> shape = s.shape;
+	std::function<double(double)> warp = s.warp;
+	// the turn follows the time, not the (possibly warped) shape parameter
+	turned.warp = nullptr;
+	turned.shape = [=](double fraction) {
+		traj_pose p = shape(warp ? warp(fraction) : fraction);
+		p.yaw += fraction * turn;
+		return p;
+	};
+	return turned;
+}
+
+bool traj_time_warp(traj_segment &s, const char *warp)
+{
+	if (strcmp(warp, "linear") == 0) s.warp = nullptr;
+	else if (strcmp(warp, "ease") == 0) s.warp = [](double f) { return f * f * (3.0 - 2.0 * f); };
+	else if (strcmp(warp, "in") == 0) s.warp = [](double f) { return f * f; };
+	else if (strcmp(warp, "out") == 0) s.warp = [](double f) { return f * (2.0 - f); };
+	else return false;
+	return true;
+}
+
+int trajectory::duration() const
+{
+	int total = 0;
+	for (const traj_segment &s : segments) total += s.duration;
+	return total;
+}
+
+traj_pose trajectory::at(int ms) const
+{
+	for (const traj_segment &s : segments)
+	{
+		if (ms <= s.duration) return s.at(s.duration ? (double)ms / s.duration : 1.0);
+		ms -= s.duration;
+	}
+	return end();
+}
+
+traj_pose trajectory::end() const
+{
+	if (segments.empty()) return traj_pose{ 0, 0, 0, 0 };
+	return segments.back().at(1.0);
+}
+
+static double yaw_difference(double a, double b)
+{
+	return fabs(remainder(a - b, 2 * M_PI));
+}
+
+static double position_difference(const traj_pose &a, const traj_pose &b)
+{
+	double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// error of the setpoint against the curve, relative to the tolerances (<= 1 is ok)
+static double relative_error(const traj_pose &setpoint, const traj_pose &exact, double tolerance, double yaw_tolerance)
+{
+	double e = position_difference(setpoint, exact) / tolerance;
+	double ey = yaw_difference(setpoint.yaw, exact.yaw) / yaw_tolerance;
+	return (e > ey) ? e : ey;
+}
+
+static traj_pose interpolate(const traj_pose &a, const traj_pose &b, double s)
+{
+	return traj_pose{ a.x + s * (b.x - a.x), a.y + s * (b.y - a.y), a.z + s * (b.z - a.z), a.yaw + s * (b.yaw - a.yaw) };
+}
+
+// zero-order hold: greedily extend each step as long as the held setpoint stays close enough
+static void sample_hold(const traj_segment &s, int offset, double tolerance, double yaw_tolerance, int max_step,
+                        std::vector<traj_sample> &samples)
+{
+	int a = 0;
+	traj_pose held = s.at(0.0);
+	samples.push_back({ offset, held });
+	for (int t = 1; t < s.duration; t++)
+	{
+		traj_pose exact = s.at((double)t / s.duration);
+		double e = relative_error(held, exact, tolerance, yaw_tolerance);
+		if ((e > 1.0) || (max_step && (t - a >= max_step)))
+		{
+			a = t;
+			// a repeated setpoint changes nothing under hold (a HOLD primitive is one POS, not one per max_step)
+			if (e < 1e-6) continue;
+			held = exact;
+			samples.push_back({ offset + a, held });
+		}
+	}
+}
+
+// linear interpolation: split recursively at the point of the largest error
+static void refine_linear(const traj_segment &s, int offset, int a, int b, const traj_pose &pa, const traj_pose &pb,
+                          double tolerance, double yaw_tolerance, int max_step, std::vector<traj_sample> &samples)
+{
+	if (b - a < 2) return;
+
+	int worst = (a + b) / 2;
+	double max_error = 0.0;
+	for (int t = a + 1; t < b; t++)
+	{
+		traj_pose exact = s.at((double)t / s.duration);
+		double e = relative_error(interpolate(pa, pb, (double)(t - a) / (b - a)), exact, tolerance, yaw_tolerance);
+		if (e > max_error)
+		{
+			max_error = e;
+			worst = t;
+		}
+	}
+
+	if ((max_error <= 1.0) && (!max_step || (b - a <= max_step))) return;
+	if (max_error <= 1.0) worst = (a + b) / 2;   // only too long step
+
+	traj_pose pw = s.at((double)worst / s.duration);
+	refine_linear(s, offset, a, worst, pa, pw, tolerance, yaw_tolerance, max_step, samples);
+	samples.push_back({ offset + worst, pw });
+	refine_linear(s, offset, worst, b, pw, pb, tolerance, yaw_tolerance, max_step, samples);
+}
+
+std::vector<traj_sample> traj_sample_adaptive(const trajectory &t, double tolerance, double yaw_tolerance,
+                                              int interpolation, int max_step)
+{
+	std::vector<traj_sample> samples;
+	int offset = 0;
+
+	for (const traj_segment &s : t.segments)
+	{
+		if (s.duration > 0)
+		{
+			// the end of the previous segment is the start of this one
+			if (!samples.empty() && (samples.back().time == offset)) samples.pop_back();
+
+			if (interpolation == TRAJ_HOLD)
+				sample_hold(s, offset, tolerance, yaw_tolerance, max_step, samples);
+			else
+			{
+				traj_pose start = s.at(0.0);
+				samples.push_back({ offset, start });
+				refine_linear(s, offset, 0, s.duration, start, s.at(1.0), tolerance, yaw_tolerance, max_step, samples);
+			}
+		}
+		offset += s.duration;
+		samples.push_back({ offset, s.at(1.0) });
+	}
+	return samples;
+}
+
+void traj_write_procedure(FILE *f, const char *name, const traj_pose *refpoint, const std::vector<traj_sample> &samples)
+{
+	fprintf(f, "#########################\n");
+	fprintf(f, "PROCEDURE %s\n", name);
+	if (refpoint)
+		fprintf(f, "0 REFPOINT %.6lf %.6lf %.6lf %.6lf\n", refpoint->x, refpoint->y, refpoint->z, refpoint->yaw);
+	for (const traj_sample &s : samples)
+		fprintf(f, "%d  POS  %.6lf %.6lf %.6lf %.6lf\n", s.time, s.pose.x, s.pose.y, s.pose.z, s.pose.yaw);
+	fprintf(f, "ENDP\n");
+	fprintf(f, "#########################\n");
+}
@@ -0,0 +1,82 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+// composable trajectory primitives for the dance procedures (PROCEDURE / REFPOINT / POS format of Dance.kt)
+// and their adaptive sampling: the POS commands are placed only as densely as needed to keep the
+// difference between the flown setpoints and the exact curve under a given tolerance
+
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct traj_pose
+{
+	double x, y, z, yaw;    // m, m, m, rad
+};
+
+// one piece of the trajectory: shape is the curve for s in [0,1], warp maps the fraction of duration to s
+struct traj_segment
+{
+	int duration;                                // ms
+	std::function<traj_pose(double)> shape;
+	std::function<double(double)> warp;
+
+	traj_pose at(double fraction) const { return shape(warp ? warp(fraction) : fraction); }
+};
+
+// horizontal circle arc around [cx,cy] starting at angle from_deg, sweep_deg > 0 is CCW,
+// height goes linearly from z to z + rise (helix), yaw starts at yaw and turns spin * swept angle
+traj_segment traj_arc(int duration, double cx, double cy, double r, double from_deg, double sweep_deg,
+                      double z, double rise, double yaw, double spin);
+
+// vertical loop starting at its top [x,y,z], first moving in the horizontal direction heading_deg (0 = +x, 90 = +y)
+traj_segment traj_vertical_loop(int duration, double x, double y, double z, double r, double heading_deg,
+                                double sweep_deg, double yaw);
+
+// straight line (including yaw change from from.yaw to to.yaw)
+traj_segment traj_line(int duration, const traj_pose &from, const traj_pose &to);
+
+// figure eight (lemniscate of Bernoulli) centered at [cx,cy], half-width size, starts and ends at its right end
+traj_segment traj_lemniscate(int duration, double cx, double cy, double size, double rotate_deg,
+                             double sweep_deg, double z, double yaw);
+
+// stay at one place
+traj_segment traj_hold(int duration, const traj_pose &p);
+
+// adds a linear yaw change of turn radians over the whole segment
+traj_segment traj_turn(const traj_segment &s, double turn);
+
+// replaces the (linear) timing of the segment: linear, ease (slow start and stop), in (slow start), out (slow stop)
+// returns false for an unknown warp name
+bool traj_time_warp(traj_segment &s, const char *warp);
+
+// segments flown one after another
+struct trajectory
+{
+	std::vector<traj_segment> segments;
+
+	int duration() const;
+	traj_pose at(int ms) const;
+	traj_pose end() const;
+};
+
+struct traj_sample
+{
+	int time;      // ms from the start of the procedure
+	traj_pose pose;
+};
+
+// how the setpoints are followed between two POS commands
+#define TRAJ_HOLD    0   // the setpoint is held until the next command (how MainActivity flies POS today)
+#define TRAJ_LINEAR  1   // the setpoint is linearly interpolated between the commands
+
+// places the samples (always at the segment boundaries) so that position error stays under tolerance (m)
+// and yaw error under yaw_tolerance (rad), max_step (ms) limits the time between samples (0 = no limit)
+std::vector<traj_sample> traj_sample_adaptive(const trajectory &t, double tolerance, double yaw_tolerance,
+                                              int interpolation, int max_step);
+
+// prints the procedure in the dance file format, refpoint may be 0
+void traj_write_procedure(FILE *f, const char *name, const traj_pose *refpoint, const std::vector<traj_sample> &samples);
+
+#endif
@@ -0,0 +1,295 @@
+// generates dance procedures from a short description of their shape (replaces the old circle.c programs)
+//
+// compile:  g++ -O2 -std=c++17 -o trajgen trajgen.cpp trajectory.cpp retime.cpp
+//
+// usage:    trajgen [-tol m] [-yawtol deg] [-interp hold|linear] [-maxstep ms] [-retime] [-d output_dir | -o output_file] description.traj
+//
+//   each procedure is written to a file with its name in output_dir (default: current directory),
+//   or all of them to one output_file (to paste into a dance file)
+//
+//   with -retime the durations of the primitives only define the shape, each procedure is flown
+//   as fast as the default limits of retime.h allow (use retimer for other limits or sync points)
+//
+// description format (one primitive per line, # comments, keywords are case insensitive):
+//
+//   PROCEDURE <name>
+//   [REFPOINT <x> <y> <z> <yaw>]         default: the starting pose, NOREFPOINT to leave it out
+//   <primitive> <duration_ms> <key> <value(s)> ...
+//   ...                                  primitives follow each other in time
+//   ENDP
+//
+//   primitives and their keys (angles in degrees, except yaw in radians, distances in m):
+//
+//   ARC / HELIX   center <cx> <cy>  radius <r>  from <deg>  sweep <deg>  z <height>  rise <dz>  spin <0|1>
+//                 (sweep > 0 is CCW, with spin 1 the yaw turns together with the drone around the center)
+//   LOOP          at <x> <y>  z <top_height>  radius <r>  heading <deg>  sweep <deg>     (vertical loop)
+//   LINE          [from <x> <y> <z>]  to <x> <y> <z>      (from defaults to the end of the previous primitive)
+//   LEMNISCATE    center <cx> <cy>  size <half_width>  rotate <deg>  sweep <deg>  z <height>
+//   HOLD          [at <x> <y> <z>]                        (stay, or rotate with turn)
+//
+//   keys common to all primitives:
+//     yaw <rad>       yaw at the start (default: yaw at the end of previous primitive, or 0)
+//     turn <deg>      additional yaw change over the primitive
+//     warp <linear|ease|in|out>   timing along the primitive
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "retime.h"
+
+// under hold the defaults keep the setpoints as close to the curve as the old 5 deg steps of circle.c
+static double tolerance = 0.07;               // m
+static double yaw_tolerance = 6.0 * M_PI / 180.0;   // rad
+static int interpolation = TRAJ_HOLD;
+static int max_step = 1000;                   // ms
+static int retime_procedures = 0;
+
+static int line_number = 0;
+
+static void parse_error(const char *msg, const char *what)
+{
+	fprintf(stderr, "line %d: %s %s\n", line_number, msg, what ? what : "");
+	exit(1);
+}
+
+static std::string upper(const std::string &s)
+{
+	std::string u(s);
+	for (char &c : u) c = toupper(c);
+	return u;
+}
+
+// key value(s) pairs of one primitive line, non-numeric values are kept as words
+struct arguments
+{
+	std::map<std::string, std::vector<double>> numbers;
+	std::map<std::string, std::string> words;
+
+	bool has(const char *key) const { return numbers.count(key) > 0; }
+
+	double get(const char *key, int index, double default_value) const
+	{
+		auto it = numbers.find(key);
+		if (it == numbers.end()) return default_value;
+		if ((int)it->second.size() <= index) parse_error("missing value of", key);
+		return it->second[index];
+	}
+
+	double need(const char *key, int index) const
+	{
+		if (!has(key)) parse_error("missing", key);
+		return get(key, index, 0.0);
+	}
+};
+
+static arguments parse_arguments(const std::vector<std::string> &tokens, size_t first)
+{
+	arguments a;
+	std::string key;
+	for (size_t i = first; i < tokens.size(); i++)
+	{
+		char *end;
+		double value = strtod(tokens[i].c_str(), &end);
+		if (*end == 0)
+		{
+			if (key.empty()) parse_error("value without a key:", tokens[i].c_str());
+			a.numbers[key].push_back(value);
+		}
+		else if (key == "WARP")
+		{
+			a.words[key] = tokens[i];
+			key.clear();
+		}
+		else
+		{
+			key = upper(tokens[i]);
+			a.numbers[key];
+			if (key == "WARP") a.numbers.erase(key);
+		}
+	}
+	return a;
+}
+
+static traj_segment make_primitive(const std::string &name, int duration, const arguments &a, const trajectory &t)
+{
+	traj_pose previous = t.end();
+	double yaw = a.get("YAW", 0, t.segments.empty() ? 0.0 : previous.yaw);
+	traj_segment s;
+
+	if ((name == "ARC") || (name == "HELIX"))
+		s = traj_arc(duration, a.get("CENTER", 0, 0.0), a.get("CENTER", 1, 0.0), a.need("RADIUS", 0),
+		             a.get("FROM", 0, 0.0), a.get("SWEEP", 0, 360.0), a.need("Z", 0), a.get("RISE", 0, 0.0),
+		             yaw, a.get("SPIN", 0, 0.0));
+	else if (name == "LOOP")
+		s = traj_vertical_loop(duration, a.get("AT", 0, 0.0), a.get("AT", 1, 0.0), a.need("Z", 0), a.need("RADIUS", 0),
+		                       a.get("HEADING", 0, 0.0), a.get("SWEEP", 0, 360.0), yaw);
+	else if (name == "LINE")
+	{
+		if (t.segments.empty() && !a.has("FROM")) parse_error("LINE needs from", 0);
+		traj_pose from{ a.get("FROM", 0, previous.x), a.get("FROM", 1, previous.y), a.get("FROM", 2, previous.z), yaw };
+		traj_pose to{ a.need("TO", 0), a.need("TO", 1), a.need("TO", 2), yaw };
+		s = traj_line(duration, from, to);
+	}
+	else if (name == "LEMNISCATE")
+		s = traj_lemniscate(duration, a.get("CENTER", 0, 0.0), a.get("CENTER", 1, 0.0), a.need("SIZE", 0),
+		                    a.get("ROTATE", 0, 0.0), a.get("SWEEP", 0, 360.0), a.need("Z", 0), yaw);
+	else if (name == "HOLD")
+	{
+		if (t.segments.empty() && !a.has("AT")) parse_error("HOLD needs at", 0);
+		s = traj_hold(duration, traj_pose{ a.get("AT", 0, previous.x), a.get("AT", 1, previous.y), a.get("AT", 2, previous.z), yaw });
+	}
+	else parse_error("unknown primitive", name.c_str());
+
+	if (a.has("TURN")) s = traj_turn(s, a.need("TURN", 0) * M_PI / 180.0);
+	auto warp = a.words.find("WARP");
+	if ((warp != a.words.end()) && !traj_time_warp(s, warp->second.c_str())) parse_error("unknown warp", warp->second.c_str());
+	return s;
+}
+
+// samples of the same path with the fastest timing within the default limits
+static std::vector<traj_sample> retimed(const std::string &name, const trajectory &t)
+{
+	std::vector<traj_pose> path;
+	for (int ms = 0; ms < t.duration(); ms += 10) path.push_back(t.at(ms));
+	path.push_back(t.end());
+
+	retime_report report;
+	std::vector<traj_sample> samples = retime_sampled(path, retime_limits(), std::vector<retime_sync>(), tolerance, yaw_tolerance,
+	                                                  interpolation, max_step, report);
+	fprintf(stderr, "%s: retimed from %d ms to %d ms\n", name.c_str(), t.duration(), report.duration);
+	for (const std::string &msg : report.messages) fprintf(stderr, "  %s\n", msg.c_str());
+	return samples;
+}
+
+static void write_procedure(const std::string &name, const trajectory &original, const traj_pose *refpoint,
+                            const char *output_dir, FILE *output)
+{
+	std::vector<traj_sample> samples = retime_procedures ? retimed(name, original)
+	                                   : traj_sample_adaptive(original, tolerance, yaw_tolerance, interpolation, max_step);
+
+	FILE *f = output;
+	if (!f)
+	{
+		std::string filename = std::string(output_dir) + "/" + name;
+		f = fopen(filename.c_str(), "w+");
+		if (!f)
+		{
+			perror("Cannot open output file");
+			return;
+		}
+	}
+	traj_write_procedure(f, name.c_str(), refpoint, samples);
+	if (!output) fclose(f);
+
+	fprintf(stderr, "%s: %d ms, %d POS\n", name.c_str(), samples.empty() ? 0 : samples.back().time, (int)samples.size());
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: trajgen [-tol m] [-yawtol deg] [-interp hold|linear] [-maxstep ms] [-retime] [-d output_dir | -o output_file] description.traj\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *output_dir = ".";
+	const char *output_file = 0;
+	const char *input = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-retime") == 0) retime_procedures = 1;
+		else if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *val = argv[i + 1];
+			if (strcmp(argv[i], "-tol") == 0) tolerance = atof(val);
+			else if (strcmp(argv[i], "-yawtol") == 0) yaw_tolerance = atof(val) * M_PI / 180.0;
+			else if (strcmp(argv[i], "-interp") == 0) interpolation = (strcmp(val, "linear") == 0) ? TRAJ_LINEAR : TRAJ_HOLD;
+			else if (strcmp(argv[i], "-maxstep") == 0) max_step = atoi(val);
+			else if (strcmp(argv[i], "-d") == 0) output_dir = val;
+			else if (strcmp(argv[i], "-o") == 0) output_file = val;
+			else usage();
+			i++;
+		}
+		else if (!input) input = argv[i];
+		else usage();
+	}
+	if (!input || (tolerance <= 0) || (yaw_tolerance <= 0)) usage();
+
+	FILE *in = fopen(input, "r");
+	if (!in)
+	{
+		perror("Cannot open input file");
+		return 1;
+	}
+	FILE *out = 0;
+	if (output_file)
+	{
+		out = fopen(output_file, "w+");
+		if (!out)
+		{
+			perror("Cannot open output file");
+			return 1;
+		}
+	}
+
+	char ln[1000];
+	std::string procedure;
+	trajectory t;
+	traj_pose refpoint;
+	int has_refpoint = 0, no_refpoint = 0;
+
+	while (fgets(ln, 1000, in))
+	{
+		line_number++;
+		std::vector<std::string> tokens;
+		for (char *tok = strtok(ln, " \t\r\n"); tok; tok = strtok(0, " \t\r\n"))
+			tokens.push_back(tok);
+		if (tokens.empty() || (tokens[0][0] == '#')) continue;
+
+		std::string cmd = upper(tokens[0]);
+		if (cmd == "PROCEDURE")
+		{
+			if (tokens.size() < 2) parse_error("missing procedure name", 0);
+			if (!procedure.empty()) parse_error("missing ENDP before", tokens[1].c_str());
+			procedure = tokens[1];
+			t.segments.clear();
+			has_refpoint = no_refpoint = 0;
+			continue;
+		}
+		if (procedure.empty()) parse_error("outside of procedure:", tokens[0].c_str());
+
+		if (cmd == "ENDP")
+		{
+			if (t.segments.empty()) parse_error("empty procedure", procedure.c_str());
+			if (!has_refpoint) refpoint = t.at(0);
+			write_procedure(procedure, t, no_refpoint ? 0 : &refpoint, output_dir, out);
+			procedure.clear();
+		}
+		else if (cmd == "REFPOINT")
+		{
+			if ((tokens.size() < 5) || (sscanf((tokens[1] + " " + tokens[2] + " " + tokens[3] + " " + tokens[4]).c_str(), "%lf %lf %lf %lf",
+			                                   &refpoint.x, &refpoint.y, &refpoint.z, &refpoint.yaw) != 4))
+				parse_error("REFPOINT needs x y z yaw", 0);
+			has_refpoint = 1;
+		}
+		else if (cmd == "NOREFPOINT") no_refpoint = 1;
+		else
+		{
+			if (tokens.size() < 2) parse_error("missing duration of", cmd.c_str());
+			int duration = atoi(tokens[1].c_str());
+			if (duration <= 0) parse_error("wrong duration of", cmd.c_str());
+			t.segments.push_back(make_primitive(cmd, duration, parse_arguments(tokens, 2), t));
+		}
+	}
+	if (!procedure.empty()) parse_error("missing ENDP of", procedure.c_str());
+
+	fclose(in);
+	if (out) fclose(out);
+	return 0;
+}